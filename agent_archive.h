@@ -0,0 +1,625 @@
+/* On-host compressed log archive for the Linux agent, with a token index for local queries.
+ *
+ * Lines of the sources marked for archiving are appended to an open block of up to
+ * ARCHIVE_BLOCK_BYTES. A block is sealed when the next line does not fit, when that line's tokens
+ * could take it past ARCHIVE_MAX_TOKENS distinct ones, or after ARCHIVE_SEAL_SEC. Sealing deflates
+ * the block on its own, so any block can be read without the ones before it, and appends it to the
+ * current segment:
+ *
+ *   <dir>/<seq>.dat  the compressed blocks, back to back
+ *   <dir>/<seq>.idx  one entry per block: offset, sizes, line count, arrival time of the first
+ *                    and last line, and a Bloom filter of the block's tokens (about 10 bits per
+ *                    distinct token, 4 probes: ~1% false positives)
+ *
+ * An index entry is written after its block, in one write(), so a reader never sees an entry
+ * whose data is missing. Segments roll over at segment_max bytes. Once the archive exceeds its
+ * quota, the oldest segments are deleted.
+ *
+ * Tokens are runs of letters, digits and . _ - @ (plus any non-ASCII byte), compared without
+ * regard to case. A token with . - or @ in it is indexed whole and in parts, so "10.0.0.5" is found
+ * by "10.0.0.5" and also by "5". A line with more than ARCHIVE_MAX_TOKENS tokens on its own gets a
+ * block whose filter rules nothing out, so it is still found. archive_query() reads only the index
+ * files. It skips blocks
+ * outside the time range or whose filter rules out a query token, and inflates the rest. It
+ * returns the lines that contain every query token.
+ *
+ * Memory is fixed at startup: the block, its token set and the compression buffers.
+ * Link with -lz. Included once by agent_inotify.c; Linux only.
+ */
+#pragma once
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define ARCHIVE_BLOCK_BYTES (64 * 1024)          /* uncompressed lines per block */
+#define ARCHIVE_TOKEN_SLOTS 16384                /* distinct-token set per block; a power of two */
+#define ARCHIVE_MAX_TOKENS (ARCHIVE_TOKEN_SLOTS / 4 * 3)
+#define ARCHIVE_BLOOM_MIN_BITS 1024
+#define ARCHIVE_BLOOM_MAX_BITS 131072            /* ARCHIVE_MAX_TOKENS * 10, rounded up */
+#define ARCHIVE_BLOOM_PROBES 4
+#define ARCHIVE_SEAL_SEC 10                      /* an open block older than this is written */
+#define ARCHIVE_SEGMENT_BYTES (64 * 1024 * 1024) /* largest segment; smaller under small quotas */
+#define ARCHIVE_MAX_TERMS 64                     /* tokens in one query */
+#define ARCHIVE_MAGIC 0x4b414931u                /* "KAI1" */
+
+/* Index entry, followed by bloom_bytes of filter. Host byte order: the archive stays on the host. */
+struct archive_entry {
+    uint32_t magic;
+    uint32_t bloom_bytes;
+    uint64_t offset; /* in the .dat file */
+    uint32_t compressed;
+    uint32_t raw;
+    uint32_t lines;
+    uint32_t reserved;
+    int64_t first; /* unix time the first and last line arrived */
+    int64_t last;
+};
+
+struct archive_stats {
+    unsigned long long lines;
+    unsigned long long bytes;      /* before compression */
+    unsigned long long compressed; /* .dat bytes written */
+    unsigned long long indexed;    /* .idx bytes written */
+    unsigned long long blocks;
+    unsigned long long segments;   /* segments started */
+    unsigned long long deleted;    /* segments deleted to stay under the quota */
+    unsigned long long errors;     /* blocks lost to write errors */
+};
+
+struct archive {
+    char dir[PATH_MAX];
+    unsigned long long quota;
+    unsigned long long segment_max;
+    unsigned long long total; /* bytes of every segment in dir */
+    unsigned long long oldest_seq;
+    unsigned long long seq; /* current segment */
+    int data_fd;
+    int idx_fd;
+    unsigned long long data_len;
+    unsigned long long idx_len;
+
+    char* block;
+    size_t block_len;
+    unsigned block_lines;
+    time_t block_first;
+    uint64_t* tokens;      /* open-addressing set of the block's token hashes, 0 = free */
+    int ntokens;
+    int unfiltered;        /* a line had more tokens than the set takes: the filter must pass all */
+    uint64_t* line_tokens; /* scratch for one line */
+    unsigned char* entry;  /* struct archive_entry + filter, written in one go */
+    char* zbuf;
+    size_t zbuf_size;
+    z_stream zdef;
+
+    struct archive_stats stats;
+};
+
+static int archive_token_char(unsigned char c)
+{
+    return isalnum(c) || c == '.' || c == '_' || c == '-' || c == '@' || c >= 0x80;
+}
+
+/* Hashes the tokens of s[0, n) (and the parts of those with . - @ in them) into out, which must
+   have room for n entries. Returns how many. */
+static size_t archive_tokenize(const char* s, size_t n, uint64_t* out)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        while (i < n && !archive_token_char((unsigned char)s[i]))
+            ++i;
+        if (i == n)
+            break;
+        uint64_t whole = 14695981039346656037ULL;
+        uint64_t part = whole;
+        size_t part_len = 0;
+        int split = 0;
+        for (; i < n && archive_token_char((unsigned char)s[i]); ++i) {
+            unsigned char c = (unsigned char)tolower((unsigned char)s[i]);
+            whole = (whole ^ c) * 1099511628211ULL;
+            if (c == '.' || c == '-' || c == '@') {
+                if (part_len > 0)
+                    out[count++] = part | 1;
+                split = 1;
+                part = 14695981039346656037ULL;
+                part_len = 0;
+            } else {
+                part = (part ^ c) * 1099511628211ULL;
+                ++part_len;
+            }
+        }
+        if (split && part_len > 0)
+            out[count++] = part | 1;
+        out[count++] = whole | 1; /* never 0: that marks a free slot */
+    }
+    return count;
+}
+
+static void archive_bloom_set(unsigned char* bloom, uint32_t bits, uint64_t h)
+{
+    uint64_t step = (h >> 32) | 1;
+    for (int i = 0; i < ARCHIVE_BLOOM_PROBES; ++i, h += step)
+        bloom[(h & (bits - 1)) >> 3] |= (unsigned char)(1u << (h & 7));
+}
+
+static int archive_bloom_test(const unsigned char* bloom, uint32_t bits, uint64_t h)
+{
+    uint64_t step = (h >> 32) | 1;
+    for (int i = 0; i < ARCHIVE_BLOOM_PROBES; ++i, h += step) {
+        if (!(bloom[(h & (bits - 1)) >> 3] & (1u << (h & 7))))
+            return 0;
+    }
+    return 1;
+}
+
+static void archive_path(const struct archive* ar, unsigned long long seq, const char* ext, char* out, size_t cap)
+{
+    snprintf(out, cap, "%s/%016llu.%s", ar->dir, seq, ext);
+}
+
+static unsigned long long archive_file_size(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (unsigned long long)st.st_size : 0;
+}
+
+/* Closes the current segment and opens the next one. */
+static int archive_roll(struct archive* ar)
+{
+    char path[PATH_MAX + 32];
+
+    if (ar->data_fd >= 0)
+        close(ar->data_fd);
+    if (ar->idx_fd >= 0)
+        close(ar->idx_fd);
+    ++ar->seq;
+    ar->data_len = ar->idx_len = 0;
+    archive_path(ar, ar->seq, "dat", path, sizeof(path));
+    ar->data_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    archive_path(ar, ar->seq, "idx", path, sizeof(path));
+    ar->idx_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (ar->data_fd < 0 || ar->idx_fd < 0) {
+        fprintf(stderr, "archive: cannot create segment %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    ++ar->stats.segments;
+    return 0;
+}
+
+/* Deletes the oldest segments (never the current one) while the archive is over its quota. */
+static void archive_enforce_quota(struct archive* ar)
+{
+    char path[PATH_MAX + 32];
+
+    while (ar->total > ar->quota && ar->oldest_seq < ar->seq) {
+        unsigned long long freed = 0;
+        archive_path(ar, ar->oldest_seq, "dat", path, sizeof(path));
+        freed += archive_file_size(path);
+        if (unlink(path) == 0)
+            ++ar->stats.deleted;
+        archive_path(ar, ar->oldest_seq, "idx", path, sizeof(path));
+        freed += archive_file_size(path);
+        unlink(path);
+        ar->total = ar->total > freed ? ar->total - freed : 0;
+        ++ar->oldest_seq;
+    }
+}
+
+/* Opens the archive in dir (created if missing) and starts a new segment after the existing ones.
+   Returns 0, or -1 if nothing can be archived. */
+static int archive_open(struct archive* ar, const char* dir, unsigned long long quota)
+{
+    memset(ar, 0, sizeof(*ar));
+    ar->data_fd = ar->idx_fd = -1;
+    snprintf(ar->dir, sizeof(ar->dir), "%s", dir);
+    ar->quota = quota;
+    ar->segment_max = quota / 8 < ARCHIVE_SEGMENT_BYTES ? quota / 8 : ARCHIVE_SEGMENT_BYTES;
+    if (ar->segment_max < ARCHIVE_BLOCK_BYTES * 4)
+        ar->segment_max = ARCHIVE_BLOCK_BYTES * 4;
+
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        fprintf(stderr, "archive: cannot create %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    DIR* d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "archive: cannot open %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    ar->oldest_seq = ULLONG_MAX;
+    for (struct dirent* e; (e = readdir(d)) != NULL;) {
+        char* end;
+        unsigned long long seq = strtoull(e->d_name, &end, 10);
+        if (end == e->d_name || (strcmp(end, ".dat") != 0 && strcmp(end, ".idx") != 0))
+            continue;
+        char path[PATH_MAX + 32];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        ar->total += archive_file_size(path);
+        if (seq > ar->seq)
+            ar->seq = seq;
+        if (seq < ar->oldest_seq)
+            ar->oldest_seq = seq;
+    }
+    closedir(d);
+    if (ar->oldest_seq == ULLONG_MAX)
+        ar->oldest_seq = 1;
+
+    ar->block = malloc(ARCHIVE_BLOCK_BYTES);
+    ar->tokens = calloc(ARCHIVE_TOKEN_SLOTS, sizeof(*ar->tokens));
+    ar->line_tokens = malloc(ARCHIVE_BLOCK_BYTES * sizeof(*ar->line_tokens));
+    ar->entry = malloc(sizeof(struct archive_entry) + ARCHIVE_BLOOM_MAX_BITS / 8);
+    ar->zbuf_size = compressBound(ARCHIVE_BLOCK_BYTES);
+    ar->zbuf = malloc(ar->zbuf_size);
+    if (!ar->block || !ar->tokens || !ar->line_tokens || !ar->entry || !ar->zbuf) {
+        perror("malloc(archive)");
+        return -1;
+    }
+    if (deflateInit(&ar->zdef, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "archive: zlib initialisation failed\n");
+        return -1;
+    }
+    if (archive_roll(ar) != 0)
+        return -1;
+    archive_enforce_quota(ar);
+    return 0;
+}
+
+/* Compresses the open block and appends it and its index entry to the current segment. */
+static void archive_seal(struct archive* ar)
+{
+    if (ar->block_len == 0)
+        return;
+
+    uint32_t bits = ARCHIVE_BLOOM_MIN_BITS;
+    while (bits < (uint32_t)ar->ntokens * 10 && bits < ARCHIVE_BLOOM_MAX_BITS)
+        bits <<= 1;
+    struct archive_entry* entry = (struct archive_entry*)ar->entry;
+    unsigned char* bloom = ar->entry + sizeof(*entry);
+    memset(bloom, ar->unfiltered ? 0xff : 0, bits / 8);
+    for (int i = 0; i < ARCHIVE_TOKEN_SLOTS && !ar->unfiltered; ++i) {
+        if (ar->tokens[i])
+            archive_bloom_set(bloom, bits, ar->tokens[i]);
+    }
+
+    deflateReset(&ar->zdef);
+    ar->zdef.next_in = (Bytef*)ar->block;
+    ar->zdef.avail_in = (uInt)ar->block_len;
+    ar->zdef.next_out = (Bytef*)ar->zbuf;
+    ar->zdef.avail_out = (uInt)ar->zbuf_size;
+    size_t len = deflate(&ar->zdef, Z_FINISH) == Z_STREAM_END ? ar->zbuf_size - ar->zdef.avail_out : 0;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->magic = ARCHIVE_MAGIC;
+    entry->bloom_bytes = bits / 8;
+    entry->offset = ar->data_len;
+    entry->compressed = (uint32_t)len;
+    entry->raw = (uint32_t)ar->block_len;
+    entry->lines = ar->block_lines;
+    entry->first = ar->block_first;
+    entry->last = time(NULL);
+    size_t entry_len = sizeof(*entry) + entry->bloom_bytes;
+
+    if (len == 0 || ar->data_fd < 0 || ar->idx_fd < 0 || write(ar->data_fd, ar->zbuf, len) != (ssize_t)len
+        || write(ar->idx_fd, ar->entry, entry_len) != (ssize_t)entry_len) {
+        /* a torn block is harmless: without its index entry no query reads it */
+        ++ar->stats.errors;
+        ar->data_len = ar->data_fd >= 0 ? (unsigned long long)lseek(ar->data_fd, 0, SEEK_END) : 0;
+    } else {
+        ar->data_len += len;
+        ar->idx_len += entry_len;
+        ar->total += len + entry_len;
+        ar->stats.compressed += len;
+        ar->stats.indexed += entry_len;
+        ++ar->stats.blocks;
+    }
+
+    memset(ar->tokens, 0, ARCHIVE_TOKEN_SLOTS * sizeof(*ar->tokens));
+    ar->ntokens = 0;
+    ar->unfiltered = 0;
+    ar->block_len = 0;
+    ar->block_lines = 0;
+
+    if (ar->data_len + ar->idx_len >= ar->segment_max || ar->data_fd < 0)
+        archive_roll(ar);
+    archive_enforce_quota(ar);
+}
+
+/* Archives one NUL-terminated, '\n'-terminated line. */
+static void archive_line(struct archive* ar, const char* line)
+{
+    size_t n = strlen(line);
+
+    if (n > ARCHIVE_BLOCK_BYTES)
+        n = ARCHIVE_BLOCK_BYTES; /* a tailed line longer than TAIL_BUF_SIZE arrives in pieces anyway */
+    size_t count = archive_tokenize(line, n, ar->line_tokens);
+    int unfiltered = count > ARCHIVE_MAX_TOKENS;
+    if (unfiltered)
+        count = ARCHIVE_MAX_TOKENS; /* keeps the set below ARCHIVE_TOKEN_SLOTS; the filter passes all */
+    /* count may hold repeats, so this can seal early but never lets the set overflow */
+    if (ar->block_len + n > ARCHIVE_BLOCK_BYTES || ar->ntokens + count > ARCHIVE_MAX_TOKENS)
+        archive_seal(ar);
+    if (ar->block_len == 0)
+        ar->block_first = time(NULL);
+    memcpy(ar->block + ar->block_len, line, n);
+    ar->block_len += n;
+    ++ar->block_lines;
+    ++ar->stats.lines;
+    ar->stats.bytes += n;
+    ar->unfiltered |= unfiltered;
+
+    for (size_t t = 0; t < count; ++t) {
+        uint64_t h = ar->line_tokens[t];
+        for (size_t i = h & (ARCHIVE_TOKEN_SLOTS - 1);; i = (i + 1) & (ARCHIVE_TOKEN_SLOTS - 1)) {
+            if (ar->tokens[i] == h)
+                break;
+            if (ar->tokens[i] == 0) {
+                ar->tokens[i] = h;
+                ++ar->ntokens;
+                break;
+            }
+        }
+    }
+}
+
+/* Writes a block that has been open too long, so queries see it. */
+static void archive_tick(struct archive* ar)
+{
+    if (ar->block_len > 0 && time(NULL) - ar->block_first >= ARCHIVE_SEAL_SEC)
+        archive_seal(ar);
+}
+
+static void archive_report(const struct archive* ar)
+{
+    fprintf(stderr,
+        "archive: lines=%llu bytes=%llu compressed=%llu index=%llu ratio=%.1f blocks=%llu segments=%llu"
+        " deleted=%llu errors=%llu | size=%llu/%llu\n",
+        ar->stats.lines, ar->stats.bytes, ar->stats.compressed, ar->stats.indexed,
+        ar->stats.compressed ? (double)ar->stats.bytes / (double)(ar->stats.compressed + ar->stats.indexed) : 0.0,
+        ar->stats.blocks, ar->stats.segments, ar->stats.deleted, ar->stats.errors, ar->total, ar->quota);
+}
+
+static void archive_close(struct archive* ar)
+{
+    archive_seal(ar);
+    if (ar->data_fd >= 0)
+        close(ar->data_fd);
+    if (ar->idx_fd >= 0)
+        close(ar->idx_fd);
+    ar->data_fd = ar->idx_fd = -1;
+    deflateEnd(&ar->zdef);
+    free(ar->block);
+    free(ar->tokens);
+    free(ar->line_tokens);
+    free(ar->entry);
+    free(ar->zbuf);
+    ar->block = ar->zbuf = NULL;
+    ar->tokens = ar->line_tokens = NULL;
+    ar->entry = NULL;
+}
+
+/* ---- queries ---- */
+
+struct archive_query_stats {
+    unsigned long long segments;
+    unsigned long long blocks;     /* in the time range */
+    unsigned long long candidates; /* passed the filters and were inflated */
+    unsigned long long matched;    /* candidates with at least one matching line */
+    unsigned long long lines;      /* lines written */
+    unsigned long long bytes_read; /* index and compressed data read */
+};
+
+/* Reads a whole file into a malloc'ed buffer. */
+static char* archive_slurp(const char* path, size_t* len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    char* buf = NULL;
+
+    *len = 0;
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) == 0 && (buf = malloc((size_t)st.st_size + 1)) != NULL) {
+        ssize_t r;
+        while (*len < (size_t)st.st_size && (r = read(fd, buf + *len, (size_t)st.st_size - *len)) > 0)
+            *len += (size_t)r;
+    }
+    close(fd);
+    return buf;
+}
+
+static int archive_by_name(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Writes to out every archived line containing all tokens of all terms, from blocks whose lines
+   arrived within [since, until] (unix time; 0 = open). Returns 0, or -1 if dir cannot be read. */
+static int archive_query(const char* dir, const char* const* terms, int nterms, long long since, long long until,
+    FILE* out, struct archive_query_stats* stats)
+{
+    uint64_t query[ARCHIVE_MAX_TERMS];
+    size_t nquery = 0;
+    char needle[256] = ""; /* the longest query token, lower case: found with memmem() before tokenizing */
+    size_t needle_len = 0;
+    uint64_t* line_tokens = malloc(ARCHIVE_BLOCK_BYTES * sizeof(*line_tokens));
+    char* raw = malloc(ARCHIVE_BLOCK_BYTES);
+    char* lower = malloc(ARCHIVE_BLOCK_BYTES);
+    char* zbuf = malloc(compressBound(ARCHIVE_BLOCK_BYTES));
+    char** names = NULL;
+    size_t nnames = 0, cap = 0;
+    z_stream zinf;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&zinf, 0, sizeof(zinf));
+    for (int t = 0; t < nterms; ++t) {
+        size_t len = strlen(terms[t]);
+        uint64_t* hashes = malloc((len + 1) * sizeof(*hashes));
+        size_t count = hashes ? archive_tokenize(terms[t], len, hashes) : 0;
+        for (size_t i = 0; i < count && nquery < ARCHIVE_MAX_TERMS; ++i)
+            query[nquery++] = hashes[i];
+        free(hashes);
+        /* the needle is a whole token, not the term: "user=root" matches lines with "user root" */
+        for (size_t i = 0; i < len;) {
+            size_t start = i;
+            while (i < len && archive_token_char((unsigned char)terms[t][i]))
+                ++i;
+            if (i - start > needle_len && i - start < sizeof(needle)) {
+                for (needle_len = 0; needle_len < i - start; ++needle_len)
+                    needle[needle_len] = (char)tolower((unsigned char)terms[t][start + needle_len]);
+            }
+            if (i == start)
+                ++i;
+        }
+    }
+
+    DIR* d = opendir(dir);
+    if (!d || !line_tokens || !raw || !lower || !zbuf || inflateInit(&zinf) != Z_OK) {
+        fprintf(stderr, "archive: cannot query %s: %s\n", dir, strerror(errno));
+        if (d)
+            closedir(d);
+        free(line_tokens);
+        free(raw);
+        free(lower);
+        free(zbuf);
+        return -1;
+    }
+    for (struct dirent* e; (e = readdir(d)) != NULL;) {
+        size_t n = strlen(e->d_name);
+        if (n < 5 || strcmp(e->d_name + n - 4, ".idx") != 0)
+            continue;
+        if (nnames == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = realloc(names, cap * sizeof(*names));
+        }
+        names[nnames++] = strndup(e->d_name, n - 4);
+    }
+    closedir(d);
+    qsort(names, nnames, sizeof(*names), archive_by_name); /* oldest segment first */
+
+    for (size_t s = 0; s < nnames; ++s) {
+        char path[PATH_MAX + 32];
+        size_t idx_len;
+        snprintf(path, sizeof(path), "%s/%s.idx", dir, names[s]);
+        char* idx = archive_slurp(path, &idx_len);
+        snprintf(path, sizeof(path), "%s/%s.dat", dir, names[s]);
+        int data_fd = open(path, O_RDONLY | O_CLOEXEC);
+        ++stats->segments;
+        stats->bytes_read += idx_len;
+
+        for (size_t pos = 0; idx && data_fd >= 0 && pos + sizeof(struct archive_entry) <= idx_len;) {
+            struct archive_entry entry;
+            memcpy(&entry, idx + pos, sizeof(entry));
+            if (entry.magic != ARCHIVE_MAGIC || pos + sizeof(entry) + entry.bloom_bytes > idx_len)
+                break; /* still being written, or damaged */
+            const unsigned char* bloom = (const unsigned char*)idx + pos + sizeof(entry);
+            pos += sizeof(entry) + entry.bloom_bytes;
+
+            if ((since && entry.last < since) || (until && entry.first > until))
+                continue;
+            ++stats->blocks;
+            int maybe = 1;
+            for (size_t q = 0; q < nquery && maybe; ++q)
+                maybe = archive_bloom_test(bloom, entry.bloom_bytes * 8, query[q]);
+            if (!maybe || entry.raw > ARCHIVE_BLOCK_BYTES || entry.compressed > compressBound(ARCHIVE_BLOCK_BYTES))
+                continue;
+
+            ++stats->candidates;
+            stats->bytes_read += entry.compressed;
+            if (pread(data_fd, zbuf, entry.compressed, (off_t)entry.offset) != (ssize_t)entry.compressed)
+                continue;
+            inflateReset(&zinf);
+            zinf.next_in = (Bytef*)zbuf;
+            zinf.avail_in = entry.compressed;
+            zinf.next_out = (Bytef*)raw;
+            zinf.avail_out = ARCHIVE_BLOCK_BYTES;
+            if (inflate(&zinf, Z_FINISH) != Z_STREAM_END || zinf.total_out != entry.raw)
+                continue;
+
+            /* only lines containing the needle can match: jump from one to the next */
+            unsigned long long before = stats->lines;
+            const char* end = raw + entry.raw;
+            for (uint32_t i = 0; i < entry.raw && needle_len > 0; ++i) {
+                unsigned char c = (unsigned char)raw[i];
+                lower[i] = (char)((unsigned)(c - 'A') < 26u ? c | 0x20 : c); /* ASCII only, like tolower() in the C locale */
+            }
+            for (const char* line = raw; line < end;) {
+                if (needle_len > 0) {
+                    const char* hit = memmem(lower + (line - raw), (size_t)(end - line), needle, needle_len);
+                    if (!hit)
+                        break;
+                    const char* nl = memrchr(lower + (line - raw), '\n', (size_t)(hit - lower - (line - raw)));
+                    if (nl)
+                        line = raw + (nl - lower) + 1;
+                }
+                const char* nl = memchr(line, '\n', (size_t)(end - line));
+                size_t len = nl ? (size_t)(nl - line) + 1 : (size_t)(end - line);
+                size_t count = archive_tokenize(line, len, line_tokens);
+                size_t found = 0;
+                for (size_t q = 0; q < nquery; ++q) {
+                    size_t t = 0;
+                    while (t < count && line_tokens[t] != query[q])
+                        ++t;
+                    if (t == count)
+                        break;
+                    ++found;
+                }
+                if (found == nquery) {
+                    fwrite(line, 1, len, out);
+                    ++stats->lines;
+                }
+                line += len;
+            }
+            if (stats->lines > before)
+                ++stats->matched;
+        }
+        if (data_fd >= 0)
+            close(data_fd);
+        free(idx);
+        free(names[s]);
+    }
+
+    inflateEnd(&zinf);
+    free(names);
+    free(line_tokens);
+    free(raw);
+    free(lower);
+    free(zbuf);
+    return 0;
+}
+
+/* Parses a query time: unix seconds, "YYYY-MM-DDTHH:MM:SS" (UTC), or an age such as "90m", "24h",
+   "7d". Returns -1 if spec is none of these. */
+static long long archive_parse_time(const char* spec, time_t now)
+{
+    char* end;
+    long long v = strtoll(spec, &end, 10);
+    struct tm tm;
+
+    if (end != spec && *end == '\0')
+        return v;
+    if (end != spec && end[1] == '\0') {
+        switch (*end) {
+        case 's': return (long long)now - v;
+        case 'm': return (long long)now - v * 60;
+        case 'h': return (long long)now - v * 3600;
+        case 'd': return (long long)now - v * 86400;
+        }
+    }
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(spec, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (end && (*end == '\0' || (*end == 'Z' && end[1] == '\0')))
+        return (long long)timegm(&tm);
+    return -1;
+}
@@ -6,194 +6,417 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/inotify.h>
-#include <sys/stat.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
-#define LINE_BUF 4096
-#define EVENT_BUF_LEN (1024 * (sizeof(struct inotify_event) + 16))
+#include "agent_archive.h"
+#include "agent_recorder.h"
+#include "agent_rollup.h"
+#include "agent_ship.h"
+#include "agent_syslog.h"
+#include "agent_tail.h"
 
 /* CONFIG — change or read from a file/env in real agent */
 const char* log_candidates[] = { "/var/log/syslog", "/var/log/messages" };
-const char* server_url = "https://example.com/ingest"; /* replace with your endpoint */
-const char* auth_token = "REPLACE_WITH_TOKEN"; /* optional auth */
+const char* server_url = "https://example.com/ingest"; /* replace with your endpoint (AGENT_SERVER_URL) */
+const char* auth_token = "REPLACE_WITH_TOKEN"; /* optional auth (AGENT_AUTH_TOKEN) */
+int syslog_port = 514; /* UDP and TCP syslog listener, 0 = off (AGENT_SYSLOG_PORT) */
+const char* syslog_bind = "127.0.0.1"; /* address of that listener; "::" = every interface, unauthenticated (AGENT_SYSLOG_BIND) */
+const char* syslog_socket = "/run/kaimz-agent.sock"; /* Unix datagram listener, "" = off (AGENT_SYSLOG_SOCKET) */
+const char* log_files = NULL; /* comma-separated files to follow instead of the first candidate (AGENT_LOG_FILES) */
+enum tail_engine io_engine = TAIL_ENGINE_EPOLL; /* file read engine: epoll or io_uring (AGENT_IO_ENGINE) */
+size_t batch_bytes = 64 * 1024; /* starting batch size; adapted at run time (AGENT_BATCH_BYTES) */
+int max_inflight = 4; /* concurrent uploads, at most; adapted at run time (AGENT_MAX_INFLIGHT) */
+long target_latency_ms = 1000; /* upload time the adaptive limits aim for (AGENT_TARGET_LATENCY_MS) */
+long batch_delay_ms = 1000; /* longest a line waits for its batch to fill (AGENT_BATCH_DELAY_MS) */
+const char* rollup_sources = NULL; /* comma-separated "syslog" and/or log files that are only counted (AGENT_ROLLUP_SOURCES) */
+int rollup_window_sec = 60; /* rollup window (AGENT_ROLLUP_WINDOW_SEC) */
+int rollup_top_k = 0; /* message templates reported per window, 0 = none (AGENT_ROLLUP_TOP_K) */
+const char* recorder_sources = NULL; /* comma-separated "syslog" and/or log files shipped only on a trigger (AGENT_RECORDER_SOURCES) */
+long recorder_mb = 64; /* compressed flight recorder size (AGENT_RECORDER_MB) */
+long recorder_minutes = 15; /* how far back the flight recorder goes (AGENT_RECORDER_MINUTES) */
+const char* recorder_pattern = NULL; /* extended regex; a matching line of any source fires a trigger (AGENT_RECORDER_TRIGGER) */
+const char* recorder_watch = NULL; /* comma-separated paths whose changes fire a trigger (AGENT_RECORDER_WATCH) */
+long recorder_cooldown_sec = 300; /* least time between two triggers (AGENT_RECORDER_COOLDOWN_SEC) */
+long recorder_after_sec = 60; /* recorded sources ship live this long after a trigger (AGENT_RECORDER_AFTER_SEC) */
+const char* control_socket = "/run/kaimz-agent.ctl"; /* Unix datagram socket for "trigger", "" = off (AGENT_CONTROL_SOCKET) */
+const char* archive_sources = NULL; /* comma-separated "syslog" and/or log files kept in the local archive (AGENT_ARCHIVE_SOURCES) */
+const char* archive_dir = "/var/lib/kaimz-agent/archive"; /* local archive, also read by "query" (AGENT_ARCHIVE_DIR) */
+long archive_mb = 1024; /* disk quota of the local archive (AGENT_ARCHIVE_MB) */
 
 static volatile sig_atomic_t keep_running = 1;
 
+#define SOURCE_ROLLUP 1 /* counted in rollups instead of shipped */
+#define SOURCE_RECORD 2 /* kept in the flight recorder instead of shipped */
+#define SOURCE_ARCHIVE 4 /* kept in the local archive instead of shipped */
+
+/* Context of the line callbacks: where lines go, and what each source does with them. */
+struct agent {
+    struct shipper* shipper;
+    struct rollup* rollup;
+    struct recorder* recorder; /* NULL when no source is recorded */
+    struct archive* archive;   /* NULL when no source is archived */
+    const struct syslog_receiver* syslog_rx;
+    const struct tailer* tailer;
+    int syslog_mode; /* SOURCE_* flags; 0 = shipped line by line */
+    unsigned char file_mode[TAIL_MAX_FILES];
+};
+
 static void handle_sig(int sig)
 {
     (void)sig;
     keep_running = 0;
 }
 
-static FILE* open_follow(const char* path)
+/* Every line, tailed from the log file or received over syslog, goes through here. */
+static void process_line(const char* line, void* ctx)
 {
-    FILE* fp = fopen(path, "r");
-    if (!fp)
-        return NULL;
-    if (fseeko(fp, 0, SEEK_END) != 0) {
-        fclose(fp);
-        return NULL;
-    }
-    return fp;
+    struct shipper* shipper = ctx;
+
+    /* Safe local printing for debug — do NOT pass line as format string */
+    fputs(line, stdout);
+    fflush(stdout);
+
+    /* staged for the next batch; ship_tick() sends it from the main loop */
+    ship_line(shipper, line, strlen(line));
 }
 
-static int send_line_to_server(CURL* curl, const char* line)
+static void route_line(struct agent* agent, int mode, const char* line, int severity)
 {
-    struct curl_slist* hdrs = NULL;
-    int rc = 0;
-    char auth_hdr[256];
-
-    /* build auth header if token present */
-    if (auth_token && auth_token[0]) {
-        snprintf(auth_hdr, sizeof(auth_hdr), "Authorization: Bearer %s", auth_token);
-        hdrs = curl_slist_append(hdrs, auth_hdr);
-    }
-    hdrs = curl_slist_append(hdrs, "Content-Type: text/plain; charset=utf-8");
-
-    curl_easy_setopt(curl, CURLOPT_URL, server_url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, line);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)strlen(line));
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L); /* short timeout for demo */
-
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        fprintf(stderr, "curl perform failed: %s\n", curl_easy_strerror(res));
-        rc = -1;
+    if (agent->recorder)
+        recorder_match(agent->recorder, line);
+    if (mode == 0)
+        process_line(line, agent->shipper);
+    if (mode & SOURCE_ROLLUP)
+        rollup_add(agent->rollup, line, severity);
+    if (mode & SOURCE_RECORD)
+        recorder_line(agent->recorder, line);
+    if (mode & SOURCE_ARCHIVE)
+        archive_line(agent->archive, line);
+}
+
+static void process_syslog_line(const char* line, void* ctx)
+{
+    struct agent* agent = ctx;
+    route_line(agent, agent->syslog_mode, line, agent->syslog_rx->pri < 0 ? -1 : agent->syslog_rx->pri & 7);
+}
+
+static void process_file_line(const char* line, void* ctx)
+{
+    struct agent* agent = ctx;
+    route_line(agent, agent->file_mode[agent->tailer->current], line, -1);
+}
+
+/* ", rollups + archive" and the like; "" for sources shipped line by line. */
+static const char* mode_name(int mode)
+{
+    static char name[64];
+    name[0] = '\0';
+    if (mode & SOURCE_ROLLUP)
+        strcat(name, " + rollups");
+    if (mode & SOURCE_RECORD)
+        strcat(name, " + flight recorder");
+    if (mode & SOURCE_ARCHIVE)
+        strcat(name, " + archive");
+    if (!name[0])
+        return name;
+    name[1] = ',';
+    return name + 1;
+}
+
+/* Sets flag on the sources named in list ("syslog" or followed files). Returns how many there are. */
+static int mark_sources(struct agent* agent, const char* list, int flag, const char* setting,
+    const char* const* paths, int npaths)
+{
+    int marked = 0;
+    char* copy;
+
+    if (!list || !(copy = strdup(list)))
+        return 0;
+    for (char* save = NULL, *p = strtok_r(copy, ",", &save); p; p = strtok_r(NULL, ",", &save)) {
+        int found = 0;
+        if (strcmp(p, "syslog") == 0) {
+            agent->syslog_mode |= flag;
+            found = 1;
+        }
+        for (int i = 0; i < npaths && i < TAIL_MAX_FILES; ++i) {
+            if (strcmp(p, paths[i]) == 0) {
+                agent->file_mode[i] |= (unsigned char)flag;
+                found = 1;
+            }
+        }
+        if (found)
+            ++marked;
+        else
+            fprintf(stderr, "%s: '%s' is neither syslog nor a followed file\n", setting, p);
     }
+    free(copy);
+    return marked;
+}
 
-    curl_slist_free_all(hdrs);
-    return rc;
+static void load_config(void)
+{
+    const char* v;
+    if ((v = getenv("AGENT_SERVER_URL")) && v[0])
+        server_url = v;
+    if ((v = getenv("AGENT_AUTH_TOKEN")))
+        auth_token = v;
+    if ((v = getenv("AGENT_SYSLOG_PORT")))
+        syslog_port = atoi(v);
+    if ((v = getenv("AGENT_SYSLOG_BIND")) && v[0])
+        syslog_bind = v;
+    if ((v = getenv("AGENT_SYSLOG_SOCKET")))
+        syslog_socket = v;
+    if ((v = getenv("AGENT_LOG_FILES")) && v[0])
+        log_files = v;
+    if ((v = getenv("AGENT_BATCH_BYTES")) && atol(v) > 0)
+        batch_bytes = (size_t)atol(v);
+    if ((v = getenv("AGENT_MAX_INFLIGHT")) && atoi(v) > 0)
+        max_inflight = atoi(v);
+    if ((v = getenv("AGENT_TARGET_LATENCY_MS")) && atol(v) > 0)
+        target_latency_ms = atol(v);
+    if ((v = getenv("AGENT_BATCH_DELAY_MS")) && atol(v) > 0)
+        batch_delay_ms = atol(v);
+    if ((v = getenv("AGENT_ROLLUP_SOURCES")) && v[0])
+        rollup_sources = v;
+    if ((v = getenv("AGENT_ROLLUP_WINDOW_SEC")) && atoi(v) > 0)
+        rollup_window_sec = atoi(v);
+    if ((v = getenv("AGENT_ROLLUP_TOP_K")) && atoi(v) >= 0)
+        rollup_top_k = atoi(v);
+    if ((v = getenv("AGENT_RECORDER_SOURCES")) && v[0])
+        recorder_sources = v;
+    if ((v = getenv("AGENT_RECORDER_MB")) && atol(v) > 0)
+        recorder_mb = atol(v);
+    if ((v = getenv("AGENT_RECORDER_MINUTES")) && atol(v) > 0)
+        recorder_minutes = atol(v);
+    if ((v = getenv("AGENT_RECORDER_TRIGGER")) && v[0])
+        recorder_pattern = v;
+    if ((v = getenv("AGENT_RECORDER_WATCH")) && v[0])
+        recorder_watch = v;
+    if ((v = getenv("AGENT_RECORDER_COOLDOWN_SEC")) && atol(v) >= 0)
+        recorder_cooldown_sec = atol(v);
+    if ((v = getenv("AGENT_RECORDER_AFTER_SEC")) && atol(v) >= 0)
+        recorder_after_sec = atol(v);
+    if ((v = getenv("AGENT_CONTROL_SOCKET")))
+        control_socket = v;
+    if ((v = getenv("AGENT_ARCHIVE_SOURCES")) && v[0])
+        archive_sources = v;
+    if ((v = getenv("AGENT_ARCHIVE_DIR")) && v[0])
+        archive_dir = v;
+    if ((v = getenv("AGENT_ARCHIVE_MB")) && atol(v) > 0)
+        archive_mb = atol(v);
+    if ((v = getenv("AGENT_IO_ENGINE"))) {
+        if (strcmp(v, "io_uring") == 0)
+            io_engine = TAIL_ENGINE_IO_URING;
+        else if (strcmp(v, "epoll") != 0)
+            fprintf(stderr, "Unknown AGENT_IO_ENGINE '%s', using epoll\n", v);
+    }
 }
 
-int main(void)
+/* "query [--since T] [--until T] [--stats] TERM...": prints the archived lines containing every
+   term. Reads the archive files directly, so it works while the agent is running. */
+static int run_query(int argc, char** argv)
 {
-    const char* path = NULL;
-    FILE* fp = NULL;
-    int inotify_fd = -1;
-    int wd = -1;
-    char line[LINE_BUF];
-
-    /* pick first readable log path */
-    for (size_t i = 0; i < sizeof(log_candidates) / sizeof(log_candidates[0]); ++i) {
-        if (access(log_candidates[i], R_OK) == 0) {
-            path = log_candidates[i];
-            break;
+    const char* terms[ARCHIVE_MAX_TERMS];
+    int nterms = 0;
+    long long since = 0, until = 0;
+    int show_stats = 0;
+    time_t now = time(NULL);
+    struct archive_query_stats stats;
+    struct timespec start, end;
+
+    for (int i = 0; i < argc; ++i) {
+        if ((strcmp(argv[i], "--since") == 0 || strcmp(argv[i], "--until") == 0) && i + 1 < argc) {
+            long long t = archive_parse_time(argv[i + 1], now);
+            if (t < 0) {
+                fprintf(stderr, "Bad time '%s': use unix seconds, YYYY-MM-DDTHH:MM:SS (UTC) or an age like 24h\n",
+                    argv[i + 1]);
+                return 2;
+            }
+            *(argv[i][2] == 's' ? &since : &until) = t;
+            ++i;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (argv[i][0] == '-' || nterms == ARCHIVE_MAX_TERMS) {
+            fprintf(stderr, "usage: agent query [--since T] [--until T] [--stats] TERM...\n");
+            return 2;
+        } else {
+            terms[nterms++] = argv[i];
         }
     }
-    if (!path) {
-        fprintf(stderr, "No readable log file found.\n");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (archive_query(archive_dir, terms, nterms, since, until, stdout, &stats) != 0)
         return 1;
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (show_stats)
+        fprintf(stderr,
+            "query: %.1f ms, segments=%llu blocks=%llu candidates=%llu matched=%llu lines=%llu read=%llu bytes\n",
+            (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6,
+            stats.segments, stats.blocks, stats.candidates, stats.matched, stats.lines, stats.bytes_read);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* paths[TAIL_MAX_FILES];
+    int npaths = 0;
+    char* file_list = NULL;
+    int epoll_fd = -1;
+    int listeners = 0;
+    int followed = 0;
+    int rolled_up = 0;
+    int recorded = 0;
+    char* watch_list = NULL;
+    long long swept_ms = 0;
+    static struct syslog_receiver syslog_rx; /* large: holds the message pool */
+    static struct tailer tailer;
+    static struct shipper shipper;
+    static struct rollup rollup; /* fixed-size counter tables */
+    static struct recorder recorder;
+    static struct archive archive;
+    struct agent agent = { &shipper, &rollup, NULL, NULL, &syslog_rx, &tailer, 0, { 0 } };
+
+    load_config();
+    if (argc > 1 && strcmp(argv[1], "query") == 0)
+        return run_query(argc - 2, argv + 2);
+
+    if (log_files) {
+        /* follow every listed file */
+        file_list = strdup(log_files);
+        for (char* save = NULL, *p = strtok_r(file_list, ",", &save); p && npaths < TAIL_MAX_FILES;
+             p = strtok_r(NULL, ",", &save))
+            paths[npaths++] = p;
+    } else {
+        /* pick first readable log path */
+        for (size_t i = 0; i < sizeof(log_candidates) / sizeof(log_candidates[0]); ++i) {
+            if (access(log_candidates[i], R_OK) == 0) {
+                paths[npaths++] = log_candidates[i];
+                break;
+            }
+        }
     }
-    printf("Agent will follow: %s\n", path);
 
     /* signal handlers for graceful shutdown */
     signal(SIGINT, handle_sig);
     signal(SIGTERM, handle_sig);
 
+    /* one wait point for inotify, the syslog sockets and the upload connections; the loop still
+       wakes every 200ms */
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
     /* init libcurl once */
     curl_global_init(CURL_GLOBAL_DEFAULT);
-    CURL* curl = curl_easy_init();
-    if (!curl) {
+    if (ship_open(&shipper, epoll_fd, server_url, auth_token, batch_bytes, max_inflight, target_latency_ms,
+            batch_delay_ms) != 0) {
         fprintf(stderr, "Failed to init curl\n");
         return 1;
     }
 
-    /* open and seek to end */
-    fp = open_follow(path);
-    if (!fp) {
-        perror("open_follow");
-        /* continue: maybe file appears later */
-    }
+    /* sources that are only counted; their summaries are shipped like any other line */
+    rolled_up = mark_sources(&agent, rollup_sources, SOURCE_ROLLUP, "AGENT_ROLLUP_SOURCES", paths, npaths);
+    rollup_open(&rollup, rollup_window_sec, rollup_top_k, process_line, &shipper);
 
-    /* inotify */
-    inotify_fd = inotify_init1(IN_NONBLOCK);
-    if (inotify_fd < 0) {
-        perror("inotify_init1");
-        inotify_fd = -1; /* fallback to polling */
-    } else {
-        wd = inotify_add_watch(inotify_fd, path, IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB);
-        if (wd < 0) {
-            perror("inotify_add_watch");
-            wd = -1;
+    /* sources only shipped when a trigger fires */
+    recorded = mark_sources(&agent, recorder_sources, SOURCE_RECORD, "AGENT_RECORDER_SOURCES", paths, npaths);
+    if (recorded > 0) {
+        watch_list = recorder_watch ? strdup(recorder_watch) : NULL;
+        if (recorder_open(&recorder, &shipper, epoll_fd, (size_t)recorder_mb * 1024 * 1024, recorder_minutes * 60,
+                recorder_cooldown_sec, recorder_after_sec, recorder_pattern, watch_list, control_socket) != 0) {
+            fprintf(stderr, "Failed to set up the flight recorder\n");
+            return 1;
         }
+        agent.recorder = &recorder;
+        printf("Agent flight recorder: %ld MB / %ld min, triggers:%s%s%s%s\n", recorder_mb, recorder_minutes,
+            recorder.has_pattern ? " pattern" : "", recorder.nwatches > 0 ? " watch" : "",
+            recorder.ctl_fd >= 0 ? " " : "", recorder.ctl_fd >= 0 ? control_socket : "");
     }
 
-    while (keep_running) {
-        /* read any new lines */
-        if (fp) {
-            while (fgets(line, sizeof(line), fp) != NULL) {
-                /* Safe local printing for debug — do NOT pass line as format string */
-                fputs(line, stdout);
-                fflush(stdout);
-
-                /* forward to server (synchronous demo) */
-                if (send_line_to_server(curl, line) != 0) {
-                    /* On failure you could enqueue the line to disk or memory for retry.
-                       For simplicity we just print an error. */
-                    fprintf(stderr, "Failed to send line, will continue.\n");
-                }
-            }
-            clearerr(fp);
+    /* sources kept on this host, for local queries */
+    if (mark_sources(&agent, archive_sources, SOURCE_ARCHIVE, "AGENT_ARCHIVE_SOURCES", paths, npaths) > 0) {
+        if (archive_open(&archive, archive_dir, (unsigned long long)archive_mb * 1024 * 1024) != 0) {
+            fprintf(stderr, "Failed to open the archive in %s\n", archive_dir);
+            return 1;
         }
+        agent.archive = &archive;
+        printf("Agent archiving to %s (%ld MB quota)\n", archive_dir, archive_mb);
+    }
 
-        /* if we have inotify, read events */
-        if (inotify_fd >= 0) {
-            char evbuf[EVENT_BUF_LEN];
-            ssize_t r = read(inotify_fd, evbuf, sizeof(evbuf));
-            if (r > 0) {
-                ssize_t i = 0;
-                while (i < r) {
-                    struct inotify_event* ev = (struct inotify_event*)(evbuf + i);
-                    if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) {
-                        /* file rotated or removed — reopen */
-                        if (fp) {
-                            fclose(fp);
-                            fp = NULL;
-                        }
-                        /* try reopen immediately */
-                        fp = open_follow(path);
-                        if (wd >= 0) {
-                            inotify_rm_watch(inotify_fd, wd);
-                            wd = -1;
-                        }
-                        if (inotify_fd >= 0)
-                            wd = inotify_add_watch(inotify_fd, path, IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB);
-                    } else if (ev->mask & IN_ATTRIB) {
-                        /* possible truncation — if file shrank, seek to end */
-                        if (fp) {
-                            struct stat st;
-                            int fd = fileno(fp);
-                            if (fd >= 0 && fstat(fd, &st) == 0) {
-                                off_t off = ftello(fp);
-                                if (off > st.st_size) {
-                                    fseeko(fp, 0, SEEK_END);
-                                }
-                            }
-                        }
-                    }
-                    i += sizeof(struct inotify_event) + ev->len;
-                }
-                continue;
-            } else if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-                perror("read(inotify_fd)");
-            }
+    /* built-in syslog receiver */
+    listeners = syslog_open(&syslog_rx, epoll_fd, syslog_bind, syslog_port, syslog_socket, process_syslog_line, &agent);
+    if (listeners > 0)
+        printf("Agent receiving syslog on %s port %d%s%s\n", syslog_bind, syslog_port,
+            syslog_rx.unix_fd >= 0 ? " and " : "", syslog_rx.unix_fd >= 0 ? syslog_socket : "");
+
+    /* log files, followed from their current end */
+    followed = tail_open(&tailer, paths, npaths, io_engine, epoll_fd, process_file_line, &agent);
+    for (int i = 0; i < followed; ++i)
+        printf("Agent will follow: %s (%s%s)\n", tailer.files[i].path, tail_engine_name(tailer.engine),
+            mode_name(agent.file_mode[i]));
+    if (listeners > 0 && agent.syslog_mode)
+        printf("Agent will ship syslog as %s\n", mode_name(agent.syslog_mode) + 2);
+
+    if (followed == 0 && listeners == 0) {
+        fprintf(stderr, "No readable log file found and no syslog listener could be opened.\n");
+        return 1;
+    }
+
+    while (keep_running) {
+        /* wait for file changes, syslog traffic or upload progress */
+        struct epoll_event events[16];
+        int timeout = ship_timeout(&shipper, 200);
+        int nev = epoll_wait(epoll_fd, events, 16, timeout);
+        if (nev < 0 && errno != EINTR)
+            perror("epoll_wait");
+        for (int e = 0; e < nev; ++e) {
+            int fd = events[e].data.fd;
+            if (!tail_handle(&tailer, fd) && !syslog_handle(&syslog_rx, fd)
+                && !(agent.recorder && recorder_handle(&recorder, fd)))
+                ship_handle(&shipper, fd, events[e].events);
         }
 
-        /* fallback sleep when nothing happened */
-        usleep(200000);
+        /* read new lines: from the files inotify flagged, or from all of them every 200ms when
+           nothing else woke us */
+        int sweep = nev == 0 && ship_now_ms() - swept_ms >= 200;
+        if (sweep)
+            swept_ms = ship_now_ms();
+        tail_read(&tailer, sweep);
+        syslog_tick(&syslog_rx);
+        rollup_tick(&rollup);
+        if (agent.recorder)
+            recorder_tick(&recorder);
+        if (agent.archive)
+            archive_tick(&archive);
+        ship_tick(&shipper);
     }
 
     /* cleanup */
-    if (fp)
-        fclose(fp);
-    if (wd >= 0 && inotify_fd >= 0)
-        inotify_rm_watch(inotify_fd, wd);
-    if (inotify_fd >= 0)
-        close(inotify_fd);
-    curl_easy_cleanup(curl);
+    if (listeners > 0)
+        syslog_report(&syslog_rx);
+    if (followed > 0)
+        tail_report(&tailer);
+    syslog_close(&syslog_rx);
+    tail_close(&tailer);
+    rollup_flush(&rollup); /* the window so far */
+    if (rolled_up > 0)
+        rollup_report(&rollup);
+    if (agent.recorder) {
+        recorder_report(&recorder);
+        recorder_close(&recorder);
+    }
+    if (agent.archive) {
+        archive_close(&archive); /* writes the open block */
+        archive_report(&archive);
+    }
+    ship_close(&shipper, 5000); /* last batches, while the epoll set is still there */
+    free(file_list);
+    free(watch_list);
+    close(epoll_fd);
     curl_global_cleanup();
     printf("Agent exiting cleanly.\n");
     return 0;
@@ -0,0 +1,489 @@
+/* Flight recorder for the Linux agent: keep recent lines in memory, ship them only on a trigger.
+ *
+ * Lines of the sources marked for recording are not shipped. They are appended to an open block of
+ * up to RECORDER_BLOCK_BYTES, which is deflated (zlib, fastest level) into a ring of compressed
+ * blocks once it is full or RECORDER_SEAL_SEC old. The ring lives in one arena of max_bytes: the
+ * oldest blocks make room for new ones, and are dropped anyway once their newest line is older
+ * than max_age_sec. Memory is fixed at startup: the arena, the block table and two buffers.
+ *
+ * A trigger ships the whole ring, oldest line first, behind a marker line
+ *
+ *   {"type":"flight_recorder","trigger":"pattern","detail":"...","lines":48211,
+ *    "from":"2026-10-18T10:02:11Z","to":"2026-10-18T10:17:11Z"}
+ *
+ * and recorded sources are then shipped live for after_sec, so the incident itself is covered too.
+ * Lines that arrive while the ring is still being handed over are recorded behind it, so they
+ * reach the server after the older ones. Triggers:
+ *   pattern  a line of any source matches an extended regular expression;
+ *   watch    a watched path changes (written, attributes, moved, deleted): file integrity events
+ *            for files such as /etc/passwd or /etc/sudoers, seen through inotify;
+ *   api      a datagram "trigger [reason]" on the control socket (mode 0600), e.g. from the FIM
+ *            sender or an operator:  echo trigger | socat - UNIX-SENDTO:/run/kaimz-agent.ctl
+ * A trigger within cooldown_sec of the last one that fired is counted and ignored, so a noisy
+ * pattern cannot turn the recorder back into full shipping. The ring is handed to the shipper one
+ * block at a time, as its staging buffer has room, so a large ring is not dropped on the floor.
+ *
+ * Link with -lz. Included once by agent_inotify.c; Linux only.
+ */
+#pragma once
+
+#include <errno.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "agent_ship.h"
+
+#define RECORDER_BLOCK_BYTES (256 * 1024)  /* uncompressed lines per block */
+#define RECORDER_SEAL_SEC 10               /* an open block older than this is compressed */
+#define RECORDER_MIN_BYTES (1024 * 1024)
+#define RECORDER_MAX_WATCHES 16
+#define RECORDER_DETAIL_MAX 256            /* trigger detail kept for the marker line */
+
+struct recorder_stats {
+    unsigned long long lines;      /* lines recorded */
+    unsigned long long bytes;      /* their size */
+    unsigned long long compressed; /* their size in the ring */
+    unsigned long long evicted;    /* lines dropped from the ring unshipped */
+    unsigned long long triggers;   /* triggers that fired */
+    unsigned long long suppressed; /* triggers ignored within the cooldown */
+    unsigned long long replayed;   /* recorded lines shipped after a trigger */
+    unsigned long long live;       /* lines shipped live after a trigger */
+};
+
+struct recorder_block {
+    size_t off; /* in the arena */
+    size_t len; /* compressed */
+    size_t raw;
+    unsigned lines;
+    time_t first; /* arrival of its first and last line */
+    time_t last;
+};
+
+struct recorder_watch {
+    const char* path;
+    int wd; /* -1 while the path is not watched */
+};
+
+struct recorder {
+    struct shipper* shipper;
+    int epoll_fd;
+
+    /* the ring: count blocks from oldest, laid out in the arena in order from write_off on */
+    char* arena;
+    size_t arena_size;
+    size_t write_off;
+    struct recorder_block* blocks;
+    int max_blocks;
+    int oldest;
+    int count;
+
+    char* open; /* lines not compressed yet */
+    size_t open_len;
+    unsigned open_lines;
+    time_t open_first;
+    char* scratch; /* deflate output and inflate output */
+    size_t scratch_size;
+    z_stream zdef;
+    z_stream zinf;
+
+    long long max_age_sec;
+    long long cooldown_ms;
+    long long after_ms;
+    regex_t pattern;
+    int has_pattern;
+    int inotify_fd;
+    struct recorder_watch watches[RECORDER_MAX_WATCHES];
+    int nwatches;
+    int ctl_fd;
+    char ctl_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+    long long triggered_ms; /* when the last trigger fired, -1 = never */
+    long long live_until_ms;
+    int draining;
+
+    struct recorder_stats stats;
+};
+
+static void recorder_add_watches(struct recorder* rec)
+{
+    for (int i = 0; i < rec->nwatches; ++i) {
+        if (rec->watches[i].wd >= 0)
+            continue;
+        rec->watches[i].wd = inotify_add_watch(rec->inotify_fd, rec->watches[i].path,
+            IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVE | IN_MOVE_SELF
+                | IN_DELETE_SELF);
+    }
+}
+
+/* Sets the recorder up. pattern, watch (comma-separated paths) and ctl_path may be NULL or empty.
+   Returns 0, or -1 if it cannot record at all. */
+static int recorder_open(struct recorder* rec, struct shipper* shipper, int epoll_fd, size_t max_bytes,
+    long long max_age_sec, long long cooldown_sec, long long after_sec, const char* pattern, char* watch,
+    const char* ctl_path)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->shipper = shipper;
+    rec->epoll_fd = epoll_fd;
+    rec->inotify_fd = rec->ctl_fd = -1;
+    rec->triggered_ms = -1;
+    rec->max_age_sec = max_age_sec;
+    rec->cooldown_ms = cooldown_sec * 1000;
+    rec->after_ms = after_sec * 1000;
+
+    rec->arena_size = max_bytes < RECORDER_MIN_BYTES ? RECORDER_MIN_BYTES : max_bytes;
+    rec->max_blocks = (int)(rec->arena_size / 4096) + 1; /* blocks compress to more than 4 KiB */
+    rec->scratch_size = compressBound(RECORDER_BLOCK_BYTES);
+    rec->arena = malloc(rec->arena_size);
+    rec->blocks = calloc((size_t)rec->max_blocks, sizeof(*rec->blocks));
+    rec->open = malloc(RECORDER_BLOCK_BYTES);
+    rec->scratch = malloc(rec->scratch_size);
+    if (!rec->arena || !rec->blocks || !rec->open || !rec->scratch) {
+        perror("malloc(recorder)");
+        return -1;
+    }
+    if (deflateInit(&rec->zdef, Z_BEST_SPEED) != Z_OK || inflateInit(&rec->zinf) != Z_OK) {
+        fprintf(stderr, "recorder: zlib initialisation failed\n");
+        return -1;
+    }
+
+    if (pattern && pattern[0]) {
+        int rc = regcomp(&rec->pattern, pattern, REG_EXTENDED | REG_NOSUB);
+        if (rc != 0) {
+            char err[128];
+            regerror(rc, &rec->pattern, err, sizeof(err));
+            fprintf(stderr, "recorder: bad trigger pattern '%s': %s\n", pattern, err);
+        } else {
+            rec->has_pattern = 1;
+        }
+    }
+
+    if (watch && watch[0]) {
+        rec->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = rec->inotify_fd };
+        if (rec->inotify_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, rec->inotify_fd, &ev) < 0) {
+            perror("recorder: inotify");
+        } else {
+            for (char* save = NULL, *p = strtok_r(watch, ",", &save); p && rec->nwatches < RECORDER_MAX_WATCHES;
+                 p = strtok_r(NULL, ",", &save)) {
+                rec->watches[rec->nwatches].path = p;
+                rec->watches[rec->nwatches++].wd = -1;
+            }
+            recorder_add_watches(rec);
+            for (int i = 0; i < rec->nwatches; ++i) {
+                if (rec->watches[i].wd < 0)
+                    fprintf(stderr, "recorder: cannot watch %s yet: %s\n", rec->watches[i].path, strerror(errno));
+            }
+        }
+    }
+
+    if (ctl_path && ctl_path[0]) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(ctl_path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "recorder: socket path too long: %s\n", ctl_path);
+        } else {
+            strcpy(addr.sun_path, ctl_path);
+            unlink(ctl_path); /* stale socket from a previous run */
+            rec->ctl_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            struct epoll_event ev = { .events = EPOLLIN, .data.fd = rec->ctl_fd };
+            int bound = -1;
+            if (rec->ctl_fd >= 0) {
+                /* triggers ship data: created owner-only (root), never world-writable even briefly */
+                mode_t old_mask = umask(077);
+                bound = bind(rec->ctl_fd, (struct sockaddr*)&addr, sizeof(addr));
+                umask(old_mask);
+            }
+            if (bound != 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, rec->ctl_fd, &ev) < 0) {
+                fprintf(stderr, "recorder: cannot bind %s: %s\n", ctl_path, strerror(errno));
+                if (rec->ctl_fd >= 0)
+                    close(rec->ctl_fd);
+                rec->ctl_fd = -1;
+            } else {
+                strcpy(rec->ctl_path, ctl_path);
+            }
+        }
+    }
+    return 0;
+}
+
+static void recorder_evict_oldest(struct recorder* rec)
+{
+    rec->stats.evicted += rec->blocks[rec->oldest].lines;
+    rec->oldest = (rec->oldest + 1) % rec->max_blocks;
+    --rec->count;
+}
+
+/* Compresses the open block into the ring, evicting the oldest blocks in its way. */
+static void recorder_seal(struct recorder* rec)
+{
+    if (rec->open_len == 0)
+        return;
+
+    deflateReset(&rec->zdef);
+    rec->zdef.next_in = (Bytef*)rec->open;
+    rec->zdef.avail_in = (uInt)rec->open_len;
+    rec->zdef.next_out = (Bytef*)rec->scratch;
+    rec->zdef.avail_out = (uInt)rec->scratch_size;
+    size_t len = deflate(&rec->zdef, Z_FINISH) == Z_STREAM_END ? rec->scratch_size - rec->zdef.avail_out : 0;
+
+    if (len == 0 || len > rec->arena_size) {
+        rec->stats.evicted += rec->open_lines;
+    } else {
+        size_t off = rec->write_off;
+        int wrap = off + len > rec->arena_size;
+        if (wrap)
+            off = 0;
+        /* blocks ahead of write_off are the oldest, in order; drop those the new one overlaps,
+           and on a wrap also those in the unused end of the arena */
+        while (rec->count > 0) {
+            const struct recorder_block* b = &rec->blocks[rec->oldest];
+            int overlaps = wrap ? b->off >= rec->write_off || b->off < len
+                                : b->off >= off && b->off < off + len;
+            if (!overlaps && rec->count < rec->max_blocks)
+                break;
+            recorder_evict_oldest(rec);
+        }
+        memcpy(rec->arena + off, rec->scratch, len);
+        struct recorder_block* b = &rec->blocks[(rec->oldest + rec->count) % rec->max_blocks];
+        b->off = off;
+        b->len = len;
+        b->raw = rec->open_len;
+        b->lines = rec->open_lines;
+        b->first = rec->open_first;
+        b->last = time(NULL);
+        ++rec->count;
+        rec->write_off = off + len;
+        rec->stats.compressed += len;
+    }
+    rec->open_len = 0;
+    rec->open_lines = 0;
+}
+
+/* Hands ring blocks to the shipper, oldest first, while its staging buffer has room for them, and
+   then the open block with the lines that arrived meanwhile. */
+static void recorder_pump(struct recorder* rec)
+{
+    while (rec->draining && rec->count > 0 && ship_room(rec->shipper) >= RECORDER_BLOCK_BYTES) {
+        const struct recorder_block* b = &rec->blocks[rec->oldest];
+        inflateReset(&rec->zinf);
+        rec->zinf.next_in = (Bytef*)(rec->arena + b->off);
+        rec->zinf.avail_in = (uInt)b->len;
+        rec->zinf.next_out = (Bytef*)rec->scratch;
+        rec->zinf.avail_out = (uInt)rec->scratch_size;
+        if (inflate(&rec->zinf, Z_FINISH) == Z_STREAM_END && rec->zinf.total_out == b->raw) {
+            ship_line(rec->shipper, rec->scratch, b->raw);
+            rec->stats.replayed += b->lines;
+            --rec->count;
+            rec->oldest = (rec->oldest + 1) % rec->max_blocks;
+        } else {
+            fprintf(stderr, "recorder: corrupt block dropped\n");
+            recorder_evict_oldest(rec);
+        }
+    }
+    if (rec->draining && rec->count == 0 && rec->open_len > 0 && ship_room(rec->shipper) >= rec->open_len) {
+        ship_line(rec->shipper, rec->open, rec->open_len);
+        rec->stats.replayed += rec->open_lines;
+        rec->open_len = 0;
+        rec->open_lines = 0;
+    }
+    if (rec->count == 0 && rec->open_len == 0)
+        rec->draining = 0;
+}
+
+static size_t recorder_json_string(char* out, size_t cap, const char* s)
+{
+    size_t len = 0;
+    out[len++] = '"';
+    for (; *s && len + 8 < cap; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = (char)c;
+        } else if (c < 0x20) {
+            len += (size_t)snprintf(out + len, cap - len, "\\u%04x", c);
+        } else {
+            out[len++] = (char)c;
+        }
+    }
+    out[len++] = '"';
+    out[len] = '\0';
+    return len;
+}
+
+/* Fires a trigger (unless within the cooldown): ships a marker line, then the ring. */
+static void recorder_trigger(struct recorder* rec, const char* kind, const char* detail)
+{
+    long long now = ship_now_ms();
+    char escaped[RECORDER_DETAIL_MAX * 6 + 3];
+    char from[32] = "", to[32] = "";
+    char marker[sizeof(escaped) + 256];
+    unsigned long long lines = 0;
+    struct tm tm;
+
+    if (rec->triggered_ms >= 0 && now - rec->triggered_ms < rec->cooldown_ms) {
+        ++rec->stats.suppressed;
+        return;
+    }
+    rec->triggered_ms = now;
+    ++rec->stats.triggers;
+
+    recorder_seal(rec);
+    for (int i = 0; i < rec->count; ++i)
+        lines += rec->blocks[(rec->oldest + i) % rec->max_blocks].lines;
+    if (rec->count > 0) {
+        strftime(from, sizeof(from), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&rec->blocks[rec->oldest].first, &tm));
+        strftime(to, sizeof(to), "%Y-%m-%dT%H:%M:%SZ",
+            gmtime_r(&rec->blocks[(rec->oldest + rec->count - 1) % rec->max_blocks].last, &tm));
+    }
+
+    char cut[RECORDER_DETAIL_MAX + 1];
+    snprintf(cut, sizeof(cut), "%s", detail ? detail : "");
+    cut[strcspn(cut, "\n")] = '\0';
+    recorder_json_string(escaped, sizeof(escaped), cut);
+    int n = snprintf(marker, sizeof(marker),
+        "{\"type\":\"flight_recorder\",\"trigger\":\"%s\",\"detail\":%s,\"lines\":%llu,\"from\":\"%s\",\"to\":\"%s\"}\n",
+        kind, escaped, lines, from, to);
+    ship_line(rec->shipper, marker, (size_t)n < sizeof(marker) ? (size_t)n : sizeof(marker) - 1);
+    fprintf(stderr, "recorder: %s trigger (%s): shipping %llu recorded lines\n", kind, cut, lines);
+
+    rec->live_until_ms = now + rec->after_ms;
+    rec->draining = rec->count > 0;
+    recorder_pump(rec);
+}
+
+/* Checks a line of any source against the trigger pattern. */
+static void recorder_match(struct recorder* rec, const char* line)
+{
+    if (rec->has_pattern && regexec(&rec->pattern, line, 0, NULL, 0) == 0)
+        recorder_trigger(rec, "pattern", line);
+}
+
+/* Records one NUL-terminated, '\n'-terminated line; after a trigger it is shipped instead, once
+   the ring has been handed over (until then it is recorded behind the ring, to keep the order). */
+static void recorder_line(struct recorder* rec, const char* line)
+{
+    size_t n = strlen(line);
+
+    if (!rec->draining && ship_now_ms() < rec->live_until_ms) {
+        ++rec->stats.live;
+        ship_line(rec->shipper, line, n);
+        return;
+    }
+    if (n > RECORDER_BLOCK_BYTES)
+        n = RECORDER_BLOCK_BYTES; /* a tailed line longer than TAIL_BUF_SIZE arrives in pieces anyway */
+    if (rec->open_len + n > RECORDER_BLOCK_BYTES)
+        recorder_seal(rec);
+    if (rec->open_len == 0)
+        rec->open_first = time(NULL);
+    memcpy(rec->open + rec->open_len, line, n);
+    rec->open_len += n;
+    ++rec->open_lines;
+    ++rec->stats.lines;
+    rec->stats.bytes += n;
+}
+
+/* Handles an epoll event. Returns 1 if fd belongs to the recorder, 0 otherwise. */
+static int recorder_handle(struct recorder* rec, int fd)
+{
+    if (fd < 0)
+        return 0;
+    if (fd == rec->inotify_fd) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        const char* changed = NULL;
+        ssize_t len;
+        while ((len = read(fd, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + len;) {
+                const struct inotify_event* ev = (const struct inotify_event*)p;
+                for (int i = 0; i < rec->nwatches; ++i) {
+                    if (rec->watches[i].wd != ev->wd)
+                        continue;
+                    if (ev->mask & IN_IGNORED)
+                        rec->watches[i].wd = -1; /* gone or replaced; watched again from recorder_tick() */
+                    else
+                        changed = rec->watches[i].path;
+                }
+                p += sizeof(*ev) + ev->len;
+            }
+        }
+        if (changed)
+            recorder_trigger(rec, "watch", changed);
+        return 1;
+    }
+    if (fd == rec->ctl_fd) {
+        char msg[RECORDER_DETAIL_MAX + 16];
+        ssize_t len;
+        while ((len = recv(fd, msg, sizeof(msg) - 1, 0)) >= 0) {
+            while (len > 0 && (msg[len - 1] == '\n' || msg[len - 1] == '\r'))
+                --len;
+            msg[len] = '\0';
+            if (strncmp(msg, "trigger", 7) == 0 && (msg[7] == '\0' || msg[7] == ' '))
+                recorder_trigger(rec, "api", msg[7] ? msg + 8 : "");
+            else
+                fprintf(stderr, "recorder: unknown control message '%s'\n", msg);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* Seals a block that has been open too long, ages out old blocks and keeps the drain going. */
+static void recorder_tick(struct recorder* rec)
+{
+    time_t now = time(NULL);
+
+    if (rec->open_len > 0 && now - rec->open_first >= RECORDER_SEAL_SEC)
+        recorder_seal(rec);
+    while (!rec->draining && rec->count > 0 && now - rec->blocks[rec->oldest].last > rec->max_age_sec)
+        recorder_evict_oldest(rec);
+    if (rec->inotify_fd >= 0)
+        recorder_add_watches(rec);
+    recorder_pump(rec);
+}
+
+static void recorder_report(const struct recorder* rec)
+{
+    size_t held = 0;
+    for (int i = 0; i < rec->count; ++i)
+        held += rec->blocks[(rec->oldest + i) % rec->max_blocks].len;
+    fprintf(stderr,
+        "recorder: lines=%llu bytes=%llu ratio=%.1f held=%zu/%zu blocks=%d evicted=%llu"
+        " | triggers=%llu suppressed=%llu replayed=%llu live=%llu\n",
+        rec->stats.lines, rec->stats.bytes,
+        rec->stats.compressed ? (double)rec->stats.bytes / (double)rec->stats.compressed : 0.0, held,
+        rec->arena_size, rec->count, rec->stats.evicted, rec->stats.triggers, rec->stats.suppressed,
+        rec->stats.replayed, rec->stats.live);
+}
+
+/* Frees everything; what is still recorded was never asked for and is dropped. */
+static void recorder_close(struct recorder* rec)
+{
+    if (rec->inotify_fd >= 0)
+        close(rec->inotify_fd);
+    if (rec->ctl_fd >= 0) {
+        close(rec->ctl_fd);
+        unlink(rec->ctl_path);
+    }
+    if (rec->has_pattern)
+        regfree(&rec->pattern);
+    deflateEnd(&rec->zdef);
+    inflateEnd(&rec->zinf);
+    free(rec->arena);
+    free(rec->blocks);
+    free(rec->open);
+    free(rec->scratch);
+    rec->inotify_fd = rec->ctl_fd = -1;
+    rec->has_pattern = 0;
+    rec->arena = rec->open = rec->scratch = NULL;
+    rec->blocks = NULL;
+}
@@ -0,0 +1,432 @@
+/* Per-window rollups for the Linux agent: count lines instead of shipping them.
+ *
+ * For sources marked aggregate-only, each line only bumps a counter keyed by (host, program,
+ * severity) for the current window (window_sec, aligned to the wall clock: per minute by default).
+ * When the window closes, one summary line per key is emitted instead of the raw lines:
+ *
+ *   {"type":"rollup","start":"2026-10-18T10:15:00Z","window_sec":60,"host":"web1",
+ *    "program":"sshd","severity":"info","count":1234}
+ *
+ * Host and program come from the syslog header (RFC 3164 as rsyslog writes it, or RFC 5424);
+ * severity from the <PRI> of messages received over syslog, null for lines read from files.
+ *
+ * With top_k > 0 the most frequent message templates (the message with every token that
+ * contains a digit replaced by "<*>") are tracked too, with the Space-Saving algorithm over
+ * 8 * top_k counters, and the top_k largest are emitted as
+ *
+ *   {"type":"rollup_template", ..., "program":"sshd","template":"Connection closed by <*> port <*>",
+ *    "count":310,"error":4}
+ *
+ * where count may overstate the true number by at most error.
+ *
+ * Memory is fixed: ROLLUP_MAX_KEYS counters and ROLLUP_TEMPLATE_SLOTS templates, nothing is
+ * allocated per line. Keys that do not fit are counted under host and program "(other)".
+ * Included once by agent_inotify.c.
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROLLUP_MAX_KEYS 4096                        /* counter slots per window; a power of two */
+#define ROLLUP_MAX_LOAD (ROLLUP_MAX_KEYS / 4 * 3)   /* keys kept before "(other)" */
+#define ROLLUP_HOST_MAX 64
+#define ROLLUP_PROGRAM_MAX 48
+#define ROLLUP_MAX_TOP_K 32
+#define ROLLUP_TEMPLATE_SLOTS (8 * ROLLUP_MAX_TOP_K)
+#define ROLLUP_TEMPLATE_MAX 160                     /* longer templates are cut */
+#define ROLLUP_SUMMARY_MAX 2048                     /* one summary line, fully escaped */
+
+/* Receives one NUL-terminated, '\n'-terminated summary line; the buffer is reused afterwards. */
+typedef void (*rollup_emit_fn)(const char* line, void* ctx);
+
+struct rollup_stats {
+    unsigned long long lines;     /* lines counted instead of shipped */
+    unsigned long long windows;   /* windows closed */
+    unsigned long long summaries; /* summary lines emitted */
+    unsigned long long overflow;  /* lines counted under "(other)" because the table was full */
+};
+
+struct rollup_key {
+    uint64_t hash; /* 0 while the slot is free */
+    unsigned long long count;
+    int severity;  /* 0-7, -1 when unknown */
+    char host[ROLLUP_HOST_MAX];
+    char program[ROLLUP_PROGRAM_MAX];
+};
+
+struct rollup_template {
+    uint64_t hash;
+    unsigned long long count;
+    unsigned long long error; /* count the slot inherited when it was taken over */
+    char program[ROLLUP_PROGRAM_MAX];
+    char text[ROLLUP_TEMPLATE_MAX];
+};
+
+struct rollup {
+    int window_sec;
+    int top_k;
+    long long window_start; /* unix time; 0 while the window is empty */
+    int nkeys;
+    unsigned long long other; /* lines in this window that found no free key */
+    int ntemplates;
+    struct rollup_key keys[ROLLUP_MAX_KEYS];
+    struct rollup_template templates[ROLLUP_TEMPLATE_SLOTS];
+    char summary[ROLLUP_SUMMARY_MAX];
+    rollup_emit_fn emit;
+    void* ctx;
+    struct rollup_stats stats;
+};
+
+static const char* const rollup_severities[] = { "emerg", "alert", "crit", "err", "warning", "notice",
+    "info", "debug" };
+
+static void rollup_open(struct rollup* r, int window_sec, int top_k, rollup_emit_fn emit, void* ctx)
+{
+    memset(r, 0, sizeof(*r));
+    r->window_sec = window_sec > 0 ? window_sec : 60;
+    r->top_k = top_k < 0 ? 0 : top_k > ROLLUP_MAX_TOP_K ? ROLLUP_MAX_TOP_K : top_k;
+    r->emit = emit;
+    r->ctx = ctx;
+}
+
+static uint64_t rollup_hash(uint64_t h, const char* s, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Next space-separated token in [p, end): returns its start and sets *n, or NULL at the end. */
+static const char* rollup_token(const char** p, const char* end, size_t* n)
+{
+    const char* s = *p;
+    while (s < end && *s == ' ')
+        ++s;
+    if (s == end)
+        return NULL;
+    const char* e = s;
+    while (e < end && *e != ' ')
+        ++e;
+    *p = e;
+    *n = (size_t)(e - s);
+    return s;
+}
+
+/* Splits a syslog line into host, program and message. Lines without a recognised header keep
+   host and program empty and the whole line as message. */
+static void rollup_parse(const char* line, size_t len, const char** host, size_t* host_len,
+    const char** program, size_t* program_len, const char** msg, const char** msg_end)
+{
+    const char* end = line + len;
+    const char* p = line;
+    int rfc5424 = 0;
+    size_t n;
+
+    *host = *program = "";
+    *host_len = *program_len = 0;
+    *msg = line;
+    *msg_end = end;
+
+    if (len > 16 && line[3] == ' ' && line[6] == ' ' && line[9] == ':' && line[12] == ':' && line[15] == ' ') {
+        p = line + 16; /* "Oct 18 10:15:30 " */
+    } else if (len > 11 && line[0] >= '0' && line[0] <= '9' && line[4] == '-' && line[10] == 'T') {
+        rollup_token(&p, end, &n); /* ISO 8601, as RFC 5424 and rsyslog's precise format write it */
+        rfc5424 = 1;
+    } else {
+        return;
+    }
+
+    const char* h = rollup_token(&p, end, &n);
+    if (!h)
+        return;
+    *host = h;
+    *host_len = n;
+
+    const char* rest = p;
+    const char* tag = rollup_token(&p, end, &n);
+    if (!tag) {
+        *msg = end;
+        return;
+    }
+    if (tag[n - 1] == ':') {
+        /* "program[pid]:" */
+        const char* bracket = memchr(tag, '[', n);
+        *program = tag;
+        *program_len = bracket ? (size_t)(bracket - tag) : n - 1;
+        *msg = p;
+    } else if (rfc5424) {
+        /* APP-NAME PROCID MSGID STRUCTURED-DATA MSG */
+        if (!(n == 1 && tag[0] == '-')) {
+            *program = tag;
+            *program_len = n;
+        }
+        rollup_token(&p, end, &n);
+        rollup_token(&p, end, &n);
+        while (p < end && *p == ' ')
+            ++p;
+        if (p < end && *p == '[') {
+            /* SD elements run to a ']' followed by a space or the end */
+            while (p < end && !(*p == ']' && (p + 1 == end || p[1] == ' ')))
+                p += *p == '\\' && p + 1 < end ? 2 : 1;
+            if (p < end)
+                ++p;
+        } else {
+            rollup_token(&p, end, &n);
+        }
+        *msg = p;
+    } else {
+        *msg = rest; /* no tag */
+    }
+    while (*msg < end && **msg == ' ')
+        ++*msg;
+}
+
+/* Writes the template of [msg, end) into out: tokens with a digit become "<*>". Returns its length. */
+static size_t rollup_template_of(const char* msg, const char* end, char* out, size_t cap)
+{
+    size_t len = 0;
+    size_t n;
+    const char* tok;
+
+    while ((tok = rollup_token(&msg, end, &n))) {
+        int variable = 0;
+        for (size_t i = 0; i < n && !variable; ++i)
+            variable = tok[i] >= '0' && tok[i] <= '9';
+        if (variable) {
+            tok = "<*>";
+            n = 3;
+        }
+        if (len + (len > 0) + n >= cap)
+            break;
+        if (len > 0)
+            out[len++] = ' ';
+        memcpy(out + len, tok, n);
+        len += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* Space-Saving: a known template is counted, a new one takes a free slot or the smallest one. */
+static void rollup_count_template(struct rollup* r, const char* program, size_t program_len,
+    const char* msg, const char* end)
+{
+    char text[ROLLUP_TEMPLATE_MAX];
+    size_t len = rollup_template_of(msg, end, text, sizeof(text));
+    uint64_t hash = rollup_hash(rollup_hash(14695981039346656037ULL, program, program_len), "", 1);
+    hash = rollup_hash(hash, text, len);
+    int slots = r->top_k * 8;
+    int min = 0;
+
+    for (int i = 0; i < r->ntemplates; ++i) {
+        if (r->templates[i].hash == hash) {
+            ++r->templates[i].count;
+            return;
+        }
+        if (r->templates[i].count < r->templates[min].count)
+            min = i;
+    }
+
+    struct rollup_template* t;
+    if (r->ntemplates < slots) {
+        t = &r->templates[r->ntemplates++];
+        t->count = 1;
+        t->error = 0;
+    } else {
+        t = &r->templates[min];
+        t->error = t->count;
+        ++t->count;
+    }
+    t->hash = hash;
+    if (program_len >= sizeof(t->program))
+        program_len = sizeof(t->program) - 1;
+    memcpy(t->program, program, program_len);
+    t->program[program_len] = '\0';
+    memcpy(t->text, text, len + 1);
+}
+
+/* printf-style append to r->summary at *len; output that does not fit is cut. */
+static void rollup_append(struct rollup* r, size_t* len, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(r->summary + *len, sizeof(r->summary) - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        *len = *len + (size_t)n < sizeof(r->summary) ? *len + (size_t)n : sizeof(r->summary) - 1;
+}
+
+/* Appends s as a JSON string (quoted and escaped) to r->summary at *len; cut if it does not fit. */
+static void rollup_json_string(struct rollup* r, size_t* len, const char* s)
+{
+    size_t cap = sizeof(r->summary) - 8; /* room for the closing quote and the rest of the line */
+    r->summary[(*len)++] = '"';
+    for (; *s && *len < cap; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            r->summary[(*len)++] = '\\';
+            r->summary[(*len)++] = (char)c;
+        } else if (c < 0x20) {
+            rollup_append(r, len, "\\u%04x", c);
+        } else {
+            r->summary[(*len)++] = (char)c;
+        }
+    }
+    r->summary[(*len)++] = '"';
+}
+
+static void rollup_emit_line(struct rollup* r, size_t len)
+{
+    if (len > sizeof(r->summary) - 2)
+        len = sizeof(r->summary) - 2;
+    r->summary[len++] = '\n';
+    r->summary[len] = '\0';
+    ++r->stats.summaries;
+    r->emit(r->summary, r->ctx);
+}
+
+static size_t rollup_header(struct rollup* r, const char* type, const char* start)
+{
+    return (size_t)snprintf(r->summary, sizeof(r->summary), "{\"type\":\"%s\",\"start\":\"%s\",\"window_sec\":%d,",
+        type, start, r->window_sec);
+}
+
+static int rollup_by_count(const void* a, const void* b)
+{
+    const struct rollup_template* x = a;
+    const struct rollup_template* y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/* Emits the summaries of the current window and starts an empty one. */
+static void rollup_flush(struct rollup* r)
+{
+    char start[32];
+    time_t t = (time_t)r->window_start;
+    struct tm tm;
+    size_t len;
+
+    if (r->window_start == 0)
+        return;
+    gmtime_r(&t, &tm);
+    strftime(start, sizeof(start), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    for (int i = 0; i < ROLLUP_MAX_KEYS; ++i) {
+        struct rollup_key* k = &r->keys[i];
+        if (k->hash == 0)
+            continue;
+        len = rollup_header(r, "rollup", start);
+        rollup_append(r, &len, "\"host\":");
+        rollup_json_string(r, &len, k->host);
+        rollup_append(r, &len, ",\"program\":");
+        rollup_json_string(r, &len, k->program);
+        if (k->severity >= 0)
+            rollup_append(r, &len, ",\"severity\":\"%s\",\"count\":%llu}", rollup_severities[k->severity], k->count);
+        else
+            rollup_append(r, &len, ",\"severity\":null,\"count\":%llu}", k->count);
+        rollup_emit_line(r, len);
+    }
+    if (r->other > 0) {
+        len = rollup_header(r, "rollup", start);
+        rollup_append(r, &len, "\"host\":\"(other)\",\"program\":\"(other)\",\"severity\":null,\"count\":%llu}", r->other);
+        rollup_emit_line(r, len);
+    }
+
+    qsort(r->templates, (size_t)r->ntemplates, sizeof(r->templates[0]), rollup_by_count);
+    for (int i = 0; i < r->ntemplates && i < r->top_k; ++i) {
+        struct rollup_template* tp = &r->templates[i];
+        len = rollup_header(r, "rollup_template", start);
+        rollup_append(r, &len, "\"program\":");
+        rollup_json_string(r, &len, tp->program);
+        rollup_append(r, &len, ",\"template\":");
+        rollup_json_string(r, &len, tp->text);
+        rollup_append(r, &len, ",\"count\":%llu,\"error\":%llu}",
+            tp->count, tp->error);
+        rollup_emit_line(r, len);
+    }
+
+    memset(r->keys, 0, sizeof(r->keys));
+    r->nkeys = 0;
+    r->other = 0;
+    r->ntemplates = 0;
+    r->window_start = 0;
+    ++r->stats.windows;
+}
+
+/* Counts one line (NUL-terminated; a trailing newline is ignored). severity is 0-7 or -1. */
+static void rollup_add(struct rollup* r, const char* line, int severity)
+{
+    long long now = (long long)time(NULL);
+    long long window = now - now % r->window_sec;
+    size_t len = strlen(line);
+    const char *host, *program, *msg, *msg_end;
+    size_t host_len, program_len;
+
+    if (r->window_start != 0 && window != r->window_start)
+        rollup_flush(r);
+    r->window_start = window;
+    ++r->stats.lines;
+
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        --len;
+    rollup_parse(line, len, &host, &host_len, &program, &program_len, &msg, &msg_end);
+    if (host_len >= ROLLUP_HOST_MAX)
+        host_len = ROLLUP_HOST_MAX - 1;
+    if (program_len >= ROLLUP_PROGRAM_MAX)
+        program_len = ROLLUP_PROGRAM_MAX - 1;
+
+    unsigned char sev = (unsigned char)(severity + 1);
+    uint64_t hash = rollup_hash(14695981039346656037ULL, host, host_len);
+    hash = rollup_hash(rollup_hash(hash, "", 1), program, program_len);
+    hash = rollup_hash(hash, (const char*)&sev, 1);
+    if (hash == 0)
+        hash = 1;
+
+    for (size_t i = (size_t)hash & (ROLLUP_MAX_KEYS - 1);; i = (i + 1) & (ROLLUP_MAX_KEYS - 1)) {
+        struct rollup_key* k = &r->keys[i];
+        if (k->hash == hash && k->severity == severity && strncmp(k->host, host, host_len) == 0
+            && k->host[host_len] == '\0' && strncmp(k->program, program, program_len) == 0
+            && k->program[program_len] == '\0') {
+            ++k->count;
+            break;
+        }
+        if (k->hash == 0) {
+            if (r->nkeys >= ROLLUP_MAX_LOAD) {
+                ++r->other;
+                ++r->stats.overflow;
+                break;
+            }
+            k->hash = hash;
+            k->count = 1;
+            k->severity = severity;
+            memcpy(k->host, host, host_len);
+            memcpy(k->program, program, program_len);
+            ++r->nkeys;
+            break;
+        }
+    }
+
+    if (r->top_k > 0)
+        rollup_count_template(r, program, program_len, msg, msg_end);
+}
+
+/* Closes the window once its time is up, even when no line arrives to do it. */
+static void rollup_tick(struct rollup* r)
+{
+    long long now = (long long)time(NULL);
+    if (r->window_start != 0 && now - now % r->window_sec != r->window_start)
+        rollup_flush(r);
+}
+
+static void rollup_report(const struct rollup* r)
+{
+    fprintf(stderr, "rollup: window=%ds lines=%llu windows=%llu summaries=%llu overflow=%llu\n", r->window_sec,
+        r->stats.lines, r->stats.windows, r->stats.summaries, r->stats.overflow);
+}
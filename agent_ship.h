@@ -0,0 +1,539 @@
+/* Batched, adaptive shipping of lines to the ingest endpoint for the Linux agent.
+ *
+ * Lines are staged and posted as text/plain batches (one log line per line) over up to
+ * max_inflight concurrent keep-alive connections. The transfers run on curl's multi interface
+ * from the agent's own epoll loop: curl's sockets are registered in the same epoll set, so a slow
+ * server no longer stalls reading the log files and syslog sockets.
+ *
+ * Batch size and the number of requests in flight follow an AIMD controller, as in TCP:
+ *   - a batch acknowledged within the target latency grows the batch by one step (1/8 of the
+ *     starting size) and the in-flight limit by one per window of successes;
+ *   - a slow answer shrinks both by a quarter;
+ *   - a transport error or a 5xx halves both and pauses shipping for a back-off that starts at
+ *     SHIP_DEFAULT_PAUSE_MS and doubles with every failed send of the batch;
+ *   - 429/503 halves both and pauses shipping for the Retry-After delay;
+ *   - 413 halves the batch size and splits the rejected batch at a line boundary: the first half
+ *     is sent again at once, the rest goes back to the front of the staging buffer. A single line
+ *     the server will not take is given up on.
+ * After a pause the same batch is sent again, up to SHIP_MAX_ATTEMPTS sends in all.
+ * Requests already in flight when the limits came down do not cut them again. The batch size
+ * stays within [start/8, start*8] (and SHIP_BATCH_MAX), the in-flight limit within
+ * [1, max_inflight].
+ *
+ * Memory is fixed: the staging buffer (SHIP_STAGE_BYTES) plus one SHIP_BATCH_MAX buffer per
+ * request slot. Lines that arrive while the staging buffer is full are dropped and counted.
+ * Included once by agent_inotify.c; Linux only.
+ */
+#pragma once
+
+#include <curl/curl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+#define SHIP_MAX_SLOTS 16                   /* ceiling for max_inflight */
+#define SHIP_BATCH_MAX (1024 * 1024)        /* largest batch the controller may grow to */
+#define SHIP_STAGE_BYTES (8 * 1024 * 1024)  /* lines waiting for a request slot */
+#define SHIP_MAX_ATTEMPTS 5                 /* sends of a batch that keeps failing or getting 429/503 */
+#define SHIP_DEFAULT_PAUSE_MS 1000          /* 429/503 without Retry-After, first error back-off */
+#define SHIP_MAX_PAUSE_MS 30000             /* longest Retry-After honoured */
+#define SHIP_TIMEOUT_MS 10000L              /* per request */
+#define SHIP_STATS_INTERVAL_SEC 60
+
+struct ship_stats {
+    unsigned long long batches;  /* batches acknowledged */
+    unsigned long long lines;    /* lines in them */
+    unsigned long long bytes;
+    unsigned long long retried;  /* batches sent again after 429/503, an error or a 5xx */
+    unsigned long long lost;     /* lines in batches given up on */
+    unsigned long long split;    /* batches split in two after a 413 */
+    unsigned long long dropped;  /* lines that found the staging buffer full */
+    unsigned long long slow;     /* answers over the target latency */
+    unsigned long long errors;   /* transport errors and 5xx other than 503 */
+    unsigned long long busy;     /* 429/503 answers */
+};
+
+struct ship_slot {
+    CURL* easy;
+    char* buf; /* SHIP_BATCH_MAX bytes */
+    size_t len;
+    size_t lines;
+    int busy;    /* request in flight */
+    int waiting; /* holds a batch to send again once the pause is over */
+    int attempts;
+    unsigned long long ticket;
+    long retry_after_ms; /* from the last answer, 0 if none */
+};
+
+struct shipper {
+    CURLM* multi;
+    struct curl_slist* headers;
+    int epoll_fd;
+    struct ship_slot slots[SHIP_MAX_SLOTS];
+    int nslots;
+
+    /* Unsent lines are stage[head, len); the oldest arrived at oldest_ms. */
+    char* stage;
+    size_t head;
+    size_t len;
+    long long oldest_ms;
+
+    /* AIMD state */
+    size_t batch_min;
+    size_t batch_max;
+    size_t batch_step;
+    size_t batch_target;
+    int inflight_limit;
+    int inflight;
+    int window; /* successes since the in-flight limit last moved */
+    unsigned long long next_ticket;
+    unsigned long long recovery_ticket; /* requests started before this one already saw the last cut */
+    long long target_latency_ms;
+    long long max_delay_ms;
+    long long paused_until_ms;
+    long long curl_deadline_ms; /* from curl's timer callback, -1 = none */
+
+    struct ship_stats stats;
+    long long reported_ms;
+};
+
+static long long ship_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* CURLMOPT_SOCKETFUNCTION: keeps curl's sockets in the agent's epoll set. */
+static int ship_socket_cb(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp)
+{
+    struct shipper* sh = userp;
+    struct epoll_event ev;
+    (void)easy;
+
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(sh->epoll_fd, EPOLL_CTL_DEL, s, NULL);
+        curl_multi_assign(sh->multi, s, NULL);
+        return 0;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (what & CURL_POLL_IN ? EPOLLIN : 0) | (what & CURL_POLL_OUT ? EPOLLOUT : 0);
+    ev.data.fd = s;
+    if (epoll_ctl(sh->epoll_fd, socketp ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, s, &ev) < 0) {
+        perror("epoll_ctl(ship)");
+        return -1;
+    }
+    if (!socketp)
+        curl_multi_assign(sh->multi, s, sh);
+    return 0;
+}
+
+/* CURLMOPT_TIMERFUNCTION: remembers when curl wants to be called without socket activity. */
+static int ship_timer_cb(CURLM* multi, long timeout_ms, void* userp)
+{
+    struct shipper* sh = userp;
+    (void)multi;
+    sh->curl_deadline_ms = timeout_ms < 0 ? -1 : ship_now_ms() + timeout_ms;
+    return 0;
+}
+
+/* CURLOPT_HEADERFUNCTION: picks up Retry-After (seconds form). */
+static size_t ship_header_cb(char* buf, size_t size, size_t nitems, void* userdata)
+{
+    struct ship_slot* slot = userdata;
+    size_t n = size * nitems;
+    static const char key[] = "retry-after:";
+
+    if (n > sizeof(key) - 1 && strncasecmp(buf, key, sizeof(key) - 1) == 0) {
+        long seconds = 0;
+        size_t i = sizeof(key) - 1;
+        while (i < n && (buf[i] == ' ' || buf[i] == '\t'))
+            ++i;
+        while (i < n && buf[i] >= '0' && buf[i] <= '9' && seconds < SHIP_MAX_PAUSE_MS / 1000)
+            seconds = seconds * 10 + (buf[i++] - '0');
+        slot->retry_after_ms = seconds * 1000;
+    }
+    return n;
+}
+
+/* Sets up max_inflight request slots (each with its own connection) posting to url.
+   Returns 0, or -1 when curl or memory could not be set up. */
+static int ship_open(struct shipper* sh, int epoll_fd, const char* url, const char* token,
+    size_t batch_bytes, int max_inflight, long target_latency_ms, long max_delay_ms)
+{
+    char auth_hdr[256];
+
+    memset(sh, 0, sizeof(*sh));
+    sh->epoll_fd = epoll_fd;
+    sh->curl_deadline_ms = -1;
+    sh->reported_ms = ship_now_ms();
+    sh->nslots = max_inflight < 1 ? 1 : max_inflight > SHIP_MAX_SLOTS ? SHIP_MAX_SLOTS : max_inflight;
+    sh->inflight_limit = (sh->nslots + 1) / 2;
+    sh->batch_target = batch_bytes < 1024 ? 1024 : batch_bytes > SHIP_BATCH_MAX ? SHIP_BATCH_MAX : batch_bytes;
+    sh->batch_min = sh->batch_target / 8 < 1024 ? 1024 : sh->batch_target / 8;
+    sh->batch_max = sh->batch_target > SHIP_BATCH_MAX / 8 ? SHIP_BATCH_MAX : sh->batch_target * 8;
+    sh->batch_step = sh->batch_target / 8;
+    /* aim well inside the timeout, or a slow link would only show up as failures */
+    sh->target_latency_ms = target_latency_ms < 1 ? 1 : target_latency_ms > SHIP_TIMEOUT_MS / 2 ? SHIP_TIMEOUT_MS / 2 : target_latency_ms;
+    sh->max_delay_ms = max_delay_ms < 1 ? 1 : max_delay_ms;
+
+    if (token && token[0]) {
+        snprintf(auth_hdr, sizeof(auth_hdr), "Authorization: Bearer %s", token);
+        sh->headers = curl_slist_append(sh->headers, auth_hdr);
+    }
+    sh->headers = curl_slist_append(sh->headers, "Content-Type: text/plain; charset=utf-8");
+    /* a 100-continue round trip per batch would count against the latency target */
+    sh->headers = curl_slist_append(sh->headers, "Expect:");
+    sh->stage = malloc(SHIP_STAGE_BYTES);
+    sh->multi = curl_multi_init();
+    if (!sh->headers || !sh->stage || !sh->multi)
+        return -1;
+    curl_multi_setopt(sh->multi, CURLMOPT_SOCKETFUNCTION, ship_socket_cb);
+    curl_multi_setopt(sh->multi, CURLMOPT_SOCKETDATA, sh);
+    curl_multi_setopt(sh->multi, CURLMOPT_TIMERFUNCTION, ship_timer_cb);
+    curl_multi_setopt(sh->multi, CURLMOPT_TIMERDATA, sh);
+    curl_multi_setopt(sh->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)sh->nslots);
+
+    for (int i = 0; i < sh->nslots; ++i) {
+        struct ship_slot* slot = &sh->slots[i];
+        slot->buf = malloc(SHIP_BATCH_MAX);
+        slot->easy = curl_easy_init();
+        if (!slot->buf || !slot->easy)
+            return -1;
+        /* everything but the body is set once; the handle keeps it across requests */
+        curl_easy_setopt(slot->easy, CURLOPT_URL, url);
+        curl_easy_setopt(slot->easy, CURLOPT_HTTPHEADER, sh->headers);
+        curl_easy_setopt(slot->easy, CURLOPT_NOPROGRESS, 1L);
+        curl_easy_setopt(slot->easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(slot->easy, CURLOPT_TIMEOUT_MS, SHIP_TIMEOUT_MS);
+        curl_easy_setopt(slot->easy, CURLOPT_HEADERFUNCTION, ship_header_cb);
+        curl_easy_setopt(slot->easy, CURLOPT_HEADERDATA, slot);
+        curl_easy_setopt(slot->easy, CURLOPT_PRIVATE, slot);
+    }
+    return 0;
+}
+
+static void ship_start(struct shipper* sh, struct ship_slot* slot)
+{
+    slot->busy = 1;
+    slot->waiting = 0;
+    slot->retry_after_ms = 0;
+    slot->ticket = sh->next_ticket++;
+    curl_easy_setopt(slot->easy, CURLOPT_POSTFIELDS, slot->buf);
+    curl_easy_setopt(slot->easy, CURLOPT_POSTFIELDSIZE, (long)slot->len);
+    curl_multi_add_handle(sh->multi, slot->easy);
+    ++sh->inflight;
+}
+
+/* Moves up to batch_target bytes of whole lines from the stage into slot. */
+static void ship_cut(struct shipper* sh, struct ship_slot* slot)
+{
+    const char* p = sh->stage + sh->head;
+    size_t avail = sh->len - sh->head;
+    size_t n = avail < sh->batch_target ? avail : sh->batch_target;
+
+    if (n < avail) {
+        const char* nl = memrchr(p, '\n', n);
+        if (nl) {
+            n = (size_t)(nl - p) + 1;
+        } else {
+            /* one line longer than the target: send it whole (up to SHIP_BATCH_MAX) */
+            nl = memchr(p + n, '\n', avail - n);
+            n = nl ? (size_t)(nl - p) + 1 : avail;
+            if (n > SHIP_BATCH_MAX)
+                n = SHIP_BATCH_MAX;
+        }
+    }
+    memcpy(slot->buf, p, n);
+    slot->len = n;
+    slot->lines = 0;
+    for (const char* q = p; (q = memchr(q, '\n', (size_t)(p + n - q))) != NULL; ++q)
+        ++slot->lines;
+    slot->attempts = 0;
+    sh->head += n;
+    if (sh->head == sh->len)
+        sh->head = sh->len = 0;
+    /* otherwise oldest_ms stays: what is left is no older than that, so it is not held up */
+}
+
+/* Starts whatever the limits allow: batches waiting out a pause first, then full batches, then
+   partial ones whose oldest line has waited max_delay_ms (or any, when force is set). */
+static void ship_pump(struct shipper* sh, int force)
+{
+    long long now = ship_now_ms();
+
+    if (now < sh->paused_until_ms)
+        return;
+    for (int i = 0; i < sh->nslots && sh->inflight < sh->inflight_limit; ++i) {
+        if (sh->slots[i].waiting)
+            ship_start(sh, &sh->slots[i]);
+    }
+    for (int i = 0; i < sh->nslots && sh->inflight < sh->inflight_limit && sh->len > sh->head; ++i) {
+        struct ship_slot* slot = &sh->slots[i];
+        if (slot->busy || slot->waiting)
+            continue;
+        if (sh->len - sh->head < sh->batch_target && !force && now - sh->oldest_ms < sh->max_delay_ms)
+            return;
+        ship_cut(sh, slot);
+        ship_start(sh, slot);
+    }
+}
+
+/* Bytes that can still be staged before lines are dropped. */
+static size_t ship_room(const struct shipper* sh)
+{
+    return SHIP_STAGE_BYTES - (sh->len - sh->head);
+}
+
+/* Puts n bytes of whole lines back at the front of the stage, due at once and ahead of anything
+   staged since. Returns 0, or -1 when the stage has no room for them. */
+static int ship_unstage(struct shipper* sh, const char* p, size_t n)
+{
+    if (n > ship_room(sh))
+        return -1;
+    if (sh->head < n) {
+        memmove(sh->stage + n, sh->stage + sh->head, sh->len - sh->head);
+        sh->len = n + (sh->len - sh->head);
+        sh->head = n;
+    }
+    sh->head -= n;
+    memcpy(sh->stage + sh->head, p, n);
+    sh->oldest_ms = ship_now_ms() - sh->max_delay_ms; /* these lines have waited already */
+    return 0;
+}
+
+/* After a 413: keeps the first half of the slot's batch (up to a line end) to send again at once
+   and puts the rest back on the stage. Returns 0 when the batch is a single line or the rest does
+   not fit on the stage. */
+static int ship_split(struct shipper* sh, struct ship_slot* slot)
+{
+    const char* half = slot->buf + slot->len / 2;
+    const char* nl = memrchr(slot->buf, '\n', slot->len / 2);
+    size_t first;
+
+    if (!nl)
+        nl = memchr(half, '\n', slot->len - slot->len / 2); /* the first line runs past the middle */
+    if (!nl)
+        return 0;
+    first = (size_t)(nl - slot->buf) + 1;
+    if (first >= slot->len || ship_unstage(sh, slot->buf + first, slot->len - first) < 0)
+        return 0;
+    slot->len = first;
+    slot->lines = 0;
+    for (const char* q = slot->buf; (q = memchr(q, '\n', (size_t)(slot->buf + first - q))) != NULL; ++q)
+        ++slot->lines;
+    slot->waiting = 1;
+    ++sh->stats.split;
+    return 1;
+}
+
+/* Stages one '\n'-terminated line. */
+static void ship_line(struct shipper* sh, const char* line, size_t n)
+{
+    if (sh->len + n > SHIP_STAGE_BYTES && sh->head > 0) {
+        memmove(sh->stage, sh->stage + sh->head, sh->len - sh->head);
+        sh->len -= sh->head;
+        sh->head = 0;
+    }
+    if (sh->len + n > SHIP_STAGE_BYTES) {
+        ++sh->stats.dropped;
+        return;
+    }
+    if (sh->len == sh->head)
+        sh->oldest_ms = ship_now_ms();
+    memcpy(sh->stage + sh->len, line, n);
+    sh->len += n;
+    if (sh->len - sh->head >= sh->batch_target)
+        ship_pump(sh, 0);
+}
+
+static void ship_decrease(struct shipper* sh, unsigned long long ticket, double factor, int concurrency)
+{
+    sh->window = 0;
+    if (ticket < sh->recovery_ticket)
+        return; /* started before the last cut; already accounted for */
+    sh->recovery_ticket = sh->next_ticket;
+    sh->batch_target = (size_t)((double)sh->batch_target * factor);
+    if (sh->batch_target < sh->batch_min)
+        sh->batch_target = sh->batch_min;
+    if (concurrency) {
+        sh->inflight_limit = (int)((double)sh->inflight_limit * factor);
+        if (sh->inflight_limit < 1)
+            sh->inflight_limit = 1;
+    }
+}
+
+static void ship_increase(struct shipper* sh)
+{
+    sh->batch_target += sh->batch_step;
+    if (sh->batch_target > sh->batch_max)
+        sh->batch_target = sh->batch_max;
+    if (++sh->window >= sh->inflight_limit && sh->inflight_limit < sh->nslots) {
+        ++sh->inflight_limit;
+        sh->window = 0;
+    }
+}
+
+/* A request finished: feed the controller, then keep, resend or give up on its batch. */
+static void ship_done(struct shipper* sh, struct ship_slot* slot, CURLcode res)
+{
+    long status = 0;
+    curl_off_t total_us = 0;
+
+    curl_easy_getinfo(slot->easy, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(slot->easy, CURLINFO_TOTAL_TIME_T, &total_us);
+    curl_multi_remove_handle(sh->multi, slot->easy);
+    slot->busy = 0;
+    --sh->inflight;
+
+    if (res == CURLE_OK && status >= 200 && status < 300) {
+        if (total_us / 1000 > sh->target_latency_ms) {
+            ++sh->stats.slow;
+            ship_decrease(sh, slot->ticket, 0.75, 1);
+        } else {
+            ship_increase(sh);
+        }
+        ++sh->stats.batches;
+        sh->stats.lines += slot->lines;
+        sh->stats.bytes += slot->len;
+        return;
+    }
+    long long pause = -1; /* how long to wait before sending the batch again; -1 = do not */
+    if (res == CURLE_OK && (status == 429 || status == 503)) {
+        pause = slot->retry_after_ms ? slot->retry_after_ms : SHIP_DEFAULT_PAUSE_MS;
+        ++sh->stats.busy;
+        ship_decrease(sh, slot->ticket, 0.5, 1);
+    } else if (res != CURLE_OK || status >= 500) {
+        pause = (long long)SHIP_DEFAULT_PAUSE_MS << slot->attempts;
+        ++sh->stats.errors;
+        ship_decrease(sh, slot->ticket, 0.5, 1);
+    } else if (status == 413) {
+        ship_decrease(sh, slot->ticket, 0.5, 0);
+        if (ship_split(sh, slot))
+            return;
+    }
+    if (pause >= 0 && ++slot->attempts < SHIP_MAX_ATTEMPTS) {
+        long long until = ship_now_ms() + (pause > SHIP_MAX_PAUSE_MS ? SHIP_MAX_PAUSE_MS : pause);
+        if (until > sh->paused_until_ms)
+            sh->paused_until_ms = until;
+        slot->waiting = 1;
+        ++sh->stats.retried;
+        return;
+    }
+    sh->stats.lost += slot->lines;
+    if (res != CURLE_OK)
+        fprintf(stderr, "ship: dropped batch of %zu lines: %s\n", slot->lines, curl_easy_strerror(res));
+    else
+        fprintf(stderr, "ship: dropped batch of %zu lines: HTTP %ld\n", slot->lines, status);
+}
+
+/* Collects finished transfers. */
+static void ship_collect(struct shipper* sh)
+{
+    CURLMsg* msg;
+    int left;
+    while ((msg = curl_multi_info_read(sh->multi, &left)) != NULL) {
+        struct ship_slot* slot = NULL;
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&slot);
+        ship_done(sh, slot, msg->data.result);
+    }
+}
+
+/* Handles an epoll event for one of curl's sockets (any fd not claimed by the other sources). */
+static void ship_handle(struct shipper* sh, int fd, uint32_t events)
+{
+    int running;
+    int mask = (events & EPOLLIN ? CURL_CSELECT_IN : 0) | (events & EPOLLOUT ? CURL_CSELECT_OUT : 0)
+        | (events & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0);
+    curl_multi_socket_action(sh->multi, fd, mask, &running);
+    ship_collect(sh);
+}
+
+static void ship_report(struct shipper* sh)
+{
+    fprintf(stderr,
+        "ship: batches=%llu lines=%llu bytes=%llu retried=%llu split=%llu lost=%llu dropped=%llu"
+        " | batch=%zu inflight_limit=%d slow=%llu errors=%llu busy=%llu\n",
+        sh->stats.batches, sh->stats.lines, sh->stats.bytes, sh->stats.retried, sh->stats.split,
+        sh->stats.lost, sh->stats.dropped, sh->batch_target, sh->inflight_limit, sh->stats.slow, sh->stats.errors,
+        sh->stats.busy);
+    sh->reported_ms = ship_now_ms();
+}
+
+/* Runs curl's timeouts, starts due batches and reports every SHIP_STATS_INTERVAL_SEC. */
+static void ship_tick(struct shipper* sh)
+{
+    long long now = ship_now_ms();
+    if (sh->curl_deadline_ms >= 0 && now >= sh->curl_deadline_ms) {
+        int running;
+        sh->curl_deadline_ms = -1;
+        curl_multi_socket_action(sh->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        ship_collect(sh);
+    }
+    ship_pump(sh, 0);
+    if (now - sh->reported_ms >= SHIP_STATS_INTERVAL_SEC * 1000LL && sh->stats.batches + sh->stats.lost)
+        ship_report(sh);
+}
+
+/* How long the event loop may sleep (at most cap_ms) before ship_tick() has work to do. */
+static int ship_timeout(const struct shipper* sh, int cap_ms)
+{
+    long long now = ship_now_ms();
+    long long wait = cap_ms;
+    int waiting = sh->len > sh->head;
+
+    if (sh->curl_deadline_ms >= 0 && sh->curl_deadline_ms - now < wait)
+        wait = sh->curl_deadline_ms - now;
+    for (int i = 0; i < sh->nslots && !waiting; ++i)
+        waiting = sh->slots[i].waiting;
+    if (waiting && sh->paused_until_ms > now) {
+        if (sh->paused_until_ms - now < wait)
+            wait = sh->paused_until_ms - now;
+    } else if (sh->len > sh->head && sh->inflight < sh->inflight_limit) {
+        if (sh->oldest_ms + sh->max_delay_ms - now < wait)
+            wait = sh->oldest_ms + sh->max_delay_ms - now;
+    }
+    return wait < 0 ? 0 : (int)wait;
+}
+
+/* Sends what is staged and waits up to linger_ms for it, then frees everything. Call after the
+   other sources are closed: every fd left in the epoll set is then curl's. */
+static void ship_close(struct shipper* sh, int linger_ms)
+{
+    long long deadline = ship_now_ms() + linger_ms;
+    int pending = 1;
+
+    while (sh->multi && pending && ship_now_ms() < deadline) {
+        struct epoll_event events[16];
+        int nev = epoll_wait(sh->epoll_fd, events, 16, ship_timeout(sh, 50));
+        for (int e = 0; e < nev; ++e)
+            ship_handle(sh, events[e].data.fd, events[e].events);
+        ship_tick(sh);
+        ship_pump(sh, 1);
+        pending = sh->len > sh->head || sh->inflight > 0;
+        for (int i = 0; i < sh->nslots && !pending; ++i)
+            pending = sh->slots[i].waiting;
+    }
+    if (sh->multi)
+        ship_report(sh);
+    for (int i = 0; i < sh->nslots; ++i) {
+        struct ship_slot* slot = &sh->slots[i];
+        if (slot->easy) {
+            if (slot->busy)
+                curl_multi_remove_handle(sh->multi, slot->easy);
+            curl_easy_cleanup(slot->easy);
+        }
+        free(slot->buf);
+    }
+    if (sh->multi)
+        curl_multi_cleanup(sh->multi);
+    curl_slist_free_all(sh->headers);
+    free(sh->stage);
+    memset(sh, 0, sizeof(*sh));
+}
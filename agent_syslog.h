@@ -0,0 +1,503 @@
+/* Built-in syslog receiver for the Linux agent.
+ *
+ * Accepts syslog over UDP and TCP (syslog_port) and over a Unix datagram socket, so messages no
+ * longer have to go through rsyslog and a file on disk before the agent sees them. The listeners
+ * are unauthenticated and whatever they receive is shipped, so UDP and TCP bind loopback unless
+ * another address (or "::" for every interface) is configured. Datagrams are
+ * read with recvmmsg() straight into a preallocated pool of message slots, SYSLOG_BATCH per
+ * system call; nothing is allocated per message. TCP accepts newline-terminated and octet-counted
+ * (RFC 6587) frames. Each message has its <PRI> header stripped so it looks like the lines rsyslog
+ * writes (the callback finds the value in rx->pri), and is handed to the same callback as lines
+ * tailed from the log file.
+ *
+ * Kernel drops (socket receive buffer overflow) are read from SO_RXQ_OVFL and counted.
+ * Included once by agent_inotify.c; Linux only.
+ */
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SYSLOG_MSG_MAX 8192                 /* longer messages are truncated */
+#define SYSLOG_BATCH 64                     /* datagrams per recvmmsg() call */
+#define SYSLOG_BATCHES_PER_WAKEUP 16        /* then yield to the other sources */
+#define SYSLOG_MAX_CONNS 64                 /* concurrent TCP senders */
+#define SYSLOG_RCVBUF (4 * 1024 * 1024)     /* absorbs bursts while a line is being shipped */
+#define SYSLOG_STATS_INTERVAL_SEC 60
+
+/* Called with one NUL-terminated, '\n'-terminated line; the buffer is reused afterwards. */
+typedef void (*syslog_line_fn)(const char* line, void* ctx);
+
+struct syslog_stats {
+    unsigned long long received;    /* messages handed to the callback */
+    unsigned long long dropped;     /* datagrams the kernel dropped on a full receive buffer */
+    unsigned long long truncated;   /* messages cut at SYSLOG_MSG_MAX */
+    unsigned long long batches;     /* recvmmsg() calls that returned data */
+    unsigned long long connections; /* TCP connections accepted */
+    unsigned long long refused;     /* TCP connections refused because all slots were in use */
+};
+
+struct syslog_conn {
+    int fd; /* -1 when the slot is free */
+    size_t len;
+    char buf[SYSLOG_MSG_MAX];
+};
+
+struct syslog_receiver {
+    int udp_fd;
+    int tcp_fd;
+    int unix_fd;
+    int epoll_fd;
+    char unix_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    uint32_t udp_overflow; /* last SO_RXQ_OVFL value seen per socket (cumulative in the kernel) */
+    uint32_t unix_overflow;
+
+    /* Preallocated message pool: recvmmsg() writes straight into these slots. */
+    struct mmsghdr msgs[SYSLOG_BATCH];
+    struct iovec iovs[SYSLOG_BATCH];
+    char ctrl[SYSLOG_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+    char bufs[SYSLOG_BATCH][SYSLOG_MSG_MAX];
+    char line[SYSLOG_MSG_MAX + 2]; /* normalized message + "\n" + NUL */
+
+    struct syslog_conn conns[SYSLOG_MAX_CONNS];
+
+    struct syslog_stats stats;
+    struct syslog_stats reported; /* stats at the last report, for rates */
+    struct timespec reported_at;
+
+    syslog_line_fn on_line;
+    void* ctx;
+    int pri; /* <PRI> of the message being handed to on_line, -1 if it had none */
+};
+
+static double syslog_elapsed(const struct timespec* since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) + (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static int syslog_watch(struct syslog_receiver* rx, int fd)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(rx->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl(syslog)");
+        return -1;
+    }
+    return 0;
+}
+
+/* Binds host, an IPv4 or IPv6 address. "::" (every interface) gets an IPv6 dual-stack socket, or
+   IPv4 when IPv6 is unavailable. */
+static int syslog_bind_inet(int type, const char* host, int port)
+{
+    struct sockaddr_in6 addr6;
+    struct sockaddr_in addr;
+    int fd, on = 1;
+
+    memset(&addr6, 0, sizeof(addr6));
+    memset(&addr, 0, sizeof(addr));
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons((uint16_t)port);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET6, host, &addr6.sin6_addr) == 1) {
+        fd = socket(AF_INET6, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            int off = 0;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, (struct sockaddr*)&addr6, sizeof(addr6)) == 0)
+                return fd;
+            int saved = errno;
+            close(fd);
+            errno = saved;
+        }
+        if (!IN6_IS_ADDR_UNSPECIFIED(&addr6.sin6_addr))
+            return -1;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/* Large receive buffer and drop counters for a datagram socket. */
+static void syslog_tune_dgram(int fd)
+{
+    int size = SYSLOG_RCVBUF, on = 1;
+    /* SO_RCVBUFFORCE exceeds rmem_max when running as root; fall back to the capped option */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+}
+
+/* Opens the listeners and registers them with epoll_fd. UDP and TCP bind host (an address; "::"
+   or "0.0.0.0" for every interface) and port; port <= 0 disables them. An empty or NULL unix_path
+   disables the Unix socket. A listener that cannot be opened is reported and skipped. Returns
+   the number of listeners opened. */
+static int syslog_open(struct syslog_receiver* rx, int epoll_fd, const char* host, int port,
+    const char* unix_path, syslog_line_fn on_line, void* ctx)
+{
+    int opened = 0;
+
+    memset(rx, 0, sizeof(*rx));
+    rx->udp_fd = rx->tcp_fd = rx->unix_fd = -1;
+    rx->epoll_fd = epoll_fd;
+    rx->on_line = on_line;
+    rx->ctx = ctx;
+    for (int i = 0; i < SYSLOG_MAX_CONNS; ++i)
+        rx->conns[i].fd = -1;
+    for (int i = 0; i < SYSLOG_BATCH; ++i) {
+        rx->iovs[i].iov_base = rx->bufs[i];
+        rx->iovs[i].iov_len = sizeof(rx->bufs[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &rx->reported_at);
+
+    if (port > 0) {
+        rx->udp_fd = syslog_bind_inet(SOCK_DGRAM, host, port);
+        if (rx->udp_fd < 0) {
+            fprintf(stderr, "syslog: cannot bind UDP %s port %d: %s\n", host, port, strerror(errno));
+        } else {
+            syslog_tune_dgram(rx->udp_fd);
+            if (syslog_watch(rx, rx->udp_fd) == 0)
+                ++opened;
+        }
+
+        rx->tcp_fd = syslog_bind_inet(SOCK_STREAM, host, port);
+        if (rx->tcp_fd < 0 || listen(rx->tcp_fd, 128) != 0) {
+            fprintf(stderr, "syslog: cannot listen on TCP %s port %d: %s\n", host, port, strerror(errno));
+            if (rx->tcp_fd >= 0)
+                close(rx->tcp_fd);
+            rx->tcp_fd = -1;
+        } else if (syslog_watch(rx, rx->tcp_fd) == 0) {
+            ++opened;
+        }
+    }
+
+    if (unix_path && unix_path[0]) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(unix_path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "syslog: socket path too long: %s\n", unix_path);
+        } else {
+            strcpy(addr.sun_path, unix_path);
+            unlink(unix_path); /* stale socket from a previous run */
+            rx->unix_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (rx->unix_fd < 0 || bind(rx->unix_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                fprintf(stderr, "syslog: cannot bind %s: %s\n", unix_path, strerror(errno));
+                if (rx->unix_fd >= 0)
+                    close(rx->unix_fd);
+                rx->unix_fd = -1;
+            } else {
+                strcpy(rx->unix_path, unix_path);
+                chmod(unix_path, 0666); /* any local process may log, as with /dev/log */
+                syslog_tune_dgram(rx->unix_fd);
+                if (syslog_watch(rx, rx->unix_fd) == 0)
+                    ++opened;
+            }
+        }
+    }
+
+    return opened;
+}
+
+/* Drops "<PRI>" and an RFC 5424 version so the message reads like a line rsyslog wrote, then
+   passes it on with a trailing newline. Embedded newlines split the message into several lines. */
+static void syslog_emit(struct syslog_receiver* rx, const char* msg, size_t len)
+{
+    while (len > 0) {
+        const char* nl = memchr(msg, '\n', len);
+        size_t n = nl ? (size_t)(nl - msg) : len;
+        const char* p = msg;
+        size_t left = n;
+
+        rx->pri = -1;
+        if (left > 2 && p[0] == '<') {
+            size_t i = 1;
+            while (i < left && i <= 4 && p[i] >= '0' && p[i] <= '9')
+                ++i;
+            if (i > 1 && i < left && p[i] == '>') {
+                rx->pri = atoi(p + 1);
+                p += i + 1;
+                left -= i + 1;
+                if (left > 2 && p[0] == '1' && p[1] == ' ') {
+                    p += 2;
+                    left -= 2;
+                }
+            }
+        }
+        while (left > 0 && (p[left - 1] == '\r' || p[left - 1] == '\0'))
+            --left;
+
+        if (left > 0) {
+            memcpy(rx->line, p, left);
+            rx->line[left] = '\n';
+            rx->line[left + 1] = '\0';
+            ++rx->stats.received;
+            rx->on_line(rx->line, rx->ctx);
+        }
+
+        if (!nl)
+            break;
+        len -= n + 1;
+        msg = nl + 1;
+    }
+}
+
+static void syslog_read_dgram(struct syslog_receiver* rx, int fd, uint32_t* overflow)
+{
+    for (int round = 0; round < SYSLOG_BATCHES_PER_WAKEUP; ++round) {
+        for (int i = 0; i < SYSLOG_BATCH; ++i) {
+            struct msghdr* hdr = &rx->msgs[i].msg_hdr;
+            hdr->msg_name = NULL;
+            hdr->msg_namelen = 0;
+            hdr->msg_iov = &rx->iovs[i];
+            hdr->msg_iovlen = 1;
+            hdr->msg_control = rx->ctrl[i];
+            hdr->msg_controllen = sizeof(rx->ctrl[i]);
+            hdr->msg_flags = 0;
+        }
+
+        int n = recvmmsg(fd, rx->msgs, SYSLOG_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("recvmmsg(syslog)");
+            return;
+        }
+        if (n == 0)
+            return;
+        ++rx->stats.batches;
+
+        for (int i = 0; i < n; ++i) {
+            struct msghdr* hdr = &rx->msgs[i].msg_hdr;
+            for (struct cmsghdr* c = CMSG_FIRSTHDR(hdr); c; c = CMSG_NXTHDR(hdr, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t total;
+                    memcpy(&total, CMSG_DATA(c), sizeof(total));
+                    rx->stats.dropped += (uint32_t)(total - *overflow);
+                    *overflow = total;
+                }
+            }
+            if (hdr->msg_flags & MSG_TRUNC)
+                ++rx->stats.truncated;
+            syslog_emit(rx, rx->bufs[i], rx->msgs[i].msg_len);
+        }
+
+        if (n < SYSLOG_BATCH)
+            return;
+    }
+}
+
+static void syslog_close_conn(struct syslog_receiver* rx, struct syslog_conn* conn)
+{
+    epoll_ctl(rx->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->len = 0;
+}
+
+static void syslog_accept(struct syslog_receiver* rx)
+{
+    for (;;) {
+        int fd = accept4(rx->tcp_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("accept(syslog)");
+            return;
+        }
+        struct syslog_conn* conn = NULL;
+        for (int i = 0; i < SYSLOG_MAX_CONNS; ++i) {
+            if (rx->conns[i].fd < 0) {
+                conn = &rx->conns[i];
+                break;
+            }
+        }
+        if (!conn) {
+            ++rx->stats.refused;
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->len = 0;
+        if (syslog_watch(rx, fd) != 0) {
+            close(fd);
+            conn->fd = -1;
+            continue;
+        }
+        ++rx->stats.connections;
+    }
+}
+
+/* Emits every complete frame in conn->buf: octet-counted ("<len> <msg>") when the frame starts
+   with a digit, otherwise up to the next newline. At end of stream the remainder is a frame too. */
+static void syslog_frames(struct syslog_receiver* rx, struct syslog_conn* conn, int eof)
+{
+    size_t pos = 0;
+    while (pos < conn->len) {
+        char* p = conn->buf + pos;
+        size_t left = conn->len - pos;
+
+        if (p[0] >= '1' && p[0] <= '9') {
+            size_t i = 0, frame = 0;
+            while (i < left && i < 6 && p[i] >= '0' && p[i] <= '9')
+                frame = frame * 10 + (size_t)(p[i++] - '0');
+            if (i < left && p[i] == ' ') {
+                if (frame > sizeof(conn->buf) - i - 1) {
+                    /* cannot be buffered: keep what fits, skip the rest of the stream */
+                    ++rx->stats.truncated;
+                    syslog_emit(rx, p + i + 1, left - i - 1);
+                    syslog_close_conn(rx, conn);
+                    return;
+                }
+                if (left - i - 1 < frame)
+                    break; /* incomplete */
+                syslog_emit(rx, p + i + 1, frame);
+                pos += i + 1 + frame;
+                continue;
+            }
+            if (i == left && !eof)
+                break; /* the length may still be arriving */
+        }
+
+        char* nl = memchr(p, '\n', left);
+        if (!nl && !eof)
+            break;
+        size_t n = nl ? (size_t)(nl - p) : left;
+        syslog_emit(rx, p, n);
+        pos += nl ? n + 1 : n;
+    }
+
+    if (pos > 0) {
+        memmove(conn->buf, conn->buf + pos, conn->len - pos);
+        conn->len -= pos;
+    }
+    if (conn->len == sizeof(conn->buf)) {
+        /* one line filled the whole buffer */
+        ++rx->stats.truncated;
+        syslog_emit(rx, conn->buf, conn->len);
+        conn->len = 0;
+    }
+}
+
+static void syslog_read_conn(struct syslog_receiver* rx, struct syslog_conn* conn)
+{
+    ssize_t r = read(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len);
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if (r > 0) {
+        conn->len += (size_t)r;
+        syslog_frames(rx, conn, 0);
+        return;
+    }
+    syslog_frames(rx, conn, 1);
+    if (conn->fd >= 0)
+        syslog_close_conn(rx, conn);
+}
+
+/* Handles an epoll event. Returns 1 if fd belongs to the receiver, 0 otherwise. */
+static int syslog_handle(struct syslog_receiver* rx, int fd)
+{
+    if (fd < 0)
+        return 0;
+    if (fd == rx->udp_fd) {
+        syslog_read_dgram(rx, fd, &rx->udp_overflow);
+        return 1;
+    }
+    if (fd == rx->unix_fd) {
+        syslog_read_dgram(rx, fd, &rx->unix_overflow);
+        return 1;
+    }
+    if (fd == rx->tcp_fd) {
+        syslog_accept(rx);
+        return 1;
+    }
+    for (int i = 0; i < SYSLOG_MAX_CONNS; ++i) {
+        if (rx->conns[i].fd == fd) {
+            syslog_read_conn(rx, &rx->conns[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Prints counters and rates since the previous report. */
+static void syslog_report(struct syslog_receiver* rx)
+{
+    double secs = syslog_elapsed(&rx->reported_at);
+    unsigned long long received = rx->stats.received - rx->reported.received;
+    unsigned long long dropped = rx->stats.dropped - rx->reported.dropped;
+    unsigned long long offered = received + dropped;
+
+    fprintf(stderr,
+        "syslog: received=%llu dropped=%llu truncated=%llu connections=%llu refused=%llu"
+        " | last %.0fs: %.0f msgs/s, drop rate %.2f%%, %.1f msgs/recvmmsg\n",
+        rx->stats.received, rx->stats.dropped, rx->stats.truncated, rx->stats.connections,
+        rx->stats.refused, secs, secs > 0 ? (double)received / secs : 0.0,
+        offered ? 100.0 * (double)dropped / (double)offered : 0.0,
+        rx->stats.batches > rx->reported.batches
+            ? (double)received / (double)(rx->stats.batches - rx->reported.batches)
+            : 0.0);
+    rx->reported = rx->stats;
+    clock_gettime(CLOCK_MONOTONIC, &rx->reported_at);
+}
+
+/* Reports every SYSLOG_STATS_INTERVAL_SEC while there is traffic. */
+static void syslog_tick(struct syslog_receiver* rx)
+{
+    if (syslog_elapsed(&rx->reported_at) < SYSLOG_STATS_INTERVAL_SEC)
+        return;
+    if (rx->stats.received == rx->reported.received && rx->stats.dropped == rx->reported.dropped) {
+        clock_gettime(CLOCK_MONOTONIC, &rx->reported_at);
+        return;
+    }
+    syslog_report(rx);
+}
+
+static void syslog_close(struct syslog_receiver* rx)
+{
+    for (int i = 0; i < SYSLOG_MAX_CONNS; ++i) {
+        if (rx->conns[i].fd >= 0) {
+            syslog_frames(rx, &rx->conns[i], 1);
+            if (rx->conns[i].fd >= 0)
+                syslog_close_conn(rx, &rx->conns[i]);
+        }
+    }
+    if (rx->udp_fd >= 0)
+        close(rx->udp_fd);
+    if (rx->tcp_fd >= 0)
+        close(rx->tcp_fd);
+    if (rx->unix_fd >= 0) {
+        close(rx->unix_fd);
+        unlink(rx->unix_path);
+    }
+    rx->udp_fd = rx->tcp_fd = rx->unix_fd = -1;
+}
@@ -0,0 +1,470 @@
+/* Log file tailing for the Linux agent.
+ *
+ * Follows up to TAIL_MAX_FILES files from their current end, splits what is appended into lines
+ * and hands each line to a callback. inotify reports appends, rotation and truncation: the main
+ * loop calls tail_read() after each wakeup, which reads the files inotify flagged, or every file
+ * when the wait timed out (and files without a watch every time). Before reading a file it
+ * compares the offset with the file size and starts over from 0 if the file has shrunk.
+ *
+ * Two read engines, chosen at startup:
+ *   epoll     one fstat() and one pread() per file per wakeup (plus a pread() per additional full
+ *             buffer).
+ *   io_uring  reads for every file are queued as IORING_OP_READ_FIXED into buffers registered
+ *             once with the kernel and submitted and reaped with a single io_uring_enter()
+ *             (after the same fstat() per file).
+ *             Set up with raw system calls, so liburing is not needed. If the kernel has no
+ *             io_uring (or it is disabled), the tailer falls back to the epoll engine.
+ * Each file has one fixed buffer of TAIL_BUF_SIZE bytes; a line longer than that is passed on in
+ * pieces. Included once by agent_inotify.c; Linux only.
+ */
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define TAIL_MAX_FILES 64
+#define TAIL_BUF_SIZE (64 * 1024)
+#define TAIL_WATCH_MASK (IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB)
+#define TAIL_EVENT_BUF_LEN (1024 * (sizeof(struct inotify_event) + 16))
+
+enum tail_engine {
+    TAIL_ENGINE_EPOLL,
+    TAIL_ENGINE_IO_URING,
+};
+
+/* Called with one NUL-terminated line (ending in '\n' unless it was split); the buffer is reused. */
+typedef void (*tail_line_fn)(const char* line, void* ctx);
+
+struct tail_stats {
+    unsigned long long lines;
+    unsigned long long bytes;
+    unsigned long long reads;    /* read requests issued */
+    unsigned long long syscalls; /* pread() or io_uring_enter() calls made for them */
+};
+
+struct tail_file {
+    char path[PATH_MAX];
+    int fd; /* -1 while the file cannot be opened */
+    int wd; /* inotify watch, -1 if none */
+    off_t offset;
+    char* buf;    /* TAIL_BUF_SIZE + 1 bytes (room for a terminating NUL) */
+    size_t carry; /* bytes of an unfinished line at the start of buf */
+    int more;     /* the last read filled the buffer: read again */
+    int dirty;    /* inotify reported a change since the last read */
+};
+
+/* Submission and completion queues mapped from the kernel. */
+struct tail_ring {
+    int fd;
+    void* sq_ptr;
+    void* cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+struct tailer {
+    enum tail_engine engine;
+    struct tail_file files[TAIL_MAX_FILES];
+    int count;
+    char* buffers; /* all file buffers, contiguous; registered with io_uring */
+    struct tail_ring ring;
+    int inotify_fd;
+    tail_line_fn on_line;
+    void* ctx;
+    int current; /* index of the file whose line is being handed to on_line */
+    struct tail_stats stats;
+};
+
+static const char* tail_engine_name(enum tail_engine engine)
+{
+    return engine == TAIL_ENGINE_IO_URING ? "io_uring" : "epoll";
+}
+
+static void tail_ring_close(struct tail_ring* r)
+{
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+    if (r->sq_ptr)
+        munmap(r->sq_ptr, r->sq_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+/* Creates the ring and registers one fixed buffer per file. Returns -1 (errno set) on failure. */
+static int tail_ring_open(struct tail_ring* r, unsigned entries, struct iovec* iovs, unsigned nr_iovs)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        r->fd = -1;
+        return -1;
+    }
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size)
+            r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        r->sq_ptr = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            r->cq_ptr = NULL;
+            goto fail;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail;
+    }
+
+    r->sq_head = (unsigned*)((char*)r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned*)((char*)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned*)((char*)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)((char*)r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned*)((char*)r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned*)((char*)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned*)((char*)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)((char*)r->cq_ptr + p.cq_off.cqes);
+
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iovs, nr_iovs) < 0)
+        goto fail;
+    return 0;
+
+fail: {
+    int saved = errno;
+    tail_ring_close(r);
+    errno = saved;
+    return -1;
+}
+}
+
+/* Opens a file and (re)arms its inotify watch. At startup reading begins at the current end; a
+   file that appears later (after rotation, or created late) is new and is read from the start. */
+static void tail_open_file(struct tailer* t, struct tail_file* f, int from_start)
+{
+    if (f->fd >= 0)
+        close(f->fd);
+    if (f->wd >= 0 && t->inotify_fd >= 0)
+        inotify_rm_watch(t->inotify_fd, f->wd);
+    f->wd = -1;
+    f->carry = 0;
+    f->more = 0;
+
+    f->fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    if (f->fd < 0)
+        return;
+    struct stat st;
+    f->offset = !from_start && fstat(f->fd, &st) == 0 ? st.st_size : 0;
+    if (t->inotify_fd >= 0) {
+        f->wd = inotify_add_watch(t->inotify_fd, f->path, TAIL_WATCH_MASK);
+        if (f->wd < 0)
+            perror("inotify_add_watch");
+    }
+}
+
+/* Starts following paths. Returns the number of files being followed (0 on failure). */
+static int tail_open(struct tailer* t, const char* const* paths, int npaths, enum tail_engine engine,
+    int epoll_fd, tail_line_fn on_line, void* ctx)
+{
+    memset(t, 0, sizeof(*t));
+    t->engine = TAIL_ENGINE_EPOLL;
+    t->ring.fd = -1;
+    t->on_line = on_line;
+    t->ctx = ctx;
+    t->count = npaths < TAIL_MAX_FILES ? npaths : TAIL_MAX_FILES;
+    if (npaths > TAIL_MAX_FILES)
+        fprintf(stderr, "tail: following only the first %d files\n", TAIL_MAX_FILES);
+    if (t->count <= 0)
+        return 0;
+
+    t->buffers = malloc((size_t)t->count * (TAIL_BUF_SIZE + 1));
+    if (!t->buffers) {
+        perror("malloc(tail buffers)");
+        t->count = 0;
+        return 0;
+    }
+
+    t->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (t->inotify_fd < 0) {
+        perror("inotify_init1");
+        t->inotify_fd = -1; /* rotation is then only noticed by the periodic reads */
+    } else {
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = t->inotify_fd };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, t->inotify_fd, &ev) < 0)
+            perror("epoll_ctl(inotify)");
+    }
+
+    for (int i = 0; i < t->count; ++i) {
+        struct tail_file* f = &t->files[i];
+        snprintf(f->path, sizeof(f->path), "%s", paths[i]);
+        f->fd = f->wd = -1;
+        f->buf = t->buffers + (size_t)i * (TAIL_BUF_SIZE + 1);
+        tail_open_file(t, f, 0);
+        if (f->fd < 0)
+            fprintf(stderr, "tail: cannot open %s: %s (will retry)\n", f->path, strerror(errno));
+    }
+
+    if (engine == TAIL_ENGINE_IO_URING) {
+        struct iovec iovs[TAIL_MAX_FILES];
+        for (int i = 0; i < t->count; ++i) {
+            iovs[i].iov_base = t->files[i].buf;
+            iovs[i].iov_len = TAIL_BUF_SIZE + 1;
+        }
+        if (tail_ring_open(&t->ring, TAIL_MAX_FILES, iovs, (unsigned)t->count) == 0)
+            t->engine = TAIL_ENGINE_IO_URING;
+        else
+            fprintf(stderr, "tail: io_uring unavailable (%s), using epoll\n", strerror(errno));
+    }
+    return t->count;
+}
+
+/* Passes on every complete line in f->buf[0, f->carry + n) and keeps the unfinished rest. */
+static void tail_consume(struct tailer* t, struct tail_file* f, size_t n)
+{
+    size_t len = f->carry + n;
+    size_t start = 0;
+
+    t->stats.bytes += n;
+    f->offset += (off_t)n;
+    t->current = (int)(f - t->files);
+    for (;;) {
+        char* nl = memchr(f->buf + start, '\n', len - start);
+        if (!nl)
+            break;
+        size_t end = (size_t)(nl - f->buf) + 1;
+        char saved = f->buf[end]; /* the slack byte makes this safe at the end of the buffer */
+        f->buf[end] = '\0';
+        ++t->stats.lines;
+        t->on_line(f->buf + start, t->ctx);
+        f->buf[end] = saved;
+        start = end;
+    }
+
+    if (start == 0 && len == TAIL_BUF_SIZE) {
+        /* a single line fills the buffer: pass it on in pieces */
+        f->buf[len] = '\0';
+        ++t->stats.lines;
+        t->on_line(f->buf, t->ctx);
+        start = len;
+    }
+    memmove(f->buf, f->buf + start, len - start);
+    f->carry = len - start;
+}
+
+static void tail_read_epoll(struct tailer* t)
+{
+    for (int i = 0; i < t->count; ++i) {
+        struct tail_file* f = &t->files[i];
+        while (f->more) {
+            size_t want = TAIL_BUF_SIZE - f->carry;
+            ssize_t r = pread(f->fd, f->buf + f->carry, want, f->offset);
+            ++t->stats.reads;
+            ++t->stats.syscalls;
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            tail_consume(t, f, (size_t)r);
+            if ((size_t)r < want)
+                break; /* caught up */
+        }
+        f->more = 0;
+    }
+}
+
+static void tail_read_io_uring(struct tailer* t)
+{
+    struct tail_ring* r = &t->ring;
+
+    for (;;) {
+        /* queue a fixed-buffer read for every file that may have more data */
+        unsigned tail = *r->sq_tail;
+        unsigned queued = 0;
+        for (int i = 0; i < t->count; ++i) {
+            struct tail_file* f = &t->files[i];
+            if (!f->more)
+                continue;
+            unsigned idx = tail & *r->sq_mask;
+            struct io_uring_sqe* sqe = &r->sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->fd = f->fd;
+            sqe->addr = (unsigned long)(f->buf + f->carry);
+            sqe->len = (unsigned)(TAIL_BUF_SIZE - f->carry);
+            sqe->off = (unsigned long long)f->offset;
+            sqe->buf_index = (unsigned short)i;
+            sqe->user_data = (unsigned long long)i;
+            r->sq_array[idx] = idx;
+            ++tail;
+            ++queued;
+        }
+        if (queued == 0)
+            return;
+        __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+        /* submit them all and wait for all of them in one system call */
+        int rc;
+        do {
+            rc = (int)syscall(__NR_io_uring_enter, r->fd, queued, queued, IORING_ENTER_GETEVENTS, NULL, 0);
+            ++t->stats.syscalls;
+        } while (rc < 0 && errno == EINTR);
+        if (rc < 0) {
+            perror("io_uring_enter");
+            return;
+        }
+        t->stats.reads += queued;
+
+        unsigned head = *r->cq_head;
+        unsigned done = 0;
+        while (done < queued) {
+            if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+                /* completions trail the submission only when interrupted; wait for the rest */
+                if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                    perror("io_uring_enter");
+                    break;
+                }
+                ++t->stats.syscalls;
+                continue;
+            }
+            struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+            struct tail_file* f = &t->files[cqe->user_data];
+            size_t want = TAIL_BUF_SIZE - f->carry;
+            f->more = 0;
+            if (cqe->res < 0)
+                fprintf(stderr, "tail: read %s: %s\n", f->path, strerror(-cqe->res));
+            if (cqe->res > 0) {
+                tail_consume(t, f, (size_t)cqe->res);
+                f->more = (size_t)cqe->res == want; /* a full buffer: there may be more */
+            }
+            ++head;
+            ++done;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/* Restarts f from the beginning if it is now shorter than what was read: it was truncated (a
+   truncating open reports IN_MODIFY, not IN_ATTRIB, so this is checked before every read). */
+static void tail_check_truncated(struct tailer* t, struct tail_file* f)
+{
+    struct stat st;
+    ++t->stats.syscalls;
+    if (fstat(f->fd, &st) == 0 && f->offset > st.st_size) {
+        f->offset = 0;
+        f->carry = 0;
+    }
+}
+
+/* Reads whatever was appended to the flagged files (all files if all is set) since the last call. */
+static void tail_read(struct tailer* t, int all)
+{
+    for (int i = 0; i < t->count; ++i) {
+        struct tail_file* f = &t->files[i];
+        if (f->fd < 0 && all)
+            tail_open_file(t, f, 1); /* it may have appeared since */
+        f->more = f->fd >= 0 && (all || f->dirty || f->wd < 0);
+        f->dirty = 0;
+        if (f->more)
+            tail_check_truncated(t, f);
+    }
+    if (t->engine == TAIL_ENGINE_IO_URING)
+        tail_read_io_uring(t);
+    else
+        tail_read_epoll(t);
+}
+
+/* Handles an epoll event. Returns 1 if fd belongs to the tailer, 0 otherwise. */
+static int tail_handle(struct tailer* t, int fd)
+{
+    if (fd < 0 || fd != t->inotify_fd)
+        return 0;
+
+    char evbuf[TAIL_EVENT_BUF_LEN];
+    ssize_t r = read(t->inotify_fd, evbuf, sizeof(evbuf));
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("read(inotify_fd)");
+
+    ssize_t i = 0;
+    while (i < r) {
+        struct inotify_event* ev = (struct inotify_event*)(evbuf + i);
+        for (int k = 0; k < t->count; ++k) {
+            struct tail_file* f = &t->files[k];
+            if (f->wd < 0 || f->wd != ev->wd)
+                continue;
+            f->dirty = 1; /* truncation is caught by the size check in tail_read() */
+            if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) {
+                /* file rotated or removed — read what is left, then reopen */
+                tail_read(t, 0);
+                tail_open_file(t, f, 1);
+                f->dirty = 1;
+            }
+        }
+        i += sizeof(struct inotify_event) + ev->len;
+    }
+    return 1;
+}
+
+static void tail_report(const struct tailer* t)
+{
+    fprintf(stderr, "tail: engine=%s files=%d lines=%llu bytes=%llu reads=%llu syscalls=%llu\n",
+        tail_engine_name(t->engine), t->count, t->stats.lines, t->stats.bytes, t->stats.reads,
+        t->stats.syscalls);
+}
+
+static void tail_close(struct tailer* t)
+{
+    for (int i = 0; i < t->count; ++i) {
+        struct tail_file* f = &t->files[i];
+        if (f->wd >= 0 && t->inotify_fd >= 0)
+            inotify_rm_watch(t->inotify_fd, f->wd);
+        if (f->fd >= 0)
+            close(f->fd);
+    }
+    if (t->engine == TAIL_ENGINE_IO_URING)
+        tail_ring_close(&t->ring);
+    if (t->inotify_fd >= 0)
+        close(t->inotify_fd);
+    free(t->buffers);
+    t->buffers = NULL;
+    t->count = 0;
+}
@@ -1,8 +1,15 @@
 package main
 
 import (
+	"context"
+	"errors"
 	"fmt"
 	"log"
+	"net/http"
+	"os"
+	"os/signal"
+	"syscall"
+	"time"
 
 	"backend/config"
 	"backend/internal/routes"
@@ -12,6 +19,9 @@ import (
 	"github.com/joho/godotenv"
 )
 
+// shutdownTimeout bounds how long a stop waits for in-flight requests and the last ingest upload
+const shutdownTimeout = 30 * time.Second
+
 func main() {
 	// Display startup banner
 	startup.PrintBanner()
@@ -34,19 +44,38 @@ func main() {
 	interval, runOnce := startup.PromptForLogInterval()
 
 	// Initialize S3 and start log scheduler
-	startup.InitializeS3AndScheduler(cfg, interval, runOnce)
+	buffer := startup.InitializeS3AndScheduler(cfg, interval, runOnce)
 
 	// Initialize Gin router
 	r := gin.Default()
 
 	// Setup routes (public + protected)
-	routes.SetupRoutes(r, []byte(cfg.JWTSecret))
+	routes.SetupRoutes(r, []byte(cfg.JWTSecret), cfg.UploadMaxInFlight)
 
 	// Start server
 	fmt.Println("═══════════════════════════════════════════════════════════════")
 	log.Printf("🚀 Server running on port %s", port)
 	fmt.Println("═══════════════════════════════════════════════════════════════")
-	if err := r.Run(":" + port); err != nil {
-		log.Fatalf("Failed to start server: %v", err)
+	srv := &http.Server{Addr: ":" + port, Handler: r}
+	go func() {
+		if err := srv.ListenAndServe(); err != nil && !errors.Is(err, http.ErrServerClosed) {
+			log.Fatalf("Failed to start server: %v", err)
+		}
+	}()
+
+	// On SIGINT/SIGTERM finish the requests in flight, then roll the open ingest segments and
+	// upload them, so a graceful stop leaves nothing behind in the write-ahead directory
+	stop := make(chan os.Signal, 1)
+	signal.Notify(stop, syscall.SIGINT, syscall.SIGTERM)
+	<-stop
+	log.Printf("Shutting down...")
+	ctx, cancel := context.WithTimeout(context.Background(), shutdownTimeout)
+	defer cancel()
+	if err := srv.Shutdown(ctx); err != nil {
+		log.Printf("Warning: Server did not shut down cleanly: %v", err)
+	}
+	if buffer != nil {
+		buffer.Close(ctx)
 	}
+	log.Printf("Server stopped")
 }
@@ -3,13 +3,26 @@ package config
 import (
 	"log"
 	"os"
+	"strconv"
+	"time"
 )
 
 type Config struct {
-	JWTSecret string
-	Port      string
-	AWSRegion string
-	S3Bucket  string
+	JWTSecret     string
+	Port          string
+	AWSRegion     string
+	S3Bucket      string
+	S3Endpoint    string
+	LogCursorFile string
+
+	// Ingest buffer for uploads (see internal/ingest)
+	IngestDir         string
+	IngestMaxBytes    int
+	IngestMaxAge      time.Duration
+	IngestMaxBuffered int64 // uploads get 503 + Retry-After while this much waits for S3
+
+	// Uploads handled at once; more get 429 + Retry-After
+	UploadMaxInFlight int
 }
 
 // Load reads configuration from environment variables
@@ -35,10 +48,38 @@ func Load() *Config {
 		s3Bucket = "kaimz-tdr"
 	}
 
+	ingestDir := os.Getenv("INGEST_WAL_DIR")
+	if ingestDir == "" {
+		ingestDir = "ingest_wal"
+	}
+
+	logCursorFile := os.Getenv("LOG_CURSOR_FILE")
+	if logCursorFile == "" {
+		logCursorFile = "log_cursor.json"
+	}
+
 	return &Config{
-		JWTSecret: jwtSecret,
-		Port:      port,
-		AWSRegion: awsRegion,
-		S3Bucket:  s3Bucket,
+		JWTSecret:     jwtSecret,
+		Port:          port,
+		AWSRegion:     awsRegion,
+		S3Bucket:      s3Bucket,
+		S3Endpoint:    os.Getenv("S3_ENDPOINT"),
+		LogCursorFile: logCursorFile,
+
+		IngestDir:         ingestDir,
+		IngestMaxBytes:    envInt("INGEST_MAX_BYTES", 8<<20),
+		IngestMaxAge:      time.Duration(envInt("INGEST_MAX_AGE_SEC", 300)) * time.Second,
+		IngestMaxBuffered: int64(envInt("INGEST_MAX_BUFFERED_MB", 1024)) << 20,
+
+		UploadMaxInFlight: envInt("UPLOAD_MAX_INFLIGHT", 64),
+	}
+}
+
+// envInt reads a positive integer from the environment, falling back to def
+func envInt(name string, def int) int {
+	value, err := strconv.Atoi(os.Getenv(name))
+	if err != nil || value <= 0 {
+		return def
 	}
+	return value
 }
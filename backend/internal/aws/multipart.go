@@ -0,0 +1,96 @@
+package aws
+
+import (
+	"context"
+	"errors"
+	"io"
+	"sync"
+)
+
+// PartSize is the size of each multipart upload part (S3 requires at least 5 MiB for all but the last)
+const PartSize = 8 << 20
+
+// partBuffers recycles part buffers across uploads; each upload holds at most two at a time
+var partBuffers = sync.Pool{
+	New: func() any { return make([]byte, PartSize) },
+}
+
+// streamedPart is one uploaded part
+type streamedPart struct {
+	Number int32
+	ETag   string
+}
+
+// streamParts reads body into part-sized buffers and hands them to put, reading the next part
+// while the previous one uploads. Memory use is two parts whatever the body size. If the whole
+// body fits in the first part, single is called with it instead and no parts are uploaded.
+// Part numbers start at 1. On error the caller must abort the upload.
+func streamParts(ctx context.Context, body io.Reader,
+	single func(ctx context.Context, data []byte) error,
+	begin func(ctx context.Context) error,
+	put func(ctx context.Context, number int32, data []byte) (string, error),
+) ([]streamedPart, int64, error) {
+	buffers := [2][]byte{partBuffers.Get().([]byte), partBuffers.Get().([]byte)}
+	defer partBuffers.Put(buffers[0])
+	defer partBuffers.Put(buffers[1])
+
+	type result struct {
+		part streamedPart
+		err  error
+	}
+	var parts []streamedPart
+	var total int64
+	var inFlight chan result // upload of the previous part, nil if none
+
+	wait := func() error {
+		if inFlight == nil {
+			return nil
+		}
+		r := <-inFlight
+		inFlight = nil
+		if r.err != nil {
+			return r.err
+		}
+		parts = append(parts, r.part)
+		return nil
+	}
+
+	for number := int32(1); ; number++ {
+		// The buffer read into now was last used by part number-2, whose upload finished
+		// before part number-1 started.
+		buf := buffers[number%2]
+		n, readErr := io.ReadFull(body, buf)
+		last := readErr == io.EOF || errors.Is(readErr, io.ErrUnexpectedEOF)
+		if readErr != nil && !last {
+			wait()
+			return nil, total, readErr
+		}
+		total += int64(n)
+
+		if number == 1 && last {
+			return nil, total, single(ctx, buf[:n])
+		}
+		if number == 1 {
+			if err := begin(ctx); err != nil {
+				return nil, total, err
+			}
+		}
+		if err := wait(); err != nil {
+			return nil, total, err
+		}
+		if n > 0 {
+			ch := make(chan result, 1)
+			go func(number int32, data []byte) {
+				etag, err := put(ctx, number, data)
+				ch <- result{streamedPart{Number: number, ETag: etag}, err}
+			}(number, buf[:n])
+			inFlight = ch
+		}
+		if last {
+			if err := wait(); err != nil {
+				return nil, total, err
+			}
+			return parts, total, nil
+		}
+	}
+}
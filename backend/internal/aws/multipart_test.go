@@ -0,0 +1,147 @@
+package aws
+
+import (
+	"bytes"
+	"context"
+	"crypto/sha256"
+	"errors"
+	"io"
+	"runtime"
+	"sync"
+	"testing"
+)
+
+// patternReader yields n bytes of a repeating pattern without holding them
+type patternReader struct {
+	n   int64
+	off int64
+}
+
+func (r *patternReader) Read(p []byte) (int, error) {
+	if r.off >= r.n {
+		return 0, io.EOF
+	}
+	if rest := r.n - r.off; int64(len(p)) > rest {
+		p = p[:rest]
+	}
+	for i := range p {
+		p[i] = byte((r.off + int64(i)) % 251)
+	}
+	r.off += int64(len(p))
+	return len(p), nil
+}
+
+// memoryStore stands in for S3: it keeps a checksum per part, not the data
+type memoryStore struct {
+	mu     sync.Mutex
+	single []byte
+	begun  bool
+	parts  map[int32][sha256.Size]byte
+	failAt int32
+	onPut  func()
+}
+
+func (s *memoryStore) stream(ctx context.Context, body io.Reader) ([]streamedPart, int64, error) {
+	s.parts = make(map[int32][sha256.Size]byte)
+	return streamParts(ctx, body,
+		func(ctx context.Context, data []byte) error {
+			s.single = append([]byte(nil), data...)
+			return nil
+		},
+		func(ctx context.Context) error {
+			s.begun = true
+			return nil
+		},
+		func(ctx context.Context, number int32, data []byte) (string, error) {
+			if s.onPut != nil {
+				s.onPut()
+			}
+			if number == s.failAt {
+				return "", errors.New("part rejected")
+			}
+			sum := sha256.Sum256(data)
+			s.mu.Lock()
+			s.parts[number] = sum
+			s.mu.Unlock()
+			return "etag", nil
+		})
+}
+
+func TestStreamPartsSmallBodyIsSingleUpload(t *testing.T) {
+	var s memoryStore
+	parts, total, err := s.stream(context.Background(), bytes.NewReader([]byte("small body")))
+	if err != nil || parts != nil || total != 10 || string(s.single) != "small body" || s.begun {
+		t.Fatalf("parts=%v total=%d err=%v single=%q begun=%v", parts, total, err, s.single, s.begun)
+	}
+}
+
+func TestStreamPartsSplitsBody(t *testing.T) {
+	const size = 2*PartSize + PartSize/2
+	var s memoryStore
+	parts, total, err := s.stream(context.Background(), &patternReader{n: size})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if total != size || !s.begun || len(parts) != 3 {
+		t.Fatalf("total=%d begun=%v parts=%v", total, s.begun, parts)
+	}
+	want := make([]byte, size)
+	(&patternReader{n: size}).Read(want)
+	for i, part := range parts {
+		if part.Number != int32(i+1) {
+			t.Fatalf("part %d numbered %d", i, part.Number)
+		}
+		end := min(int64(i+1)*PartSize, size)
+		if s.parts[part.Number] != sha256.Sum256(want[int64(i)*PartSize:end]) {
+			t.Errorf("part %d holds the wrong bytes", part.Number)
+		}
+	}
+}
+
+func TestStreamPartsStopsOnFailedPart(t *testing.T) {
+	s := memoryStore{failAt: 2}
+	if _, _, err := s.stream(context.Background(), &patternReader{n: 5 * PartSize}); err == nil {
+		t.Fatal("failed part not reported")
+	}
+	if len(s.parts) > 2 {
+		t.Fatalf("kept uploading after a failed part: %d parts", len(s.parts))
+	}
+}
+
+// The peak heap while parts upload, and what the whole upload allocates, must not grow with the
+// body: two part buffers, whether the body is 4 parts or 32.
+func TestStreamPartsMemoryIndependentOfSize(t *testing.T) {
+	if testing.Short() {
+		t.Skip("streams 288 MiB")
+	}
+	measure := func(size int64) (peak, allocated uint64) {
+		var stats runtime.MemStats
+		runtime.GC()
+		runtime.ReadMemStats(&stats)
+		base, before := stats.HeapInuse, stats.TotalAlloc
+		s := memoryStore{onPut: func() {
+			var during runtime.MemStats
+			runtime.ReadMemStats(&during)
+			if during.HeapInuse > base && during.HeapInuse-base > peak {
+				peak = during.HeapInuse - base
+			}
+		}}
+		if _, total, err := s.stream(context.Background(), &patternReader{n: size}); err != nil || total != size {
+			t.Fatalf("%d bytes: total=%d err=%v", size, total, err)
+		}
+		runtime.ReadMemStats(&stats)
+		return peak, stats.TotalAlloc - before
+	}
+
+	smallPeak, smallAlloc := measure(4 * PartSize)
+	largePeak, largeAlloc := measure(32 * PartSize)
+	t.Logf("32 MiB body: peak %d KiB, allocated %d KiB; 256 MiB body: peak %d KiB, allocated %d KiB",
+		smallPeak>>10, smallAlloc>>10, largePeak>>10, largeAlloc>>10)
+	const limit = 3 * PartSize // two part buffers plus slack
+	if smallPeak > limit || largePeak > limit {
+		t.Errorf("peak heap above %d bytes", limit)
+	}
+	if smallAlloc > limit || largeAlloc > limit {
+		t.Errorf("allocated more than %d bytes", limit)
+	}
+}
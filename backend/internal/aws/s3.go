@@ -4,11 +4,15 @@ import (
 	"bytes"
 	"context"
 	"fmt"
+	"io"
+	neturl "net/url"
 	"time"
 
 	"github.com/aws/aws-sdk-go-v2/aws"
 	"github.com/aws/aws-sdk-go-v2/config"
 	"github.com/aws/aws-sdk-go-v2/service/s3"
+	"github.com/aws/aws-sdk-go-v2/service/s3/types"
+	"github.com/google/uuid"
 )
 
 type S3Client struct {
@@ -17,7 +21,8 @@ type S3Client struct {
 }
 
 // NewS3Client creates a new S3 client using the kaimz-tdr AWS profile
-func NewS3Client(ctx context.Context, region, bucket string) (*S3Client, error) {
+// A non-empty endpoint points the client at an S3-compatible server (e.g. MinIO) with path-style addressing
+func NewS3Client(ctx context.Context, region, bucket, endpoint string) (*S3Client, error) {
 	cfg, err := config.LoadDefaultConfig(ctx,
 		config.WithSharedConfigProfile("kaimz-tdr"),
 		config.WithRegion(region),
@@ -33,7 +38,12 @@ func NewS3Client(ctx context.Context, region, bucket string) (*S3Client, error)
 	}
 
 	return &S3Client{
-		client: s3.NewFromConfig(cfg),
+		client: s3.NewFromConfig(cfg, func(o *s3.Options) {
+			if endpoint != "" {
+				o.BaseEndpoint = aws.String(endpoint)
+				o.UsePathStyle = true
+			}
+		}),
 		bucket: bucket,
 	}, nil
 }
@@ -78,20 +88,166 @@ func (s *S3Client) UploadLogWithKey(ctx context.Context, key string, logContent
 	return url, nil
 }
 
-// ListLogs lists all log files in the logs/ prefix
-func (s *S3Client) ListLogs(ctx context.Context) ([]string, error) {
-	result, err := s.client.ListObjectsV2(ctx, &s3.ListObjectsV2Input{
-		Bucket: aws.String(s.bucket),
-		Prefix: aws.String("logs/"),
+// StreamKey returns a fresh object key for a streamed log upload under logs/
+func StreamKey() string {
+	return fmt.Sprintf("logs/%s_%s.log", time.Now().Format("2006-01-02_15-04-05"), uuid.New().String())
+}
+
+// BatchKey returns a fresh object key for an NDJSON batch under logs/batches/
+func BatchKey() string {
+	now := time.Now().UTC()
+	return fmt.Sprintf("logs/batches/%s/%s_%s.ndjson", now.Format("2006-01-02"), now.Format("150405.000"), uuid.New().String())
+}
+
+// UploadBatch stores an NDJSON batch of log records as a single object under logs/batches/
+func (s *S3Client) UploadBatch(ctx context.Context, body []byte) (string, error) {
+	key := BatchKey()
+
+	_, err := s.client.PutObject(ctx, &s3.PutObjectInput{
+		Bucket:      aws.String(s.bucket),
+		Key:         aws.String(key),
+		Body:        bytes.NewReader(body),
+		ContentType: aws.String("application/x-ndjson"),
+	})
+
+	if err != nil {
+		return "", fmt.Errorf("failed to upload log batch to S3: %w", err)
+	}
+
+	url := fmt.Sprintf("s3://%s/%s", s.bucket, key)
+	return url, nil
+}
+
+// PutObject stores body under key; contentEncoding is optional (e.g. "gzip")
+func (s *S3Client) PutObject(ctx context.Context, key string, body []byte, contentType, contentEncoding string) error {
+	input := &s3.PutObjectInput{
+		Bucket:      aws.String(s.bucket),
+		Key:         aws.String(key),
+		Body:        bytes.NewReader(body),
+		ContentType: aws.String(contentType),
+	}
+	if contentEncoding != "" {
+		input.ContentEncoding = aws.String(contentEncoding)
+	}
+
+	if _, err := s.client.PutObject(ctx, input); err != nil {
+		return fmt.Errorf("failed to upload object to S3: %w", err)
+	}
+	return nil
+}
+
+// UploadStream stores body under key without holding it in memory: it is sent as a multipart
+// upload in PartSize parts (two buffered at a time), or as a single PUT when it fits in one part.
+// A failed multipart upload is aborted so no partial object or orphaned parts are left.
+// Returns the S3 URL and the number of bytes stored.
+func (s *S3Client) UploadStream(ctx context.Context, key string, body io.Reader, contentType string) (string, int64, error) {
+	var uploadID *string
+	parts, size, err := streamParts(ctx, body,
+		func(ctx context.Context, data []byte) error {
+			return s.PutObject(ctx, key, data, contentType, "")
+		},
+		func(ctx context.Context) error {
+			out, err := s.client.CreateMultipartUpload(ctx, &s3.CreateMultipartUploadInput{
+				Bucket:      aws.String(s.bucket),
+				Key:         aws.String(key),
+				ContentType: aws.String(contentType),
+			})
+			if err != nil {
+				return err
+			}
+			uploadID = out.UploadId
+			return nil
+		},
+		func(ctx context.Context, number int32, data []byte) (string, error) {
+			out, err := s.client.UploadPart(ctx, &s3.UploadPartInput{
+				Bucket:     aws.String(s.bucket),
+				Key:        aws.String(key),
+				UploadId:   uploadID,
+				PartNumber: aws.Int32(number),
+				Body:       bytes.NewReader(data),
+			})
+			if err != nil {
+				return "", err
+			}
+			return aws.ToString(out.ETag), nil
+		},
+	)
+
+	if err == nil && uploadID != nil {
+		completed := make([]types.CompletedPart, len(parts))
+		for i, part := range parts {
+			completed[i] = types.CompletedPart{PartNumber: aws.Int32(part.Number), ETag: aws.String(part.ETag)}
+		}
+		_, err = s.client.CompleteMultipartUpload(ctx, &s3.CompleteMultipartUploadInput{
+			Bucket:          aws.String(s.bucket),
+			Key:             aws.String(key),
+			UploadId:        uploadID,
+			MultipartUpload: &types.CompletedMultipartUpload{Parts: completed},
+		})
+	}
+	if err != nil {
+		if uploadID != nil {
+			// Use a fresh context: the request's may be the reason the upload failed
+			abortCtx, cancel := context.WithTimeout(context.Background(), 30*time.Second)
+			defer cancel()
+			s.client.AbortMultipartUpload(abortCtx, &s3.AbortMultipartUploadInput{
+				Bucket:   aws.String(s.bucket),
+				Key:      aws.String(key),
+				UploadId: uploadID,
+			})
+		}
+		return "", size, fmt.Errorf("failed to stream upload to S3: %w", err)
+	}
+
+	url := fmt.Sprintf("s3://%s/%s", s.bucket, key)
+	return url, size, nil
+}
+
+// MoveObject renames an object with a server-side copy, so the data never passes through the backend
+func (s *S3Client) MoveObject(ctx context.Context, from, to string) (string, error) {
+	_, err := s.client.CopyObject(ctx, &s3.CopyObjectInput{
+		Bucket:     aws.String(s.bucket),
+		Key:        aws.String(to),
+		CopySource: aws.String((&neturl.URL{Path: s.bucket + "/" + from}).EscapedPath()),
 	})
+	if err != nil {
+		return "", fmt.Errorf("failed to copy object in S3: %w", err)
+	}
+	if err := s.DeleteObject(ctx, from); err != nil {
+		return "", err
+	}
+	return fmt.Sprintf("s3://%s/%s", s.bucket, to), nil
+}
 
+// DeleteObject removes an object
+func (s *S3Client) DeleteObject(ctx context.Context, key string) error {
+	_, err := s.client.DeleteObject(ctx, &s3.DeleteObjectInput{
+		Bucket: aws.String(s.bucket),
+		Key:    aws.String(key),
+	})
 	if err != nil {
-		return nil, fmt.Errorf("failed to list logs from S3: %w", err)
+		return fmt.Errorf("failed to delete object from S3: %w", err)
 	}
+	return nil
+}
+
+// ListLogs lists all log files in the logs/ prefix, including the hour-partitioned
+// aggregates under logs/agg/, following continuation tokens past the 1000-key page limit
+func (s *S3Client) ListLogs(ctx context.Context) ([]string, error) {
+	paginator := s3.NewListObjectsV2Paginator(s.client, &s3.ListObjectsV2Input{
+		Bucket: aws.String(s.bucket),
+		Prefix: aws.String("logs/"),
+	})
 
 	var keys []string
-	for _, obj := range result.Contents {
-		keys = append(keys, *obj.Key)
+	for paginator.HasMorePages() {
+		page, err := paginator.NextPage(ctx)
+		if err != nil {
+			return nil, fmt.Errorf("failed to list logs from S3: %w", err)
+		}
+		for _, obj := range page.Contents {
+			keys = append(keys, *obj.Key)
+		}
 	}
 
 	return keys, nil
@@ -1,5 +1,7 @@
 package constants
 
+import "time"
+
 // macOS log command constants
 const (
 	// MacOSLogStreamCommand is the base command for streaming logs on macOS
@@ -20,29 +22,39 @@ const (
 	// WindowsStreamLogsScript gets recent network events for streaming
 	WindowsStreamLogsScript = `Get-WinEvent -FilterHashtable @{LogName='Microsoft-Windows-NetworkProfile/Operational'; StartTime=(Get-Date).AddMinutes(-5)} -MaxEvents 50 | Format-List TimeCreated, Message`
 
-	// WindowsFetchLogsScriptTemplate is a template for fetching logs with time parameter
-	// Usage: fmt.Sprintf(WindowsFetchLogsScriptTemplate, startTime)
+	// WindowsFetchLogsScriptTemplate is a template for fetching logs after a cursor, oldest first.
+	// Each matching event is printed on one line, prefixed with its round-trip (ISO 8601) timestamp.
+	// A final "#scanned <timestamp>" line reports the newest event examined, matching or not,
+	// so the cursor can move past events that were filtered out.
+	// Usage: fmt.Sprintf(WindowsFetchLogsScriptTemplate, startTime, WindowsMaxEvents)
 	WindowsFetchLogsScriptTemplate = `
 		$startTime = [DateTime]::Parse('%s')
-		Get-WinEvent -FilterHashtable @{
+		$events = @(Get-WinEvent -FilterHashtable @{
 			LogName='System';
 			StartTime=$startTime
-		} -MaxEvents 100 -ErrorAction SilentlyContinue | 
+		} -MaxEvents %d -Oldest -ErrorAction SilentlyContinue)
+		$events |
 		Where-Object { $_.Message -match 'network|ethernet|wifi|adapter' } |
-		Select-Object -First 50 |
-		Format-Table TimeCreated, Id, LevelDisplayName, Message -AutoSize |
-		Out-String -Width 200
+		ForEach-Object { '{0:o} {1} {2} {3}' -f $_.TimeCreated, $_.Id, $_.LevelDisplayName, ($_.Message -replace '\s+', ' ') }
+		if ($events.Count -gt 0) { '#scanned ' + $events[-1].TimeCreated.ToString('o') }
 	`
+
+	// WindowsScannedMarker prefixes the last line of WindowsFetchLogsScriptTemplate output
+	WindowsScannedMarker = "#scanned "
 )
 
 // Log fetching limits
 const (
-	// MaxLogLines is the maximum number of log lines to return for macOS
-	MaxLogLines = 100
+	// DefaultLogLookback is how far back the first collection run reaches when there is no cursor yet
+	DefaultLogLookback = 60 * time.Minute
 
-	// WindowsMaxEvents is the maximum number of events to fetch from Windows Event Log
-	WindowsMaxEvents = 100
+	// MaxLogChunkBytes is the size at which fetched log entries are uploaded as one object
+	MaxLogChunkBytes = 1 << 20
 
-	// WindowsMaxResults is the maximum number of filtered results to return
-	WindowsMaxResults = 50
+	// MaxLogLineBytes is the longest single log line accepted from the log command
+	MaxLogLineBytes = 1 << 20
+
+	// WindowsMaxEvents is the maximum number of events examined per run on Windows; the cursor
+	// picks up the rest on the next run
+	WindowsMaxEvents = 100
 )
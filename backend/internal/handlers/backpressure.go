@@ -0,0 +1,51 @@
+package handlers
+
+import (
+	"errors"
+	"strconv"
+	"time"
+
+	"github.com/gin-gonic/gin"
+
+	"backend/internal/ingest"
+)
+
+// uploadRetryAfter is what a sender turned away by LimitUploads is told to wait
+const uploadRetryAfter = time.Second
+
+// LimitUploads lets at most max upload requests through at once. Past that, requests are
+// answered 429 with Retry-After at once instead of queueing, so senders shrink their batches
+// and concurrency (see fim/flow_control.h and agent_ship.h) rather than pile up timeouts.
+func LimitUploads(max int) gin.HandlerFunc {
+	slots := make(chan struct{}, max)
+	return func(c *gin.Context) {
+		select {
+		case slots <- struct{}{}:
+			defer func() { <-slots }()
+			c.Next()
+		default:
+			setRetryAfter(c, uploadRetryAfter)
+			c.AbortWithStatusJSON(429, gin.H{"error": "too many concurrent uploads"})
+		}
+	}
+}
+
+// respondIngestError maps an ingest buffer failure to 503 with Retry-After when the buffer is
+// full (the sender keeps the data and tries again), or to 500
+func respondIngestError(c *gin.Context, err error) {
+	if errors.Is(err, ingest.ErrFull) {
+		setRetryAfter(c, ingestBuffer.RetryAfter())
+		c.JSON(503, gin.H{"error": err.Error()})
+		return
+	}
+	c.JSON(500, gin.H{"error": err.Error()})
+}
+
+// setRetryAfter sends d in whole seconds, rounded up
+func setRetryAfter(c *gin.Context, d time.Duration) {
+	seconds := int((d + time.Second - 1) / time.Second)
+	if seconds < 1 {
+		seconds = 1
+	}
+	c.Header("Retry-After", strconv.Itoa(seconds))
+}
@@ -1,9 +1,21 @@
 package handlers
 
 import (
+	"bufio"
+	"bytes"
+	"compress/gzip"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"net/http"
+	"strings"
+
 	"github.com/gin-gonic/gin"
 
 	"backend/internal/aws"
+	"backend/internal/ingest"
+	"backend/internal/wire"
 )
 
 // S3 client instance (initialize in main.go)
@@ -14,18 +26,112 @@ func SetS3Client(client *aws.S3Client) {
 	s3Client = client
 }
 
+// Ingest buffer instance; when set, uploads are aggregated instead of stored one object each
+var ingestBuffer *ingest.Buffer
+
+// SetIngestBuffer sets the ingest buffer for the upload handlers to use
+func SetIngestBuffer(buffer *ingest.Buffer) {
+	ingestBuffer = buffer
+}
+
 // UploadLogRequest represents the request body for uploading logs
 type UploadLogRequest struct {
 	Log      string `json:"log" binding:"required"`
 	Filename string `json:"filename"` // Optional custom filename
 }
 
+// streamThreshold is the body size above which uploads are streamed to S3 instead of being read whole
+const streamThreshold = 1 << 20
+
+// maxStreamBytes caps a streamed upload (after decompression)
+const maxStreamBytes = 5 << 30
+
+// isStreamedUpload reports whether a request takes the streaming path: bodies that are large or of
+// unknown size (chunked). A small compressed body is decompressed and read whole like any other,
+// so it goes through the ingest buffer and its backpressure.
+func isStreamedUpload(c *gin.Context) bool {
+	return c.Request.ContentLength < 0 || c.Request.ContentLength > streamThreshold
+}
+
+// isRawLogUpload reports whether the body is the log text itself rather than an UploadLogRequest
+func isRawLogUpload(c *gin.Context) bool {
+	contentType := c.ContentType()
+	return contentType == "text/plain" || contentType == "application/octet-stream"
+}
+
+// requestBody returns the request body, gunzipped for Content-Encoding: gzip, failing with
+// *http.MaxBytesError once more than limit bytes have been read (after decompression)
+func requestBody(c *gin.Context, limit int64) (io.ReadCloser, error) {
+	body := http.MaxBytesReader(c.Writer, c.Request.Body, limit)
+	switch strings.ToLower(c.GetHeader("Content-Encoding")) {
+	case "", "identity":
+		return body, nil
+	case "gzip":
+		zr, err := gzip.NewReader(body)
+		if err != nil {
+			return nil, fmt.Errorf("invalid gzip body: %w", err)
+		}
+		return struct {
+			io.Reader
+			io.Closer
+		}{&cappedReader{r: zr, remaining: limit, limit: limit}, body}, nil
+	default:
+		return nil, fmt.Errorf("unsupported Content-Encoding %q", c.GetHeader("Content-Encoding"))
+	}
+}
+
+// cappedReader fails with *http.MaxBytesError instead of returning more than limit bytes
+type cappedReader struct {
+	r         io.Reader
+	remaining int64
+	limit     int64
+}
+
+func (c *cappedReader) Read(p []byte) (int, error) {
+	if c.remaining <= 0 {
+		// Probe for one more byte so a body of exactly limit bytes still ends cleanly
+		var probe [1]byte
+		if n, err := c.r.Read(probe[:]); n == 0 {
+			return 0, err
+		}
+		return 0, &http.MaxBytesError{Limit: c.limit}
+	}
+	if int64(len(p)) > c.remaining {
+		p = p[:c.remaining]
+	}
+	n, err := c.r.Read(p)
+	c.remaining -= int64(n)
+	return n, err
+}
+
+// respondBodyError maps a request body failure to 413 or 400
+func respondBodyError(c *gin.Context, err error) {
+	var tooLarge *http.MaxBytesError
+	if errors.As(err, &tooLarge) {
+		c.JSON(413, gin.H{"error": fmt.Sprintf("body exceeds %d bytes", tooLarge.Limit)})
+		return
+	}
+	c.JSON(400, gin.H{"error": err.Error()})
+}
+
 // UploadLog handles uploading log strings to S3
+// Large or chunked bodies are streamed to S3 (see uploadLogStream); a text/plain or
+// application/octet-stream body is the log itself, with the object key in ?filename=.
+// With the ingest buffer set, smaller bodies of either kind go through it instead.
 func UploadLog() gin.HandlerFunc {
 	return func(c *gin.Context) {
+		if isStreamedUpload(c) || (isRawLogUpload(c) && ingestBuffer == nil) {
+			uploadLogStream(c)
+			return
+		}
+		if isRawLogUpload(c) {
+			uploadRawLogBuffered(c)
+			return
+		}
+
 		var req UploadLogRequest
-		if err := c.ShouldBindJSON(&req); err != nil {
-			c.JSON(400, gin.H{"error": err.Error()})
+		if err := bindUploadRequest(c, &req); err != nil {
+			respondBodyError(c, err)
 			return
 		}
 
@@ -34,6 +140,20 @@ func UploadLog() gin.HandlerFunc {
 			return
 		}
 
+		if ingestBuffer != nil {
+			line, err := json.Marshal(req)
+			if err != nil {
+				c.JSON(500, gin.H{"error": err.Error()})
+				return
+			}
+			if err := ingestBuffer.Append(c.GetString("user_id"), "upload", append(line, '\n')); err != nil {
+				respondIngestError(c, err)
+				return
+			}
+			c.JSON(200, gin.H{"message": "log accepted"})
+			return
+		}
+
 		var url string
 		var err error
 
@@ -56,6 +176,315 @@ func UploadLog() gin.HandlerFunc {
 	}
 }
 
+// bindUploadRequest decodes an UploadLogRequest from a body that is read whole, gunzipping it first
+// for Content-Encoding: gzip
+func bindUploadRequest(c *gin.Context, req *UploadLogRequest) error {
+	body, err := requestBody(c, maxBatchBytes)
+	if err != nil {
+		return err
+	}
+	defer body.Close()
+	if err := json.NewDecoder(body).Decode(req); err != nil {
+		return err
+	}
+	if req.Log == "" {
+		return errMissingLog
+	}
+	return nil
+}
+
+// uploadRawLogBuffered hands a raw log body to the ingest buffer as one UploadLogRequest record
+// per line (blank lines are skipped), so it is subject to the same backpressure as JSON uploads
+func uploadRawLogBuffered(c *gin.Context) {
+	reader, err := requestBody(c, maxBatchBytes)
+	if err != nil {
+		respondBodyError(c, err)
+		return
+	}
+	body, err := io.ReadAll(reader)
+	reader.Close()
+	if err != nil {
+		respondBodyError(c, err)
+		return
+	}
+
+	filename := c.Query("filename")
+	var records bytes.Buffer
+	count := 0
+	for _, line := range bytes.Split(body, []byte{'\n'}) {
+		line = bytes.TrimSuffix(line, []byte{'\r'})
+		if len(line) == 0 {
+			continue
+		}
+		record, err := json.Marshal(UploadLogRequest{Log: string(line), Filename: filename})
+		if err != nil {
+			c.JSON(500, gin.H{"error": err.Error()})
+			return
+		}
+		records.Write(record)
+		records.WriteByte('\n')
+		count++
+	}
+	if count == 0 {
+		c.JSON(400, gin.H{"error": errMissingLog.Error()})
+		return
+	}
+
+	if err := ingestBuffer.Append(c.GetString("user_id"), "upload", records.Bytes()); err != nil {
+		respondIngestError(c, err)
+		return
+	}
+	c.JSON(200, gin.H{"message": "log accepted", "lines": count})
+}
+
+// uploadLogStream stores a log without holding it in memory: the body is decompressed if needed
+// and the log text (the raw body, or the "log" field decoded on the fly) is sent straight into a
+// multipart upload. As "filename" may follow "log" in the JSON, the object is written under a
+// generated key and renamed server-side afterwards.
+func uploadLogStream(c *gin.Context) {
+	if s3Client == nil {
+		c.JSON(500, gin.H{"error": "S3 client not initialized"})
+		return
+	}
+
+	ctx := c.Request.Context()
+	body, err := requestBody(c, maxStreamBytes)
+	if err != nil {
+		c.JSON(400, gin.H{"error": err.Error()})
+		return
+	}
+	defer body.Close()
+
+	if isRawLogUpload(c) {
+		key := c.Query("filename")
+		if key == "" {
+			key = aws.StreamKey()
+		}
+		url, size, err := s3Client.UploadStream(ctx, key, body, "text/plain")
+		if err != nil {
+			var tooLarge *http.MaxBytesError
+			if errors.As(err, &tooLarge) {
+				respondBodyError(c, err)
+				return
+			}
+			c.JSON(500, gin.H{"error": err.Error()})
+			return
+		}
+		if size == 0 {
+			s3Client.DeleteObject(ctx, key)
+			c.JSON(400, gin.H{"error": errMissingLog.Error()})
+			return
+		}
+		c.JSON(200, gin.H{
+			"message": "log uploaded successfully",
+			"url":     url,
+			"bytes":   size,
+		})
+		return
+	}
+
+	logText, finish := streamLogField(body)
+	key := aws.StreamKey()
+	url, size, uploadErr := s3Client.UploadStream(ctx, key, logText, "text/plain")
+	// Closing lets the parser finish if the upload stopped reading early; it then reports
+	// io.ErrClosedPipe, and the upload error is the one that matters
+	logText.Close()
+	filename, parseErr := finish()
+	if parseErr != nil && !errors.Is(parseErr, io.ErrClosedPipe) {
+		if uploadErr == nil {
+			// The log field was complete but the rest of the body was not valid
+			s3Client.DeleteObject(ctx, key)
+		}
+		respondBodyError(c, parseErr)
+		return
+	}
+	if uploadErr != nil {
+		c.JSON(500, gin.H{"error": uploadErr.Error()})
+		return
+	}
+	if filename != "" && filename != key {
+		if url, err = s3Client.MoveObject(ctx, key, filename); err != nil {
+			c.JSON(500, gin.H{"error": err.Error()})
+			return
+		}
+	}
+
+	c.JSON(200, gin.H{
+		"message": "log uploaded successfully",
+		"url":     url,
+		"bytes":   size,
+	})
+}
+
+// maxBatchBytes caps the (decompressed) size of an upload or batch body that is read whole
+const maxBatchBytes = 32 << 20
+
+// UploadLogBatch stores an NDJSON body (one UploadLogRequest object per line) as a single S3 object.
+// Binary batches (Content-Type application/x-fim-binary) are decoded and stored as the same NDJSON.
+// Large or chunked NDJSON batches are validated and streamed to S3 as they arrive.
+func UploadLogBatch() gin.HandlerFunc {
+	return func(c *gin.Context) {
+		if s3Client == nil {
+			c.JSON(500, gin.H{"error": "S3 client not initialized"})
+			return
+		}
+
+		if isStreamedUpload(c) && c.ContentType() != wire.ContentType {
+			uploadBatchStream(c)
+			return
+		}
+
+		reader, err := requestBody(c, maxBatchBytes)
+		if err != nil {
+			c.JSON(400, gin.H{"error": err.Error()})
+			return
+		}
+		body, err := io.ReadAll(reader)
+		reader.Close()
+		if err != nil {
+			var tooLarge *http.MaxBytesError
+			if errors.As(err, &tooLarge) {
+				c.JSON(413, gin.H{"error": fmt.Sprintf("batch exceeds %d bytes", maxBatchBytes)})
+				return
+			}
+			c.JSON(400, gin.H{"error": err.Error()})
+			return
+		}
+
+		var count int
+		if c.ContentType() == wire.ContentType {
+			body, count, err = decodeBinaryBatch(body)
+		} else {
+			count, err = validateBatch(body)
+		}
+		if err != nil {
+			c.JSON(400, gin.H{"error": err.Error()})
+			return
+		}
+		if count == 0 {
+			c.JSON(400, gin.H{"error": "batch contains no records"})
+			return
+		}
+
+		if ingestBuffer != nil {
+			if len(body) > 0 && body[len(body)-1] != '\n' {
+				body = append(body, '\n')
+			}
+			if err := ingestBuffer.Append(c.GetString("user_id"), "batch", body); err != nil {
+				respondIngestError(c, err)
+				return
+			}
+			c.JSON(200, gin.H{
+				"message": "batch accepted",
+				"count":   count,
+			})
+			return
+		}
+
+		url, err := s3Client.UploadBatch(c.Request.Context(), body)
+		if err != nil {
+			c.JSON(500, gin.H{"error": err.Error()})
+			return
+		}
+
+		c.JSON(200, gin.H{
+			"message": "batch uploaded successfully",
+			"url":     url,
+			"count":   count,
+		})
+	}
+}
+
+// uploadBatchStream validates NDJSON records line by line while they stream into a multipart
+// upload; a bad record aborts the upload, so nothing is stored for a rejected batch.
+func uploadBatchStream(c *gin.Context) {
+	ctx := c.Request.Context()
+	body, err := requestBody(c, maxStreamBytes)
+	if err != nil {
+		c.JSON(400, gin.H{"error": err.Error()})
+		return
+	}
+	defer body.Close()
+
+	records, finish := validateNDJSONStream(body)
+	key := aws.BatchKey()
+	url, _, uploadErr := s3Client.UploadStream(ctx, key, records, "application/x-ndjson")
+	records.Close()
+	count, validateErr := finish()
+	if validateErr != nil && !errors.Is(validateErr, io.ErrClosedPipe) {
+		if uploadErr == nil {
+			s3Client.DeleteObject(ctx, key)
+		}
+		respondBodyError(c, validateErr)
+		return
+	}
+	if uploadErr != nil {
+		c.JSON(500, gin.H{"error": uploadErr.Error()})
+		return
+	}
+
+	c.JSON(200, gin.H{
+		"message": "batch uploaded successfully",
+		"url":     url,
+		"count":   count,
+	})
+}
+
+// validateBatch checks that every non-empty line is an upload record with a log field
+func validateBatch(body []byte) (int, error) {
+	scanner := bufio.NewScanner(bytes.NewReader(body))
+	scanner.Buffer(make([]byte, 0, 64*1024), maxBatchBytes)
+
+	count := 0
+	lineNo := 0
+	for scanner.Scan() {
+		lineNo++
+		line := bytes.TrimSpace(scanner.Bytes())
+		if len(line) == 0 {
+			continue
+		}
+		var record UploadLogRequest
+		if err := json.Unmarshal(line, &record); err != nil {
+			return 0, fmt.Errorf("line %d: %w", lineNo, err)
+		}
+		if record.Log == "" {
+			return 0, fmt.Errorf("line %d: missing log field", lineNo)
+		}
+		count++
+	}
+	if err := scanner.Err(); err != nil {
+		return 0, err
+	}
+	return count, nil
+}
+
+// decodeBinaryBatch converts a binary batch frame into NDJSON upload records
+func decodeBinaryBatch(body []byte) ([]byte, int, error) {
+	records, err := wire.Decode(body)
+	if err != nil {
+		return nil, 0, err
+	}
+
+	var out bytes.Buffer
+	out.Grow(len(body) * 2)
+	for i, record := range records {
+		text, err := record.LogText()
+		if err != nil {
+			return nil, 0, fmt.Errorf("record %d: %w", i+1, err)
+		}
+		if text == "" {
+			return nil, 0, fmt.Errorf("record %d: missing log field", i+1)
+		}
+		line, err := json.Marshal(UploadLogRequest{Log: text, Filename: record.Filename})
+		if err != nil {
+			return nil, 0, fmt.Errorf("record %d: %w", i+1, err)
+		}
+		out.Write(line)
+		out.WriteByte('\n')
+	}
+	return out.Bytes(), len(records), nil
+}
+
 // ListLogs returns all log files from S3
 func ListLogs() gin.HandlerFunc {
 	return func(c *gin.Context) {
@@ -70,9 +499,14 @@ func ListLogs() gin.HandlerFunc {
 			return
 		}
 
-		c.JSON(200, gin.H{
+		response := gin.H{
 			"logs":  logs,
 			"count": len(logs),
-		})
+		}
+		if ingestBuffer != nil {
+			// Records accepted but not yet rolled into an object under logs/agg/
+			response["buffered"] = ingestBuffer.Stats()
+		}
+		c.JSON(200, response)
 	}
 }
@@ -0,0 +1,412 @@
+package handlers
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"strconv"
+	"unicode/utf16"
+	"unicode/utf8"
+)
+
+// maxStreamRecordBytes caps a single NDJSON record on the streaming batch path
+const maxStreamRecordBytes = 8 << 20
+
+// maxFieldBytes caps the JSON fields other than "log" on the streaming upload path
+const maxFieldBytes = 4096
+
+var errMissingLog = errors.New("missing log field")
+
+// streamLogField parses an UploadLogRequest object from body without holding the log text:
+// the unescaped "log" value is written to the returned reader as it is parsed. finish waits for
+// the rest of the object and returns the filename (which may follow the log) or the first error.
+// The reader fails with that error too, so a consumer never mistakes a bad body for a complete one.
+// Close the reader when done with it, so the parser is not left blocked on a consumer that gave up.
+func streamLogField(body io.Reader) (logText io.ReadCloser, finish func() (string, error)) {
+	pr, pw := io.Pipe()
+	done := make(chan struct{})
+	var filename string
+	var parseErr error
+
+	go func() {
+		defer close(done)
+		p := jsonStreamParser{r: bufio.NewReaderSize(body, 64*1024)}
+		var sawLog bool
+		filename, sawLog, parseErr = p.parseUploadObject(pw)
+		if parseErr == nil && !sawLog {
+			parseErr = errMissingLog
+		}
+		if !sawLog || parseErr != nil {
+			pw.CloseWithError(parseErr)
+		}
+	}()
+
+	return pr, func() (string, error) {
+		<-done
+		return filename, parseErr
+	}
+}
+
+type jsonStreamParser struct {
+	r *bufio.Reader
+}
+
+// parseUploadObject reads {"log": "...", "filename": "...", ...}. The log value is streamed to
+// out, which is closed as soon as the value ends.
+func (p *jsonStreamParser) parseUploadObject(out *io.PipeWriter) (filename string, sawLog bool, err error) {
+	if err := p.expect('{'); err != nil {
+		return "", false, err
+	}
+	first := true
+	for {
+		c, err := p.next()
+		if err != nil {
+			return "", sawLog, err
+		}
+		if c == '}' && first {
+			break
+		}
+		if !first {
+			if c == '}' {
+				break
+			}
+			if c != ',' {
+				return "", sawLog, fmt.Errorf("invalid JSON: expected ',' or '}', got %q", c)
+			}
+			if c, err = p.next(); err != nil {
+				return "", sawLog, err
+			}
+		}
+		first = false
+		if c != '"' {
+			return "", sawLog, fmt.Errorf("invalid JSON: expected object key, got %q", c)
+		}
+		var key bytes.Buffer
+		if err := p.readString(&key, maxFieldBytes); err != nil {
+			return "", sawLog, err
+		}
+		if err := p.expect(':'); err != nil {
+			return "", sawLog, err
+		}
+
+		switch key.String() {
+		case "log":
+			if sawLog {
+				return "", sawLog, errors.New("duplicate log field")
+			}
+			if err := p.expect('"'); err != nil {
+				return "", sawLog, fmt.Errorf("log must be a string: %w", err)
+			}
+			// Escapes are decoded a few bytes at a time; batch them up before they cross the pipe
+			buffered := bufio.NewWriterSize(out, 64*1024)
+			counter := &countingWriter{w: buffered}
+			if err := p.readString(counter, -1); err != nil {
+				return "", sawLog, err
+			}
+			if counter.n == 0 {
+				return "", sawLog, errMissingLog
+			}
+			if err := buffered.Flush(); err != nil {
+				return "", sawLog, err
+			}
+			sawLog = true
+			out.Close()
+		case "filename":
+			if err := p.expect('"'); err != nil {
+				return "", sawLog, fmt.Errorf("filename must be a string: %w", err)
+			}
+			var name bytes.Buffer
+			if err := p.readString(&name, maxFieldBytes); err != nil {
+				return "", sawLog, err
+			}
+			filename = name.String()
+		default:
+			if err := p.skipValue(0); err != nil {
+				return "", sawLog, err
+			}
+		}
+	}
+	if _, err := p.next(); err != io.EOF {
+		return "", sawLog, errors.New("invalid JSON: data after object")
+	}
+	return filename, sawLog, nil
+}
+
+// next returns the next non-whitespace byte
+func (p *jsonStreamParser) next() (byte, error) {
+	for {
+		c, err := p.r.ReadByte()
+		if err != nil {
+			return 0, err
+		}
+		if c != ' ' && c != '\t' && c != '\n' && c != '\r' {
+			return c, nil
+		}
+	}
+}
+
+func (p *jsonStreamParser) expect(want byte) error {
+	c, err := p.next()
+	if err == io.EOF {
+		return io.ErrUnexpectedEOF
+	}
+	if err != nil {
+		return err
+	}
+	if c != want {
+		return fmt.Errorf("invalid JSON: expected %q, got %q", want, c)
+	}
+	return nil
+}
+
+// readString unescapes a string body (opening quote already read) into w, up to limit bytes
+// of output (-1 = no limit). Runs of plain bytes are written without copying.
+func (p *jsonStreamParser) readString(w io.Writer, limit int) error {
+	written := 0
+	emit := func(b []byte) error {
+		written += len(b)
+		if limit >= 0 && written > limit {
+			return fmt.Errorf("JSON string exceeds %d bytes", limit)
+		}
+		_, err := w.Write(b)
+		return err
+	}
+	var scratch [utf8.UTFMax]byte
+	for {
+		// Hand over everything up to the next quote or backslash straight from the read buffer
+		run := 0
+		buffered, _ := p.r.Peek(p.r.Buffered())
+		for run < len(buffered) && buffered[run] != '"' && buffered[run] != '\\' && buffered[run] >= 0x20 {
+			run++
+		}
+		if run > 0 {
+			if err := emit(buffered[:run]); err != nil {
+				return err
+			}
+			p.r.Discard(run)
+			continue
+		}
+
+		c, err := p.r.ReadByte()
+		if err == io.EOF {
+			return io.ErrUnexpectedEOF
+		}
+		if err != nil {
+			return err
+		}
+		switch {
+		case c == '"':
+			return nil
+		case c < 0x20:
+			return errors.New("invalid JSON: control character in string")
+		case c != '\\':
+			scratch[0] = c
+			if err := emit(scratch[:1]); err != nil {
+				return err
+			}
+			continue
+		}
+
+		esc, err := p.r.ReadByte()
+		if err != nil {
+			return io.ErrUnexpectedEOF
+		}
+		var r rune
+		switch esc {
+		case '"', '\\', '/':
+			r = rune(esc)
+		case 'b':
+			r = '\b'
+		case 'f':
+			r = '\f'
+		case 'n':
+			r = '\n'
+		case 'r':
+			r = '\r'
+		case 't':
+			r = '\t'
+		case 'u':
+			if r, err = p.readHex4(); err != nil {
+				return err
+			}
+			if utf16.IsSurrogate(r) {
+				// A high surrogate must be followed by \uDC00-\uDFFF; anything else becomes U+FFFD
+				if peek, _ := p.r.Peek(2); len(peek) == 2 && peek[0] == '\\' && peek[1] == 'u' {
+					p.r.Discard(2)
+					low, err := p.readHex4()
+					if err != nil {
+						return err
+					}
+					r = utf16.DecodeRune(r, low)
+				} else {
+					r = utf8.RuneError
+				}
+			}
+		default:
+			return fmt.Errorf("invalid JSON: bad escape \\%c", esc)
+		}
+		n := utf8.EncodeRune(scratch[:], r)
+		if err := emit(scratch[:n]); err != nil {
+			return err
+		}
+	}
+}
+
+func (p *jsonStreamParser) readHex4() (rune, error) {
+	var hex [4]byte
+	if _, err := io.ReadFull(p.r, hex[:]); err != nil {
+		return 0, io.ErrUnexpectedEOF
+	}
+	v, err := strconv.ParseUint(string(hex[:]), 16, 16)
+	if err != nil {
+		return 0, fmt.Errorf("invalid JSON: bad \\u escape %q", hex[:])
+	}
+	return rune(v), nil
+}
+
+// skipValue skips one JSON value of any type
+func (p *jsonStreamParser) skipValue(depth int) error {
+	if depth > 64 {
+		return errors.New("invalid JSON: nesting too deep")
+	}
+	c, err := p.next()
+	if err != nil {
+		return io.ErrUnexpectedEOF
+	}
+	switch c {
+	case '"':
+		return p.readString(io.Discard, maxFieldBytes)
+	case '{', '[':
+		closing := byte('}')
+		if c == '[' {
+			closing = ']'
+		}
+		for first := true; ; first = false {
+			c, err := p.next()
+			if err != nil {
+				return io.ErrUnexpectedEOF
+			}
+			if c == closing && first {
+				return nil
+			}
+			if !first {
+				if c == closing {
+					return nil
+				}
+				if c != ',' {
+					return fmt.Errorf("invalid JSON: expected ',' got %q", c)
+				}
+			} else {
+				p.r.UnreadByte()
+			}
+			if closing == '}' {
+				if err := p.expect('"'); err != nil {
+					return err
+				}
+				if err := p.readString(io.Discard, maxFieldBytes); err != nil {
+					return err
+				}
+				if err := p.expect(':'); err != nil {
+					return err
+				}
+			}
+			if err := p.skipValue(depth + 1); err != nil {
+				return err
+			}
+		}
+	default:
+		// number, true, false or null: consume the literal
+		for {
+			b, err := p.r.ReadByte()
+			if err != nil {
+				return nil
+			}
+			if b == ',' || b == '}' || b == ']' || b == ' ' || b == '\t' || b == '\n' || b == '\r' {
+				p.r.UnreadByte()
+				return nil
+			}
+		}
+	}
+}
+
+type countingWriter struct {
+	w io.Writer
+	n int64
+}
+
+func (c *countingWriter) Write(b []byte) (int, error) {
+	n, err := c.w.Write(b)
+	c.n += int64(n)
+	return n, err
+}
+
+// validateNDJSONStream copies NDJSON upload records from body to the returned reader, checking
+// each line like validateBatch does. A bad line fails the reader, so a consumer uploading from
+// it must discard what it stored. finish returns the record count or the first error. Close the
+// reader when done with it.
+func validateNDJSONStream(body io.Reader) (records io.ReadCloser, finish func() (int, error)) {
+	pr, pw := io.Pipe()
+	done := make(chan struct{})
+	var count int
+	var validateErr error
+
+	go func() {
+		defer close(done)
+		r := bufio.NewReaderSize(body, 64*1024)
+		var line []byte
+		lineNo := 0
+		for {
+			fragment, err := r.ReadSlice('\n')
+			line = append(line, fragment...)
+			if err == bufio.ErrBufferFull {
+				if len(line) > maxStreamRecordBytes {
+					validateErr = fmt.Errorf("line %d: record exceeds %d bytes", lineNo+1, maxStreamRecordBytes)
+					break
+				}
+				continue
+			}
+			if err != nil && err != io.EOF {
+				validateErr = err
+				break
+			}
+			if len(line) > 0 {
+				lineNo++
+				if trimmed := bytes.TrimSpace(line); len(trimmed) > 0 {
+					var record UploadLogRequest
+					if jsonErr := json.Unmarshal(trimmed, &record); jsonErr != nil {
+						validateErr = fmt.Errorf("line %d: %w", lineNo, jsonErr)
+						break
+					}
+					if record.Log == "" {
+						validateErr = fmt.Errorf("line %d: missing log field", lineNo)
+						break
+					}
+					count++
+					if line[len(line)-1] != '\n' {
+						line = append(line, '\n')
+					}
+					if _, werr := pw.Write(line); werr != nil {
+						validateErr = werr
+						break
+					}
+				}
+			}
+			line = line[:0]
+			if err == io.EOF {
+				break
+			}
+		}
+		if validateErr == nil && count == 0 {
+			validateErr = errors.New("batch contains no records")
+		}
+		pw.CloseWithError(validateErr)
+	}()
+
+	return pr, func() (int, error) {
+		<-done
+		return count, validateErr
+	}
+}
@@ -0,0 +1,97 @@
+package handlers
+
+import (
+	"crypto/sha256"
+	"io"
+	"runtime"
+	"strings"
+	"testing"
+)
+
+// repeatReader yields n copies of b without holding them
+type repeatReader struct {
+	b byte
+	n int64
+}
+
+func (r *repeatReader) Read(p []byte) (int, error) {
+	if r.n == 0 {
+		return 0, io.EOF
+	}
+	if int64(len(p)) > r.n {
+		p = p[:r.n]
+	}
+	for i := range p {
+		p[i] = r.b
+	}
+	r.n -= int64(len(p))
+	return len(p), nil
+}
+
+func uploadBody(prefix string, logBytes int64, suffix string) io.Reader {
+	return io.MultiReader(strings.NewReader(prefix), &repeatReader{b: 'x', n: logBytes}, strings.NewReader(suffix))
+}
+
+func TestStreamLogField(t *testing.T) {
+	cases := []struct {
+		body, log, filename string
+	}{
+		{`{"log":"hello","filename":"a.log"}`, "hello", "a.log"},
+		{`{"filename":"b.log","log":"tab\there \"q\" é 😀"}`, "tab\there \"q\" é 😀", "b.log"},
+		{` { "other" : [1, {"x": null}], "log" : "x" , "n": 12 } `, "x", ""},
+	}
+	for _, c := range cases {
+		logText, finish := streamLogField(strings.NewReader(c.body))
+		got, err := io.ReadAll(logText)
+		logText.Close()
+		filename, finishErr := finish()
+		if err != nil || finishErr != nil || string(got) != c.log || filename != c.filename {
+			t.Errorf("%s: log=%q filename=%q err=%v/%v", c.body, got, filename, err, finishErr)
+		}
+	}
+
+	for _, body := range []string{`{"filename":"a"}`, `{"log":""}`, `{"log":"unterminated`, `{"log":"a"} trailing`, `{"log":1}`} {
+		logText, finish := streamLogField(strings.NewReader(body))
+		_, readErr := io.ReadAll(logText)
+		logText.Close()
+		if _, err := finish(); err == nil {
+			t.Errorf("%s: accepted", body)
+		} else if readErr == nil && !strings.Contains(body, "trailing") {
+			// trailing data is only seen after the log ended; everything else must fail the reader
+			t.Errorf("%s: reader ended cleanly", body)
+		}
+	}
+}
+
+// The log value is handed through without being held: what parsing allocates must not grow with
+// the size of the log, whether it is 16 MiB or 256 MiB.
+func TestStreamLogFieldMemoryIndependentOfSize(t *testing.T) {
+	if testing.Short() {
+		t.Skip("streams 272 MiB")
+	}
+	measure := func(size int64) uint64 {
+		var stats runtime.MemStats
+		runtime.GC()
+		runtime.ReadMemStats(&stats)
+		before := stats.TotalAlloc
+
+		logText, finish := streamLogField(uploadBody(`{"filename":"big.log","log":"`, size, `"}`))
+		hash := sha256.New()
+		n, err := io.Copy(hash, logText)
+		logText.Close()
+		filename, finishErr := finish()
+		if err != nil || finishErr != nil || n != size || filename != "big.log" {
+			t.Fatalf("%d bytes: copied %d, filename %q, err %v/%v", size, n, filename, err, finishErr)
+		}
+		runtime.ReadMemStats(&stats)
+		return stats.TotalAlloc - before
+	}
+
+	small := measure(16 << 20)
+	large := measure(256 << 20)
+	t.Logf("allocated %d KiB for a 16 MiB log, %d KiB for a 256 MiB log", small>>10, large>>10)
+	const limit = 1 << 20 // the read and write buffers (64 KiB each) and the pipe hand-off
+	if small > limit || large > limit {
+		t.Errorf("allocated more than %d bytes", limit)
+	}
+}
@@ -0,0 +1,422 @@
+// Package ingest aggregates small log uploads into hour-partitioned, gzip-compressed S3 objects.
+//
+// Records are appended per agent and source to a local write-ahead segment file and synced to
+// disk before the upload request is acknowledged. A segment is rolled once it reaches a size or
+// age threshold (or its hour has passed): it is compressed and stored as one object under
+// <prefix>YYYY/MM/DD/HH/<agent>/<source>/, then deleted locally. A segment whose upload fails
+// stays on disk and is retried, and segments left over from a crash are uploaded at start-up,
+// so nothing acknowledged is lost. With MaxBuffered set, appends are refused with ErrFull while
+// that much data waits for the store, so a backend that cannot keep up pushes back on senders
+// instead of filling its disk.
+package ingest
+
+import (
+	"bytes"
+	"compress/gzip"
+	"context"
+	"errors"
+	"fmt"
+	"log"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// ErrFull is returned by Append while MaxBuffered bytes are waiting for the store. Nothing was
+// written; the caller should ask the sender to retry after RetryAfter.
+var ErrFull = errors.New("ingest buffer full")
+
+// Store receives rolled segments (aws.S3Client in the server)
+type Store interface {
+	PutObject(ctx context.Context, key string, body []byte, contentType, contentEncoding string) error
+}
+
+// Options controls where segments are kept and when they are rolled
+type Options struct {
+	Dir      string        // directory for the write-ahead segment files
+	Prefix   string        // object key prefix, e.g. "logs/agg/"
+	MaxBytes int           // roll a segment once it holds this many (uncompressed) bytes
+	MaxAge   time.Duration // roll a segment once its first record is this old
+	// refuse appends while this many bytes (open and pending segments) wait for the store; 0 = no limit
+	MaxBuffered int64
+}
+
+// Stats describes what has not reached the store yet and what has
+type Stats struct {
+	OpenSegments    int   `json:"open_segments"`
+	PendingSegments int   `json:"pending_segments"`
+	BufferedBytes   int64 `json:"buffered_bytes"`
+	UploadedObjects int64 `json:"uploaded_objects"`
+	UploadFailures  int64 `json:"upload_failures"`
+}
+
+type partitionKey struct {
+	hour   string // "2006010215", UTC
+	agent  string
+	source string
+}
+
+type segment struct {
+	mu     sync.Mutex
+	key    partitionKey
+	seq    uint64
+	path   string
+	file   *os.File // nil once closed
+	size   int64
+	opened time.Time
+}
+
+// Buffer is safe for concurrent use
+type Buffer struct {
+	opts  Options
+	store Store
+
+	mu              sync.Mutex
+	open            map[partitionKey]*segment
+	pending         []*segment // closed segments waiting for upload, oldest first
+	seq             uint64
+	uploadedObjects int64
+	uploadFailures  int64
+	buffered        atomic.Int64 // bytes in open and pending segments
+	interval        time.Duration
+
+	uploadMu sync.Mutex // one upload pass at a time
+	wake     chan struct{}
+	stop     chan struct{}
+	done     chan struct{}
+}
+
+// New opens (or creates) the segment directory, queues any segments left by a previous run for
+// upload and starts the background roller.
+func New(store Store, opts Options) (*Buffer, error) {
+	if err := os.MkdirAll(opts.Dir, 0o755); err != nil {
+		return nil, fmt.Errorf("failed to create ingest directory: %w", err)
+	}
+	b := &Buffer{
+		opts:  opts,
+		store: store,
+		open:  make(map[partitionKey]*segment),
+		seq:   uint64(time.Now().UnixNano()),
+		wake:  make(chan struct{}, 1),
+		stop:  make(chan struct{}),
+		done:  make(chan struct{}),
+	}
+	b.interval = opts.MaxAge / 4
+	if b.interval <= 0 || b.interval > 5*time.Second {
+		b.interval = 5 * time.Second
+	}
+	if err := b.recover(); err != nil {
+		return nil, err
+	}
+	go b.run()
+	return b, nil
+}
+
+// Append durably adds NDJSON lines (each ending in '\n') to the agent/source partition of the
+// current hour. When it returns nil the data is on disk and will reach the store. It returns
+// ErrFull, without writing anything, while MaxBuffered bytes are waiting.
+func (b *Buffer) Append(agent, source string, lines []byte) error {
+	if len(lines) == 0 {
+		return nil
+	}
+	if b.opts.MaxBuffered > 0 && b.buffered.Load() >= b.opts.MaxBuffered {
+		b.signal() // make sure an upload pass is on its way
+		return ErrFull
+	}
+	key := partitionKey{
+		hour:   time.Now().UTC().Format("2006010215"),
+		agent:  sanitize(agent),
+		source: sanitize(source),
+	}
+
+	b.mu.Lock()
+	seg, err := b.segmentFor(key)
+	if err != nil {
+		b.mu.Unlock()
+		return err
+	}
+	seg.mu.Lock() // held across the write so a roll waits for it
+	b.mu.Unlock()
+
+	_, err = seg.file.Write(lines)
+	if err == nil {
+		err = seg.file.Sync()
+	}
+	if err == nil {
+		// Only acknowledged bytes count towards the roll threshold and MaxBuffered
+		seg.size += int64(len(lines))
+		b.buffered.Add(int64(len(lines)))
+	}
+	full := seg.size >= int64(b.opts.MaxBytes)
+	seg.mu.Unlock()
+
+	if err != nil {
+		// The segment may now end in a partial line; recovery drops it, but roll now so later
+		// records do not follow it.
+		b.roll(seg)
+		return fmt.Errorf("failed to write ingest segment: %w", err)
+	}
+	if full {
+		b.roll(seg)
+	}
+	return nil
+}
+
+// Stats returns a snapshot of the buffer counters
+func (b *Buffer) Stats() Stats {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+	s := Stats{
+		OpenSegments:    len(b.open),
+		PendingSegments: len(b.pending),
+		UploadedObjects: b.uploadedObjects,
+		UploadFailures:  b.uploadFailures,
+	}
+	for _, seg := range b.open {
+		seg.mu.Lock()
+		s.BufferedBytes += seg.size
+		seg.mu.Unlock()
+	}
+	for _, seg := range b.pending {
+		s.BufferedBytes += seg.size
+	}
+	return s
+}
+
+// RetryAfter is how long a sender turned away with ErrFull should wait: until the next upload
+// pass has had a go at the pending segments.
+func (b *Buffer) RetryAfter() time.Duration {
+	return b.interval
+}
+
+// Close rolls every open segment and makes one last upload attempt. Segments that could not be
+// uploaded stay on disk for the next start.
+func (b *Buffer) Close(ctx context.Context) {
+	close(b.stop)
+	<-b.done
+	b.rollAll(func(*segment) bool { return true })
+	b.uploadPending(ctx)
+}
+
+// segmentFor returns the open segment for key, creating its file if needed. Caller holds b.mu.
+func (b *Buffer) segmentFor(key partitionKey) (*segment, error) {
+	if seg, ok := b.open[key]; ok {
+		return seg, nil
+	}
+	b.seq++
+	seg := &segment{key: key, seq: b.seq, opened: time.Now()}
+	seg.path = filepath.Join(b.opts.Dir, segmentName(key, seg.seq))
+	f, err := os.OpenFile(seg.path, os.O_CREATE|os.O_WRONLY|os.O_APPEND, 0o644)
+	if err != nil {
+		return nil, fmt.Errorf("failed to create ingest segment: %w", err)
+	}
+	seg.file = f
+	b.open[key] = seg
+	return seg, nil
+}
+
+// roll closes seg and queues it for upload (no-op if it was already rolled)
+func (b *Buffer) roll(seg *segment) {
+	b.mu.Lock()
+	if b.open[seg.key] != seg {
+		b.mu.Unlock()
+		return
+	}
+	delete(b.open, seg.key)
+	b.mu.Unlock()
+
+	seg.mu.Lock()
+	seg.file.Close()
+	seg.file = nil
+	seg.mu.Unlock()
+
+	b.mu.Lock()
+	b.pending = append(b.pending, seg)
+	b.mu.Unlock()
+	b.signal()
+}
+
+func (b *Buffer) rollAll(due func(*segment) bool) {
+	b.mu.Lock()
+	var segs []*segment
+	for _, seg := range b.open {
+		if due(seg) {
+			segs = append(segs, seg)
+		}
+	}
+	b.mu.Unlock()
+	for _, seg := range segs {
+		b.roll(seg)
+	}
+}
+
+func (b *Buffer) signal() {
+	select {
+	case b.wake <- struct{}{}:
+	default:
+	}
+}
+
+func (b *Buffer) run() {
+	defer close(b.done)
+	ticker := time.NewTicker(b.interval)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case <-b.stop:
+			return
+		case <-ticker.C:
+			hour := time.Now().UTC().Format("2006010215")
+			b.rollAll(func(seg *segment) bool {
+				return seg.key.hour != hour || time.Since(seg.opened) >= b.opts.MaxAge
+			})
+		case <-b.wake:
+		}
+		b.uploadPending(context.Background())
+	}
+}
+
+// uploadPending uploads queued segments oldest first and stops at the first failure; the rest
+// are retried on the next tick.
+func (b *Buffer) uploadPending(ctx context.Context) {
+	b.uploadMu.Lock()
+	defer b.uploadMu.Unlock()
+
+	for {
+		b.mu.Lock()
+		if len(b.pending) == 0 {
+			b.mu.Unlock()
+			return
+		}
+		seg := b.pending[0]
+		b.mu.Unlock()
+
+		err := b.upload(ctx, seg)
+		if os.IsNotExist(err) {
+			log.Printf("⚠️  Ingest segment %s disappeared before upload, skipping it", seg.path)
+			b.mu.Lock()
+			b.pending = b.pending[1:]
+			b.mu.Unlock()
+			b.buffered.Add(-seg.size)
+			continue
+		}
+		if err != nil {
+			b.mu.Lock()
+			b.uploadFailures++
+			b.mu.Unlock()
+			log.Printf("⚠️  Ingest upload of %s failed, will retry: %v", filepath.Base(seg.path), err)
+			return
+		}
+
+		b.mu.Lock()
+		b.pending = b.pending[1:]
+		b.uploadedObjects++
+		b.mu.Unlock()
+		b.buffered.Add(-seg.size)
+	}
+}
+
+func (b *Buffer) upload(ctx context.Context, seg *segment) error {
+	data, err := os.ReadFile(seg.path)
+	if err != nil {
+		return err
+	}
+	// A crash mid-write can leave a partial last line; it was never acknowledged.
+	if i := bytes.LastIndexByte(data, '\n'); i+1 != len(data) {
+		data = data[:i+1]
+	}
+	if len(data) > 0 {
+		var body bytes.Buffer
+		body.Grow(len(data) / 4)
+		zw := gzip.NewWriter(&body)
+		if _, err := zw.Write(data); err != nil {
+			return err
+		}
+		if err := zw.Close(); err != nil {
+			return err
+		}
+		if err := b.store.PutObject(ctx, b.objectKey(seg), body.Bytes(), "application/x-ndjson", "gzip"); err != nil {
+			return err
+		}
+	}
+	if err := os.Remove(seg.path); err != nil && !os.IsNotExist(err) {
+		log.Printf("⚠️  Failed to remove uploaded ingest segment %s: %v", seg.path, err)
+	}
+	return nil
+}
+
+// objectKey places a segment under <prefix>YYYY/MM/DD/HH/<agent>/<source>/<seq>.ndjson.gz
+func (b *Buffer) objectKey(seg *segment) string {
+	h := seg.key.hour
+	return fmt.Sprintf("%s%s/%s/%s/%s/%s/%s/%d.ndjson.gz",
+		b.opts.Prefix, h[0:4], h[4:6], h[6:8], h[8:10], seg.key.agent, seg.key.source, seg.seq)
+}
+
+// recover queues the segment files of a previous run for upload
+func (b *Buffer) recover() error {
+	paths, err := filepath.Glob(filepath.Join(b.opts.Dir, "*.wal"))
+	if err != nil {
+		return err
+	}
+	for _, path := range paths {
+		key, seq, ok := parseSegmentName(filepath.Base(path))
+		if !ok {
+			log.Printf("⚠️  Ignoring unrecognised ingest segment %s", path)
+			continue
+		}
+		info, err := os.Stat(path)
+		if err != nil {
+			continue
+		}
+		b.pending = append(b.pending, &segment{key: key, seq: seq, path: path, size: info.Size()})
+		b.buffered.Add(info.Size())
+		if seq >= b.seq {
+			b.seq = seq + 1
+		}
+	}
+	if len(b.pending) > 0 {
+		log.Printf("Recovered %d ingest segment(s) from %s", len(b.pending), b.opts.Dir)
+		b.signal()
+	}
+	return nil
+}
+
+// segmentName is "<hour>~<agent>~<source>~<seq>.wal"; sanitize() keeps '~' out of the parts
+func segmentName(key partitionKey, seq uint64) string {
+	return fmt.Sprintf("%s~%s~%s~%d.wal", key.hour, key.agent, key.source, seq)
+}
+
+func parseSegmentName(name string) (partitionKey, uint64, bool) {
+	parts := strings.Split(strings.TrimSuffix(name, ".wal"), "~")
+	if len(parts) != 4 || len(parts[0]) != 10 {
+		return partitionKey{}, 0, false
+	}
+	seq, err := strconv.ParseUint(parts[3], 10, 64)
+	if err != nil {
+		return partitionKey{}, 0, false
+	}
+	return partitionKey{hour: parts[0], agent: parts[1], source: parts[2]}, seq, true
+}
+
+// sanitize keeps a partition name safe for both file names and object keys
+func sanitize(name string) string {
+	if name == "" {
+		return "unknown"
+	}
+	out := []byte(name)
+	for i, c := range out {
+		ok := c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c >= '0' && c <= '9' || c == '-' || c == '_' || c == '.'
+		if !ok {
+			out[i] = '_'
+		}
+	}
+	if len(out) > 64 {
+		out = out[:64]
+	}
+	return string(out)
+}
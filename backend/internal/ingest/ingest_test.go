@@ -0,0 +1,297 @@
+package ingest
+
+import (
+	"bytes"
+	"compress/gzip"
+	"context"
+	"errors"
+	"io"
+	"os"
+	"path/filepath"
+	"regexp"
+	"strings"
+	"sync"
+	"testing"
+	"time"
+
+	"backend/internal/aws"
+)
+
+// testStore keeps what reaches it (decompressed) so the tests can check it. With
+// INGEST_TEST_S3_ENDPOINT and INGEST_TEST_S3_BUCKET set, every object is also stored in that
+// S3-compatible stand-in, e.g. MinIO from `docker compose --profile local-s3 up minio` with
+// INGEST_TEST_S3_ENDPOINT=http://localhost:9000 and the MinIO credentials in AWS_ACCESS_KEY_ID
+// and AWS_SECRET_ACCESS_KEY.
+type testStore struct {
+	next Store
+
+	mu      sync.Mutex
+	fail    bool
+	objects map[string]string
+}
+
+func newTestStore(t *testing.T) *testStore {
+	s := &testStore{objects: make(map[string]string)}
+	endpoint := os.Getenv("INGEST_TEST_S3_ENDPOINT")
+	if endpoint == "" {
+		return s
+	}
+	bucket := os.Getenv("INGEST_TEST_S3_BUCKET")
+	if bucket == "" {
+		t.Fatal("INGEST_TEST_S3_ENDPOINT is set but INGEST_TEST_S3_BUCKET is not")
+	}
+	region := os.Getenv("AWS_REGION")
+	if region == "" {
+		region = "us-east-1"
+	}
+	client, err := aws.NewS3Client(context.Background(), region, bucket, endpoint)
+	if err != nil {
+		t.Fatalf("S3 stand-in: %v", err)
+	}
+	s.next = client
+	return s
+}
+
+func (s *testStore) PutObject(ctx context.Context, key string, body []byte, contentType, contentEncoding string) error {
+	s.mu.Lock()
+	fail := s.fail
+	s.mu.Unlock()
+	if fail {
+		return errors.New("store unavailable")
+	}
+	if contentType != "application/x-ndjson" || contentEncoding != "gzip" {
+		return errors.New("unexpected content type " + contentType + " / " + contentEncoding)
+	}
+	zr, err := gzip.NewReader(bytes.NewReader(body))
+	if err != nil {
+		return err
+	}
+	data, err := io.ReadAll(zr)
+	if err != nil {
+		return err
+	}
+	if s.next != nil {
+		if err := s.next.PutObject(ctx, key, body, contentType, contentEncoding); err != nil {
+			return err
+		}
+	}
+	s.mu.Lock()
+	s.objects[key] = string(data)
+	s.mu.Unlock()
+	return nil
+}
+
+func (s *testStore) setFail(fail bool) {
+	s.mu.Lock()
+	s.fail = fail
+	s.mu.Unlock()
+}
+
+func (s *testStore) snapshot() map[string]string {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	out := make(map[string]string, len(s.objects))
+	for k, v := range s.objects {
+		out[k] = v
+	}
+	return out
+}
+
+func waitFor(t *testing.T, what string, cond func() bool) {
+	t.Helper()
+	deadline := time.Now().Add(5 * time.Second)
+	for !cond() {
+		if time.Now().After(deadline) {
+			t.Fatalf("timed out waiting for %s", what)
+		}
+		time.Sleep(10 * time.Millisecond)
+	}
+}
+
+func walFiles(t *testing.T, dir string) []string {
+	t.Helper()
+	paths, err := filepath.Glob(filepath.Join(dir, "*.wal"))
+	if err != nil {
+		t.Fatal(err)
+	}
+	return paths
+}
+
+var objectKeyPattern = regexp.MustCompile(`^logs/agg/\d{4}/\d{2}/\d{2}/\d{2}/agent-1/upload/\d+\.ndjson\.gz$`)
+
+func TestAppendRollsAtMaxBytes(t *testing.T) {
+	store := newTestStore(t)
+	dir := t.TempDir()
+	b, err := New(store, Options{Dir: dir, Prefix: "logs/agg/", MaxBytes: 100, MaxAge: time.Hour})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer b.Close(context.Background())
+
+	line := `{"log":"` + strings.Repeat("x", 30) + `"}` + "\n"
+	for i := 0; i < 2; i++ {
+		if err := b.Append("agent-1", "upload", []byte(line)); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if s := b.Stats(); s.OpenSegments != 1 || s.BufferedBytes != int64(2*len(line)) {
+		t.Fatalf("after two appends: %+v", s)
+	}
+	if got := len(store.snapshot()); got != 0 {
+		t.Fatalf("%d objects uploaded below MaxBytes", got)
+	}
+
+	// The third line takes the segment past MaxBytes: it is rolled and uploaded as one object
+	if err := b.Append("agent-1", "upload", []byte(line)); err != nil {
+		t.Fatal(err)
+	}
+	waitFor(t, "the rolled segment to be uploaded", func() bool { return b.Stats().UploadedObjects == 1 })
+	objects := store.snapshot()
+	if len(objects) != 1 {
+		t.Fatalf("want one object, got %v", objects)
+	}
+	for key, data := range objects {
+		if !objectKeyPattern.MatchString(key) {
+			t.Errorf("object key %q is not hour-partitioned per agent and source", key)
+		}
+		if data != strings.Repeat(line, 3) {
+			t.Errorf("object holds %q", data)
+		}
+	}
+	if s := b.Stats(); s.OpenSegments != 0 || s.PendingSegments != 0 || s.BufferedBytes != 0 {
+		t.Fatalf("after upload: %+v", s)
+	}
+	if files := walFiles(t, dir); len(files) != 0 {
+		t.Fatalf("uploaded segment left on disk: %v", files)
+	}
+}
+
+func TestFailedWriteIsNotCounted(t *testing.T) {
+	b, err := New(newTestStore(t), Options{Dir: t.TempDir(), Prefix: "logs/agg/", MaxBytes: 1 << 20, MaxAge: time.Hour})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer b.Close(context.Background())
+
+	if err := b.Append("agent-1", "upload", []byte("{}\n")); err != nil {
+		t.Fatal(err)
+	}
+	// Make the next write fail
+	b.mu.Lock()
+	var seg *segment
+	for _, s := range b.open {
+		seg = s
+	}
+	b.mu.Unlock()
+	seg.mu.Lock()
+	seg.file.Close()
+	seg.mu.Unlock()
+
+	if err := b.Append("agent-1", "upload", []byte(`{"log":"lost"}`+"\n")); err == nil {
+		t.Fatal("append to a closed segment succeeded")
+	}
+	seg.mu.Lock()
+	size := seg.size
+	seg.mu.Unlock()
+	if size != 3 {
+		t.Fatalf("segment size %d after a failed write, want only the 3 written bytes", size)
+	}
+	// The written part is still uploaded, after which nothing may be left counted
+	waitFor(t, "the buffered count to drain", func() bool { return b.buffered.Load() == 0 })
+}
+
+func TestBackpressureAndRetryAfterStoreOutage(t *testing.T) {
+	store := newTestStore(t)
+	store.setFail(true)
+	dir := t.TempDir()
+	b, err := New(store, Options{Dir: dir, Prefix: "logs/agg/", MaxBytes: 10, MaxAge: time.Hour, MaxBuffered: 10})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer b.Close(context.Background())
+
+	line := []byte(`{"log":"outage"}` + "\n")
+	if err := b.Append("agent-1", "upload", line); err != nil {
+		t.Fatal(err)
+	}
+	waitFor(t, "a failed upload", func() bool { return b.Stats().UploadFailures > 0 })
+	if err := b.Append("agent-1", "upload", line); !errors.Is(err, ErrFull) {
+		t.Fatalf("append while the store is down: %v, want ErrFull", err)
+	}
+	if files := walFiles(t, dir); len(files) != 1 {
+		t.Fatalf("segment waiting for the store should stay on disk, have %v", files)
+	}
+
+	store.setFail(false)
+	b.signal()
+	waitFor(t, "the retried upload", func() bool { return b.Stats().UploadedObjects == 1 })
+	if err := b.Append("agent-1", "upload", line); err != nil {
+		t.Fatalf("append after the store came back: %v", err)
+	}
+}
+
+func TestRecoverUploadsSegmentsOfPreviousRun(t *testing.T) {
+	dir := t.TempDir()
+	down := newTestStore(t)
+	down.setFail(true)
+	crashed, err := New(down, Options{Dir: dir, Prefix: "logs/agg/", MaxBytes: 1 << 20, MaxAge: time.Hour})
+	if err != nil {
+		t.Fatal(err)
+	}
+	acked := `{"log":"one"}` + "\n" + `{"log":"two"}` + "\n"
+	if err := crashed.Append("agent-1", "upload", []byte(acked)); err != nil {
+		t.Fatal(err)
+	}
+	files := walFiles(t, dir)
+	if len(files) != 1 {
+		t.Fatalf("want one segment file, have %v", files)
+	}
+	// A crash in the middle of a write leaves a partial line that was never acknowledged
+	f, err := os.OpenFile(files[0], os.O_WRONLY|os.O_APPEND, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	f.WriteString(`{"log":"tor`)
+	f.Close()
+
+	store := newTestStore(t)
+	b, err := New(store, Options{Dir: dir, Prefix: "logs/agg/", MaxBytes: 1 << 20, MaxAge: time.Hour})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer b.Close(context.Background())
+	waitFor(t, "the recovered segment to be uploaded", func() bool { return b.Stats().UploadedObjects == 1 })
+	for key, data := range store.snapshot() {
+		if !objectKeyPattern.MatchString(key) {
+			t.Errorf("object key %q", key)
+		}
+		if data != acked {
+			t.Errorf("recovered object holds %q, want %q", data, acked)
+		}
+	}
+	if files := walFiles(t, dir); len(files) != 0 {
+		t.Fatalf("recovered segment left on disk: %v", files)
+	}
+	crashed.Close(context.Background()) // its segment is gone; nothing to do
+}
+
+func TestCloseRollsOpenSegments(t *testing.T) {
+	store := newTestStore(t)
+	dir := t.TempDir()
+	b, err := New(store, Options{Dir: dir, Prefix: "logs/agg/", MaxBytes: 1 << 20, MaxAge: time.Hour})
+	if err != nil {
+		t.Fatal(err)
+	}
+	for _, source := range []string{"upload", "batch"} {
+		if err := b.Append("agent-1", source, []byte(`{"log":"`+source+`"}`+"\n")); err != nil {
+			t.Fatal(err)
+		}
+	}
+	b.Close(context.Background())
+	if got := len(store.snapshot()); got != 2 {
+		t.Fatalf("Close uploaded %d objects, want one per partition", got)
+	}
+	if files := walFiles(t, dir); len(files) != 0 {
+		t.Fatalf("Close left segments on disk: %v", files)
+	}
+}
@@ -0,0 +1,92 @@
+package logging
+
+import (
+	"encoding/json"
+	"errors"
+	"fmt"
+	"os"
+	"path/filepath"
+	"sync"
+	"time"
+)
+
+// Cursor remembers the timestamp of the newest log entry that has been uploaded, so each
+// collection run only fetches what came after it. It is persisted as a small JSON file.
+type Cursor struct {
+	mu   sync.Mutex
+	path string
+	last time.Time
+}
+
+type cursorFile struct {
+	LastTimestamp time.Time `json:"last_timestamp"`
+}
+
+// LoadCursor reads the cursor file at path. A missing file yields an empty cursor.
+func LoadCursor(path string) (*Cursor, error) {
+	c := &Cursor{path: path}
+	data, err := os.ReadFile(path)
+	if errors.Is(err, os.ErrNotExist) {
+		return c, nil
+	}
+	if err != nil {
+		return c, fmt.Errorf("failed to read log cursor: %w", err)
+	}
+	var f cursorFile
+	if err := json.Unmarshal(data, &f); err != nil {
+		return c, fmt.Errorf("failed to parse log cursor %s: %w", path, err)
+	}
+	c.last = f.LastTimestamp
+	return c, nil
+}
+
+// Since returns where the next run should start: the last uploaded entry, or now minus
+// lookback when nothing has been uploaded yet.
+func (c *Cursor) Since(lookback time.Duration) time.Time {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	if c.last.IsZero() {
+		return time.Now().Add(-lookback)
+	}
+	return c.last
+}
+
+// Advance moves the cursor forward to t and persists it. Older timestamps are ignored.
+func (c *Cursor) Advance(t time.Time) error {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	if !t.After(c.last) {
+		return nil
+	}
+	c.last = t
+	return c.save()
+}
+
+// save writes the cursor through a temporary file so a crash never leaves it half written.
+func (c *Cursor) save() error {
+	if c.path == "" {
+		return nil
+	}
+	data, err := json.Marshal(cursorFile{LastTimestamp: c.last})
+	if err != nil {
+		return err
+	}
+	tmp, err := os.CreateTemp(filepath.Dir(c.path), filepath.Base(c.path)+".*")
+	if err != nil {
+		return fmt.Errorf("failed to save log cursor: %w", err)
+	}
+	if _, err := tmp.Write(data); err != nil {
+		tmp.Close()
+		os.Remove(tmp.Name())
+		return fmt.Errorf("failed to save log cursor: %w", err)
+	}
+	if err := tmp.Close(); err != nil {
+		os.Remove(tmp.Name())
+		return fmt.Errorf("failed to save log cursor: %w", err)
+	}
+	if err := os.Rename(tmp.Name(), c.path); err != nil {
+		os.Remove(tmp.Name())
+		return fmt.Errorf("failed to save log cursor: %w", err)
+	}
+	return nil
+}
@@ -2,10 +2,11 @@ package logging
 
 import (
 	"bufio"
+	"bytes"
+	"context"
 	"fmt"
 	"os/exec"
 	"runtime"
-	"strings"
 	"time"
 
 	"backend/internal/constants"
@@ -38,48 +39,142 @@ func StreamLogs() {
 	cmd.Wait()
 }
 
-func FetchLogs(lastPeriodLength int) string {
-	var cmd *exec.Cmd
-	var output []byte
-	var err error
+// LogChunk is a run of whole log entries handed to the uploader.
+type LogChunk struct {
+	Data []byte    // newline-terminated entries; empty when only the cursor moves
+	Last time.Time // newest entry in Data, or the newest event examined if that is later
+}
 
-	if runtime.GOOS == "windows" {
-		// Windows: Fetch limited network events
-		minutesAgo := time.Now().Add(-time.Duration(lastPeriodLength) * time.Minute).Format("2006-01-02T15:04:05")
-		psScript := fmt.Sprintf(constants.WindowsFetchLogsScriptTemplate, minutesAgo)
+// FetchLogsSince streams the network log entries newer than since and passes them to handle in
+// chunks of about chunkBytes, each ending on an entry boundary, so the output is never held in
+// memory as a whole. If handle fails the log command is stopped and the error returned; chunks
+// handled before that stay handled, so the caller can advance its cursor chunk by chunk.
+func FetchLogsSince(ctx context.Context, since time.Time, chunkBytes int, handle func(LogChunk) error) error {
+	ctx, cancel := context.WithCancel(ctx)
+	defer cancel()
 
-		cmd = exec.Command("powershell", "-Command", psScript)
-		output, err = cmd.CombinedOutput()
+	var cmd *exec.Cmd
+	var parseTime func(line []byte) (time.Time, bool)
 
-		if err != nil {
-			fmt.Printf("Error fetching Windows logs: %v\n", err)
-			return ""
-		}
+	if runtime.GOOS == "windows" {
+		// Windows: events after the cursor, oldest first, one line each
+		psScript := fmt.Sprintf(constants.WindowsFetchLogsScriptTemplate,
+			since.Format("2006-01-02T15:04:05.0000000Z07:00"), constants.WindowsMaxEvents)
+		cmd = exec.CommandContext(ctx, "powershell", "-Command", psScript)
+		parseTime = parseWindowsLogTime
 	} else {
-		// macOS: Fetch logs with compact format and limit output
-		period := fmt.Sprintf("%dm", lastPeriodLength)
-		cmd = exec.Command(
+		// macOS: compact entries from the cursor (whole seconds) onwards
+		cmd = exec.CommandContext(ctx,
 			constants.MacOSLogStreamCommand,
 			constants.MacOSLogShowAction,
 			"--predicate", constants.MacOSLogPredicate,
 			"--style", constants.MacOSLogStyleCompact,
-			"--last", period,
+			"--start", since.Local().Format("2006-01-02 15:04:05"),
 		)
-		output, err = cmd.CombinedOutput()
+		parseTime = parseMacOSLogTime
+	}
 
-		if err != nil {
-			fmt.Printf("Error fetching macOS logs: %v\n", err)
-			return ""
+	stdout, err := cmd.StdoutPipe()
+	if err != nil {
+		return fmt.Errorf("failed to open log command output: %w", err)
+	}
+	var stderr bytes.Buffer
+	cmd.Stderr = &stderr
+	if err := cmd.Start(); err != nil {
+		return fmt.Errorf("failed to start log command: %w", err)
+	}
+
+	chunk := make([]byte, 0, chunkBytes)
+	var chunkLast, scanned time.Time
+	entries, uploaded := 0, 0
+	keep := false
+	flush := func(last time.Time) error {
+		if err := handle(LogChunk{Data: chunk, Last: last}); err != nil {
+			return err
 		}
+		uploaded += len(chunk)
+		chunk = chunk[:0]
+		return nil
+	}
 
-		// Limit macOS logs to configured max lines
-		lines := strings.Split(string(output), "\n")
-		if len(lines) > constants.MaxLogLines {
-			lines = lines[len(lines)-constants.MaxLogLines:]
+	var runErr error
+	scanner := bufio.NewScanner(stdout)
+	scanner.Buffer(make([]byte, 64*1024), constants.MaxLogLineBytes)
+	for scanner.Scan() {
+		line := scanner.Bytes()
+		if rest, ok := bytes.CutPrefix(line, []byte(constants.WindowsScannedMarker)); ok {
+			if t, err := time.Parse(time.RFC3339Nano, string(rest)); err == nil {
+				scanned = t
+			}
+			continue
+		}
+		if t, ok := parseTime(line); ok {
+			// A new entry. Entries at or before the cursor were uploaded by an earlier run.
+			keep = t.After(since)
+			if !keep {
+				continue
+			}
+			// Split only where the timestamp changes, so a cursor never falls inside a group
+			// of entries sharing one.
+			if len(chunk) > 0 && len(chunk)+len(line)+1 > chunkBytes && t.After(chunkLast) {
+				if runErr = flush(chunkLast); runErr != nil {
+					break
+				}
+			}
+			chunkLast = t
+			entries++
+		} else if !keep {
+			continue // header, or continuation of a skipped entry
 		}
-		output = []byte(strings.Join(lines, "\n"))
+		chunk = append(chunk, line...)
+		chunk = append(chunk, '\n')
 	}
+	if runErr == nil {
+		runErr = scanner.Err()
+	}
+	if runErr != nil {
+		cancel()
+	}
+	waitErr := cmd.Wait()
+	if runErr != nil {
+		return runErr
+	}
+	if waitErr != nil {
+		// What was read is not uploaded; the cursor stays put and the next run fetches it again.
+		return fmt.Errorf("log command failed: %w: %s", waitErr, bytes.TrimSpace(stderr.Bytes()))
+	}
+
+	last := chunkLast
+	if scanned.After(last) {
+		last = scanned
+	}
+	if len(chunk) > 0 || scanned.After(chunkLast) {
+		if err := flush(last); err != nil {
+			return err
+		}
+	}
+
+	fmt.Printf("Fetched %d new log entries (%d bytes) from %s since %s\n",
+		entries, uploaded, runtime.GOOS, since.Format(time.RFC3339))
+	return nil
+}
 
-	fmt.Printf("Fetched %d bytes of logs from %s (last %d minutes)\n", len(output), runtime.GOOS, lastPeriodLength)
-	return string(output)
+// parseMacOSLogTime reads the "2006-01-02 15:04:05.000" local timestamp starting a compact entry.
+func parseMacOSLogTime(line []byte) (time.Time, bool) {
+	const layout = "2006-01-02 15:04:05.000"
+	if len(line) < len(layout) || line[0] < '0' || line[0] > '9' {
+		return time.Time{}, false
+	}
+	t, err := time.ParseInLocation(layout, string(line[:len(layout)]), time.Local)
+	return t, err == nil
+}
+
+// parseWindowsLogTime reads the round-trip timestamp starting each line of the PowerShell output.
+func parseWindowsLogTime(line []byte) (time.Time, bool) {
+	field, _, _ := bytes.Cut(line, []byte(" "))
+	if len(field) == 0 || field[0] < '0' || field[0] > '9' {
+		return time.Time{}, false
+	}
+	t, err := time.Parse(time.RFC3339Nano, string(field))
+	return t, err == nil
 }
@@ -7,8 +7,8 @@ import (
 	"backend/internal/handlers"
 )
 
-// SetupRoutes configures all application routes
-func SetupRoutes(r *gin.Engine, secret []byte) {
+// SetupRoutes configures all application routes; at most maxUploads log uploads are handled at once
+func SetupRoutes(r *gin.Engine, secret []byte, maxUploads int) {
 	// Health check
 	r.GET("/", func(c *gin.Context) {
 		c.JSON(200, gin.H{"Kaimz Agent is currently running.": "ok"})
@@ -31,8 +31,10 @@ func SetupRoutes(r *gin.Engine, secret []byte) {
 		// Example protected endpoint - returns user info from JWT
 		api.GET("/me", handlers.GetCurrentUser())
 
-		// S3 Log upload endpoints
-		api.POST("/logs/upload", handlers.UploadLog())
+		// S3 Log upload endpoints, sharing one concurrency limit
+		uploads := handlers.LimitUploads(maxUploads)
+		api.POST("/logs/upload", uploads, handlers.UploadLog())
+		api.POST("/logs/batch", uploads, handlers.UploadLogBatch())
 		api.GET("/logs", handlers.ListLogs())
 
 		// Any other protected routes go here
@@ -1,35 +1,72 @@
 package scheduler
 
 import (
+	"bytes"
 	"context"
+	"fmt"
 	"log"
+	"sync"
 	"time"
 
 	"backend/internal/aws"
+	"backend/internal/constants"
 	"backend/internal/logging"
 )
 
-// FetchAndUploadLogs fetches network logs and uploads them to S3
+var (
+	// fetchMu keeps the start-up fetch and ticker runs from overlapping
+	fetchMu sync.Mutex
+	cursor  *logging.Cursor
+)
+
+// FetchAndUploadLogs fetches the network logs written since the last run and uploads them to S3
+// in chunks, advancing the persisted cursor after each successful upload
 func FetchAndUploadLogs(ctx context.Context, s3Client *aws.S3Client) {
+	if !fetchMu.TryLock() {
+		log.Println("⚠️  Previous log fetch still running, skipping this one")
+		return
+	}
+	defer fetchMu.Unlock()
+
 	log.Println("🔄 Fetching network logs...")
-	logs := logging.FetchLogs(60) // Fetch last 60 minutes of logs
+	since := cursor.Since(constants.DefaultLogLookback)
+	stamp := time.Now().Format("2006-01-02_15-04-05")
+	part := 0
 
-	if logs != "" {
-		url, err := s3Client.UploadLog(ctx, logs)
-		if err != nil {
-			log.Printf("❌ Failed to upload logs to S3: %v", err)
-		} else {
+	err := logging.FetchLogsSince(ctx, since, constants.MaxLogChunkBytes, func(chunk logging.LogChunk) error {
+		if len(chunk.Data) > 0 {
+			key := fmt.Sprintf("logs/%s_%03d.log", stamp, part)
+			url, _, err := s3Client.UploadStream(ctx, key, bytes.NewReader(chunk.Data), "text/plain")
+			if err != nil {
+				return err
+			}
+			part++
 			log.Printf("✅ Logs uploaded to S3: %s", url)
 		}
-	} else {
-		log.Println("⚠️  No logs fetched")
+		if err := cursor.Advance(chunk.Last); err != nil {
+			log.Printf("⚠️  %v", err)
+		}
+		return nil
+	})
+
+	if err != nil {
+		log.Printf("❌ Failed to fetch or upload logs: %v", err)
+	} else if part == 0 {
+		log.Println("⚠️  No new logs fetched")
 	}
 }
 
 // StartLogScheduler starts the log fetching routine
 // If runOnce is true, fetches logs once and stops
 // If runOnce is false, fetches logs immediately then every interval
-func StartLogScheduler(ctx context.Context, s3Client *aws.S3Client, interval time.Duration, runOnce bool) {
+// cursorPath is where the last uploaded log timestamp is kept between runs and restarts
+func StartLogScheduler(ctx context.Context, s3Client *aws.S3Client, interval time.Duration, runOnce bool, cursorPath string) {
+	var err error
+	cursor, err = logging.LoadCursor(cursorPath)
+	if err != nil {
+		log.Printf("⚠️  %v; starting from the last %v", err, constants.DefaultLogLookback)
+	}
+
 	// Fetch logs immediately on startup
 	go FetchAndUploadLogs(ctx, s3Client)
 
@@ -7,27 +7,47 @@ import (
 	"backend/config"
 	"backend/internal/aws"
 	"backend/internal/handlers"
+	"backend/internal/ingest"
 	"backend/internal/scheduler"
 	"time"
 )
 
 // InitializeS3AndScheduler initializes S3 client and starts log scheduler
-func InitializeS3AndScheduler(cfg *config.Config, interval time.Duration, runOnce bool) {
+// Returns the ingest buffer (nil when there is none) so the caller can close it on shutdown
+func InitializeS3AndScheduler(cfg *config.Config, interval time.Duration, runOnce bool) *ingest.Buffer {
 	if cfg.S3Bucket == "" {
-		return
+		return nil
 	}
 
 	ctx := context.Background()
-	s3Client, err := aws.NewS3Client(ctx, cfg.AWSRegion, cfg.S3Bucket)
+	s3Client, err := aws.NewS3Client(ctx, cfg.AWSRegion, cfg.S3Bucket, cfg.S3Endpoint)
 	if err != nil {
 		log.Printf("Warning: Failed to initialize S3 client: %v", err)
-		return
+		return nil
 	}
 
 	// Set S3 client for API handlers
 	handlers.SetS3Client(s3Client)
 	log.Printf("S3 client initialized for bucket: %s", cfg.S3Bucket)
 
+	// Aggregate uploads into hour-partitioned objects; without it every upload is its own PUT
+	buffer, err := ingest.New(s3Client, ingest.Options{
+		Dir:         cfg.IngestDir,
+		Prefix:      "logs/agg/",
+		MaxBytes:    cfg.IngestMaxBytes,
+		MaxAge:      cfg.IngestMaxAge,
+		MaxBuffered: cfg.IngestMaxBuffered,
+	})
+	if err != nil {
+		log.Printf("Warning: Failed to initialize ingest buffer, storing uploads directly: %v", err)
+		buffer = nil
+	} else {
+		handlers.SetIngestBuffer(buffer)
+		log.Printf("Ingest buffer in %s (roll at %d bytes or %v, refuse uploads past %d MiB waiting)",
+			cfg.IngestDir, cfg.IngestMaxBytes, cfg.IngestMaxAge, cfg.IngestMaxBuffered>>20)
+	}
+
 	// Start log fetching scheduler
-	scheduler.StartLogScheduler(ctx, s3Client, interval, runOnce)
+	scheduler.StartLogScheduler(ctx, s3Client, interval, runOnce, cfg.LogCursorFile)
+	return buffer
 }
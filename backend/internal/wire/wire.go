@@ -0,0 +1,213 @@
+// Package wire decodes the compact binary batch format sent by the FIM agents
+// (Content-Type application/x-fim-binary). The encoder and the full format description
+// live in fim/wire_format.h; keep the two in step.
+package wire
+
+import (
+	"bytes"
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"time"
+)
+
+// ContentType identifies a binary batch body
+const ContentType = "application/x-fim-binary"
+
+// Version is the current schema version; frames of version 1 (events without the raw utc_time
+// string) are still accepted from older agents
+const Version = 2
+
+var magic = []byte("FIMB")
+
+// Record types
+const (
+	TypeLog   = 1
+	TypeEvent = 2
+)
+
+// maxTableEntries bounds the per-frame string table so a hostile frame cannot grow it without
+// limit; the agent's writer stops interning at the same count (kWireMaxInterned)
+const maxTableEntries = 1 << 16
+
+// Event holds the structured fields of an event record
+type Event struct {
+	EventID     uint16 `json:"event_id"`
+	UtcTime     string `json:"utc_time,omitempty"`
+	Computer    string `json:"computer,omitempty"`
+	Channel     string `json:"channel,omitempty"`
+	Image       string `json:"image,omitempty"`
+	Target      string `json:"target,omitempty"`
+	ProcessGUID string `json:"process_guid,omitempty"`
+	Hashes      string `json:"hashes,omitempty"`
+	User        string `json:"user,omitempty"`
+}
+
+// Record is one decoded record; Event is set for TypeEvent records
+type Record struct {
+	Type     int
+	Filename string
+	Log      string
+	Event    *Event
+}
+
+// LogText returns the text stored as the record's log: the raw log, or the event as compact JSON
+func (r Record) LogText() (string, error) {
+	if r.Event == nil {
+		return r.Log, nil
+	}
+	// Keep <, > and & as-is so the text matches what the agent produces for JSON uploads
+	var buf bytes.Buffer
+	encoder := json.NewEncoder(&buf)
+	encoder.SetEscapeHTML(false)
+	if err := encoder.Encode(r.Event); err != nil {
+		return "", err
+	}
+	return string(bytes.TrimRight(buf.Bytes(), "\n")), nil
+}
+
+// IsFrame reports whether body starts with the binary frame header
+func IsFrame(body []byte) bool {
+	return len(body) >= len(magic)+1 && bytes.Equal(body[:len(magic)], magic)
+}
+
+type reader struct {
+	buf     []byte
+	pos     int
+	table   []string
+	version byte
+}
+
+func (r *reader) uvarint() (uint64, error) {
+	value, n := binary.Uvarint(r.buf[r.pos:])
+	if n <= 0 {
+		return 0, errors.New("bad varint")
+	}
+	r.pos += n
+	return value, nil
+}
+
+func (r *reader) str() (string, error) {
+	tag, err := r.uvarint()
+	if err != nil {
+		return "", err
+	}
+	switch {
+	case tag == 0:
+		return "", nil
+	case tag >= 3:
+		index := tag - 3
+		if index >= uint64(len(r.table)) {
+			return "", fmt.Errorf("string reference %d out of range", index)
+		}
+		return r.table[index], nil
+	}
+	length, err := r.uvarint()
+	if err != nil {
+		return "", err
+	}
+	if length > uint64(len(r.buf)-r.pos) {
+		return "", errors.New("string runs past end of record")
+	}
+	value := string(r.buf[r.pos : r.pos+int(length)])
+	r.pos += int(length)
+	if tag == 2 {
+		if len(r.table) >= maxTableEntries {
+			return "", errors.New("string table too large")
+		}
+		r.table = append(r.table, value)
+	}
+	return value, nil
+}
+
+// Decode parses a complete frame into its records
+func Decode(body []byte) ([]Record, error) {
+	if !IsFrame(body) {
+		return nil, errors.New("not a binary batch frame")
+	}
+	version := body[len(magic)]
+	if version < 1 || version > Version {
+		return nil, fmt.Errorf("unsupported wire version %d", version)
+	}
+
+	frame := &reader{buf: body, pos: len(magic) + 1, version: version}
+	var records []Record
+	for frame.pos < len(frame.buf) {
+		length, err := frame.uvarint()
+		if err != nil {
+			return nil, fmt.Errorf("record %d: %w", len(records)+1, err)
+		}
+		if length > uint64(len(frame.buf)-frame.pos) {
+			return nil, fmt.Errorf("record %d: length exceeds body", len(records)+1)
+		}
+		end := frame.pos + int(length)
+		// Each record is bounded by its length prefix; the string table carries across records
+		rec := &reader{buf: frame.buf[:end], pos: frame.pos, table: frame.table, version: version}
+		record, err := decodeRecord(rec)
+		if err != nil {
+			return nil, fmt.Errorf("record %d: %w", len(records)+1, err)
+		}
+		frame.table = rec.table
+		frame.pos = end
+		records = append(records, record)
+	}
+	return records, nil
+}
+
+func decodeRecord(r *reader) (Record, error) {
+	recordType, err := r.uvarint()
+	if err != nil {
+		return Record{}, err
+	}
+
+	record := Record{Type: int(recordType)}
+	switch recordType {
+	case TypeLog:
+		if record.Filename, err = r.str(); err != nil {
+			return Record{}, err
+		}
+		if record.Log, err = r.str(); err != nil {
+			return Record{}, err
+		}
+	case TypeEvent:
+		if record.Filename, err = r.str(); err != nil {
+			return Record{}, err
+		}
+		event := &Event{}
+		eventID, err := r.uvarint()
+		if err != nil {
+			return Record{}, err
+		}
+		if eventID > 0xFFFF {
+			return Record{}, fmt.Errorf("event id %d out of range", eventID)
+		}
+		event.EventID = uint16(eventID)
+		millis, err := r.uvarint()
+		if err != nil {
+			return Record{}, err
+		}
+		var rawTime string
+		if r.version >= 2 {
+			// The agent's time text, sent when it could not turn it into millis
+			if rawTime, err = r.str(); err != nil {
+				return Record{}, err
+			}
+		}
+		if millis != 0 {
+			event.UtcTime = time.UnixMilli(int64(millis)).UTC().Format("2006-01-02 15:04:05.000")
+		} else {
+			event.UtcTime = rawTime
+		}
+		for _, field := range []*string{&event.Computer, &event.Channel, &event.Image, &event.Target,
+			&event.ProcessGUID, &event.Hashes, &event.User} {
+			if *field, err = r.str(); err != nil {
+				return Record{}, err
+			}
+		}
+		record.Event = event
+	default:
+		return Record{}, fmt.Errorf("unknown record type %d", recordType)
+	}
+	return record, nil
+}
@@ -0,0 +1,188 @@
+package wire
+
+import (
+	"encoding/binary"
+	"os"
+	"reflect"
+	"strconv"
+	"strings"
+	"testing"
+)
+
+// testdata/agent_frame.bin is written by the agent's WireWriter:
+//
+//	fim_replay <fim_config.yml> --wire-fixture backend/internal/wire/testdata/agent_frame.bin
+//
+// (see run_wire_fixture in fim/fim_replay.cpp, which builds exactly these records)
+var agentRecords = []Record{
+	{Type: TypeEvent, Filename: "events", Event: &Event{
+		EventID:     11,
+		UtcTime:     "2025-11-17 10:15:30.123",
+		Computer:    "WS-01.corp.example",
+		Channel:     "Microsoft-Windows-Sysmon/Operational",
+		Image:       `C:\Windows\explorer.exe`,
+		Target:      `\\fs01\share\Finance\Q3 "plan".xlsx`,
+		ProcessGUID: "{5770385f-c22a-43e0-bf4c-06f5698ffbd9}",
+		Hashes:      "SHA256=0123456789ABCDEF",
+		User:        `CORP\alice`,
+	}},
+	{Type: TypeLog, Filename: "fim.log", Log: `[HASH] changed C:\Temp\a.txt ✓`},
+	// Every interned value repeats (sent as table references); the time did not parse and is
+	// passed through as text
+	{Type: TypeEvent, Filename: "events", Event: &Event{
+		EventID:     23,
+		UtcTime:     "17/11/2025 10:15:31",
+		Computer:    "WS-01.corp.example",
+		Channel:     "Microsoft-Windows-Sysmon/Operational",
+		Image:       `C:\Windows\explorer.exe`,
+		Target:      `\\fs01\share\Finance\résumé.docx`,
+		ProcessGUID: "{5770385f-c22a-43e0-bf4c-06f5698ffbd9}",
+		User:        `CORP\alice`,
+	}},
+	{Type: TypeEvent, Filename: "events", Event: &Event{EventID: 2, Target: `C:\Temp\a.txt`}},
+	{Type: TypeLog},
+}
+
+func agentFrame(t *testing.T) []byte {
+	t.Helper()
+	body, err := os.ReadFile("testdata/agent_frame.bin")
+	if err != nil {
+		t.Fatal(err)
+	}
+	return body
+}
+
+func TestDecodeAgentFrame(t *testing.T) {
+	records, err := Decode(agentFrame(t))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !reflect.DeepEqual(records, agentRecords) {
+		for i := range records {
+			if i < len(agentRecords) && !reflect.DeepEqual(records[i], agentRecords[i]) {
+				t.Errorf("record %d: got %+v / %+v, want %+v / %+v",
+					i, records[i], records[i].Event, agentRecords[i], agentRecords[i].Event)
+			}
+		}
+		t.Fatalf("decoded %d records, want %d", len(records), len(agentRecords))
+	}
+
+	text, err := records[2].LogText()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !strings.Contains(text, `"utc_time":"17/11/2025 10:15:31"`) {
+		t.Errorf("unparsed time missing from %s", text)
+	}
+	if text, _ := records[3].LogText(); text != `{"event_id":2,"target":"C:\\Temp\\a.txt"}` {
+		t.Errorf("empty fields not omitted: %s", text)
+	}
+}
+
+func TestDecodeTruncatedFrame(t *testing.T) {
+	body := agentFrame(t)
+	for cut := len(magic) + 1; cut < len(body); cut++ {
+		records, err := Decode(body[:cut])
+		if err != nil {
+			continue
+		}
+		// Only a cut at a record boundary decodes, and then to the records before it
+		if len(records) == 0 {
+			continue
+		}
+		if !reflect.DeepEqual(records, agentRecords[:len(records)]) || len(records) == len(agentRecords) {
+			t.Fatalf("frame cut at %d of %d bytes decoded to %d records", cut, len(body), len(records))
+		}
+	}
+	if _, err := Decode(body[:len(magic)]); err == nil {
+		t.Error("header without a version decoded")
+	}
+}
+
+// frame builds frames by hand, for inputs the agent never writes
+type frame struct {
+	buf []byte
+}
+
+func newFrame(version byte) *frame {
+	return &frame{buf: append(append([]byte{}, magic...), version)}
+}
+
+func (f *frame) record(body []byte) {
+	f.buf = binary.AppendUvarint(f.buf, uint64(len(body)))
+	f.buf = append(f.buf, body...)
+}
+
+func literal(b []byte, tag uint64, s string) []byte {
+	b = binary.AppendUvarint(b, tag)
+	b = binary.AppendUvarint(b, uint64(len(s)))
+	return append(b, s...)
+}
+
+func TestDecodeMalformedRecords(t *testing.T) {
+	cases := map[string][]byte{
+		"string past record end": literal([]byte{TypeLog}, 1, "filename")[:6],
+		"reference out of range": {TypeLog, 3, 0},
+		"unterminated varint":    {TypeLog, 0x80},
+		"unknown record type":    {9, 0, 0},
+		"event id out of range":  binary.AppendUvarint([]byte{TypeEvent, 0}, 0x10000),
+	}
+	for name, body := range cases {
+		f := newFrame(Version)
+		f.record(body)
+		if _, err := Decode(f.buf); err == nil {
+			t.Errorf("%s: decoded", name)
+		}
+	}
+
+	f := newFrame(Version)
+	f.buf = append(f.buf, 5, TypeLog, 0) // length prefix larger than what follows
+	if _, err := Decode(f.buf); err == nil {
+		t.Error("record running past the frame decoded")
+	}
+	if _, err := Decode(newFrame(Version + 1).buf); err == nil {
+		t.Error("unknown version decoded")
+	}
+}
+
+func TestDecodeVersion1Event(t *testing.T) {
+	// Older agents send no utcTime string after the millis
+	body := []byte{TypeEvent, 0}
+	body = binary.AppendUvarint(body, 11)
+	body = binary.AppendUvarint(body, 1763374530123)
+	body = literal(body, 2, "WS-01")
+	body = append(body, 0, 0, 0, 0, 0, 0)
+	f := newFrame(1)
+	f.record(body)
+	records, err := Decode(f.buf)
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := &Event{EventID: 11, UtcTime: "2025-11-17 10:15:30.123", Computer: "WS-01"}
+	if len(records) != 1 || !reflect.DeepEqual(records[0].Event, want) {
+		t.Fatalf("got %+v", records)
+	}
+}
+
+func TestStringTableCap(t *testing.T) {
+	// One interned filename per record, then a record referring to the last table entry
+	build := func(entries int) []byte {
+		f := newFrame(Version)
+		for i := 0; i < entries; i++ {
+			f.record(append(literal([]byte{TypeLog}, 2, "host-"+strconv.Itoa(i)), 0))
+		}
+		f.record(append(binary.AppendUvarint([]byte{TypeLog}, uint64(3+entries-1)), 0))
+		return f.buf
+	}
+
+	records, err := Decode(build(maxTableEntries))
+	if err != nil {
+		t.Fatalf("frame with a full table: %v", err)
+	}
+	if last := records[len(records)-1].Filename; last != "host-"+strconv.Itoa(maxTableEntries-1) {
+		t.Fatalf("reference to the last table entry gave %q", last)
+	}
+	if _, err := Decode(build(maxTableEntries + 1)); err == nil || !strings.Contains(err.Error(), "string table too large") {
+		t.Fatalf("frame past the table cap: %v", err)
+	}
+}
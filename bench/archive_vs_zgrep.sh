@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+# Compares "agent query" on the local archive with zgrep on a gzip -6 copy of the same lines.
+#
+#   bench/archive_vs_zgrep.sh [AGENT] [LINES] [RUNS]
+#
+# AGENT defaults to ./agent (gcc -std=c11 -O2 -o agent agent_inotify.c -lcurl -lz), LINES to
+# 2000000 synthetic sshd lines (about 250 MB) with a unique request id each, RUNS to 3. The agent
+# archives them as it tails the file; then each case is timed RUNS times from the page cache,
+# and both outputs are compared byte for byte. Nothing is shipped: the upload URL is a closed
+# port and the syslog listeners are off.
+set -euo pipefail
+
+agent=$(realpath "${1:-./agent}")
+lines=${2:-2000000}
+runs=${3:-3}
+work=$(mktemp -d)
+trap 'kill "$pid" 2>/dev/null || true; rm -rf "$work"' EXIT
+pid=
+
+log=$work/app.log
+: > "$log"
+export AGENT_LOG_FILES=$log AGENT_ARCHIVE_SOURCES=$log AGENT_ARCHIVE_DIR=$work/archive
+export AGENT_SERVER_URL=http://127.0.0.1:9/ AGENT_SYSLOG_PORT=0 AGENT_SYSLOG_SOCKET= AGENT_CONTROL_SOCKET=
+"$agent" > /dev/null 2> "$work/agent.err" &
+pid=$!
+sleep 1
+
+# user<N> repeats every 50000 lines and host<NN> every 7, so "user17 host03" hits every 7th user17
+awk -v n="$lines" 'BEGIN {
+    for (i = 0; i < n; ++i)
+        printf "Nov 17 %02d:%02d:%02d host%02d sshd[%d]: Accepted publickey for user%d from 10.%d.%d.%d port %d req=%010.0f\n",
+            int(i / 3600) % 24, int(i / 60) % 60, i % 60, i % 7, 1000 + i % 30000, i % 50000,
+            int(i / 65536) % 256, int(i / 256) % 256, i % 256, 1024 + i % 60000, (i * 2654435761) % 4294967296
+}' >> "$log"
+
+# wait until the agent has caught up: the archive stops growing
+size=-1
+while [ "$(du -sb "$work/archive" | cut -f1)" != "$size" ]; do
+    size=$(du -sb "$work/archive" | cut -f1)
+    sleep 2
+done
+kill -TERM "$pid"
+wait "$pid" || true
+pid=
+gzip -6 -c "$log" > "$log.gz"
+echo "$lines lines, $(du -sh "$log" | cut -f1) raw, $(du -sh "$log.gz" | cut -f1) gzip -6," \
+    "archive $(du -ch "$work"/archive/*.dat | tail -1 | cut -f1) data + $(du -ch "$work"/archive/*.idx | tail -1 | cut -f1) index"
+
+ms() { date +%s%N | cut -b1-13; }
+
+# bench NAME QUERY_TERMS... -- ZGREP_PIPELINE
+bench() {
+    local name=$1
+    shift
+    local terms=()
+    while [ "$1" != "--" ]; do terms+=("$1"); shift; done
+    shift
+    local q="" z="" t
+    for _ in $(seq "$runs"); do
+        sync
+        t=$(ms); "$agent" query "${terms[@]}" > "$work/q.out"; q="$q $(($(ms) - t))"
+        t=$(ms); bash -c "$1" > "$work/z.out" || true; z="$z $(($(ms) - t))"
+    done
+    local same=differ
+    cmp -s "$work/q.out" "$work/z.out" && same=same
+    printf "%-26s %7s hits  query ms:%-18s zgrep ms:%-18s output %s\n" \
+        "$name" "$(wc -l < "$work/q.out")" "$q" "$z" "$same"
+}
+
+rare=$(awk -v i=$((lines / 2)) 'BEGIN { printf "%010.0f", (i * 2654435761) % 4294967296 }')
+bench "rare term" "$rare" -- "zgrep -w $rare '$log.gz'"
+bench "absent IP" 203.0.113.77 -- "zgrep -wF 203.0.113.77 '$log.gz'"
+bench "two terms" user17 host03 -- "zgrep -w user17 '$log.gz' | grep -w host03"
+bench "term in every block" sshd -- "zgrep -w sshd '$log.gz'"
+"$agent" query --stats "$rare" > /dev/null
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Load test of the agent's syslog receiver.
+
+    bench/syslog_load.py [--agent ./agent] [--transport udp|tcp|unix] [--rate N] [--count N]
+
+Starts an HTTP sink on loopback and the agent shipping to it, with its syslog listeners on a free
+port and a Unix socket in a scratch directory. Then it sends --count messages over --transport,
+--rate per second (0 = as fast as possible). When the sink stops receiving lines the agent is
+stopped, and its exit report (received, dropped, msgs/s, drop rate) is printed next to what was
+offered and what reached the sink. Kernel drops only show for UDP and only up to the last
+datagram the agent received (SO_RXQ_OVFL rides on the next message).
+"""
+import argparse
+import http.server
+import os
+import signal
+import socket
+import subprocess
+import tempfile
+import threading
+import time
+
+
+class Sink(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    lines = 0
+    lock = threading.Lock()
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        with Sink.lock:
+            Sink.lines += body.count(b"\n")
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def connect(transport, port, path):
+    if transport == "udp":
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        s.connect(("127.0.0.1", port))
+    elif transport == "tcp":
+        s = socket.create_connection(("127.0.0.1", port))
+    else:
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+        s.connect(path)
+    return s
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("--agent", default="./agent")
+    ap.add_argument("--transport", choices=("udp", "tcp", "unix"), default="udp")
+    ap.add_argument("--rate", type=int, default=5000, help="messages per second, 0 = flood")
+    ap.add_argument("--count", type=int, default=20000)
+    args = ap.parse_args()
+
+    sink = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Sink)
+    threading.Thread(target=sink.serve_forever, daemon=True).start()
+
+    work = tempfile.mkdtemp()
+    port = free_port()
+    sock_path = os.path.join(work, "syslog.sock")
+    quiet_log = os.path.join(work, "none.log")
+    open(quiet_log, "w").close()
+    env = dict(os.environ,
+               AGENT_SERVER_URL="http://127.0.0.1:%d/ingest" % sink.server_address[1],
+               AGENT_SYSLOG_BIND="127.0.0.1", AGENT_SYSLOG_PORT=str(port), AGENT_SYSLOG_SOCKET=sock_path,
+               AGENT_CONTROL_SOCKET="", AGENT_LOG_FILES=quiet_log)
+    agent = subprocess.Popen([os.path.realpath(args.agent)], env=env, stdout=subprocess.DEVNULL,
+                             stderr=subprocess.PIPE, text=True)
+    deadline = time.time() + 5
+    while not os.path.exists(sock_path) and time.time() < deadline:
+        time.sleep(0.05)
+    time.sleep(0.2)
+
+    s = connect(args.transport, port, sock_path)
+    pad = "x" * 80
+    start = time.perf_counter()
+    for seq in range(args.count):
+        msg = "<13>Nov 17 10:15:30 bench load[1]: seq=%d %s" % (seq, pad)
+        if args.transport == "tcp":
+            s.sendall((msg + "\n").encode())
+        else:
+            try:
+                s.send(msg.encode())
+            except (BlockingIOError, ConnectionRefusedError):
+                pass  # lost before the kernel queued it: the agent cannot count it either
+        if args.rate and seq % 100 == 99:
+            ahead = (seq + 1) / args.rate - (time.perf_counter() - start)
+            if ahead > 0:
+                time.sleep(ahead)
+    sent_secs = time.perf_counter() - start
+    s.close()
+
+    # shipped when the sink has seen every message, or nothing new for two seconds
+    last, idle = -1, time.time()
+    while Sink.lines < args.count and time.time() - idle < 2:
+        if Sink.lines != last:
+            last, idle = Sink.lines, time.time()
+        time.sleep(0.1)
+    elapsed = time.perf_counter() - start
+    agent.send_signal(signal.SIGTERM)
+    _, err = agent.communicate(timeout=30)
+    sink.shutdown()
+
+    print("%s: offered %d msgs at %.0f msgs/s; sink got %d lines, %.0f msgs/s end to end"
+          % (args.transport, args.count, args.count / sent_secs, Sink.lines, Sink.lines / elapsed))
+    for line in err.splitlines():
+        if line.startswith(("syslog:", "ship:")):
+            print("  agent " + line)
+    os.remove(quiet_log)
+    os.rmdir(work)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,142 @@
+/* Compares the agent's two file read engines (agent_tail.h): epoll + pread() against io_uring.
+ *
+ *   gcc -std=c11 -O2 -Wall -Wextra -o tail_engines bench/tail_engines.c
+ *   ./tail_engines [FILES LINES ROUNDS]
+ *
+ * Each round appends LINES lines of 100 bytes to each of FILES files in a scratch directory, then
+ * times one tail_read() over all of them, as the agent's periodic sweep does. Only tail_read() is
+ * timed. Reported per engine: microseconds per round, and the read system calls made (pread() or
+ * io_uring_enter(), plus one fstat() per file per round for the truncation check). Both engines
+ * must hand on every line and byte written. Without arguments a fixed set of cases runs.
+ * Files are started over (untimed) every FILE_ROLL_BYTES so the scratch directory stays small.
+ */
+#define _GNU_SOURCE
+#include <time.h>
+
+#include "../agent_tail.h"
+
+#define LINE_BYTES 100
+#define FILE_ROLL_BYTES (16 * 1024 * 1024)
+
+struct result {
+    double usecs;
+    unsigned long long lines;
+    unsigned long long bytes;
+    unsigned long long syscalls;
+    enum tail_engine engine;
+};
+
+static unsigned long long seen_bytes;
+
+static void count_line(const char* line, void* ctx)
+{
+    (void)ctx;
+    seen_bytes += strlen(line);
+}
+
+static void run(const char* dir, enum tail_engine engine, int nfiles, int lines, int rounds, struct result* res)
+{
+    char names[TAIL_MAX_FILES][PATH_MAX];
+    const char* paths[TAIL_MAX_FILES];
+    int fds[TAIL_MAX_FILES];
+    static struct tailer t;
+    char* chunk = malloc((size_t)lines * LINE_BYTES + 1); /* + the NUL of the last snprintf() */
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    for (int i = 0; i < lines; ++i)
+        snprintf(chunk + (size_t)i * LINE_BYTES, LINE_BYTES + 1, "%-*d\n", LINE_BYTES - 1, i);
+    for (int f = 0; f < nfiles; ++f) {
+        snprintf(names[f], sizeof(names[f]), "%s/%02d.log", dir, f);
+        paths[f] = names[f];
+        fds[f] = open(names[f], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    }
+
+    memset(res, 0, sizeof(*res));
+    seen_bytes = 0;
+    tail_open(&t, paths, nfiles, engine, epoll_fd, count_line, NULL);
+    res->engine = t.engine;
+    size_t written = 0;
+    for (int r = 0; r < rounds; ++r) {
+        if (written + (size_t)lines * LINE_BYTES > FILE_ROLL_BYTES) {
+            /* start over with empty files, outside the timed part */
+            res->lines += t.stats.lines;
+            res->bytes += t.stats.bytes;
+            res->syscalls += t.stats.syscalls;
+            tail_close(&t);
+            for (int f = 0; f < nfiles; ++f) {
+                if (ftruncate(fds[f], 0) != 0)
+                    perror("ftruncate");
+            }
+            tail_open(&t, paths, nfiles, engine, epoll_fd, count_line, NULL);
+            written = 0;
+        }
+        for (int f = 0; f < nfiles; ++f) {
+            if (write(fds[f], chunk, (size_t)lines * LINE_BYTES) != (ssize_t)lines * LINE_BYTES)
+                perror("write");
+        }
+        written += (size_t)lines * LINE_BYTES;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        tail_read(&t, 1);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        res->usecs += (double)(end.tv_sec - start.tv_sec) * 1e6 + (double)(end.tv_nsec - start.tv_nsec) / 1e3;
+    }
+    res->lines += t.stats.lines;
+    res->bytes += t.stats.bytes;
+    res->syscalls += t.stats.syscalls;
+    tail_close(&t);
+
+    for (int f = 0; f < nfiles; ++f) {
+        close(fds[f]);
+        unlink(names[f]);
+    }
+    close(epoll_fd);
+    free(chunk);
+}
+
+static int compare(const char* dir, int nfiles, int lines, int rounds)
+{
+    unsigned long long want_lines = (unsigned long long)nfiles * (unsigned long long)lines * (unsigned long long)rounds;
+    unsigned long long want_bytes = want_lines * LINE_BYTES;
+    int ok = 1;
+
+    printf("%5d %16d %7d", nfiles, lines, rounds);
+    for (int e = 0; e < 2; ++e) {
+        struct result res;
+        run(dir, e == 0 ? TAIL_ENGINE_EPOLL : TAIL_ENGINE_IO_URING, nfiles, lines, rounds, &res);
+        int complete = res.lines == want_lines && res.bytes == want_bytes && seen_bytes == want_bytes;
+        printf("  %-8s %9.1f (%llu)%s", tail_engine_name(res.engine), res.usecs / rounds, res.syscalls,
+            complete ? "" : " INCOMPLETE");
+        ok &= complete;
+    }
+    printf("\n");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    static const int cases[][3] = { { 64, 1, 5000 }, { 64, 20, 5000 }, { 64, 2000, 300 }, { 8, 5, 20000 } };
+    char dir[] = "/tmp/tail_engines.XXXXXX";
+    int ok = 1;
+
+    (void)tail_handle; /* the inotify path and the exit report are not exercised here */
+    (void)tail_report;
+    if (argc != 1 && (argc != 4 || atoi(argv[1]) < 1 || atoi(argv[1]) > TAIL_MAX_FILES || atoi(argv[2]) < 1
+            || atoi(argv[3]) < 1)) {
+        fprintf(stderr, "usage: %s [FILES (1-%d) LINES ROUNDS]\n", argv[0], TAIL_MAX_FILES);
+        return 2;
+    }
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    printf("files  lines/file/round  rounds  engine   us/round (syscalls)\n");
+    if (argc == 4)
+        ok = compare(dir, atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+    else
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+            ok &= compare(dir, cases[i][0], cases[i][1], cases[i][2]);
+    rmdir(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,673 @@
+// Alert fan-out: every event record and hash-change line goes to each configured sink - the
+// backend API, syslog over UDP or TCP (alerts.methods.syslog) and a local NDJSON file
+// (alerts.methods.file_log).
+// Each sink sits behind its own SinkChannel: a bounded queue (drop-oldest by default) drained by
+// one delivery thread that hands over whatever has accumulated as one batch. A sink that is slow
+// or down only fills its own queue and retries with back-off; the pipeline workers and the
+// other sinks never wait for it. Delivery is at-least-once: a batch that fails part-way is sent
+// again as a whole (the API sink resumes at the record that failed). For the API, batched records
+// count as delivered once they are in a batch; a batch upload that still fails after the
+// uploader's own retries is logged and dropped there.
+// Records carry the priority of their monitored directory. Sink queues serve CRITICAL records
+// first and drop LOW ones first when full, and each sink tracks end-to-end latency (event
+// received to sink accepted) per priority class.
+// Records come from a recycling pool (buffer_pool.h) and are filled in place, so a record reuses
+// the key and text capacity of an earlier one instead of allocating its own.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "api_uploader.h"
+#include "buffer_pool.h"
+#include "env.h"
+#include "fim_config.h"
+#include "json_escape.h"
+#include "latency.h"
+#include "priority.h"
+#include "wire_format.h"
+#include "work_queue.h"
+
+namespace fim {
+
+enum class AlertKind {
+	Event,      // one Sysmon/Security file event
+	HashChange, // a [HASH] baseline/changed/removed line
+};
+
+inline const char* alert_kind_name(AlertKind kind) {
+	return kind == AlertKind::HashChange ? "hash" : "event";
+}
+
+struct AlertRecord {
+	AlertKind kind{AlertKind::Event};
+	Priority priority{Priority::Medium};
+	uint64_t unixMillis{0};         // when the agent raised it
+	std::chrono::steady_clock::time_point received{std::chrono::steady_clock::now()}; // for latency
+	std::string key;                // object name suffix for the API (build_event_object_suffix())
+	std::string text;               // JSON fields record, event XML or hash line; empty when `event` is set
+	WireEvent event;                // structured form, when hasEvent (a sink wants_wire_events())
+	bool hasEvent{false};
+};
+
+using AlertPtr = std::shared_ptr<const AlertRecord>;
+
+inline uint64_t unix_millis_now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// The record as text: its own text, or the JSON form of its structured event.
+inline const std::string& alert_text(const AlertRecord& record, std::string& scratch) {
+	if (!record.hasEvent || !record.text.empty()) return record.text;
+	scratch = wire_event_json(record.event);
+	return scratch;
+}
+
+// RFC 3339 UTC with milliseconds, e.g. 2024-05-01T12:00:00.123Z.
+inline void append_rfc3339_utc(std::string& out, uint64_t unixMillis) {
+	const std::time_t seconds = static_cast<std::time_t>(unixMillis / 1000);
+	std::tm tm{};
+#if defined(_WIN32)
+	gmtime_s(&tm, &seconds);
+#else
+	gmtime_r(&seconds, &tm);
+#endif
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ", tm.tm_year + 1900, tm.tm_mon + 1,
+		tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<unsigned>(unixMillis % 1000));
+	out += buf;
+}
+
+inline std::string rfc3339_utc(uint64_t unixMillis) {
+	std::string out;
+	append_rfc3339_utc(out, unixMillis);
+	return out;
+}
+
+class AlertSink {
+public:
+	virtual ~AlertSink() = default;
+
+	virtual std::string name() const = 0;
+
+	// Delivers the batch in order; false means it should be retried later. Called from the
+	// sink's own delivery thread only.
+	virtual bool deliver(const std::vector<AlertPtr>& batch) = 0;
+
+	// True when the sink can take structured events (AlertRecord::event) instead of text.
+	virtual bool wants_wire_events() const { return false; }
+
+	// Records this sink handles; the others are never queued on its channel.
+	virtual bool accepts(const AlertRecord& /*record*/) const { return true; }
+
+	// Extra sink-specific metrics for the periodic stats output. Must be thread-safe.
+	virtual void log_stats(std::ostream& /*os*/) const {}
+};
+
+// The backend API through ApiUploader, which does its own batching and connection pooling.
+// CRITICAL records get a channel of their own (AlertFanout::add_api): appending HIGH and bulk
+// records waits when every batch upload thread is busy and their queue is full, and a CRITICAL
+// record must never queue behind that.
+class ApiSink : public AlertSink {
+public:
+	enum class Records {
+		All,
+		Critical, // only CRITICAL records, posted one at a time over the reserved connection
+		Batched,  // everything else
+	};
+
+	explicit ApiSink(ApiUploader& uploader, Records records = Records::All) : uploader_(uploader), records_(records) {}
+
+	std::string name() const override { return records_ == Records::Critical ? "api-critical" : "api"; }
+
+	bool wants_wire_events() const override { return uploader_.binary(); }
+
+	bool accepts(const AlertRecord& record) const override {
+		if (records_ == Records::All) return true;
+		return (record.priority == Priority::Critical) == (records_ == Records::Critical);
+	}
+
+	void log_stats(std::ostream& os) const override {
+		if (records_ == Records::Critical || !uploader_.batching()) return;
+		const BatchStats b = uploader_.batch_stats();
+		os << "[FIM] Batches=" << b.batches << " records=" << b.records << " bytes=" << b.bytes
+		   << " urgent_posts=" << uploader_.urgent_posts() << std::endl;
+		if (!uploader_.adaptive()) return;
+		BatchLimits current;
+		const FlowStats f = uploader_.flow_stats(&current);
+		os << "[FIM] Flow batch_events=" << current.maxEvents << " batch_bytes=" << current.maxBytes
+		   << " inflight_limit=" << f.inFlightLimit << " grew=" << f.batchIncreases << '/' << f.inFlightIncreases
+		   << " shrank=" << f.decreases << " slow=" << f.slow << " errors=" << f.errors << " busy=" << f.backpressure << " retried=" << uploader_.busy_retries() << std::endl;
+	}
+
+	// Fails on the first record the uploader could not post or hand to a batcher, so the channel
+	// retries with back-off. The retry of the same batch resumes at that record: the ones before
+	// it are already in a batch or posted, and appending them again would duplicate them.
+	bool deliver(const std::vector<AlertPtr>& batch) override {
+		if (!uploader_.configured()) return false;
+		size_t i = !batch.empty() && batch.front().get() == resumeFront_ ? resumeAt_ : 0;
+		resumeFront_ = nullptr;
+		std::string scratch;
+		for (; i < batch.size(); ++i) {
+			const AlertRecord& record = *batch[i];
+			const bool ok = record.hasEvent && uploader_.binary()
+				? uploader_.submit_event(record.key, record.event, record.priority)
+				: uploader_.submit(record.key, alert_text(record, scratch), record.priority);
+			if (!ok) {
+				resumeFront_ = batch.front().get();
+				resumeAt_ = i;
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	ApiUploader& uploader_;
+	const Records records_;
+	// Where a failed batch stopped; only touched by the channel's delivery thread.
+	const AlertRecord* resumeFront_{nullptr};
+	size_t resumeAt_{0};
+};
+
+namespace detail {
+
+#if defined(_WIN32)
+using socket_handle = SOCKET;
+constexpr socket_handle kInvalidSocket = INVALID_SOCKET;
+inline void close_socket(socket_handle s) { closesocket(s); }
+#else
+using socket_handle = int;
+constexpr socket_handle kInvalidSocket = -1;
+inline void close_socket(socket_handle s) { ::close(s); }
+#endif
+
+inline bool net_startup() {
+#if defined(_WIN32)
+	static const bool ok = []() {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return ok;
+#else
+	return true;
+#endif
+}
+
+inline std::string local_host_name() {
+	char buf[256] = {};
+	if (!net_startup() || gethostname(buf, sizeof(buf) - 1) != 0 || !buf[0]) return "-";
+	std::string name(buf);
+	for (char& c : name) {
+		if (c <= ' ' || c > '~') c = '_'; // HOSTNAME is PRINTUSASCII in RFC 5424
+	}
+	return name;
+}
+
+// Connected socket to host:port with send/receive timeouts; kInvalidSocket on failure.
+inline socket_handle connect_socket(const std::string& host, unsigned port, bool stream, unsigned timeoutMs) {
+	if (!net_startup()) return kInvalidSocket;
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = stream ? SOCK_STREAM : SOCK_DGRAM;
+	addrinfo* found = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return kInvalidSocket;
+	socket_handle s = kInvalidSocket;
+	for (addrinfo* ai = found; ai; ai = ai->ai_next) {
+		s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (s == kInvalidSocket) continue;
+#if defined(_WIN32)
+		const DWORD timeout = timeoutMs;
+#else
+		timeval timeout{};
+		timeout.tv_sec = static_cast<time_t>(timeoutMs / 1000);
+		timeout.tv_usec = static_cast<suseconds_t>((timeoutMs % 1000) * 1000);
+#endif
+		setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+		if (connect(s, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0) break;
+		close_socket(s);
+		s = kInvalidSocket;
+	}
+	freeaddrinfo(found);
+	return s;
+}
+
+inline bool send_all(socket_handle s, const char* data, size_t size) {
+#if defined(MSG_NOSIGNAL)
+	const int flags = MSG_NOSIGNAL; // a dropped TCP peer must not raise SIGPIPE
+#else
+	const int flags = 0;
+#endif
+	while (size > 0) {
+		const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+		const auto sent = send(s, data, chunk, flags);
+		if (sent <= 0) return false;
+		data += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+} // namespace detail
+
+// RFC 5424 syslog. UDP sends one datagram per record (RFC 5426); TCP sends the whole batch in one
+// write with octet-counting framing (RFC 6587) and reconnects after an error.
+class SyslogSink : public AlertSink {
+public:
+	// Longest message put in one UDP datagram; longer records are truncated.
+	static constexpr size_t kMaxDatagram = 8192;
+	// facility 13 (log audit); severity notice for events, info for hash lines.
+	static constexpr int kFacility = 13;
+
+	SyslogSink(std::string server, unsigned port, bool tcp, unsigned timeoutMs = 5000)
+		: server_(std::move(server)), port_(port), tcp_(tcp), timeoutMs_(timeoutMs), host_(detail::local_host_name()) {}
+
+	~SyslogSink() override { disconnect(); }
+
+	std::string name() const override {
+		return std::string(tcp_ ? "syslog-tcp " : "syslog-udp ") + server_ + ":" + std::to_string(port_);
+	}
+
+	bool deliver(const std::vector<AlertPtr>& batch) override {
+		if (socket_ == detail::kInvalidSocket) {
+			socket_ = detail::connect_socket(server_, port_, tcp_, timeoutMs_);
+			if (socket_ == detail::kInvalidSocket) return false;
+		}
+		frames_.clear();
+		for (const AlertPtr& record : batch) {
+			format(*record, message_);
+			if (tcp_) {
+				frames_ += std::to_string(message_.size());
+				frames_.push_back(' ');
+				frames_ += message_;
+			} else {
+				if (message_.size() > kMaxDatagram) message_.resize(kMaxDatagram);
+				if (!detail::send_all(socket_, message_.data(), message_.size())) {
+					disconnect();
+					return false;
+				}
+			}
+		}
+		if (tcp_ && !detail::send_all(socket_, frames_.data(), frames_.size())) {
+			disconnect();
+			return false;
+		}
+		return true;
+	}
+
+	// <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA MSG, line breaks flattened.
+	void format(const AlertRecord& record, std::string& out) const {
+		const int severity = record.kind == AlertKind::HashChange ? 6 : 5;
+		out = "<" + std::to_string(kFacility * 8 + severity) + ">1 ";
+		append_rfc3339_utc(out, record.unixMillis);
+		out += ' ';
+		out += host_;
+		out += " fim_sender - ";
+		out += alert_kind_name(record.kind);
+		out += " - ";
+		const size_t start = out.size();
+		out += alert_text(record, scratch_);
+		for (size_t i = start; i < out.size(); ++i) {
+			if (out[i] == '\n' || out[i] == '\r') out[i] = ' ';
+		}
+	}
+
+private:
+	void disconnect() {
+		if (socket_ != detail::kInvalidSocket) detail::close_socket(socket_);
+		socket_ = detail::kInvalidSocket;
+	}
+
+	std::string server_;
+	unsigned port_;
+	bool tcp_;
+	unsigned timeoutMs_;
+	std::string host_;
+	detail::socket_handle socket_{detail::kInvalidSocket};
+	std::string message_;
+	std::string frames_;
+	mutable std::string scratch_;
+};
+
+// Appends one JSON object per line: {"time":...,"kind":...,"key":...,"log":...}. The file is
+// reopened after a write error, so a log rotated away (or a full disk) recovers on its own.
+class FileSink : public AlertSink {
+public:
+	explicit FileSink(std::string path) : path_(std::move(path)) {}
+
+	std::string name() const override { return "file " + path_; }
+
+	bool deliver(const std::vector<AlertPtr>& batch) override {
+		if (!out_.is_open()) {
+			out_.clear();
+			out_.open(std::filesystem::u8path(path_), std::ios::binary | std::ios::app);
+			if (!out_) {
+				out_.close();
+				return false;
+			}
+		}
+		// Written in chunks, so the buffer settles at one chunk and a record whatever the batch size
+		buffer_.clear();
+		for (const AlertPtr& record : batch) {
+			buffer_ += "{\"time\":\"";
+			append_rfc3339_utc(buffer_, record->unixMillis);
+			buffer_ += "\",\"kind\":\"";
+			buffer_ += alert_kind_name(record->kind);
+			buffer_ += "\",\"key\":\"";
+			json_escape_append(buffer_, record->key);
+			buffer_ += "\",\"log\":\"";
+			json_escape_append(buffer_, alert_text(*record, scratch_));
+			buffer_ += "\"}\n";
+			if (buffer_.size() >= kWriteChunk) {
+				out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+				buffer_.clear();
+			}
+		}
+		out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+		out_.flush();
+		if (!out_) {
+			out_.close();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static constexpr size_t kWriteChunk = 64 * 1024;
+
+	std::string path_;
+	std::ofstream out_;
+	std::string buffer_;
+	std::string scratch_;
+};
+
+struct SinkOptions {
+	size_t queueCapacity{4096};
+	OverflowPolicy overflow{OverflowPolicy::DropOldest};
+	size_t maxBatch{256};
+	std::chrono::milliseconds retryMin{250};
+	std::chrono::milliseconds retryMax{30000};
+
+	// FIM_SINK_QUEUE_CAPACITY, FIM_SINK_QUEUE_OVERFLOW (drop_oldest | drop_newest | block) and
+	// FIM_SINK_MAX_BATCH; the same for every sink. All optional.
+	static SinkOptions from_env() {
+		SinkOptions options;
+		options.queueCapacity = getenv_size("FIM_SINK_QUEUE_CAPACITY", options.queueCapacity);
+		options.maxBatch = getenv_size("FIM_SINK_MAX_BATCH", options.maxBatch);
+		const std::string overflow = getenv_string("FIM_SINK_QUEUE_OVERFLOW");
+		if (!overflow.empty() && !parse_overflow_policy(overflow, options.overflow)) {
+			std::cerr << "[FIM] Unknown FIM_SINK_QUEUE_OVERFLOW '" << overflow << "', using drop_oldest." << std::endl;
+		}
+		return options;
+	}
+};
+
+struct SinkStats {
+	QueueStats queue;        // enqueued / dropped / depth / high watermark of the sink's queue
+	uint64_t delivered{0};   // records the sink accepted
+	uint64_t failures{0};    // failed delivery attempts
+	uint64_t abandoned{0};   // records given up on at shutdown because the sink was failing
+	bool healthy{true};      // last delivery attempt succeeded
+};
+
+// One sink, its queue and its delivery thread.
+class SinkChannel {
+public:
+	SinkChannel(std::unique_ptr<AlertSink> sink, const SinkOptions& options)
+		: sink_(std::move(sink)), options_(options), queue_(options.queueCapacity, options.overflow) {
+		thread_ = std::thread([this]() { run(); });
+	}
+
+	~SinkChannel() { stop(); }
+
+	SinkChannel(const SinkChannel&) = delete;
+	SinkChannel& operator=(const SinkChannel&) = delete;
+
+	bool push(AlertPtr record) {
+		const size_t lane = priority_index(record->priority);
+		return queue_.push(std::move(record), lane);
+	}
+
+	// Refuses new records, makes one last attempt at what is queued, then joins. Idempotent.
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		cv_.notify_all();
+		queue_.close();
+		if (thread_.joinable()) thread_.join();
+	}
+
+	const AlertSink& sink() const { return *sink_; }
+
+	SinkStats stats() const {
+		SinkStats s;
+		s.queue = queue_.stats();
+		s.delivered = delivered_.load(std::memory_order_relaxed);
+		s.failures = failures_.load(std::memory_order_relaxed);
+		s.abandoned = abandoned_.load(std::memory_order_relaxed);
+		s.healthy = healthy_.load(std::memory_order_relaxed);
+		return s;
+	}
+
+	// Event received to accepted by this sink.
+	const LatencyHistogram& latency(Priority priority) const { return latency_[priority_index(priority)]; }
+
+private:
+	void run() {
+		std::vector<AlertPtr> batch;
+		batch.reserve(options_.maxBatch);
+		while (queue_.pop_batch(batch, options_.maxBatch)) {
+			deliver_with_retry(batch);
+			batch.clear();
+		}
+	}
+
+	void deliver_with_retry(const std::vector<AlertPtr>& batch) {
+		auto backoff = options_.retryMin;
+		for (;;) {
+			bool ok = false;
+			try {
+				ok = sink_->deliver(batch);
+			} catch (const std::exception& ex) {
+				std::cerr << "[FIM] Sink " << sink_->name() << " threw: " << ex.what() << std::endl;
+			}
+			if (ok) {
+				delivered_.fetch_add(batch.size(), std::memory_order_relaxed);
+				const auto done = std::chrono::steady_clock::now();
+				for (const AlertPtr& record : batch) latency_[priority_index(record->priority)].record(done - record->received);
+				if (!healthy_.exchange(true)) std::cout << "[FIM] Sink " << sink_->name() << " recovered" << std::endl;
+				return;
+			}
+			failures_.fetch_add(1, std::memory_order_relaxed);
+			if (healthy_.exchange(false)) {
+				std::cerr << "[FIM] Sink " << sink_->name() << " failed; retrying with back-off" << std::endl;
+			}
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (stopping_ || cv_.wait_for(lock, backoff, [this]() { return stopping_; })) {
+				abandoned_.fetch_add(batch.size(), std::memory_order_relaxed);
+				return;
+			}
+			backoff = std::min(backoff * 2, options_.retryMax);
+		}
+	}
+
+	std::unique_ptr<AlertSink> sink_;
+	SinkOptions options_;
+	BoundedQueue<AlertPtr> queue_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stopping_{false};
+	std::atomic<uint64_t> delivered_{0};
+	std::atomic<uint64_t> failures_{0};
+	std::atomic<uint64_t> abandoned_{0};
+	std::atomic<bool> healthy_{true};
+	std::array<LatencyHistogram, kPriorityCount> latency_;
+	std::thread thread_;
+};
+
+// The set of sinks every alert goes to. Sinks are added at start-up, before the first publish().
+class AlertFanout {
+public:
+	// Most records kept for reuse (all sinks share each record). FIM_ALERT_RECORD_POOL overrides it.
+	static constexpr size_t kDefaultRecordPool = 8192;
+	// A record whose key or text grew past this gives the memory back before it is reused.
+	static constexpr size_t kMaxRetainedText = 64 * 1024;
+
+	AlertFanout() : records_(getenv_size("FIM_ALERT_RECORD_POOL", kDefaultRecordPool)) {}
+	~AlertFanout() { stop(); }
+
+	AlertFanout(const AlertFanout&) = delete;
+	AlertFanout& operator=(const AlertFanout&) = delete;
+
+	void add(std::unique_ptr<AlertSink> sink, const SinkOptions& options = SinkOptions::from_env()) {
+		if (sink->wants_wire_events()) wireEvents_ = true;
+		// Enough records for a full queue plus the batch in delivery, made now rather than
+		// during the first burst.
+		records_.reserve(options.queueCapacity + options.maxBatch);
+		std::cout << "[FIM] Alert sink: " << sink->name() << std::endl;
+		channels_.push_back(std::make_unique<SinkChannel>(std::move(sink), options));
+	}
+
+	// The backend API, as two sinks: CRITICAL records on one channel, everything else on another.
+	void add_api(ApiUploader& uploader, const SinkOptions& options = SinkOptions::from_env()) {
+		add(std::make_unique<ApiSink>(uploader, ApiSink::Records::Critical), options);
+		add(std::make_unique<ApiSink>(uploader, ApiSink::Records::Batched), options);
+	}
+
+	// The syslog and file_log methods enabled in fim_config.yml.
+	void add_configured(const AlertMethods& methods, const SinkOptions& options = SinkOptions::from_env()) {
+		if (methods.syslog.enabled) {
+			const bool tcp = methods.syslog.protocol == "tcp";
+			if (!tcp && methods.syslog.protocol != "udp") {
+				std::cerr << "[FIM] Unknown syslog protocol '" << methods.syslog.protocol << "', using udp." << std::endl;
+			}
+			add(std::make_unique<SyslogSink>(methods.syslog.server, methods.syslog.port, tcp), options);
+		}
+		if (methods.fileLog.enabled) {
+			add(std::make_unique<FileSink>(methods.fileLog.path), options);
+		}
+	}
+
+	bool empty() const { return channels_.empty(); }
+	size_t size() const { return channels_.size(); }
+
+	// True when some sink takes structured events; records then carry `event` instead of JSON text.
+	bool wants_wire_events() const { return wireEvents_; }
+
+	// Queues the record on every sink. Never waits on a sink unless its queue uses the block policy.
+	void publish(AlertRecord record) {
+		publish_with([&record](AlertRecord& pooled) { pooled = std::move(record); });
+	}
+
+	// Like publish(), but fill(AlertRecord&) writes the record in place: it gets a pooled record
+	// reset to defaults with empty key and text that keep their capacity.
+	template <typename Fill>
+	void publish_with(Fill&& fill) {
+		if (channels_.empty()) return;
+		const std::shared_ptr<AlertRecord> record = records_.acquire();
+		reset(*record);
+		fill(*record);
+		if (!record->unixMillis) record->unixMillis = unix_millis_now();
+		const AlertPtr shared = record;
+		for (const auto& channel : channels_) {
+			if (channel->sink().accepts(*shared)) channel->push(shared);
+		}
+	}
+
+	PoolStats record_pool_stats() const { return records_.stats(); }
+
+	// Drains every sink's queue (one last attempt each) and joins the delivery threads. Idempotent.
+	void stop() {
+		for (const auto& channel : channels_) channel->stop();
+	}
+
+	std::vector<std::pair<std::string, SinkStats>> stats() const {
+		std::vector<std::pair<std::string, SinkStats>> out;
+		for (const auto& channel : channels_) out.emplace_back(channel->sink().name(), channel->stats());
+		return out;
+	}
+
+	void log_stats(std::ostream& os) const {
+		for (const auto& channel : channels_) {
+			const SinkStats s = channel->stats();
+			os << "[FIM] Sink " << channel->sink().name() << (s.healthy ? "" : " (failing)")
+			   << " queued=" << s.queue.enqueued
+			   << " delivered=" << s.delivered
+			   << " depth=" << s.queue.depth << "/" << s.queue.capacity
+			   << " high=" << s.queue.highWatermark
+			   << " dropped=" << s.queue.dropped
+			   << " failures=" << s.failures
+			   << " abandoned=" << s.abandoned;
+			if (s.queue.dropped) {
+				os << " dropped_by_priority=" << s.queue.droppedByLane[0] << "/" << s.queue.droppedByLane[1] << "/"
+				   << s.queue.droppedByLane[2] << "/" << s.queue.droppedByLane[3];
+			}
+			os << std::endl;
+			for (size_t i = 0; i < kPriorityCount; ++i) {
+				const Priority priority = static_cast<Priority>(i);
+				const LatencyHistogram& h = channel->latency(priority);
+				if (!h.count()) continue;
+				os << "[FIM] Sink " << channel->sink().name() << " latency " << priority_name(priority)
+				   << " records=" << h.count() << " p50_us=" << h.percentile_us(0.50)
+				   << " p99_us=" << h.percentile_us(0.99) << " max_us=" << h.max_us() << std::endl;
+			}
+			channel->sink().log_stats(os);
+		}
+	}
+
+private:
+	static void reset(AlertRecord& record) {
+		record.kind = AlertKind::Event;
+		record.priority = Priority::Medium;
+		record.unixMillis = 0;
+		record.received = std::chrono::steady_clock::now();
+		// Cleared in place so the next record is built into the same capacity
+		WireEvent& ev = record.event;
+		for (std::string* text : { &record.key, &record.text, &ev.utcTime, &ev.computer, &ev.channel, &ev.image,
+				&ev.target, &ev.processGuid, &ev.hashes, &ev.user }) {
+			if (text->capacity() > kMaxRetainedText) std::string().swap(*text);
+			else text->clear();
+		}
+		ev.eventId = 0;
+		ev.unixMillis = 0;
+		record.hasEvent = false;
+	}
+
+	std::vector<std::unique_ptr<SinkChannel>> channels_;
+	RecyclingPool<AlertRecord> records_;
+	bool wireEvents_{false};
+};
+
+} // namespace fim
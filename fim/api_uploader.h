@@ -0,0 +1,430 @@
+// HTTP uploader that forwards event payloads to the backend API.
+// Requires FIM_API_URL (and optional FIM_API_TOKEN) environment variables.
+// Uploads run concurrently through a pooled keep-alive transport; the only lock taken is the
+// short one guarding the configuration snapshot. Each batcher has FIM_API_MAX_INFLIGHT upload
+// threads of its own, so the thread submitting records does not wait for batch uploads unless
+// all of them are busy and their queue is full.
+// With batching enabled (the default) records are grouped into NDJSON payloads and posted to the
+// batch route (/api/logs/batch), which stores one S3 object per batch instead of one per event.
+// FIM_API_ENCODING=binary sends those batches in the compact wire_format.h encoding instead.
+// Records carry the priority of their monitored directory: CRITICAL ones skip batching and are
+// posted at once over a reserved connection, HIGH ones use the regular batcher, and MEDIUM/LOW
+// ones go to a bulk batcher with larger batches and a longer delay.
+// Records are encoded straight into the batch (or into a pooled body buffer for single posts),
+// and requests only borrow the token and paths, so the upload path allocates nothing per record
+// once the batch and body buffers have grown to their working size.
+// Batch uploads are paced by a FlowController (flow_control.h): batch sizes and the number of
+// batches in flight (across both batchers' upload threads) follow the observed latency, errors
+// and 429/503 answers, and a batch the backend turned away with Retry-After is sent again once
+// that delay has passed. CRITICAL posts are not paced.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "buffer_pool.h"
+#include "env.h"
+#include "event_batcher.h"
+#include "flow_control.h"
+#include "http_transport.h"
+#include "json_escape.h"
+#include "priority.h"
+#include "wire_format.h"
+
+namespace fim {
+
+enum class WireEncoding {
+	Ndjson,
+	Binary, // wire_format.h frames; only used for batches
+};
+
+class ApiUploader {
+public:
+	explicit ApiUploader(TransportFactory factory) : factory_(factory) {}
+
+	// Reads FIM_API_URL, FIM_API_TOKEN, FIM_API_MAX_INFLIGHT and FIM_API_TIMEOUT_MS, plus the batching
+	// knobs FIM_BATCH_MAX_EVENTS (1 disables batching), FIM_BATCH_MAX_BYTES, FIM_BATCH_MAX_DELAY_MS,
+	// FIM_BATCH_BULK_MAX_DELAY_MS and FIM_API_BATCH_PATH. FIM_API_ENCODING selects ndjson (default)
+	// or binary batches. Batch sizes and FIM_API_MAX_INFLIGHT are adapted at run time unless
+	// FIM_API_ADAPTIVE=0; FIM_API_TARGET_LATENCY_MS is the batch upload time they aim for.
+	void refresh_from_env() {
+		TransportOptions options;
+		options.maxInFlight = getenv_size("FIM_API_MAX_INFLIGHT", options.maxInFlight);
+		options.timeoutMs = static_cast<unsigned>(getenv_size("FIM_API_TIMEOUT_MS", options.timeoutMs));
+		BatchLimits limits;
+		limits.maxEvents = getenv_size("FIM_BATCH_MAX_EVENTS", limits.maxEvents);
+		limits.maxBytes = getenv_size("FIM_BATCH_MAX_BYTES", limits.maxBytes);
+		limits.maxDelay = std::chrono::milliseconds(getenv_size("FIM_BATCH_MAX_DELAY_MS",
+			static_cast<size_t>(limits.maxDelay.count())));
+		BatchLimits bulk = bulk_limits(limits);
+		bulk.maxDelay = std::chrono::milliseconds(getenv_size("FIM_BATCH_BULK_MAX_DELAY_MS",
+			static_cast<size_t>(bulk.maxDelay.count())));
+		WireEncoding encoding = WireEncoding::Ndjson;
+		const std::string encodingName = getenv_string("FIM_API_ENCODING");
+		if (encodingName == "binary") {
+			encoding = WireEncoding::Binary;
+		} else if (!encodingName.empty() && encodingName != "ndjson") {
+			std::cerr << "[FIM] Unknown FIM_API_ENCODING '" << encodingName << "', using ndjson." << std::endl;
+		}
+		std::optional<FlowOptions> flow;
+		const std::string adaptive = getenv_string("FIM_API_ADAPTIVE");
+		if (adaptive != "0" && adaptive != "off" && adaptive != "false") {
+			flow.emplace();
+			flow->maxInFlight = options.maxInFlight;
+			// Aim well inside the timeout, or a slow link would only show up as failures.
+			flow->targetLatency = std::chrono::milliseconds(std::min<size_t>(
+				getenv_size("FIM_API_TARGET_LATENCY_MS", static_cast<size_t>(flow->targetLatency.count())),
+				options.timeoutMs / 2));
+		}
+		configure(getenv_string("FIM_API_URL"), getenv_string("FIM_API_TOKEN"), options, limits,
+			getenv_string("FIM_API_BATCH_PATH"), encoding, bulk, flow);
+	}
+
+	// MEDIUM/LOW batches: four times the size of regular ones, five times the delay.
+	static BatchLimits bulk_limits(const BatchLimits& limits) {
+		BatchLimits bulk = limits;
+		bulk.maxEvents = limits.maxEvents * 4;
+		bulk.maxBytes = limits.maxBytes * 4;
+		bulk.maxDelay = limits.maxDelay * 5;
+		return bulk;
+	}
+
+	// Replaces the endpoint and transport. In-flight uploads finish on the previous transport and
+	// records still batched for it are flushed once the last user releases it. bulkLimits
+	// defaults to bulk_limits(limits). With flow set, limits and bulkLimits are the starting point
+	// the controller scales from; without it they are fixed.
+	void configure(const std::string& url, const std::string& token, const TransportOptions& options,
+		const BatchLimits& limits = BatchLimits(), const std::string& batchPath = std::string(),
+		WireEncoding encoding = WireEncoding::Ndjson, std::optional<BatchLimits> bulkLimits = std::nullopt,
+		std::optional<FlowOptions> flow = std::nullopt) {
+		std::shared_ptr<State> next;
+		if (!url.empty()) {
+			next = std::make_shared<State>();
+			if (!parse_http_url(url, next->endpoint)) {
+				std::cerr << "[FIM] Invalid FIM_API_URL, unable to forward events." << std::endl;
+				next.reset();
+			} else {
+				next->token = token;
+				next->transport = factory_(next->endpoint, options);
+				if (next->transport) {
+					// One connection of its own for CRITICAL records, so they never queue behind bulk uploads.
+					TransportOptions urgentOptions = options;
+					urgentOptions.maxInFlight = 1;
+					next->urgentTransport = factory_(next->endpoint, urgentOptions);
+					if (!next->urgentTransport) next->urgentTransport = next->transport;
+				}
+				if (!next->transport) {
+					next.reset();
+				} else if (limits.maxEvents > 1) {
+					next->batchResource = batchPath.empty() ? default_batch_resource(next->endpoint.resource) : batchPath;
+					State* raw = next.get();
+					EventBatcher::BeginFn begin;
+					EventBatcher::BeginFn bulkBegin;
+					if (encoding == WireEncoding::Binary) {
+						next->binary = true;
+						begin = [raw](std::string& payload) { raw->writer.begin(payload); };
+						bulkBegin = [raw](std::string& payload) { raw->bulkWriter.begin(payload); };
+					}
+					next->limits = limits;
+					next->bulkLimits = bulkLimits ? *bulkLimits : bulk_limits(limits);
+					if (flow) next->flow = std::make_unique<FlowController>(*flow);
+					const size_t uploaders = std::max<size_t>(options.maxInFlight, 1);
+					next->batcher = std::make_unique<EventBatcher>(limits, [raw](const std::string& payload, size_t count) {
+						post_batch(*raw, *raw->transport, payload, count, true);
+					}, std::move(begin), uploaders);
+					next->bulkBatcher = std::make_unique<EventBatcher>(next->bulkLimits,
+						[raw](const std::string& payload, size_t count) { post_batch(*raw, *raw->transport, payload, count, true); },
+						std::move(bulkBegin), uploaders);
+				} else if (encoding == WireEncoding::Binary) {
+					std::cerr << "[FIM] FIM_API_ENCODING=binary needs batching; sending JSON records." << std::endl;
+				}
+			}
+		}
+		std::lock_guard<std::mutex> lock(stateMutex_);
+		state_ = std::move(next);
+		configured_.store(state_ != nullptr, std::memory_order_release);
+	}
+
+	bool configured() const { return configured_.load(std::memory_order_acquire); }
+
+	std::string transport_name() const {
+		auto state = snapshot();
+		return state ? state->transport->name() : "none";
+	}
+
+	bool batching() const {
+		auto state = snapshot();
+		return state && state->batcher;
+	}
+
+	bool binary() const {
+		auto state = snapshot();
+		return state && state->binary;
+	}
+
+	bool adaptive() const {
+		auto state = snapshot();
+		return state && state->flow;
+	}
+
+	// Queues the payload for the next batch of its priority class, or uploads it immediately when
+	// batching is off or it is CRITICAL. Returns false only when the payload could not be handed off.
+	bool submit(const std::string& keySuffix, const std::string& payload, Priority priority = Priority::High) {
+		if (payload.empty()) return false;
+		auto state = snapshot();
+		if (!state) return false;
+		if (priority == Priority::Critical) {
+			urgentPosts_.fetch_add(1, std::memory_order_relaxed);
+			if (!state->binary) return post_single(*state, *state->urgentTransport, keySuffix, payload);
+			PooledBuffer frame(state->bodies);
+			{
+				std::lock_guard<std::mutex> lock(state->urgentMutex);
+				state->urgentWriter.begin(*frame);
+				state->urgentWriter.add_log(*frame, keySuffix, payload);
+			}
+			return post_batch(*state, *state->urgentTransport, *frame, 1);
+		}
+		EventBatcher* batcher = state->batcher_for(priority);
+		if (state->binary) {
+			WireWriter& writer = state->writer_for(priority);
+			batcher->append([&](std::string& out) { writer.add_log(out, keySuffix, payload); });
+			return true;
+		}
+		if (batcher) {
+			batcher->append([&](std::string& out) {
+				append_record(out, keySuffix, payload);
+				out.push_back('\n');
+			});
+			return true;
+		}
+		return post_single(*state, *state->transport, keySuffix, payload);
+	}
+
+	// Structured event: a binary event record, or its JSON form as the log text otherwise.
+	bool submit_event(const std::string& keySuffix, const WireEvent& event, Priority priority = Priority::High) {
+		auto state = snapshot();
+		if (!state) return false;
+		if (!state->binary) return submit(keySuffix, wire_event_json(event), priority);
+		if (priority == Priority::Critical) {
+			urgentPosts_.fetch_add(1, std::memory_order_relaxed);
+			PooledBuffer frame(state->bodies);
+			{
+				std::lock_guard<std::mutex> lock(state->urgentMutex);
+				state->urgentWriter.begin(*frame);
+				state->urgentWriter.add_event(*frame, keySuffix, event);
+			}
+			return post_batch(*state, *state->urgentTransport, *frame, 1);
+		}
+		WireWriter& writer = state->writer_for(priority);
+		state->batcher_for(priority)->append([&](std::string& out) { writer.add_event(out, keySuffix, event); });
+		return true;
+	}
+
+	// Uploads one payload as its own object, bypassing any batching.
+	bool upload_payload(const std::string& keySuffix, const std::string& payload) {
+		if (payload.empty()) return false;
+		auto state = snapshot();
+		if (!state) return false;
+		return post_single(*state, *state->transport, keySuffix, payload);
+	}
+
+	// Pushes out any partially filled batch and waits for the batch uploads (e.g. on shutdown).
+	void flush() {
+		auto state = snapshot();
+		if (state && state->batcher) state->batcher->flush();
+		if (state && state->bulkBatcher) state->bulkBatcher->flush();
+	}
+
+	// Regular and bulk batches together.
+	BatchStats batch_stats() const {
+		auto state = snapshot();
+		BatchStats total;
+		if (!state || !state->batcher) return total;
+		for (const EventBatcher* batcher : { state->batcher.get(), state->bulkBatcher.get() }) {
+			const BatchStats b = batcher->stats();
+			total.records += b.records;
+			total.batches += b.batches;
+			total.bytes += b.bytes;
+		}
+		return total;
+	}
+
+	// CRITICAL records posted on their own, bypassing the batchers.
+	uint64_t urgent_posts() const { return urgentPosts_.load(std::memory_order_relaxed); }
+
+	// Flow controller state, plus the regular batch limits it currently yields; zeroes when the
+	// uploads are not adaptive.
+	FlowStats flow_stats(BatchLimits* current = nullptr) const {
+		auto state = snapshot();
+		if (!state || !state->flow) return FlowStats();
+		if (current) *current = state->batcher->limits();
+		return state->flow->stats();
+	}
+
+	// Batch uploads repeated because the backend answered 429/503.
+	uint64_t busy_retries() const {
+		auto state = snapshot();
+		return state ? state->busyRetries.load(std::memory_order_relaxed) : 0;
+	}
+
+	// Payload and body buffers of the current configuration, batchers included.
+	PoolStats buffer_stats() const {
+		auto state = snapshot();
+		PoolStats total;
+		if (!state) return total;
+		auto add = [&total](const PoolStats& p) {
+			total.reused += p.reused;
+			total.created += p.created;
+			total.misses += p.misses;
+		};
+		add(state->bodies.stats());
+		if (state->batcher) add(state->batcher->buffer_stats());
+		if (state->bulkBatcher) add(state->bulkBatcher->buffer_stats());
+		return total;
+	}
+
+	ApiUploader(const ApiUploader&) = delete;
+	ApiUploader& operator=(const ApiUploader&) = delete;
+
+private:
+	struct State {
+		// Both batchers flush before either is destroyed: a flush may rescale the other one.
+		~State() {
+			if (batcher) batcher->stop();
+			if (bulkBatcher) bulkBatcher->stop();
+		}
+
+		HttpEndpoint endpoint;
+		std::string token;
+		std::string batchResource;
+		bool binary{false};
+		mutable WireWriter writer;     // only touched under the batcher lock
+		mutable WireWriter bulkWriter; // only touched under the bulk batcher lock
+		mutable std::mutex urgentMutex;
+		mutable WireWriter urgentWriter; // CRITICAL frames, under urgentMutex
+		mutable BufferPool bodies{kPooledBodies, kMaxPooledBody}; // single-record bodies and frames
+		std::shared_ptr<HttpTransport> transport;
+		std::shared_ptr<HttpTransport> urgentTransport; // CRITICAL posts; may be the same as transport
+		BatchLimits limits;                    // configured; what the flow controller scales
+		BatchLimits bulkLimits;
+		std::unique_ptr<FlowController> flow;  // null when the limits are fixed
+		mutable std::atomic<uint64_t> busyRetries{0};
+		// Declared last: flushed while the transports are alive.
+		std::unique_ptr<EventBatcher> batcher;     // HIGH
+		std::unique_ptr<EventBatcher> bulkBatcher; // MEDIUM and LOW
+
+		EventBatcher* batcher_for(Priority priority) const {
+			return priority == Priority::High ? batcher.get() : bulkBatcher.get();
+		}
+		WireWriter& writer_for(Priority priority) const {
+			return priority == Priority::High ? writer : bulkWriter;
+		}
+
+		void apply_flow_limits() const {
+			const BatchLimits regular = flow->scaled(limits);
+			const BatchLimits bulk = flow->scaled(bulkLimits);
+			batcher->set_limits(regular.maxEvents, regular.maxBytes);
+			bulkBatcher->set_limits(bulk.maxEvents, bulk.maxBytes);
+		}
+	};
+
+	// Single-record bodies in flight at once (one per pooled connection is plenty), and the largest
+	// body buffer worth keeping.
+	static constexpr size_t kPooledBodies = 16;
+	static constexpr size_t kMaxPooledBody = 1 << 20;
+	// Times a paced batch is offered to a busy (429/503) backend before it is dropped.
+	static constexpr unsigned kMaxBusyAttempts = 5;
+
+	// Same JSON object the single-upload route accepts, one per NDJSON line.
+	static void append_record(std::string& out, const std::string& keySuffix, const std::string& payload) {
+		out += "{\"log\":\"";
+		json_escape_append(out, payload);
+		out += "\",\"filename\":\"";
+		json_escape_append(out, keySuffix);
+		out += "\"}";
+	}
+
+	// "/api/logs/upload" -> "/api/logs/batch"; any other path gets "/batch" appended.
+	static std::string default_batch_resource(const std::string& resource) {
+		std::string path = resource.substr(0, resource.find('?'));
+		static const std::string kUpload = "/upload";
+		if (path.size() >= kUpload.size() && path.compare(path.size() - kUpload.size(), kUpload.size(), kUpload) == 0) {
+			path.erase(path.size() - kUpload.size());
+		} else if (!path.empty() && path.back() == '/') {
+			path.pop_back();
+		}
+		return path + "/batch";
+	}
+
+	static bool post_single(const State& state, HttpTransport& transport, const std::string& keySuffix,
+		const std::string& payload) {
+		PooledBuffer body(state.bodies);
+		append_record(*body, keySuffix, payload);
+		HttpRequest req;
+		req.bearerToken = state.token;
+		req.body = body->data();
+		req.bodySize = body->size();
+		return check_response(transport, transport.post(req), "Upload");
+	}
+
+	// paced: the batch goes through the flow controller (and waits out a busy backend).
+	static bool post_batch(const State& state, HttpTransport& transport, const std::string& payload, size_t count,
+		bool paced = false) {
+		HttpRequest req;
+		req.resource = state.batchResource;
+		req.contentType = state.binary ? kWireContentType : "application/x-ndjson";
+		req.bearerToken = state.token;
+		req.body = payload.data();
+		req.bodySize = payload.size();
+		HttpResponse resp;
+		if (paced && state.flow) {
+			for (unsigned attempt = 1;; ++attempt) {
+				const uint64_t ticket = state.flow->acquire();
+				const auto start = FlowController::clock::now();
+				resp = transport.post(req);
+				if (state.flow->release(ticket, resp, FlowController::clock::now() - start)) state.apply_flow_limits();
+				if (!FlowController::backpressure(resp) || attempt == kMaxBusyAttempts) break;
+				state.busyRetries.fetch_add(1, std::memory_order_relaxed);
+			}
+		} else {
+			resp = transport.post(req);
+		}
+		if (!check_response(transport, resp, "Batch upload")) {
+			std::cerr << "[FIM] Dropped batch of " << count << " records (" << payload.size() << " bytes)." << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	static bool check_response(const HttpTransport& transport, const HttpResponse& resp, const char* what) {
+		if (!resp.error.empty()) {
+			std::cerr << "[FIM] " << what << " via " << transport.name() << " failed: " << resp.error << std::endl;
+			return false;
+		}
+		if (!resp.ok()) {
+			std::cerr << "[FIM] " << what << " rejected with HTTP " << resp.status << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::shared_ptr<const State> snapshot() const {
+		std::lock_guard<std::mutex> lock(stateMutex_);
+		return state_;
+	}
+
+	TransportFactory factory_;
+	mutable std::mutex stateMutex_;
+	std::shared_ptr<const State> state_;
+	std::atomic<bool> configured_{false};
+	std::atomic<uint64_t> urgentPosts_{0};
+};
+
+} // namespace fim
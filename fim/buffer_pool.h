@@ -0,0 +1,163 @@
+// Recycled buffers and objects for the shipping path.
+// Payloads, request bodies and alert records are handed back after use instead of freed, keeping
+// whatever capacity they grew to, so once the pools have warmed up to the working set a record
+// travels from the pipeline to the transport without touching the heap. Both pools are bounded:
+// past their limit they fall back to plain allocation (counted as a miss) rather than wait.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fim {
+
+struct PoolStats {
+	uint64_t reused{0};  // requests served from the pool
+	uint64_t created{0}; // allocations made to grow the pool up to its limit
+	uint64_t misses{0};  // allocations made because the pool was exhausted (or a buffer was too big to keep)
+};
+
+// Free list of std::string buffers. acquire() returns an empty string that usually already has
+// capacity; release() takes it back unless the free list is full or the buffer grew past
+// maxCapacity (one oversized payload should not pin its memory for good).
+class BufferPool {
+public:
+	BufferPool(size_t maxBuffers, size_t maxCapacity) : maxBuffers_(maxBuffers), maxCapacity_(maxCapacity) {
+		free_.reserve(maxBuffers_);
+	}
+
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+
+	std::string acquire() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!free_.empty()) {
+				std::string buffer = std::move(free_.back());
+				free_.pop_back();
+				++stats_.reused;
+				return buffer;
+			}
+			++stats_.created;
+		}
+		return std::string();
+	}
+
+	void release(std::string&& buffer) {
+		if (buffer.capacity() > maxCapacity_.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			++stats_.misses;
+			return; // freed on the way out
+		}
+		buffer.clear();
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (free_.size() < maxBuffers_) free_.push_back(std::move(buffer));
+	}
+
+	// For owners whose payloads change size at run time (adaptive batches); buffers already pooled
+	// are kept until they next come back.
+	void set_max_capacity(size_t maxCapacity) { maxCapacity_.store(maxCapacity, std::memory_order_relaxed); }
+
+	PoolStats stats() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return stats_;
+	}
+
+private:
+	const size_t maxBuffers_;
+	std::atomic<size_t> maxCapacity_;
+	mutable std::mutex mutex_;
+	std::vector<std::string> free_;
+	PoolStats stats_;
+};
+
+// Takes a buffer from the pool for the lifetime of the scope and gives it back afterwards.
+class PooledBuffer {
+public:
+	explicit PooledBuffer(BufferPool& pool) : pool_(pool), buffer_(pool.acquire()) {}
+	~PooledBuffer() { pool_.release(std::move(buffer_)); }
+
+	PooledBuffer(const PooledBuffer&) = delete;
+	PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+	std::string& operator*() { return buffer_; }
+	std::string* operator->() { return &buffer_; }
+
+private:
+	BufferPool& pool_;
+	std::string buffer_;
+};
+
+// Objects shared between consumers (an alert record queued on every sink) and recycled once the
+// last consumer lets go. Each slot is one make_shared allocation, made by reserve() or when the
+// pool grows; a slot is free again when the pool holds its only reference, and hands its members
+// (with their capacity) to the next acquire(). Slots are probed round-robin from where the last
+// search stopped, which finds a free one at once when records are released roughly in the order
+// they were taken. Past maxSlots acquire() falls back to a fresh make_shared.
+template <typename T>
+class RecyclingPool {
+public:
+	explicit RecyclingPool(size_t maxSlots) : maxSlots_(std::max<size_t>(maxSlots, 1)) {
+		slots_.reserve(maxSlots_);
+	}
+
+	RecyclingPool(const RecyclingPool&) = delete;
+	RecyclingPool& operator=(const RecyclingPool&) = delete;
+
+	// The object keeps whatever the previous user left in it; the caller resets what it uses.
+	std::shared_ptr<T> acquire() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		const size_t probes = std::min(slots_.size(), kMaxProbes);
+		for (size_t i = 0; i < probes; ++i) {
+			if (cursor_ >= slots_.size()) cursor_ = 0;
+			const std::shared_ptr<T>& slot = slots_[cursor_++];
+			if (slot.use_count() == 1) {
+				// Pairs with the release decrement of the last consumer, so its reads of the old
+				// contents happen before the caller overwrites them.
+				std::atomic_thread_fence(std::memory_order_acquire);
+				++stats_.reused;
+				return slot;
+			}
+		}
+		if (slots_.size() < maxSlots_) {
+			slots_.push_back(std::make_shared<T>());
+			++stats_.created;
+			return slots_.back();
+		}
+		++stats_.misses;
+		return std::make_shared<T>();
+	}
+
+	// Creates slots up front (up to maxSlots) so the pool need not grow while it is busy.
+	void reserve(size_t count) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		while (slots_.size() < std::min(count, maxSlots_)) {
+			slots_.push_back(std::make_shared<T>());
+			++stats_.created;
+		}
+	}
+
+	PoolStats stats() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return stats_;
+	}
+
+private:
+	// Bounds the search when most slots are in flight; past it the pool grows instead.
+	static constexpr size_t kMaxProbes = 32;
+
+	const size_t maxSlots_;
+	mutable std::mutex mutex_;
+	std::vector<std::shared_ptr<T>> slots_;
+	size_t cursor_{0};
+	PoolStats stats_;
+};
+
+} // namespace fim
@@ -0,0 +1,136 @@
+// Hot reload of fim_config.yml.
+// A background thread polls the file's modification time and size; when they change (and the
+// content really differs) the file is parsed again, a new PathMatcher is compiled and handed to
+// EventPipeline::reload(), which swaps it in without blocking the event path and reconciles the
+// hash index (new roots are indexed, removed ones dropped). A file that no longer parses is
+// reported and the rules in force are kept. Only directory and exclusion rules are reloaded;
+// fim_settings.scan_interval still needs a restart.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "env.h"
+#include "event_pipeline.h"
+#include "fim_config.h"
+#include "path_matcher.h"
+#include "utf_convert.h"
+
+namespace fim {
+
+class ConfigWatcher {
+public:
+	// FIM_CONFIG_RELOAD_SEC sets the poll interval (default 5 s, 0 disables reloading).
+	ConfigWatcher(EventPipeline& pipeline, std::filesystem::path path, unsigned scanIntervalSec)
+		: pipeline_(pipeline),
+		  path_(std::move(path)),
+		  interval_(getenv_string("FIM_CONFIG_RELOAD_SEC") == "0" ? std::chrono::seconds(0)
+		                                                          : std::chrono::seconds(getenv_size("FIM_CONFIG_RELOAD_SEC", 5))),
+		  scanIntervalSec_(scanIntervalSec) {
+		stamp_ = read_stamp();
+		content_ = read_content();
+	}
+
+	ConfigWatcher(const ConfigWatcher&) = delete;
+	ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+	~ConfigWatcher() { stop(); }
+
+	void start() {
+		if (interval_.count() == 0 || thread_.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = false;
+		}
+		thread_ = std::thread([this]() { run(); });
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		cv_.notify_all();
+		if (thread_.joinable()) thread_.join();
+	}
+
+	// Reloads now if the file changed since the last check; true when new rules were applied.
+	bool check() {
+		const Stamp stamp = read_stamp();
+		if (stamp == stamp_) return false;
+		stamp_ = stamp;
+		std::string content = read_content();
+		if (content.empty() || content == content_) return false;
+
+		FimConfig config;
+		try {
+			config = load_fim_config(wide_to_utf8(path_.wstring()));
+		} catch (const std::exception& ex) {
+			std::cerr << "[FIM] Config reload failed, keeping current rules: " << ex.what() << std::endl;
+			return false;
+		}
+		content_ = std::move(content);
+		if (config.scanIntervalSec != scanIntervalSec_) {
+			std::cout << "[FIM] fim_settings.scan_interval changed; restart to apply it" << std::endl;
+			scanIntervalSec_ = config.scanIntervalSec;
+		}
+		pipeline_.reload(PathMatcher(config));
+		return true;
+	}
+
+private:
+	struct Stamp {
+		std::filesystem::file_time_type modified{};
+		uintmax_t size{0};
+
+		bool operator==(const Stamp& other) const { return modified == other.modified && size == other.size; }
+	};
+
+	Stamp read_stamp() const {
+		Stamp stamp;
+		std::error_code ec;
+		stamp.modified = std::filesystem::last_write_time(path_, ec);
+		if (ec) return Stamp();
+		stamp.size = std::filesystem::file_size(path_, ec);
+		if (ec) stamp.size = 0;
+		return stamp;
+	}
+
+	std::string read_content() const {
+		std::ifstream in(path_, std::ios::binary);
+		if (!in) return std::string();
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!cv_.wait_for(lock, interval_, [this]() { return stopping_; })) {
+			lock.unlock();
+			check();
+			lock.lock();
+		}
+	}
+
+	EventPipeline& pipeline_;
+	std::filesystem::path path_;
+	std::chrono::seconds interval_;
+	unsigned scanIntervalSec_;
+	Stamp stamp_;
+	std::string content_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stopping_{false};
+	std::thread thread_;
+};
+
+} // namespace fim
@@ -0,0 +1,190 @@
+// libcurl backend for fim::HttpTransport.
+// Keeps a fixed pool of easy handles, one per allowed in-flight request. Each handle holds its
+// own keep-alive connection, so steady-state uploads reuse sockets instead of reconnecting.
+// The URL and header list of a handle are kept between requests and only rebuilt when the
+// request asks for different ones, so a steady stream of uploads sets no strings on the handle.
+// Portable: this is the backend used when the uploader is built on Linux (link with -lcurl).
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "http_transport.h"
+
+namespace fim {
+
+class CurlTransport : public HttpTransport {
+public:
+	CurlTransport(const HttpEndpoint& endpoint, const TransportOptions& options)
+		: endpoint_(endpoint), options_(options) {
+		static std::once_flag globalInit;
+		std::call_once(globalInit, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+		const size_t count = options.maxInFlight == 0 ? 1 : options.maxInFlight;
+		handles_.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			CURL* curl = curl_easy_init();
+			if (!curl) continue;
+			// Options that never change; curl_easy_reset is not called so they (and the
+			// connection cache) survive between requests.
+			curl_easy_setopt(curl, CURLOPT_POST, 1L);
+			curl_easy_setopt(curl, CURLOPT_USERAGENT, options_.userAgent.c_str());
+			curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(options_.timeoutMs));
+			curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+			curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &CurlTransport::discard_body);
+			curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &CurlTransport::capture_header);
+			handles_.push_back(std::make_unique<Handle>());
+			handles_.back()->curl = curl;
+			idle_.push_back(handles_.back().get());
+		}
+	}
+
+	~CurlTransport() override {
+		for (const auto& handle : handles_) {
+			curl_easy_cleanup(handle->curl);
+			curl_slist_free_all(handle->headers);
+		}
+	}
+
+	CurlTransport(const CurlTransport&) = delete;
+	CurlTransport& operator=(const CurlTransport&) = delete;
+
+	bool valid() const { return !handles_.empty(); }
+
+	HttpResponse post(const HttpRequest& req) override {
+		HttpResponse resp;
+		if (!valid()) {
+			resp.error = "curl_easy_init failed";
+			return resp;
+		}
+
+		Handle* handle = acquire();
+		CURL* curl = handle->curl;
+		prepare(*handle, req);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req.body ? req.body : "");
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(req.bodySize));
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &resp);
+
+		const CURLcode rc = curl_easy_perform(curl);
+		if (rc == CURLE_OK) {
+			long status = 0;
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+			resp.status = static_cast<int>(status);
+		} else {
+			resp.error = curl_easy_strerror(rc);
+		}
+
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, nullptr);
+		release(handle);
+		return resp;
+	}
+
+	const char* name() const override { return "libcurl"; }
+
+private:
+	// One easy handle with the URL and header list of its last request. Requests from the
+	// uploader repeat the same few combinations, so both are rebuilt only when they change.
+	struct Handle {
+		CURL* curl{nullptr};
+		struct curl_slist* headers{nullptr};
+		std::string resource;
+		std::string contentType;
+		std::string bearerToken;
+		bool extraHeaders{false};
+		bool prepared{false};
+	};
+
+	void prepare(Handle& handle, const HttpRequest& req) const {
+		const std::string_view resource = req.resource.empty() ? std::string_view(endpoint_.resource) : req.resource;
+		if (!handle.prepared || handle.resource != resource) {
+			handle.resource.assign(resource.data(), resource.size());
+			const std::string url = std::string(endpoint_.secure ? "https://" : "http://") + endpoint_.host + ":" +
+				std::to_string(endpoint_.port) + handle.resource;
+			curl_easy_setopt(handle.curl, CURLOPT_URL, url.c_str()); // curl keeps its own copy
+		}
+		if (handle.prepared && !handle.extraHeaders && req.headers.empty() && handle.contentType == req.contentType &&
+			handle.bearerToken == req.bearerToken) {
+			return;
+		}
+		handle.contentType.assign(req.contentType.data(), req.contentType.size());
+		handle.bearerToken.assign(req.bearerToken.data(), req.bearerToken.size());
+		handle.extraHeaders = !req.headers.empty();
+		handle.prepared = true;
+
+		struct curl_slist* headers = nullptr;
+		headers = curl_slist_append(headers, ("Content-Type: " + handle.contentType).c_str());
+		if (!handle.bearerToken.empty()) {
+			headers = curl_slist_append(headers, ("Authorization: Bearer " + handle.bearerToken).c_str());
+		}
+		for (const auto& header : req.headers) {
+			headers = curl_slist_append(headers, (header.first + ": " + header.second).c_str());
+		}
+		// Avoid the extra round trip curl adds for "Expect: 100-continue" on larger bodies.
+		headers = curl_slist_append(headers, "Expect:");
+		curl_easy_setopt(handle.curl, CURLOPT_HTTPHEADER, headers);
+		curl_slist_free_all(handle.headers);
+		handle.headers = headers;
+	}
+
+	Handle* acquire() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [this]() { return !idle_.empty(); });
+		Handle* handle = idle_.back();
+		idle_.pop_back();
+		return handle;
+	}
+
+	void release(Handle* handle) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			idle_.push_back(handle);
+		}
+		cv_.notify_one();
+	}
+
+	static size_t discard_body(char*, size_t size, size_t nmemb, void*) { return size * nmemb; }
+
+	static size_t capture_header(char* data, size_t size, size_t nmemb, void* userdata) {
+		const size_t len = size * nmemb;
+		auto* resp = static_cast<HttpResponse*>(userdata);
+		static const char kRetryAfter[] = "retry-after:";
+		const size_t keyLen = sizeof(kRetryAfter) - 1;
+		if (resp && len > keyLen) {
+			bool match = true;
+			for (size_t i = 0; i < keyLen && match; ++i) {
+				char c = data[i];
+				if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+				match = (c == kRetryAfter[i]);
+			}
+			if (match) {
+				// Seconds form only; the value is not NUL-terminated, so parse it in place.
+				size_t i = keyLen;
+				while (i < len && (data[i] == ' ' || data[i] == '\t')) ++i;
+				unsigned long seconds = 0;
+				for (; i < len && data[i] >= '0' && data[i] <= '9' && seconds < 86400UL * 365; ++i) {
+					seconds = seconds * 10 + static_cast<unsigned long>(data[i] - '0');
+				}
+				resp->retryAfterSec = static_cast<unsigned>(seconds);
+			}
+		}
+		return len;
+	}
+
+	HttpEndpoint endpoint_;
+	TransportOptions options_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::vector<std::unique_ptr<Handle>> handles_;
+	std::vector<Handle*> idle_;
+};
+
+} // namespace fim
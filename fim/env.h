@@ -0,0 +1,31 @@
+// Environment variable helpers shared by the FIM sender components.
+// Settings arrive through the process environment, usually populated from the .env file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace fim {
+
+inline std::string getenv_string(const char* name) {
+	if (const char* value = std::getenv(name)) return value;
+	return {};
+}
+
+// Positive integer setting; missing, malformed or zero values fall back (with a warning when set).
+inline size_t getenv_size(const char* name, size_t fallback) {
+	const char* value = std::getenv(name);
+	if (!value || !*value) return fallback;
+	char* end = nullptr;
+	const unsigned long long parsed = std::strtoull(value, &end, 10);
+	if (end == value || *end != '\0' || parsed == 0) {
+		std::cerr << "[FIM] Ignoring invalid " << name << "='" << value << "'" << std::endl;
+		return fallback;
+	}
+	return static_cast<size_t>(parsed);
+}
+
+} // namespace fim
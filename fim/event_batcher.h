@@ -0,0 +1,259 @@
+// Client-side batching of upload records into NDJSON (or wire_format.h binary) payloads.
+// A batch is flushed when it reaches maxBytes or maxEvents, or when its oldest record has
+// waited maxDelay. Flushing happens outside the lock, so concurrent flushes are possible and
+// the flush callback must be thread-safe (the pooled transports are).
+// Without upload threads a full batch is flushed on the thread whose record filled it, and a
+// batch that timed out on the timer thread. With N of them, a full batch is handed to whichever
+// thread is free next, so append() only waits when all N are busy and one more batch is already
+// waiting for them.
+// Payload buffers are recycled: the callback borrows the payload and it goes back to the pool
+// afterwards, so a warmed-up batcher builds every batch in memory it already owns.
+// The size limits can be changed while running (flow_control.h adapts them to the link).
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "buffer_pool.h"
+
+namespace fim {
+
+struct BatchLimits {
+	size_t maxBytes{256 * 1024};
+	size_t maxEvents{500};
+	std::chrono::milliseconds maxDelay{2000};
+};
+
+struct BatchStats {
+	uint64_t records{0};
+	uint64_t batches{0};
+	uint64_t bytes{0};
+};
+
+class EventBatcher {
+public:
+	// Receives one payload (e.g. newline-terminated NDJSON records) and the number of records in it.
+	// The payload is only valid during the call.
+	using FlushFn = std::function<void(const std::string& payload, size_t count)>;
+	// Optional frame header writer, called before the first record of every batch.
+	using BeginFn = std::function<void(std::string& payload)>;
+
+	// uploaders: threads that run the flush callback (0 = the appending or timer thread does).
+	EventBatcher(const BatchLimits& limits, FlushFn flush, BeginFn begin = nullptr, size_t uploaders = 0)
+		: limits_(limits), flush_(std::move(flush)), begin_(std::move(begin)),
+		  buffers_(kPooledPayloads + 2 * uploaders, std::max<size_t>(limits.maxBytes, 1) * 4),
+		  uploaderCount_(uploaders) {
+		if (limits_.maxEvents == 0) limits_.maxEvents = 1;
+		if (limits_.maxBytes == 0) limits_.maxBytes = 1;
+		pending_ = buffers_.acquire();
+		for (size_t i = 0; i < uploaderCount_; ++i) uploaders_.emplace_back([this]() { run_uploader(); });
+		timer_ = std::thread([this]() { run_timer(); });
+	}
+
+	~EventBatcher() { stop(); }
+
+	EventBatcher(const EventBatcher&) = delete;
+	EventBatcher& operator=(const EventBatcher&) = delete;
+
+	// Appends one JSON record (without trailing newline).
+	void add(const std::string& record) {
+		append([&record](std::string& payload) {
+			payload.append(record);
+			payload.push_back('\n');
+		});
+	}
+
+	// Lets encode() write one record straight into the pending batch; runs under the batch lock,
+	// so encoders may keep per-batch state (reset from BeginFn).
+	template <typename Encode>
+	void append(Encode&& encode) {
+		std::string ready;
+		size_t readyCount = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (stopped_) return;
+			if (pendingCount_ == 0) {
+				oldest_ = std::chrono::steady_clock::now();
+				cv_.notify_one();
+				if (begin_) begin_(pending_);
+			}
+			encode(pending_);
+			++pendingCount_;
+			if (pending_.size() >= limits_.maxBytes || pendingCount_ >= limits_.maxEvents) {
+				take_locked(ready, readyCount);
+			}
+		}
+		if (readyCount) hand_off(std::move(ready), readyCount);
+	}
+
+	// Flushes the pending batch and waits until the upload threads have flushed every batch
+	// handed to them. Must not be called from the flush callback.
+	void flush() {
+		std::string ready;
+		size_t readyCount = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			take_locked(ready, readyCount);
+		}
+		if (readyCount) hand_off(std::move(ready), readyCount);
+		std::unique_lock<std::mutex> lock(readyMutex_);
+		idleCv_.wait(lock, [this]() { return !readyFull_ && uploading_ == 0; });
+	}
+
+	// Flushes what is pending and stops the latency timer and upload threads. Idempotent.
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (stopped_) return;
+			stopped_ = true;
+		}
+		cv_.notify_all();
+		if (timer_.joinable()) timer_.join();
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(readyMutex_);
+			uploadersStopped_ = true;
+		}
+		readyCv_.notify_all();
+		spaceCv_.notify_all();
+		for (std::thread& uploader : uploaders_) uploader.join();
+	}
+
+	// New size thresholds; the delay stays. A pending batch already past them goes out with the
+	// next record.
+	void set_limits(size_t maxEvents, size_t maxBytes) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		limits_.maxEvents = std::max<size_t>(maxEvents, 1);
+		limits_.maxBytes = std::max<size_t>(maxBytes, 1);
+		buffers_.set_max_capacity(limits_.maxBytes * 4);
+	}
+
+	BatchLimits limits() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return limits_;
+	}
+
+	BatchStats stats() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return stats_;
+	}
+
+	PoolStats buffer_stats() const { return buffers_.stats(); }
+
+private:
+	// Payloads that can be out at once: the one filling plus those being flushed concurrently
+	// (the pool grows by two per upload thread).
+	static constexpr size_t kPooledPayloads = 16;
+
+	void take_locked(std::string& out, size_t& count) {
+		count = pendingCount_;
+		if (count == 0) return;
+		out.swap(pending_);
+		pending_ = buffers_.acquire();
+		if (pending_.capacity() < out.capacity()) pending_.reserve(out.capacity());
+		pendingCount_ = 0;
+		++stats_.batches;
+		stats_.records += count;
+		stats_.bytes += out.size();
+	}
+
+	void deliver(std::string&& payload, size_t count) {
+		flush_(payload, count);
+		buffers_.release(std::move(payload));
+	}
+
+	// Delivers the batch here without upload threads (or once they have stopped); otherwise
+	// leaves it for the next free one, waiting while another batch is already waiting.
+	void hand_off(std::string&& payload, size_t count) {
+		if (uploaderCount_) {
+			std::unique_lock<std::mutex> lock(readyMutex_);
+			spaceCv_.wait(lock, [this]() { return !readyFull_ || uploadersStopped_; });
+			if (!uploadersStopped_) {
+				ready_.swap(payload);
+				readyEvents_ = count;
+				readyFull_ = true;
+				lock.unlock();
+				readyCv_.notify_one();
+				return;
+			}
+		}
+		deliver(std::move(payload), count);
+	}
+
+	void run_uploader() {
+		std::unique_lock<std::mutex> lock(readyMutex_);
+		for (;;) {
+			readyCv_.wait(lock, [this]() { return readyFull_ || uploadersStopped_; });
+			if (!readyFull_) return;
+			std::string payload;
+			payload.swap(ready_);
+			const size_t count = readyEvents_;
+			readyFull_ = false;
+			++uploading_;
+			lock.unlock();
+			spaceCv_.notify_one();
+			deliver(std::move(payload), count);
+			lock.lock();
+			if (--uploading_ == 0 && !readyFull_) idleCv_.notify_all();
+		}
+	}
+
+	void run_timer() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!stopped_) {
+			if (pendingCount_ == 0) {
+				cv_.wait(lock, [this]() { return stopped_ || pendingCount_ > 0; });
+				continue;
+			}
+			const auto deadline = oldest_ + limits_.maxDelay;
+			if (std::chrono::steady_clock::now() < deadline) {
+				cv_.wait_until(lock, deadline);
+				continue;
+			}
+			std::string ready;
+			size_t readyCount = 0;
+			take_locked(ready, readyCount);
+			lock.unlock();
+			if (readyCount) hand_off(std::move(ready), readyCount);
+			lock.lock();
+		}
+	}
+
+	BatchLimits limits_;
+	FlushFn flush_;
+	BeginFn begin_;
+	BufferPool buffers_;
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::string pending_;
+	size_t pendingCount_{0};
+	std::chrono::steady_clock::time_point oldest_{};
+	BatchStats stats_;
+	bool stopped_{false};
+	std::thread timer_;
+
+	// The batch waiting for an upload thread, and the threads.
+	const size_t uploaderCount_;
+	std::mutex readyMutex_;
+	std::condition_variable readyCv_; // a batch is ready, or the threads should exit
+	std::condition_variable spaceCv_; // ready_ was taken
+	std::condition_variable idleCv_;  // nothing queued or being flushed
+	std::string ready_;
+	size_t readyEvents_{0};
+	bool readyFull_{false};
+	size_t uploading_{0};
+	bool uploadersStopped_{false};
+	std::vector<std::thread> uploaders_;
+};
+
+} // namespace fim
@@ -0,0 +1,707 @@
+// FIM event pipeline: everything that happens to a file event after it leaves its source.
+// Classifies the target path, queues the event on the worker pool, fans the event out to the alert
+// sinks (alert_sinks.h), and keeps the file hash index up to date (reporting adds, changes and
+// removals).
+// Portable: the Windows sender plugs in BCrypt hashing and the EvtSubscribe source, the replay
+// tool plugs in the portable SHA-256 and ReplayEventSource.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "alert_sinks.h"
+#include "env.h"
+#include "event_source.h"
+#include "hash_index.h"
+#include "latency.h"
+#include "path_matcher.h"
+#include "rcu.h"
+#include "sha256.h"
+#include "sysmon_fields.h"
+#include "utf_convert.h"
+#include "wire_format.h"
+#include "work_queue.h"
+
+namespace fim {
+
+// Computes the lowercase hex SHA-256 of a file; false when the file cannot be read.
+using FileHasher = bool (*)(const std::wstring& path, std::string& hashHex);
+
+inline bool portable_file_hasher(const std::wstring& path, std::string& hashHex) {
+	return hash_file_sha256(wide_to_utf8(path), hashHex);
+}
+
+inline unsigned long current_process_id() {
+#if defined(_WIN32)
+	return static_cast<unsigned long>(_getpid());
+#else
+	return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// "20251117T101530.123Z", the prefix used for every uploaded object name.
+inline void append_utc_object_timestamp(std::string& out) {
+	const auto now = std::chrono::system_clock::now();
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+	const std::time_t t = std::chrono::system_clock::to_time_t(now);
+	std::tm tm{};
+#if defined(_WIN32)
+	gmtime_s(&tm, &t);
+#else
+	gmtime_r(&t, &tm);
+#endif
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%04d%02d%02dT%02d%02d%02d.%03dZ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+		tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(ms));
+	out += buf;
+}
+
+inline std::string utc_object_timestamp() {
+	std::string out;
+	append_utc_object_timestamp(out);
+	return out;
+}
+
+// The append_ forms write into a caller's (reused) buffer; the build_ forms return a new string.
+inline void append_event_object_suffix(std::string& out, uint16_t eventId, const char* extension = ".xml") {
+	append_utc_object_timestamp(out);
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "_evt-%u_pid-%lu", static_cast<unsigned>(eventId), current_process_id());
+	out += buf;
+	out += extension;
+}
+
+inline std::string build_event_object_suffix(uint16_t eventId, const char* extension = ".xml") {
+	std::string out;
+	append_event_object_suffix(out, eventId, extension);
+	return out;
+}
+
+inline void append_hash_log_suffix(std::string& out, const char* tag) {
+	append_utc_object_timestamp(out);
+	out += "_hash-";
+	out += tag;
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "_pid-%lu.log", current_process_id());
+	out += buf;
+}
+
+inline std::string build_hash_log_suffix(const char* tag) {
+	std::string out;
+	append_hash_log_suffix(out, tag);
+	return out;
+}
+
+inline const wchar_t* event_label(uint16_t eventId) {
+	// Common Sysmon file EventIDs; Security 4663 = access attempt
+	switch (eventId) {
+	case 11: return L"CREATED";
+	case 23: return L"DELETED";
+	case 26: return L"DELETE_DETECTED";
+	case 4663: return L"ACCESS";
+	default: return L"EVENT";
+	}
+}
+
+// Console output: wide on Windows (as the sender always printed), UTF-8 elsewhere.
+inline void echo_line(const std::wstring& line, bool toStderr = false) {
+	static std::mutex echoMutex;
+	std::lock_guard<std::mutex> lock(echoMutex);
+#if defined(_WIN32)
+	(toStderr ? std::wcerr : std::wcout) << line << std::endl;
+#else
+	(toStderr ? std::cerr : std::cout) << wide_to_utf8(line) << std::endl;
+#endif
+}
+
+// What gets uploaded per event: a compact JSON record of the extracted fields (default), or the
+// full rendered event XML as before.
+enum class EventPayloadFormat {
+	Fields,
+	Xml,
+};
+
+inline const char* event_payload_format_name(EventPayloadFormat format) {
+	return format == EventPayloadFormat::Xml ? "xml" : "fields";
+}
+
+inline bool parse_event_payload_format(const std::string& text, EventPayloadFormat& out) {
+	if (text == "fields") { out = EventPayloadFormat::Fields; return true; }
+	if (text == "xml") { out = EventPayloadFormat::Xml; return true; }
+	return false;
+}
+
+// Structured upload record for one event. Falls back to id + target when the XML is unusable.
+inline void append_event_payload(std::string& out, const FimEvent& ev) {
+	SysmonFields<wchar_t> fields;
+	if (!extract_sysmon_fields(std::wstring_view(ev.xml), fields)) {
+		fields = SysmonFields<wchar_t>();
+		fields.eventId = ev.eventId;
+		fields.targetFilename = ev.target;
+	}
+	append_event_record(out, fields);
+}
+
+inline std::string build_event_payload(const FimEvent& ev) {
+	std::string out;
+	append_event_payload(out, ev);
+	return out;
+}
+
+// Binary-format event record: the same fields as build_event_payload(), decoded to UTF-8 into
+// `out`, whose strings are refilled in place (a recycled record keeps their capacity).
+inline void fill_wire_event(const FimEvent& ev, WireEvent& out) {
+	clear_wire_event(out);
+	SysmonFields<wchar_t> fields;
+	if (!extract_sysmon_fields(std::wstring_view(ev.xml), fields)) {
+		out.eventId = ev.eventId;
+		wide_to_utf8(ev.target, out.target);
+		return;
+	}
+	out.eventId = fields.eventId;
+	append_utf8_text(out.utcTime, fields.utcTime.empty() ? fields.systemTime : fields.utcTime);
+	out.unixMillis = parse_utc_millis(out.utcTime);
+	if (out.unixMillis) out.utcTime.clear(); // the text is only sent when it did not parse
+	append_utf8_text(out.computer, fields.computer);
+	append_utf8_text(out.channel, fields.channel);
+	append_utf8_text(out.image, fields.image);
+	append_utf8_text(out.target, fields.targetFilename);
+	append_utf8_text(out.processGuid, fields.processGuid);
+	append_utf8_text(out.hashes, fields.hashes);
+	append_utf8_text(out.user, fields.user);
+}
+
+inline WireEvent build_wire_event(const FimEvent& ev) {
+	WireEvent out;
+	fill_wire_event(ev, out);
+	return out;
+}
+
+enum class HashLogMode {
+	Silent,
+	Verbose,
+};
+
+struct PipelineOptions {
+	size_t workers{4};
+	size_t queueCapacity{4096};
+	OverflowPolicy overflow{OverflowPolicy::Block};
+	bool echo{true}; // print each event and hash change to the console
+	EventPayloadFormat payload{EventPayloadFormat::Fields};
+
+	// Pool sizing comes from FIM_WORKER_THREADS, FIM_QUEUE_CAPACITY and FIM_QUEUE_OVERFLOW
+	// (block | drop_newest | drop_oldest); FIM_EVENT_PAYLOAD selects fields | xml. All optional.
+	static PipelineOptions from_env() {
+		PipelineOptions options;
+		options.workers = getenv_size("FIM_WORKER_THREADS", options.workers);
+		options.queueCapacity = getenv_size("FIM_QUEUE_CAPACITY", options.queueCapacity);
+		const std::string overflow = getenv_string("FIM_QUEUE_OVERFLOW");
+		if (!overflow.empty() && !parse_overflow_policy(overflow, options.overflow)) {
+			std::cerr << "[FIM] Unknown FIM_QUEUE_OVERFLOW '" << overflow << "', using block." << std::endl;
+		}
+		const std::string payload = getenv_string("FIM_EVENT_PAYLOAD");
+		if (!payload.empty() && !parse_event_payload_format(payload, options.payload)) {
+			std::cerr << "[FIM] Unknown FIM_EVENT_PAYLOAD '" << payload << "', using fields." << std::endl;
+		}
+		return options;
+	}
+};
+
+class EventPipeline {
+public:
+	EventPipeline(PathMatcher matcher, AlertFanout& sinks, FileHasher hasher)
+		: matcher_(std::make_shared<const PathMatcher>(std::move(matcher))), sinks_(sinks), hasher_(hasher) {}
+
+	~EventPipeline() { stop(); }
+
+	EventPipeline(const EventPipeline&) = delete;
+	EventPipeline& operator=(const EventPipeline&) = delete;
+
+	void start(const PipelineOptions& options) {
+		echo_ = options.echo;
+		payload_ = options.payload;
+		pool_ = std::make_unique<WorkerPool<FimEvent>>(options.workers, options.queueCapacity, options.overflow,
+			[this](FimEvent& ev) { process(ev); });
+		std::cout << "[FIM] Event workers=" << options.workers << " queue_capacity=" << options.queueCapacity
+		          << " overflow=" << overflow_policy_name(options.overflow)
+		          << " payload=" << event_payload_format_name(options.payload) << std::endl;
+	}
+
+	// Abandons background indexing, drains queued events and joins the workers. Idempotent.
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(indexMutex_);
+			baselineStop_.store(true, std::memory_order_relaxed);
+		}
+		indexCv_.notify_all();
+		if (indexThread_.joinable()) indexThread_.join();
+		if (pool_) pool_->stop();
+	}
+
+	// Counts the event and decides whether it is worth queueing.
+	PathClassification classify(std::wstring_view target) {
+		received_.fetch_add(1, std::memory_order_relaxed);
+		PathClassification c = matcher_.read()->classify(target);
+		if (c.verdict == PathVerdict::Unmonitored) unmonitored_.fetch_add(1, std::memory_order_relaxed);
+		else if (c.verdict == PathVerdict::Excluded) excluded_.fetch_add(1, std::memory_order_relaxed);
+		return c;
+	}
+
+	// Sources that have to do extra work per event (e.g. render XML) check this first.
+	bool wants_xml() const { return !sinks_.empty(); }
+
+	// Queues an event that classify() accepted, in the queue lane of its priority (under
+	// back-pressure LOW events are dropped first). Runs inline if the pool is not started.
+	void submit(FimEvent&& ev) {
+		if (pool_) {
+			const size_t lane = priority_index(ev.priority);
+			pool_->submit(std::move(ev), lane); // drops are counted in the pool stats
+		} else {
+			process(ev);
+		}
+	}
+
+	// classify() + submit() for sources that deliver fully extracted events.
+	void deliver(FimEvent&& ev) {
+		const PathClassification c = classify(ev.target);
+		if (!c.monitored()) return;
+		ev.priority = c.priority;
+		submit(std::move(ev));
+	}
+
+	// Silently hashes every monitored file under the configured roots, CRITICAL roots first, on
+	// the calling thread. Files a live event has already handled are left alone (see mark_live()).
+	void build_baseline() {
+		const auto matcher = matcher_.snapshot();
+		run_index_job(IndexJob{ matcher, roots_by_priority(*matcher, all_roots(*matcher)), true });
+	}
+
+	// Same as build_baseline() but on the background indexing thread, so event sources can be
+	// started first; live events are served (and take precedence) while it runs. stop() abandons it.
+	void start_baseline() {
+		const auto matcher = matcher_.snapshot();
+		queue_index_job(IndexJob{ matcher, roots_by_priority(*matcher, all_roots(*matcher)), true });
+	}
+
+	// True while background indexing (start-up baseline or roots added by reload()) is pending.
+	bool baseline_running() const { return baselineRunning_.load(std::memory_order_acquire); }
+
+	// Waits until background indexing is idle (returns at once when nothing was queued).
+	void wait_baseline() {
+		std::unique_lock<std::mutex> lock(indexMutex_);
+		indexCv_.wait(lock, [this]() { return indexJobs_.empty() && !indexActive_; });
+	}
+
+	// Swaps in new path rules without blocking readers (see rcu.h) and reconciles the index:
+	// entries the new rules do not monitor are dropped silently, and roots that are new or whose
+	// filters changed are indexed in the background like the start-up baseline. Files already
+	// indexed are not hashed again.
+	void reload(PathMatcher next) {
+		std::lock_guard<std::mutex> reloadLock(reloadMutex_);
+		const auto previous = matcher_.snapshot();
+		const auto fresh = std::make_shared<const PathMatcher>(std::move(next));
+		matcher_.publish(fresh);
+
+		size_t dropped = 0;
+		std::vector<std::wstring> stale;
+		for (size_t shard = 0; shard < FileHashIndex::kShardCount; ++shard) {
+			stale.clear();
+			index_.for_each_in_shard(shard, [&](const std::wstring& path, const std::string&) {
+				if (!fresh->classify(path).monitored()) stale.push_back(path);
+			});
+			for (const auto& path : stale) dropped += remove_hash_record(path, HashLogMode::Silent) ? 1 : 0;
+		}
+
+		std::unordered_set<std::string> known;
+		for (uint32_t i = 0; i < previous->roots().size(); ++i) known.insert(previous->root_signature(i));
+		std::vector<uint32_t> added;
+		for (uint32_t i = 0; i < fresh->roots().size(); ++i) {
+			if (!known.count(fresh->root_signature(i))) added.push_back(i);
+		}
+		std::cout << "[FIM] Config reloaded: roots=" << fresh->roots().size() << " new_or_changed=" << added.size()
+		          << " dropped_entries=" << dropped << std::endl;
+		if (!added.empty()) queue_index_job(IndexJob{ fresh, roots_by_priority(*fresh, std::move(added)), false });
+	}
+
+	// Rescan entry points: re-hash a file, or drop one that no longer exists, and report any
+	// difference exactly as a live event would.
+	HashChange rescan_file(const std::wstring& path) {
+		if (!matcher_.read()->classify(path).monitored()) return HashChange::Unchanged; // dropped by a reload
+		std::string hash;
+		if (!hasher_(path, hash)) {
+			hashFailures_.fetch_add(1, std::memory_order_relaxed);
+			return HashChange::Unchanged;
+		}
+		return upsert_hash_record(path, hash, HashLogMode::Verbose);
+	}
+
+	bool report_missing(const std::wstring& path) {
+		return remove_hash_record(path, HashLogMode::Verbose);
+	}
+
+	void log_stats(std::ostream& os) const {
+		if (pool_) {
+			const QueueStats s = pool_->stats();
+			os << "[FIM] Queue depth=" << s.depth << "/" << s.capacity
+			   << " high=" << s.highWatermark
+			   << " enqueued=" << s.enqueued
+			   << " processed=" << s.processed
+			   << " failed=" << s.failed
+			   << " dropped=" << s.dropped
+			   << " blocked=" << s.blocked;
+			if (s.dropped) {
+				os << " dropped_by_priority=" << s.droppedByLane[0] << "/" << s.droppedByLane[1] << "/"
+				   << s.droppedByLane[2] << "/" << s.droppedByLane[3];
+			}
+			os << std::endl;
+		}
+		os << "[FIM] Events received=" << received_.load()
+		   << " unmonitored=" << unmonitored_.load()
+		   << " excluded=" << excluded_.load()
+		   << " hash_failures=" << hashFailures_.load()
+		   << " indexed=" << index_.size()
+		   << " latency_us p50=" << latency_.percentile_us(0.50)
+		   << " p99=" << latency_.percentile_us(0.99)
+		   << " max=" << latency_.max_us() << std::endl;
+		for (size_t i = 0; i < kPriorityCount; ++i) {
+			const LatencyHistogram& h = latencyByPriority_[i];
+			if (!h.count()) continue;
+			os << "[FIM] Latency " << priority_name(static_cast<Priority>(i)) << " events=" << h.count()
+			   << " p50_us=" << h.percentile_us(0.50) << " p99_us=" << h.percentile_us(0.99)
+			   << " max_us=" << h.max_us() << std::endl;
+		}
+		os << "[FIM] Startup baseline=";
+		if (baseline_running()) os << "indexing";
+		else os << baselineMs_.load() << "ms";
+		os << " first_event=";
+		if (firstEventSeen_.load()) os << firstEventMs_.load() << "ms";
+		else os << "none";
+		os << std::endl;
+		sinks_.log_stats(os);
+	}
+
+	QueueStats queue_stats() const { return pool_ ? pool_->stats() : QueueStats(); }
+	// Milliseconds from construction to the first processed event (0 until there is one).
+	uint64_t first_event_ms() const { return firstEventMs_.load(std::memory_order_relaxed); }
+	const LatencyHistogram& latency() const { return latency_; }
+	const LatencyHistogram& latency(Priority priority) const { return latencyByPriority_[priority_index(priority)]; }
+	// Current rules for long-lived use (a walk or pass); hold the pointer, not a reference into it.
+	std::shared_ptr<const PathMatcher> matcher() const { return matcher_.snapshot(); }
+	FileHashIndex& index() { return index_; }
+
+private:
+	void process(FimEvent& ev) {
+		if (baseline_running()) mark_live(ev.target);
+		if (echo_) {
+			std::wstringstream wss;
+			wss << L"[PID " << current_process_id() << L"] " << event_label(ev.eventId) << L" : " << ev.target;
+			echo_line(wss.str());
+		}
+		publish_event(ev);
+		handle_hash_tracking(ev.target, ev.eventId);
+		const auto done = std::chrono::steady_clock::now();
+		latency_.record(done - ev.received);
+		latencyByPriority_[priority_index(ev.priority)].record(done - ev.received);
+		if (!firstEventSeen_.exchange(true, std::memory_order_relaxed)) {
+			const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(done - created_).count();
+			firstEventMs_.store(static_cast<uint64_t>(ms), std::memory_order_relaxed);
+			std::cout << "[FIM] First event processed " << ms << " ms after start"
+			          << (baseline_running() ? " (baseline still indexing)" : "") << std::endl;
+		}
+	}
+
+	// While the background baseline runs, every path a live event touched is remembered so the
+	// baseline never overwrites (or resurrects) what the live event recorded.
+	void mark_live(const std::wstring& path) {
+		std::lock_guard<std::mutex> lock(liveMutex_);
+		if (baseline_running()) liveTouched_.insert(FileHashIndex::normalize_path_key(path));
+	}
+
+	bool touched_by_live_event(const std::wstring& path) {
+		std::lock_guard<std::mutex> lock(liveMutex_);
+		return liveTouched_.count(FileHashIndex::normalize_path_key(path)) != 0;
+	}
+
+	void publish_event(const FimEvent& ev) {
+		static std::once_flag warnOnce;
+		if (sinks_.empty()) {
+			std::call_once(warnOnce, []() {
+				std::cerr << "[FIM] No alert sinks. Provide FIM_API_URL (and optional FIM_API_TOKEN) or enable "
+				          << "alerts.methods in fim_config.yml to forward events." << std::endl;
+			});
+			return;
+		}
+		if (ev.xml.empty()) return;
+		const bool raw = payload_ == EventPayloadFormat::Xml;
+		sinks_.publish_with([&](AlertRecord& record) {
+			record.kind = AlertKind::Event;
+			record.priority = ev.priority;
+			record.received = ev.received;
+			append_event_object_suffix(record.key, ev.eventId, raw ? ".xml" : ".json");
+			if (raw) wide_to_utf8(ev.xml, record.text);
+			else if (sinks_.wants_wire_events()) {
+				fill_wire_event(ev, record.event);
+				record.hasEvent = true;
+			}
+			else append_event_payload(record.text, ev);
+		});
+	}
+
+	void handle_hash_tracking(const std::wstring& fullPath, uint16_t eventId) {
+		if (eventId == 23 || eventId == 26) {
+			remove_hash_record(fullPath, HashLogMode::Verbose);
+			return;
+		}
+
+		std::string newHash;
+		if (!hasher_(fullPath, newHash)) {
+			hashFailures_.fetch_add(1, std::memory_order_relaxed);
+			if (echo_) echo_line(L"[HASH] Unable to compute hash for " + fullPath, true);
+			return;
+		}
+		upsert_hash_record(fullPath, newHash, HashLogMode::Verbose);
+	}
+
+	void emit_hash_log_entry(const std::wstring& prefix, const std::wstring& path, const std::string& previousHash,
+		const std::string& newHash, const char* tag) {
+		std::wstringstream wss;
+		wss << L"[HASH] " << prefix << L" path=" << path;
+		if (!previousHash.empty()) {
+			wss << L" previous=" << utf8_to_wide(previousHash);
+		}
+		if (!newHash.empty()) {
+			wss << L" current=" << utf8_to_wide(newHash);
+		}
+		const std::wstring line = wss.str();
+		if (echo_) echo_line(line);
+
+		if (!sinks_.empty()) {
+			const Priority priority = matcher_.read()->classify(path).priority;
+			sinks_.publish_with([&](AlertRecord& record) {
+				record.kind = AlertKind::HashChange;
+				record.priority = priority;
+				append_hash_log_suffix(record.key, tag);
+				wide_to_utf8(line, record.text);
+			});
+		}
+	}
+
+	HashChange upsert_hash_record(const std::wstring& fullPath, const std::string& newHash, HashLogMode mode) {
+		if (newHash.empty()) return HashChange::Unchanged;
+		std::string previousHash;
+		const HashChange change = index_.upsert(fullPath, newHash, &previousHash);
+		if (mode != HashLogMode::Verbose) return change;
+		if (change == HashChange::Added) {
+			emit_hash_log_entry(L"Recorded baseline hash", fullPath, {}, newHash, "add");
+		} else if (change == HashChange::Changed) {
+			emit_hash_log_entry(L"Hash changed", fullPath, previousHash, newHash, "change");
+		}
+		return change;
+	}
+
+	bool remove_hash_record(const std::wstring& fullPath, HashLogMode mode) {
+		std::string previousHash;
+		if (!index_.remove(fullPath, &previousHash)) return false;
+		if (mode == HashLogMode::Verbose) {
+			emit_hash_log_entry(L"Hash entry removed", fullPath, previousHash, {}, "remove");
+		}
+		return true;
+	}
+
+	struct IndexJob {
+		std::shared_ptr<const PathMatcher> matcher;
+		std::vector<uint32_t> roots; // indices into matcher->roots(), walked in this order
+		bool initial{false};         // the start-up baseline (reported as such)
+	};
+
+	static std::vector<uint32_t> all_roots(const PathMatcher& matcher) {
+		std::vector<uint32_t> roots(matcher.roots().size());
+		for (uint32_t i = 0; i < roots.size(); ++i) roots[i] = i;
+		return roots;
+	}
+
+	static std::vector<uint32_t> roots_by_priority(const PathMatcher& matcher, std::vector<uint32_t> roots) {
+		std::stable_sort(roots.begin(), roots.end(), [&matcher](uint32_t a, uint32_t b) {
+			return matcher.roots()[a].priority < matcher.roots()[b].priority;
+		});
+		return roots;
+	}
+
+	// Lock order: indexMutex_, then liveMutex_.
+	void queue_index_job(IndexJob job) {
+		std::lock_guard<std::mutex> lock(indexMutex_);
+		if (baselineStop_.load(std::memory_order_relaxed)) return;
+		{
+			std::lock_guard<std::mutex> liveLock(liveMutex_);
+			baselineRunning_.store(true, std::memory_order_release);
+		}
+		indexJobs_.push_back(std::move(job));
+		if (!indexThread_.joinable()) indexThread_ = std::thread([this]() { run_index_thread(); });
+		indexCv_.notify_all();
+	}
+
+	void run_index_thread() {
+		std::unique_lock<std::mutex> lock(indexMutex_);
+		for (;;) {
+			indexCv_.wait(lock, [this]() { return baselineStop_.load(std::memory_order_relaxed) || !indexJobs_.empty(); });
+			if (baselineStop_.load(std::memory_order_relaxed)) break;
+			IndexJob job = std::move(indexJobs_.front());
+			indexJobs_.pop_front();
+			indexActive_ = true;
+			lock.unlock();
+			run_index_job(job);
+			lock.lock();
+			indexActive_ = false;
+			if (indexJobs_.empty()) {
+				{
+					std::lock_guard<std::mutex> liveLock(liveMutex_);
+					baselineRunning_.store(false, std::memory_order_release);
+					liveTouched_.clear();
+				}
+				indexCv_.notify_all();
+			}
+		}
+		// Stopped: the queued jobs never run, so the baseline is over here too
+		indexJobs_.clear();
+		indexActive_ = false;
+		{
+			std::lock_guard<std::mutex> liveLock(liveMutex_);
+			baselineRunning_.store(false, std::memory_order_release);
+			liveTouched_.clear();
+		}
+		indexCv_.notify_all();
+	}
+
+	void run_index_job(const IndexJob& job) {
+		const auto begin = std::chrono::steady_clock::now();
+		const size_t before = index_.size();
+		for (const uint32_t rootIndex : job.roots) {
+			if (baselineStop_.load(std::memory_order_relaxed)) break;
+			index_root(*job.matcher, rootIndex);
+		}
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+		const char* stopped = baselineStop_.load() ? " (stopped early)" : "";
+		if (job.initial) {
+			baselineMs_.store(static_cast<uint64_t>(ms), std::memory_order_relaxed);
+			std::cout << "[FIM] Baseline indexed " << index_.size() << " files in " << ms << " ms" << stopped << std::endl;
+		} else {
+			std::cout << "[FIM] Indexed " << job.roots.size() << " new or changed root(s): "
+			          << index_.size() - std::min(index_.size(), before) << " files added in " << ms << " ms" << stopped << std::endl;
+		}
+	}
+
+	void index_root(const PathMatcher& matcher, uint32_t rootIndex) {
+		const auto& rootRule = matcher.roots()[rootIndex];
+		const std::wstring& root = rootRule.path;
+		std::error_code ec;
+		const std::filesystem::path fsPath(root);
+		if (!std::filesystem::exists(fsPath, ec)) {
+			echo_line(L"[HASH] Skipping missing path: " + root, true);
+			return;
+		}
+
+		if (std::filesystem::is_regular_file(fsPath, ec)) {
+			index_baseline_file(fsPath.wstring());
+			return;
+		}
+
+		if (!std::filesystem::is_directory(fsPath, ec)) {
+			return;
+		}
+
+		auto index_entry = [this, &matcher, rootIndex](const std::filesystem::directory_entry& entry) {
+			std::error_code entryEc;
+			if (!entry.is_regular_file(entryEc)) return;
+			const std::wstring path = entry.path().wstring();
+			// Same classification as live events: skips excluded names. Files under a nested
+			// root are left to that root, which may have a different priority.
+			const PathClassification c = matcher.classify(path);
+			if (c.monitored() && c.root == rootIndex) {
+				index_baseline_file(path);
+			}
+		};
+
+		try {
+			const std::filesystem::directory_options opts = std::filesystem::directory_options::skip_permission_denied;
+			if (rootRule.recursive) {
+				for (std::filesystem::recursive_directory_iterator it(fsPath, opts), end; it != end; ++it) {
+					if (baselineStop_.load(std::memory_order_relaxed)) break;
+					index_entry(*it);
+				}
+			} else {
+				for (std::filesystem::directory_iterator it(fsPath, opts), end; it != end; ++it) {
+					if (baselineStop_.load(std::memory_order_relaxed)) break;
+					index_entry(*it);
+				}
+			}
+		} catch (const std::exception& ex) {
+			echo_line(L"[HASH] Failed to index " + root + L": " + utf8_to_wide(ex.what()), true);
+		}
+	}
+
+	void index_baseline_file(const std::wstring& filePath) {
+		if (index_.lookup(filePath) || touched_by_live_event(filePath)) return;
+		std::string hash;
+		if (!hasher_(filePath, hash)) return;
+		// Checked again under the lock: an event may have arrived while the file was hashed.
+		std::lock_guard<std::mutex> lock(liveMutex_);
+		if (liveTouched_.count(FileHashIndex::normalize_path_key(filePath)) != 0) return;
+		// A reload may have dropped this root while the file was hashed.
+		if (!matcher_.read()->classify(filePath).monitored()) return;
+		upsert_hash_record(filePath, hash, HashLogMode::Silent);
+	}
+
+	RcuPointer<PathMatcher> matcher_;
+	std::mutex reloadMutex_;
+	AlertFanout& sinks_;
+	FileHasher hasher_;
+	FileHashIndex index_;
+	bool echo_{true};
+	EventPayloadFormat payload_{EventPayloadFormat::Fields};
+	std::unique_ptr<WorkerPool<FimEvent>> pool_;
+	LatencyHistogram latency_;
+	std::array<LatencyHistogram, kPriorityCount> latencyByPriority_;
+	std::atomic<uint64_t> received_{0};
+	std::atomic<uint64_t> unmonitored_{0};
+	std::atomic<uint64_t> excluded_{0};
+	std::atomic<uint64_t> hashFailures_{0};
+	const std::chrono::steady_clock::time_point created_{std::chrono::steady_clock::now()};
+	std::atomic<bool> firstEventSeen_{false};
+	std::atomic<uint64_t> firstEventMs_{0};
+	std::atomic<bool> baselineRunning_{false};
+	std::atomic<bool> baselineStop_{false};
+	std::atomic<uint64_t> baselineMs_{0};
+	std::mutex liveMutex_;
+	std::unordered_set<std::wstring> liveTouched_;
+	std::mutex indexMutex_;
+	std::condition_variable indexCv_;
+	std::deque<IndexJob> indexJobs_;
+	bool indexActive_{false};
+	std::thread indexThread_;
+};
+
+} // namespace fim
@@ -0,0 +1,36 @@
+// Event source abstraction for the FIM pipeline.
+// The live Windows sender feeds the pipeline from EvtSubscribe callbacks; ReplayEventSource
+// (replay_source.h) feeds it from recorded event XML so the same path can run on Linux.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "priority.h"
+
+namespace fim {
+
+// What the pipeline needs from one file event, independent of where it came from.
+struct FimEvent {
+	uint16_t eventId{0};
+	std::wstring target; // TargetFilename (Sysmon) or ObjectName (Security 4663)
+	std::wstring xml;    // full event XML; may be left empty when uploads are disabled
+	Priority priority{Priority::Medium}; // of the monitored root covering target (set by the pipeline)
+	std::chrono::steady_clock::time_point received{std::chrono::steady_clock::now()};
+};
+
+using EventSink = std::function<void(FimEvent&& event)>;
+
+class EventSource {
+public:
+	virtual ~EventSource() = default;
+	// Begins delivering events to sink (possibly from another thread). False if it could not start.
+	virtual bool start(EventSink sink) = 0;
+	virtual void stop() = 0;
+	virtual const char* name() const = 0;
+};
+
+} // namespace fim
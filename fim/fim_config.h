@@ -0,0 +1,143 @@
+// fim_config.yml loading (yaml-cpp only, portable).
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "priority.h"
+
+namespace fim {
+
+struct MonitoredDirectory {
+	std::string path;
+	std::string name;
+	bool recursive{true};
+	Priority priority{Priority::Medium};
+	std::vector<std::string> fileTypes;       // filename globs to include; empty or "*" = all
+	std::vector<std::string> excludePatterns; // filename globs to skip
+};
+
+// alerts.methods.syslog
+struct SyslogMethod {
+	bool enabled{false};
+	std::string server{"localhost"};
+	unsigned port{514};
+	std::string protocol{"udp"}; // udp | tcp
+};
+
+// alerts.methods.file_log
+struct FileLogMethod {
+	bool enabled{false};
+	std::string path; // log_file
+};
+
+struct AlertMethods {
+	SyslogMethod syslog;
+	FileLogMethod fileLog;
+};
+
+struct FimConfig {
+	std::vector<MonitoredDirectory> directories; // enabled entries only
+	std::vector<std::string> globalExcludes;     // exclusions.global_patterns
+	unsigned scanIntervalSec{0};                 // fim_settings.scan_interval, 0 = unset
+	AlertMethods alerts;                         // alerts.methods
+};
+
+namespace detail {
+
+template <typename T>
+inline T yaml_value_or(const YAML::Node& node, const T& fallback) {
+	if (!node) return fallback;
+	try { return node.as<T>(); } catch (...) { return fallback; }
+}
+
+inline std::vector<std::string> yaml_string_list(const YAML::Node& node) {
+	std::vector<std::string> out;
+	if (!node || !node.IsSequence()) return out;
+	for (const auto& item : node) {
+		try {
+			auto value = item.as<std::string>();
+			if (!value.empty()) out.emplace_back(std::move(value));
+		} catch (...) {
+			// skip malformed entry
+		}
+	}
+	return out;
+}
+
+} // namespace detail
+
+// Loads the parts of fim_config.yml the sender acts on.
+// Throws std::runtime_error (or YAML::Exception) if the config cannot be read/parsed.
+inline FimConfig load_fim_config(const std::string& config_path) {
+	YAML::Node root = YAML::LoadFile(config_path);
+	if (!root || !root.IsMap()) {
+		throw std::runtime_error("FIM config root must be a map/object");
+	}
+
+	FimConfig cfg;
+	if (const YAML::Node settings = root["fim_settings"]) {
+		cfg.scanIntervalSec = detail::yaml_value_or<unsigned>(settings["scan_interval"], 0);
+	}
+
+	const YAML::Node md = root["monitored_directories"];
+	if (md && md.IsSequence()) {
+		for (const auto& item : md) {
+			if (!item || !item.IsMap()) continue;
+			// enabled defaults to true if missing
+			if (!detail::yaml_value_or<bool>(item["enabled"], true)) continue;
+
+			MonitoredDirectory dir;
+			dir.path = detail::yaml_value_or<std::string>(item["path"], std::string());
+			if (dir.path.empty()) continue; // skip malformed path
+			dir.name = detail::yaml_value_or<std::string>(item["name"], std::string());
+			dir.recursive = detail::yaml_value_or<bool>(item["recursive"], true);
+			dir.priority = parse_priority(detail::yaml_value_or<std::string>(item["priority"], std::string()));
+			dir.fileTypes = detail::yaml_string_list(item["file_types"]);
+			dir.excludePatterns = detail::yaml_string_list(item["exclude_patterns"]);
+			cfg.directories.emplace_back(std::move(dir));
+		}
+	}
+
+	if (const YAML::Node exclusions = root["exclusions"]) {
+		cfg.globalExcludes = detail::yaml_string_list(exclusions["global_patterns"]);
+	}
+
+	if (const YAML::Node alerts = root["alerts"]) {
+		const YAML::Node methods = alerts["methods"];
+		if (const YAML::Node syslog = methods ? methods["syslog"] : YAML::Node()) {
+			SyslogMethod& m = cfg.alerts.syslog;
+			m.enabled = detail::yaml_value_or<bool>(syslog["enabled"], false);
+			m.server = detail::yaml_value_or<std::string>(syslog["server"], m.server);
+			m.port = detail::yaml_value_or<unsigned>(syslog["port"], m.port);
+			m.protocol = detail::yaml_value_or<std::string>(syslog["protocol"], m.protocol);
+			std::transform(m.protocol.begin(), m.protocol.end(), m.protocol.begin(),
+				[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		}
+		if (const YAML::Node fileLog = methods ? methods["file_log"] : YAML::Node()) {
+			FileLogMethod& m = cfg.alerts.fileLog;
+			m.enabled = detail::yaml_value_or<bool>(fileLog["enabled"], false);
+			m.path = detail::yaml_value_or<std::string>(fileLog["log_file"], std::string());
+			if (m.path.empty()) m.enabled = false;
+		}
+	}
+	return cfg;
+}
+
+// Returns the list of directory paths to monitor where the entry is enabled (or enabled missing -> true).
+// Throws std::runtime_error if the config cannot be read/parsed.
+inline std::vector<std::string> get_monitored_paths(const std::string& config_path) {
+	std::vector<std::string> paths;
+	for (auto& dir : load_fim_config(config_path).directories) {
+		paths.emplace_back(std::move(dir.path));
+	}
+	return paths;
+}
+
+} // namespace fim
@@ -0,0 +1,1502 @@
+// FIM replay driver - runs recorded Sysmon/Security events through the sender pipeline.
+// Same classification, hashing, batching and upload code as windows_event_sender.cpp, fed by
+// ReplayEventSource instead of EvtSubscribe, so throughput and latency can be measured on Linux.
+//
+// Usage: fim_replay <fim_config.yml> <events.xml|dir>... [--rate N] [--loops N] [--workers N] [--echo] [--payload-bench]
+//        fim_replay <fim_config.yml> --index-bench N
+//        fim_replay <fim_config.yml> --sink-check N
+//        fim_replay <fim_config.yml> --alloc-check N
+//        fim_replay <fim_config.yml> --flow-check SECONDS
+//        fim_replay <fim_config.yml> --queue-check
+//        fim_replay <fim_config.yml> --matcher-check RULES
+//        fim_replay <fim_config.yml> --fields-fuzz N
+//        fim_replay <fim_config.yml> --escape-check N
+//        fim_replay <fim_config.yml> --wire-fixture FILE
+//   --rate N         events per second (default: as fast as possible)
+//   --loops N        passes over the recorded events (default 1)
+//   --workers N      pipeline worker threads (default FIM_WORKER_THREADS or 4)
+//   --echo           print every event / hash change as the live sender does
+//   --payload-bench  only time upload payload building (raw XML, extracted fields, binary) and exit
+//   --escape-bench   only time JSON escaping of the event XML (vector vs scalar) and exit
+//   --utf-bench      only time UTF-16/32 <-> UTF-8 transcoding of the event XML (vector vs scalar) and exit
+//   --rescan         after the replay, run one throttled rescan pass (FIM_RESCAN_* budgets and
+//                    state file) and report what it found
+//   --reload CFG     after the replay, hot-reload the rules from CFG (as the sender's config
+//                    watcher does) and report how the hash index was reconciled
+//   --index-bench N  only fill the file hash index with N synthetic paths, report bytes/entry and
+//                    lookups/s (one thread and --workers threads), and exit; no event files needed
+//   --sink-check N   only push N alerts through the sink fan-out to local stand-ins (UDP and TCP
+//                    syslog listeners on loopback, a temporary file, and a deliberately slow sink
+//                    in place of the API), report what each received and how long publishing took
+//   --alloc-check N  only ship N synthetic events (fields payload) through the sink fan-out and
+//                    ApiUploader to a stand-in transport plus local syslog and file sinks, after an
+//                    equal warm-up, and count heap allocations made meanwhile; fails unless zero
+//   --flow-check S   only publish records through the API sinks for S seconds each over three
+//                    simulated links (LAN, a slow high-RTT WAN, a backend answering 429 with
+//                    Retry-After) and report how the adaptive batch size and in-flight limit
+//                    settled; fails if records were lost
+//   --queue-check    only run the event queue and worker pool through lane order, each overflow
+//                    policy on a full queue, blocking, close() and a throwing handler, and exit
+//   --matcher-check N  only check the path matcher on hand-picked paths (component boundaries,
+//                    nested and non-recursive roots, each glob shape), then build N roots, compare
+//                    classify() with a linear reference on synthetic paths and time both
+//   --fields-fuzz N  only scan N mutated/truncated event XMLs (UTF-8 and wide) with the Sysmon field
+//                    extractor and check every field stays in bounds and every record is valid
+//                    JSON (FIM_FUZZ_SEED picks the sequence); fails on any bad input
+//   --escape-check N only compare the vectorised JSON escaper with the scalar one on every byte that
+//                    needs escaping (and the high bytes) at every offset around the 16/32-byte chunk
+//                    boundaries, then on N random inputs; fails on any difference
+//   --wire-fixture FILE  only write a binary batch frame built by WireWriter (interned, repeated and
+//                    empty strings, an unparseable event time, log records) to FILE for the backend's
+//                    decoder test, after checking the reference decoder reads it back, and check that
+//                    interning stops at kWireMaxInterned
+// Uploads use FIM_API_URL etc. from the environment and alerts.methods from the config, exactly
+// like the sender; leave both unset to measure the local pipeline only.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "alert_sinks.h"
+#include "api_uploader.h"
+#include "curl_transport.h"
+#include "event_pipeline.h"
+#include "fim_config.h"
+#include "hash_index.h"
+#include "replay_source.h"
+#include "rescan_scheduler.h"
+
+// Every heap allocation in the process, for --alloc-check. Threads that set t_uncounted (the
+// check's own bookkeeping) are left out.
+static std::atomic<uint64_t> g_allocations{0};
+static thread_local bool t_uncounted = false;
+
+void* operator new(std::size_t size) {
+	if (!t_uncounted) g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+// Out of line, so GCC does not pair the free() with an inlined std::allocator allocation.
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+std::unique_ptr<fim::HttpTransport> make_api_transport(const fim::HttpEndpoint& endpoint, const fim::TransportOptions& options) {
+	auto transport = std::make_unique<fim::CurlTransport>(endpoint, options);
+	if (!transport->valid()) {
+		std::cerr << "[FIM] Failed to initialise " << transport->name() << " transport" << std::endl;
+		return nullptr;
+	}
+	return transport;
+}
+
+int usage() {
+	std::cerr << "usage: fim_replay <fim_config.yml> <events.xml|dir>... [--rate N] [--loops N] [--workers N] [--echo] [--rescan] [--reload CFG] [--payload-bench] [--escape-bench] [--utf-bench]\n"
+	          << "       fim_replay <fim_config.yml> --index-bench N\n"
+	          << "       fim_replay <fim_config.yml> --sink-check N\n"
+	          << "       fim_replay <fim_config.yml> --alloc-check N\n"
+	          << "       fim_replay <fim_config.yml> --flow-check SECONDS\n"
+	          << "       fim_replay <fim_config.yml> --queue-check\n"
+	          << "       fim_replay <fim_config.yml> --matcher-check RULES\n"
+	          << "       fim_replay <fim_config.yml> --fields-fuzz N\n"
+	          << "       fim_replay <fim_config.yml> --escape-check N\n"
+	          << "       fim_replay <fim_config.yml> --wire-fixture FILE" << std::endl;
+	return 2;
+}
+
+struct BenchResult {
+	double seconds{0};
+	size_t bytes{0};
+};
+
+void print_bench(const char* label, const BenchResult& r, size_t count) {
+	std::cout << std::fixed << std::setprecision(1) << "[FIM] Payload " << label << ": "
+	          << (r.seconds > 0 ? static_cast<double>(count) / r.seconds : 0.0) << " events/s, "
+	          << (count ? static_cast<double>(r.bytes) / static_cast<double>(count) : 0.0) << " bytes/event" << std::endl;
+}
+
+// Builds what the uploader puts on the wire for every loaded event, `loops` times per format:
+// NDJSON lines with raw XML, NDJSON lines with extracted fields, and binary frames of
+// `batchSize` records. The binary frames are decoded again and compared as a round-trip check.
+void run_payload_bench(const std::vector<fim::FimEvent>& events, size_t loops, size_t batchSize) {
+	using clock = std::chrono::steady_clock;
+	const size_t count = events.size() * loops;
+	for (const auto format : { fim::EventPayloadFormat::Xml, fim::EventPayloadFormat::Fields }) {
+		BenchResult r;
+		const auto begin = clock::now();
+		for (size_t loop = 0; loop < loops; ++loop) {
+			for (const auto& ev : events) {
+				const std::string body = format == fim::EventPayloadFormat::Xml
+					? fim::json_escape(fim::wide_to_utf8(ev.xml))
+					: fim::json_escape(fim::build_event_payload(ev));
+				r.bytes += body.size() + 1;
+			}
+		}
+		r.seconds = std::chrono::duration<double>(clock::now() - begin).count();
+		print_bench(format == fim::EventPayloadFormat::Xml ? "xml/ndjson" : "fields/ndjson", r, count);
+	}
+
+	BenchResult r;
+	std::vector<std::string> frames;
+	fim::WireWriter writer;
+	std::string frame;
+	size_t inFrame = 0;
+	const auto begin = clock::now();
+	for (size_t loop = 0; loop < loops; ++loop) {
+		for (const auto& ev : events) {
+			if (inFrame == 0) writer.begin(frame);
+			writer.add_event(frame, "bench", fim::build_wire_event(ev));
+			if (++inFrame == batchSize) {
+				r.bytes += frame.size();
+				frames.push_back(std::move(frame));
+				frame.clear();
+				inFrame = 0;
+			}
+		}
+	}
+	if (inFrame) {
+		r.bytes += frame.size();
+		frames.push_back(std::move(frame));
+	}
+	r.seconds = std::chrono::duration<double>(clock::now() - begin).count();
+	print_bench("fields/binary", r, count);
+
+	size_t index = 0;
+	for (const auto& f : frames) {
+		std::vector<fim::WireRecord> records;
+		if (!fim::decode_wire_frame(f, records)) {
+			std::cerr << "[FIM] Binary round-trip failed: frame did not decode" << std::endl;
+			return;
+		}
+		for (const auto& record : records) {
+			const std::string expected = fim::wire_event_json(fim::build_wire_event(events[index++ % events.size()]));
+			if (fim::wire_event_json(record.event) != expected) {
+				std::cerr << "[FIM] Binary round-trip mismatch at record " << index - 1 << std::endl;
+				return;
+			}
+		}
+	}
+	std::cout << "[FIM] Binary round-trip ok (" << index << " records, " << frames.size() << " frames)" << std::endl;
+}
+
+// Escapes every loaded event's UTF-8 XML with the vectorised and the scalar escaper and checks
+// that both produce the same bytes.
+void run_escape_bench(const std::vector<fim::FimEvent>& events, size_t loops) {
+	std::vector<std::string> inputs;
+	size_t inputBytes = 0;
+	for (const auto& ev : events) {
+		inputs.push_back(fim::wide_to_utf8(ev.xml));
+		inputBytes += inputs.back().size();
+	}
+	for (const auto& input : inputs) {
+		if (fim::json_escape(input) != fim::json_escape_scalar(input)) {
+			std::cerr << "[FIM] json_escape output differs from the scalar reference" << std::endl;
+			return;
+		}
+	}
+
+	using clock = std::chrono::steady_clock;
+	std::string out;
+	for (const bool vector : { false, true }) {
+		size_t outBytes = 0;
+		const auto begin = clock::now();
+		for (size_t loop = 0; loop < loops; ++loop) {
+			for (const auto& input : inputs) {
+				out.clear();
+				if (vector) fim::json_escape_append(out, input);
+				else fim::json_escape_append_scalar(out, input);
+				outBytes += out.size();
+			}
+		}
+		const double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+		const double mb = static_cast<double>(inputBytes * loops) / (1024.0 * 1024.0);
+		std::cout << std::fixed << std::setprecision(1) << "[FIM] json_escape " << (vector ? "vector" : "scalar")
+		          << ": " << (seconds > 0 ? mb / seconds : 0.0) << " MiB/s (" << outBytes / (loops ? loops : 1)
+		          << " bytes out per pass)" << std::endl;
+	}
+}
+
+// Differential check of the vectorised escaper against the scalar reference, without event files.
+// First every short length up to three 32-byte chunks, with each byte that matters (controls, '"',
+// '\\', the 0x1F/0x20 and 0x7F/0x80 edges, high bytes) at every offset, over ASCII and high-byte
+// filler and at every start alignment within a chunk; then `count` random inputs mixing the same
+// bytes. Appends onto a non-empty buffer, as the uploader does.
+int run_escape_check(size_t count) {
+	static const unsigned char kSpecial[] = {
+		0x00, 0x01, 0x08, 0x09, 0x0A, 0x0C, 0x0D, 0x1F, 0x20, '"', '\\', '/', 0x7F, 0x80, 0xBF, 0xC3, 0xE2, 0xF0, 0xFF,
+	};
+	size_t inputs = 0;
+	size_t mismatches = 0;
+	std::string vector;
+	std::string scalar;
+	auto compare = [&](std::string_view input) {
+		++inputs;
+		vector.assign("{\"k\":\"");
+		scalar.assign(vector);
+		fim::json_escape_append(vector, input);
+		fim::json_escape_append_scalar(scalar, input);
+		if (vector != scalar && mismatches++ < 5) {
+			std::cerr << "[FIM] json_escape differs from the scalar reference on " << input.size() << " bytes:";
+			for (unsigned char c : input) std::cerr << ' ' << std::hex << static_cast<unsigned>(c) << std::dec;
+			std::cerr << std::endl;
+		}
+	};
+
+	std::string buffer(32 + 96, 'a');
+	for (const unsigned char filler : { static_cast<unsigned char>('a'), static_cast<unsigned char>(0xE9) }) {
+		for (size_t len = 0; len <= 96; ++len) {
+			for (size_t at = 0; at < len; ++at) {
+				for (const unsigned char special : kSpecial) {
+					for (size_t align = 0; align < 32; align += (len % 16 == 0 || len % 16 == 15) ? 1 : 7) {
+						std::fill(buffer.begin(), buffer.end(), static_cast<char>(filler));
+						buffer[align + at] = static_cast<char>(special);
+						// A second hit one chunk later, so a chunk is resumed after an escape.
+						if (at + 17 < len) buffer[align + at + 17] = '"';
+						compare(std::string_view(buffer).substr(align, len));
+					}
+				}
+			}
+		}
+	}
+
+	std::mt19937_64 rng(fim::getenv_size("FIM_FUZZ_SEED", 1));
+	std::string input;
+	for (size_t i = 0; i < count; ++i) {
+		input.resize(rng() % 200);
+		for (char& c : input) {
+			const uint64_t r = rng();
+			switch (r % 4) {
+			case 0: c = static_cast<char>(kSpecial[(r >> 8) % sizeof(kSpecial)]); break;
+			case 1: c = static_cast<char>(0x80 | ((r >> 8) & 0x7F)); break;
+			default: c = static_cast<char>(0x20 + (r >> 8) % 0x5F); break;
+			}
+		}
+		compare(input);
+	}
+	std::cout << "[FIM] Escape check: " << inputs << " inputs, " << mismatches << " mismatches" << std::endl;
+	std::cout << "[FIM] Escape check " << (mismatches ? "FAILED" : "passed") << std::endl;
+	return mismatches ? 1 : 0;
+}
+
+// Writes the frame backend/internal/wire/testdata/agent_frame.bin holds; wire_test.go expects
+// exactly these records, so change both together.
+int run_wire_fixture(const std::string& path) {
+	fim::WireEvent first;
+	first.eventId = 11;
+	first.unixMillis = fim::parse_utc_millis("2025-11-17 10:15:30.123");
+	first.computer = "WS-01.corp.example";
+	first.channel = "Microsoft-Windows-Sysmon/Operational";
+	first.image = "C:\\Windows\\explorer.exe";
+	first.target = "\\\\fs01\\share\\Finance\\Q3 \"plan\".xlsx";
+	first.processGuid = "{5770385f-c22a-43e0-bf4c-06f5698ffbd9}";
+	first.hashes = "SHA256=0123456789ABCDEF";
+	first.user = "CORP\\alice";
+
+	fim::WireEvent second = first; // every interned value repeats and is sent as a reference
+	second.eventId = 23;
+	second.unixMillis = fim::parse_utc_millis("17/11/2025 10:15:31");
+	second.utcTime = "17/11/2025 10:15:31";
+	second.target = "\\\\fs01\\share\\Finance\\r\xc3\xa9sum\xc3\xa9.docx";
+	second.hashes.clear();
+
+	fim::WireEvent third; // only the id and a target; every other string is empty
+	third.eventId = 2;
+	third.target = "C:\\Temp\\a.txt";
+
+	fim::WireWriter writer;
+	std::string frame;
+	writer.begin(frame);
+	writer.add_event(frame, "events", first);
+	writer.add_log(frame, "fim.log", "[HASH] changed C:\\Temp\\a.txt \xe2\x9c\x93");
+	writer.add_event(frame, "events", second);
+	writer.add_event(frame, "events", third);
+	writer.add_log(frame, "", "");
+
+	std::vector<fim::WireRecord> records;
+	const fim::WireEvent* expected[] = { &first, nullptr, &second, &third, nullptr };
+	bool ok = fim::decode_wire_frame(frame, records) && records.size() == 5;
+	for (size_t i = 0; ok && i < records.size(); ++i) {
+		if (expected[i]) ok = fim::wire_event_json(records[i].event) == fim::wire_event_json(*expected[i]);
+	}
+	if (!ok || second.unixMillis != 0) {
+		std::cerr << "[FIM] Wire fixture does not decode back to its records" << std::endl;
+		return 1;
+	}
+
+	// Past the cap new values go out as plain literals, so the frame stays within the backend's table
+	std::string big;
+	writer.begin(big);
+	fim::WireEvent ev;
+	for (size_t i = 0; i < fim::kWireMaxInterned + 100; ++i) {
+		ev.computer = "host-" + std::to_string(i);
+		writer.add_event(big, "events", ev);
+	}
+	std::vector<fim::WireRecord> bigRecords;
+	if (writer.interned_count() != fim::kWireMaxInterned || !fim::decode_wire_frame(big, bigRecords) ||
+		bigRecords.size() != fim::kWireMaxInterned + 100 || bigRecords.back().event.computer != ev.computer) {
+		std::cerr << "[FIM] Wire writer interned " << writer.interned_count() << " strings, cap is "
+		          << fim::kWireMaxInterned << std::endl;
+		return 1;
+	}
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+	if (!out) {
+		std::cerr << "[FIM] Could not write " << path << std::endl;
+		return 1;
+	}
+	std::cout << "[FIM] Wire fixture: " << records.size() << " records, " << frame.size() << " bytes -> " << path
+	          << std::endl;
+	return 0;
+}
+
+// Transcodes every loaded event's XML wide -> UTF-8 and back with the vectorised and the scalar
+// converters, into reused buffers as the pipeline does, and checks both produce the same text.
+void run_utf_bench(const std::vector<fim::FimEvent>& events, size_t loops) {
+	std::vector<std::string> utf8;
+	size_t utf8Bytes = 0;
+	for (const auto& ev : events) {
+		std::string vec, ref;
+		std::wstring back, backRef;
+		fim::wide_to_utf8(ev.xml, vec);
+		fim::wide_to_utf8_scalar(ev.xml, ref);
+		fim::utf8_to_wide(vec, back);
+		fim::utf8_to_wide_scalar(ref, backRef);
+		if (vec != ref || back != backRef) {
+			std::cerr << "[FIM] UTF transcoding differs from the scalar reference" << std::endl;
+			return;
+		}
+		utf8Bytes += vec.size();
+		utf8.push_back(std::move(vec));
+	}
+
+	using clock = std::chrono::steady_clock;
+	const double mb = static_cast<double>(utf8Bytes * loops) / (1024.0 * 1024.0);
+	auto report = [mb](const char* label, double seconds) {
+		std::cout << std::fixed << std::setprecision(1) << "[FIM] " << label << ": "
+		          << (seconds > 0 ? mb / seconds : 0.0) << " MiB/s (UTF-8 side)" << std::endl;
+	};
+	std::string narrow;
+	std::wstring wide;
+	for (const bool vector : { false, true }) {
+		auto begin = clock::now();
+		for (size_t loop = 0; loop < loops; ++loop) {
+			for (const auto& ev : events) {
+				narrow.clear();
+				if (vector) fim::wide_to_utf8(ev.xml, narrow);
+				else fim::wide_to_utf8_scalar(ev.xml, narrow);
+			}
+		}
+		report(vector ? "wide_to_utf8 vector" : "wide_to_utf8 scalar",
+			std::chrono::duration<double>(clock::now() - begin).count());
+
+		begin = clock::now();
+		for (size_t loop = 0; loop < loops; ++loop) {
+			for (const auto& text : utf8) {
+				wide.clear();
+				if (vector) fim::utf8_to_wide(text, wide);
+				else fim::utf8_to_wide_scalar(text, wide);
+			}
+		}
+		report(vector ? "utf8_to_wide vector" : "utf8_to_wide scalar",
+			std::chrono::duration<double>(clock::now() - begin).count());
+	}
+}
+
+// Share-like synthetic paths: a few thousand directories, 8.3-ish filenames, mixed extensions.
+std::wstring synthetic_path(size_t i) {
+	static const wchar_t* const kExt[] = { L".docx", L".xlsx", L".pdf", L".dll", L".txt", L".png" };
+	return L"D:\\Shares\\dept" + std::to_wstring(i % 61) + L"\\project" + std::to_wstring(i % 2039) +
+		L"\\archive\\Document_" + std::to_wstring(i) + kExt[i % 6];
+}
+
+std::string synthetic_digest(size_t i) {
+	fim::Sha256 sha;
+	sha.update(&i, sizeof(i));
+	uint8_t digest[fim::Sha256::kDigestSize];
+	sha.finish(digest);
+	return fim::digest_to_hex(digest, sizeof(digest));
+}
+
+// Fills a FileHashIndex with `count` entries and reports memory per entry and lookup throughput.
+void run_index_bench(size_t count, size_t threads) {
+	using clock = std::chrono::steady_clock;
+	fim::FileHashIndex index;
+	std::vector<std::wstring> paths;
+	std::vector<std::string> digests;
+	paths.reserve(count);
+	digests.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		paths.push_back(synthetic_path(i));
+		digests.push_back(synthetic_digest(i));
+	}
+
+	auto begin = clock::now();
+	for (size_t i = 0; i < count; ++i) index.upsert(paths[i], digests[i]);
+	double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+	size_t pathBytes = 0;
+	for (const auto& p : paths) pathBytes += p.size();
+	std::cout << std::fixed << std::setprecision(1) << "[FIM] Index " << index.size() << " entries: "
+	          << static_cast<double>(index.memory_bytes()) / static_cast<double>(count ? count : 1) << " bytes/entry (avg path "
+	          << static_cast<double>(pathBytes) / static_cast<double>(count ? count : 1) << " chars), "
+	          << (seconds > 0 ? static_cast<double>(count) / seconds : 0.0) << " inserts/s" << std::endl;
+
+	if (threads == 0) threads = 1;
+	for (const size_t n : { static_cast<size_t>(1), threads }) {
+		std::atomic<size_t> found{0};
+		std::vector<std::thread> pool;
+		begin = clock::now();
+		for (size_t t = 0; t < n; ++t) {
+			pool.emplace_back([&, t] {
+				std::string hex;
+				size_t hits = 0;
+				for (size_t i = t; i < count; i += n) hits += index.lookup(paths[(i * 7919) % count], &hex) ? 1 : 0;
+				found.fetch_add(hits);
+			});
+		}
+		for (auto& worker : pool) worker.join();
+		seconds = std::chrono::duration<double>(clock::now() - begin).count();
+		std::cout << "[FIM] Index lookups (" << n << " thread" << (n == 1 ? "" : "s") << "): "
+		          << (seconds > 0 ? static_cast<double>(count) / seconds : 0.0) << " lookups/s"
+		          << (found.load() == count ? "" : " (MISSING ENTRIES)") << std::endl;
+		if (n == threads) break;
+	}
+}
+
+// Reports one named check; returns whether it held.
+bool check(const char* what, bool ok) {
+	if (!ok) std::cerr << "[FIM] Check failed: " << what << std::endl;
+	return ok;
+}
+
+std::vector<int> drain_queue(fim::BoundedQueue<int>& queue) {
+	std::vector<int> items;
+	queue.close();
+	for (int item; queue.pop(item);) items.push_back(item);
+	return items;
+}
+
+// Exercises BoundedQueue and WorkerPool: lane order, each overflow policy on a full queue (which
+// item is sacrificed, and that a more urgent newcomer is not), blocking and close(), pop_batch,
+// and a pool whose handler throws.
+int run_queue_check() {
+	using fim::OverflowPolicy;
+	bool ok = true;
+
+	{ // most urgent lane first, FIFO within a lane
+		fim::BoundedQueue<int> queue(8, OverflowPolicy::Block);
+		queue.push(30, 3);
+		queue.push(20, 2);
+		queue.push(21, 2);
+		queue.push(0, 0);
+		queue.push(31, 3);
+		queue.push(99, 7); // out-of-range lanes count as the least urgent
+		ok &= check("lane order", drain_queue(queue) == std::vector<int>({ 0, 20, 21, 30, 31, 99 }));
+	}
+
+	{ // drop_newest: a full lane rejects its own newcomer, and a more urgent one bumps the newest bulk item
+		fim::BoundedQueue<int> queue(4, OverflowPolicy::DropNewest);
+		for (int i = 0; i < 3; ++i) queue.push(20 + i, 2);
+		queue.push(30, 3);
+		ok &= check("drop_newest bumps a less urgent item", queue.push(23, 2));
+		ok &= check("drop_newest rejects a less urgent newcomer", !queue.push(31, 3));
+		ok &= check("drop_newest rejects a same-lane newcomer", !queue.push(24, 2));
+		ok &= check("drop_newest admits a more urgent newcomer", queue.push(10, 1));
+		const fim::QueueStats s = queue.stats();
+		ok &= check("drop_newest counters", s.dropped == 4 && s.droppedByLane[3] == 2 && s.droppedByLane[2] == 2 && s.depth == 4);
+		ok &= check("drop_newest keeps the oldest", drain_queue(queue) == std::vector<int>({ 10, 20, 21, 22 }));
+	}
+
+	{ // drop_oldest: the oldest item of the least urgent lane goes, never a more urgent one
+		fim::BoundedQueue<int> queue(4, OverflowPolicy::DropOldest);
+		for (int i = 0; i < 4; ++i) queue.push(20 + i, 2);
+		ok &= check("drop_oldest admits a same-lane newcomer", queue.push(24, 2));
+		ok &= check("drop_oldest rejects a less urgent newcomer", !queue.push(30, 3));
+		ok &= check("drop_oldest admits a more urgent newcomer", queue.push(0, 0));
+		const fim::QueueStats s = queue.stats();
+		ok &= check("drop_oldest counters", s.dropped == 3 && s.droppedByLane[2] == 2 && s.droppedByLane[3] == 1 &&
+			s.enqueued == 6 && s.highWatermark == 4);
+		ok &= check("drop_oldest keeps the newest", drain_queue(queue) == std::vector<int>({ 0, 22, 23, 24 }));
+	}
+
+	{ // block: a push on a full queue waits for a pop; close() releases a waiting push
+		fim::BoundedQueue<int> queue(2, OverflowPolicy::Block);
+		queue.push(1);
+		queue.push(2);
+		std::atomic<int> pushed{0};
+		std::thread producer([&]() {
+			pushed = queue.push(3) ? 1 : -1;
+			pushed = queue.push(4) ? 2 : -2; // full again; released by close()
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		ok &= check("block waits on a full queue", pushed.load() == 0);
+		int item = 0;
+		queue.pop(item);
+		for (int i = 0; i < 100 && pushed.load() == 0; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		ok &= check("block resumes after a pop", pushed.load() == 1);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		queue.close();
+		producer.join();
+		ok &= check("close releases a blocked push", pushed.load() == -2 && queue.stats().blocked == 2);
+		ok &= check("close keeps queued items", drain_queue(queue) == std::vector<int>({ 2, 3 }));
+		ok &= check("closed queue refuses pushes", !queue.push(5));
+	}
+
+	{ // pop_batch takes up to maxItems, most urgent first
+		fim::BoundedQueue<int> queue(16, OverflowPolicy::Block);
+		for (int i = 0; i < 6; ++i) queue.push(i, i % 2 ? 1 : 3);
+		std::vector<int> batch;
+		ok &= check("pop_batch count", queue.pop_batch(batch, 4) == 4);
+		ok &= check("pop_batch order", batch == std::vector<int>({ 1, 3, 5, 0 }));
+	}
+
+	{ // a throwing handler is counted and does not stop the pool; stop() drains what is queued
+		std::atomic<int> handled{0};
+		fim::WorkerPool<int> pool(3, 1024, OverflowPolicy::Block, [&handled](int& item) {
+			if (item % 10 == 0) throw std::runtime_error("bad item");
+			handled.fetch_add(1);
+		});
+		for (int i = 0; i < 1000; ++i) pool.submit(i, static_cast<size_t>(i) % fim::kQueueLanes);
+		pool.stop();
+		const fim::QueueStats s = pool.stats();
+		ok &= check("pool processed everything", s.processed == 1000 && s.failed == 100 && handled.load() == 900);
+		ok &= check("stopped pool refuses work", !pool.submit(1));
+	}
+
+	std::cout << "[FIM] Queue check " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+fim::PathMatcher::Root matcher_root(const wchar_t* path, bool recursive, std::vector<const wchar_t*> include,
+	std::vector<const wchar_t*> exclude, fim::Priority priority = fim::Priority::Medium) {
+	fim::PathMatcher::Root root;
+	root.path = path;
+	root.recursive = recursive;
+	root.priority = priority;
+	for (const wchar_t* pattern : include) root.include.add(pattern);
+	for (const wchar_t* pattern : exclude) root.exclude.add(pattern);
+	return root;
+}
+
+// What classify() must return, worked out the slow way: every root compared against the path,
+// every pattern through the plain glob matcher.
+struct ReferenceMatcher {
+	struct Rule {
+		std::wstring path; // folded
+		bool recursive;
+		std::vector<std::wstring> include;
+		std::vector<std::wstring> exclude;
+	};
+	std::vector<Rule> rules;
+	std::vector<std::wstring> globalExclude;
+
+	static bool any(const std::vector<std::wstring>& patterns, const std::wstring& name) {
+		for (const auto& pattern : patterns) {
+			if (fim::detail::glob_match(fim::fold_path(pattern), name)) return true;
+		}
+		return false;
+	}
+
+	std::pair<fim::PathVerdict, uint32_t> classify(const std::wstring& path) const {
+		const std::wstring folded = fim::fold_path(path);
+		uint32_t best = fim::detail::WideTrie::kNone;
+		size_t bestLen = 0;
+		for (uint32_t i = 0; i < rules.size(); ++i) {
+			const std::wstring& root = rules[i].path;
+			if (root.size() < bestLen || folded.compare(0, root.size(), root) != 0) continue;
+			if (folded.size() == root.size() || folded[root.size()] == L'\\') {
+				best = i;
+				bestLen = root.size();
+			}
+		}
+		if (best == fim::detail::WideTrie::kNone) return { fim::PathVerdict::Unmonitored, best };
+		const std::wstring rest = folded.substr(std::min(folded.size(), bestLen + 1));
+		if (rest.empty()) return { fim::PathVerdict::Monitored, best };
+		const size_t sep = rest.rfind(L'\\');
+		if (!rules[best].recursive && sep != std::wstring::npos) return { fim::PathVerdict::Unmonitored, best };
+		const std::wstring name = sep == std::wstring::npos ? rest : rest.substr(sep + 1);
+		const Rule& rule = rules[best];
+		if (any(globalExclude, name) || any(rule.exclude, name) || (!rule.include.empty() && !any(rule.include, name))) {
+			return { fim::PathVerdict::Excluded, best };
+		}
+		return { fim::PathVerdict::Monitored, best };
+	}
+};
+
+// Checks the path matcher on hand-picked cases (component boundaries, nested and non-recursive
+// roots, case and separators, each glob shape), then builds `ruleCount` roots with mixed filters,
+// compares classify() with ReferenceMatcher on synthetic paths and times both.
+int run_matcher_check(size_t ruleCount) {
+	using fim::PathVerdict;
+	bool ok = true;
+
+	fim::PathMatcher matcher;
+	matcher.add_global_exclude(L"*.tmp");
+	matcher.add_global_exclude(L"Thumbs.db");
+	matcher.add_root(matcher_root(L"C:\\Data\\", true, { L"*.docx", L"report-?.txt", L"~$*", L"*.x?s*" }, { L"secret*" }));
+	matcher.add_root(matcher_root(L"C:\\Data\\Logs", false, {}, { L"*.bak" }, fim::Priority::Critical));
+	matcher.add_root(matcher_root(L"D:/Shares", true, {}, {}));
+	auto expect = [&](const wchar_t* path, PathVerdict verdict, uint32_t root) {
+		const fim::PathClassification c = matcher.classify(path);
+		const bool match = c.verdict == verdict && (verdict == PathVerdict::Unmonitored || c.root == root);
+		if (!match) std::cerr << "[FIM] Check failed: classify " << fim::wide_to_utf8(path) << std::endl;
+		ok &= match;
+	};
+	expect(L"C:\\Data", PathVerdict::Monitored, 0);                      // the root itself
+	expect(L"C:\\Data\\a.docx", PathVerdict::Monitored, 0);
+	expect(L"C:\\Database\\a.docx", PathVerdict::Unmonitored, 0);        // not a component boundary
+	expect(L"C:\\Dat\\a.docx", PathVerdict::Unmonitored, 0);
+	expect(L"c:/DATA/Sub/Deeper/B.DOCX", PathVerdict::Monitored, 0);    // case and '/' folded
+	expect(L"C:\\Data\\a.txt", PathVerdict::Excluded, 0);                // not in file_types
+	expect(L"C:\\Data\\report-1.txt", PathVerdict::Monitored, 0);        // general glob
+	expect(L"C:\\Data\\report-12.txt", PathVerdict::Excluded, 0);
+	expect(L"C:\\Data\\~$draft.anything", PathVerdict::Monitored, 0);    // prefix glob
+	expect(L"C:\\Data\\book.xlsx", PathVerdict::Monitored, 0);
+	expect(L"C:\\Data\\secret.docx", PathVerdict::Excluded, 0);          // root exclude wins
+	expect(L"C:\\Data\\a.docx.tmp", PathVerdict::Excluded, 0);           // global exclude
+	expect(L"C:\\Data\\sub\\thumbs.DB", PathVerdict::Excluded, 0);
+	expect(L"C:\\Data\\Logs\\app.log", PathVerdict::Monitored, 1);       // deepest root wins
+	expect(L"C:\\Data\\Logs\\app.bak", PathVerdict::Excluded, 1);
+	expect(L"C:\\Data\\Logs\\old\\app.log", PathVerdict::Unmonitored, 1); // below a non-recursive root
+	expect(L"C:\\Data\\Logsold\\a.docx", PathVerdict::Monitored, 0);     // sibling of the nested root
+	expect(L"D:\\Shares\\x\\y\\z.bin", PathVerdict::Monitored, 2);
+	expect(L"D:\\Share", PathVerdict::Unmonitored, 2);
+	ok &= check("priority follows the root", matcher.classify(L"C:\\Data\\Logs\\a").priority == fim::Priority::Critical);
+
+	// Many roots of every filter shape: exact names, prefix*, *suffix, irregular globs, '*'.
+	static const wchar_t* const kInclude[][3] = {
+		{ L"*.docx", L"*.xlsx", nullptr }, { L"report-??.*", nullptr, nullptr }, { L"desktop.ini", L"~$*", nullptr },
+		{ L"*", nullptr, nullptr }, { nullptr, nullptr, nullptr }, { L"*.t?t", L"*.pdf", L"data_*" },
+	};
+	static const wchar_t* const kExclude[][2] = {
+		{ nullptr, nullptr }, { L"*.bak", nullptr }, { L"~*", L"*.old" }, { L"secret?.*", nullptr },
+	};
+	static const wchar_t* const kNames[] = {
+		L"a.docx", L"B.XLSX", L"report-01.pdf", L"report-1.pdf", L"desktop.ini", L"~$a.docx", L"notes.txt",
+		L"notes.tst", L"data_1.csv", L"x.bak", L"y.old", L"secret1.docx", L"z.tmp", L"thumbs.db", L"plain",
+	};
+	fim::PathMatcher big;
+	ReferenceMatcher reference;
+	for (const wchar_t* pattern : { L"*.tmp", L"thumbs.db" }) {
+		big.add_global_exclude(pattern);
+		reference.globalExclude.push_back(pattern);
+	}
+	for (size_t i = 0; i < ruleCount; ++i) {
+		// Every 16th root nests under an earlier one; a few are not recursive.
+		std::wstring path = L"D:\\Shares\\dept" + std::to_wstring(i % 61) + L"\\project" + std::to_wstring(i);
+		if (i % 16 == 15) path = L"D:\\Shares\\dept" + std::to_wstring((i - 15) % 61) + L"\\project" + std::to_wstring(i - 15) + L"\\sub";
+		fim::PathMatcher::Root root;
+		ReferenceMatcher::Rule rule;
+		root.path = path;
+		rule.path = fim::fold_path(path);
+		root.recursive = rule.recursive = i % 7 != 3;
+		for (const wchar_t* pattern : kInclude[i % 6]) {
+			if (!pattern) continue;
+			root.include.add(pattern);
+			rule.include.push_back(pattern);
+		}
+		for (const wchar_t* pattern : kExclude[i % 4]) {
+			if (!pattern) continue;
+			root.exclude.add(pattern);
+			rule.exclude.push_back(pattern);
+		}
+		big.add_root(std::move(root));
+		reference.rules.push_back(std::move(rule));
+	}
+
+	std::vector<std::wstring> paths;
+	for (size_t i = 0; i < 20000; ++i) {
+		const size_t project = (i * 7919) % (ruleCount + ruleCount / 8 + 1); // some past the last root
+		std::wstring path = L"D:\\Shares\\dept" + std::to_wstring(project % 61) + L"\\project" + std::to_wstring(project);
+		switch (i % 5) {
+		case 1: path += L"\\sub"; break;
+		case 2: path += L"\\sub\\deeper"; break;
+		case 3: path += L"0"; break; // project120 is not under project12
+		default: break;
+		}
+		paths.push_back(path + L"\\" + kNames[i % (sizeof(kNames) / sizeof(kNames[0]))]);
+	}
+	size_t mismatches = 0;
+	std::array<size_t, 3> verdicts{};
+	for (const auto& path : paths) {
+		const fim::PathClassification c = big.classify(path);
+		const auto expected = reference.classify(path);
+		++verdicts[static_cast<size_t>(c.verdict)];
+		if (c.verdict != expected.first || (c.verdict != PathVerdict::Unmonitored && c.root != expected.second)) {
+			if (mismatches++ < 5) std::cerr << "[FIM] Matcher differs from the reference on " << fim::wide_to_utf8(path) << std::endl;
+		}
+	}
+	ok &= check("matcher agrees with the reference", mismatches == 0);
+
+	using clock = std::chrono::steady_clock;
+	auto measure = [&paths](size_t passes, auto&& classify) {
+		size_t monitored = 0;
+		const auto begin = clock::now();
+		for (size_t pass = 0; pass < passes; ++pass) {
+			for (const auto& path : paths) monitored += classify(path) == PathVerdict::Monitored;
+		}
+		const double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+		return std::make_pair(seconds > 0 ? static_cast<double>(paths.size() * passes) / seconds : 0.0, monitored);
+	};
+	const auto compiled = measure(10, [&big](const std::wstring& path) { return big.classify(path).verdict; });
+	const auto linear = measure(1, [&reference](const std::wstring& path) { return reference.classify(path).first; });
+	std::cout << std::fixed << std::setprecision(0) << "[FIM] Matcher " << ruleCount << " roots (" << big.trie_nodes()
+	          << " trie nodes): " << compiled.first << " paths/s, linear reference " << linear.first << " paths/s; "
+	          << "monitored=" << verdicts[2] << " excluded=" << verdicts[1] << " unmonitored=" << verdicts[0] << std::endl;
+	std::cout << "[FIM] Matcher check " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+// Stand-in for a backend that has stalled: every batch takes `delay` to "upload".
+class SlowSink : public fim::AlertSink {
+public:
+	explicit SlowSink(std::chrono::milliseconds delay) : delay_(delay) {}
+	std::string name() const override { return "slow-api stand-in"; }
+	bool deliver(const std::vector<fim::AlertPtr>&) override {
+		std::this_thread::sleep_for(delay_);
+		return true;
+	}
+
+private:
+	std::chrono::milliseconds delay_;
+};
+
+// Loopback syslog listener counting received messages (datagrams, or octet-counted TCP frames).
+class SyslogListener {
+public:
+	explicit SyslogListener(bool tcp) : tcp_(tcp) {
+		fd_ = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+		const int rcvbuf = 8 << 20;
+		setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(addr);
+		if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+			getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0 || (tcp && listen(fd_, 4) != 0)) {
+			std::perror("[FIM] listener");
+			return;
+		}
+		port_ = ntohs(addr.sin_port);
+		timeval timeout{};
+		timeout.tv_usec = 200 * 1000;
+		setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		thread_ = std::thread([this]() { tcp_ ? run_tcp() : run_udp(); });
+	}
+
+	~SyslogListener() {
+		stop_ = true;
+		if (thread_.joinable()) thread_.join();
+		close(fd_);
+	}
+
+	unsigned port() const { return port_; }
+	size_t received() const { return received_.load(); }
+
+private:
+	void run_udp() {
+		std::vector<char> buf(65536);
+		while (!stop_) {
+			if (recv(fd_, buf.data(), buf.size(), 0) > 0) received_.fetch_add(1);
+		}
+	}
+
+	void run_tcp() {
+		int conn = -1;
+		std::string pending;
+		std::vector<char> buf(65536);
+		while (!stop_) {
+			if (conn < 0) {
+				conn = accept(fd_, nullptr, nullptr);
+				if (conn < 0) continue;
+				timeval timeout{};
+				timeout.tv_usec = 200 * 1000;
+				setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			}
+			const ssize_t n = recv(conn, buf.data(), buf.size(), 0);
+			if (n == 0) {
+				close(conn);
+				conn = -1;
+				continue;
+			}
+			if (n < 0) continue;
+			pending.append(buf.data(), static_cast<size_t>(n));
+			for (;;) { // "LEN SP MSG" frames
+				const size_t space = pending.find(' ');
+				if (space == std::string::npos) break;
+				const size_t len = std::strtoul(pending.c_str(), nullptr, 10);
+				if (pending.size() < space + 1 + len) break;
+				pending.erase(0, space + 1 + len);
+				received_.fetch_add(1);
+			}
+		}
+		if (conn >= 0) close(conn);
+	}
+
+	bool tcp_;
+	int fd_{-1};
+	unsigned port_{0};
+	std::atomic<bool> stop_{false};
+	std::atomic<size_t> received_{0};
+	std::thread thread_;
+};
+
+// Publishes `count` alerts to a fan-out of UDP syslog, TCP syslog, file and a slow sink, all local.
+// The fast sinks must receive everything and publishing must not be held up by the slow one;
+// the slow one sheds LOW records first and must not lose a CRITICAL one (1 in 100).
+int run_sink_check(size_t count) {
+	using clock = std::chrono::steady_clock;
+	SyslogListener udp(false);
+	SyslogListener tcp(true);
+	if (!udp.port() || !tcp.port()) return 1;
+	const std::string filePath = "/tmp/fim_sink_check_" + std::to_string(getpid()) + ".log";
+	std::remove(filePath.c_str());
+
+	fim::SinkOptions options = fim::SinkOptions::from_env();
+	options.queueCapacity = std::max(options.queueCapacity, count);
+	fim::SinkOptions slowOptions = options;
+	slowOptions.queueCapacity = 256; // small on purpose: the stalled sink has to shed load
+	fim::AlertFanout sinks;
+	sinks.add(std::make_unique<fim::SyslogSink>("127.0.0.1", udp.port(), false), options);
+	sinks.add(std::make_unique<fim::SyslogSink>("127.0.0.1", tcp.port(), true), options);
+	sinks.add(std::make_unique<fim::FileSink>(filePath), options);
+	sinks.add(std::make_unique<SlowSink>(std::chrono::milliseconds(50)), slowOptions);
+
+	const auto begin = clock::now();
+	for (size_t i = 0; i < count; ++i) {
+		fim::AlertRecord record;
+		record.kind = i % 4 ? fim::AlertKind::Event : fim::AlertKind::HashChange;
+		record.priority = i % 100 ? static_cast<fim::Priority>(1 + i % 3) : fim::Priority::Critical;
+		record.key = "check-" + std::to_string(i) + ".json";
+		record.text = "{\"event_id\":11,\"target\":\"C:\\\\Data\\\\file" + std::to_string(i) + ".txt\"}";
+		sinks.publish(std::move(record));
+	}
+	const double publishSeconds = std::chrono::duration<double>(clock::now() - begin).count();
+	std::this_thread::sleep_for(std::chrono::milliseconds(300)); // let the listeners catch up
+	const auto stats = sinks.stats();
+	sinks.log_stats(std::cout);
+	sinks.stop();
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+	size_t lines = 0;
+	std::ifstream in(filePath);
+	for (std::string line; std::getline(in, line);) ++lines;
+	std::remove(filePath.c_str());
+	std::cout << std::fixed << std::setprecision(1) << "[FIM] Sink check: published " << count << " alerts in "
+	          << publishSeconds * 1000 << " ms; received udp=" << udp.received() << " tcp=" << tcp.received()
+	          << " file=" << lines << " slow=" << stats[3].second.delivered << " (dropped " << stats[3].second.queue.dropped
+	          << ")" << std::endl;
+	const bool ok = tcp.received() == count && lines == count && stats[3].second.queue.droppedByLane[0] == 0;
+	std::cout << "[FIM] Sink check " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+// Accepts every request without touching the network (or the heap).
+class NullTransport : public fim::HttpTransport {
+public:
+	fim::HttpResponse post(const fim::HttpRequest& req) override {
+		posts_.fetch_add(1, std::memory_order_relaxed);
+		bytes_.fetch_add(req.bodySize, std::memory_order_relaxed);
+		fim::HttpResponse resp;
+		resp.status = 200;
+		return resp;
+	}
+	const char* name() const override { return "null"; }
+
+	static std::atomic<uint64_t> posts_;
+	static std::atomic<uint64_t> bytes_;
+};
+
+std::atomic<uint64_t> NullTransport::posts_{0};
+std::atomic<uint64_t> NullTransport::bytes_{0};
+
+std::unique_ptr<fim::HttpTransport> make_null_transport(const fim::HttpEndpoint&, const fim::TransportOptions&) {
+	return std::make_unique<NullTransport>();
+}
+
+// Sysmon FileCreate event with every field the fields payload carries.
+fim::FimEvent synthetic_event(size_t i) {
+	const std::string target = "C:\\Data\\share\\project-" + std::to_string(i % 97) + "\\report-" + std::to_string(i) + ".docx";
+	const std::string xml =
+		"<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+		"<Provider Name='Microsoft-Windows-Sysmon'/><EventID>11</EventID>"
+		"<TimeCreated SystemTime='2025-11-17T10:15:30.1234567Z'/><Channel>Microsoft-Windows-Sysmon/Operational</Channel>"
+		"<Computer>FS01.corp.example.com</Computer></System><EventData>"
+		"<Data Name='UtcTime'>2025-11-17 10:15:30.123</Data>"
+		"<Data Name='ProcessGuid'>{5c2f1a4e-7b1d-6550-a203-000000001a00}</Data>"
+		"<Data Name='Image'>C:\\Program Files\\Microsoft Office\\root\\Office16\\WINWORD.EXE</Data>"
+		"<Data Name='TargetFilename'>" + target + "</Data>"
+		"<Data Name='Hashes'>SHA256=9F86D081884C7D659A2FEAA0C55AD015A3BF4F1B2B0B822CD15D6C15B0F00A08</Data>"
+		"<Data Name='User'>CORP\\alice</Data></EventData></Event>";
+	fim::FimEvent ev;
+	ev.eventId = 11;
+	ev.target = fim::utf8_to_wide(target);
+	ev.xml = fim::utf8_to_wide(xml);
+	return ev;
+}
+
+// Ships `count` events the way EventPipeline::publish_event does (pooled record, object key,
+// fields payload) to the API (batched NDJSON through ApiUploader, 1 in 100 CRITICAL and posted
+// on its own), UDP syslog and a file. The same load runs until the pools stop growing; one more
+// run must then not allocate at all. Records go out in chunks that are drained before the next
+// one, which bounds the number of records in flight.
+int run_alloc_check(size_t count) {
+	constexpr size_t kChunk = 1000;
+	SyslogListener udp(false);
+	if (!udp.port()) return 1;
+	const std::string filePath = "/tmp/fim_alloc_check_" + std::to_string(getpid()) + ".log";
+	std::remove(filePath.c_str());
+
+	fim::ApiUploader uploader(make_null_transport);
+	uploader.configure("http://127.0.0.1/api/logs/upload", "alloc-check-token", fim::TransportOptions(),
+		fim::BatchLimits(), std::string(), fim::WireEncoding::Ndjson, std::nullopt, fim::FlowOptions());
+	fim::SinkOptions options = fim::SinkOptions::from_env();
+	options.queueCapacity = std::max(options.queueCapacity, kChunk);
+	fim::AlertFanout sinks;
+	sinks.add_api(uploader, options);
+	sinks.add(std::make_unique<fim::SyslogSink>("127.0.0.1", udp.port(), false), options);
+	sinks.add(std::make_unique<fim::FileSink>(filePath), options);
+
+	std::vector<fim::FimEvent> events;
+	for (size_t i = 0; i < 256; ++i) events.push_back(synthetic_event(i));
+
+	auto drained = [&sinks]() {
+		t_uncounted = true; // stats() builds names and vectors
+		bool done = true;
+		for (const auto& entry : sinks.stats()) done = done && entry.second.delivered == entry.second.queue.enqueued;
+		t_uncounted = false;
+		return done;
+	};
+	auto ship = [&](size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			const fim::FimEvent& ev = events[i % events.size()];
+			sinks.publish_with([&](fim::AlertRecord& record) {
+				record.kind = fim::AlertKind::Event;
+				record.priority = i % 100 ? fim::Priority::High : fim::Priority::Critical;
+				record.received = ev.received;
+				fim::append_event_object_suffix(record.key, ev.eventId, ".json");
+				fim::append_event_payload(record.text, ev);
+			});
+			if ((i + 1) % kChunk == 0 || i + 1 == n) {
+				while (!drained()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				uploader.flush();
+			}
+		}
+	};
+
+	// Warm up until a whole run leaves the pools as they were: that is the steady state.
+	for (int round = 0; round < 10; ++round) {
+		const uint64_t created = sinks.record_pool_stats().created + uploader.buffer_stats().created;
+		ship(count);
+		if (sinks.record_pool_stats().created + uploader.buffer_stats().created == created && round > 0) break;
+	}
+	const uint64_t postsBefore = NullTransport::posts_.load();
+	const uint64_t before = g_allocations.load();
+	const auto begin = std::chrono::steady_clock::now();
+	ship(count);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	const uint64_t allocations = g_allocations.load() - before;
+	const uint64_t posts = NullTransport::posts_.load() - postsBefore;
+
+	const fim::PoolStats records = sinks.record_pool_stats();
+	const fim::PoolStats buffers = uploader.buffer_stats();
+	sinks.stop();
+	std::remove(filePath.c_str());
+	std::cout << std::fixed << std::setprecision(1) << "[FIM] Alloc check: shipped " << count << " events in "
+	          << seconds * 1000 << " ms (" << posts << " API posts, " << udp.received() << " syslog datagrams in total); "
+	          << "heap allocations " << allocations << " (" << std::setprecision(4)
+	          << static_cast<double>(allocations) / static_cast<double>(count) << "/event)" << std::endl;
+	std::cout << "[FIM] Record pool: reused=" << records.reused << " created=" << records.created
+	          << " misses=" << records.misses << "; payload/body buffers: reused=" << buffers.reused
+	          << " created=" << buffers.created << " misses=" << buffers.misses << std::endl;
+	const bool ok = allocations == 0;
+	std::cout << "[FIM] Alloc check " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+// True when `text` is a JSON object whose values are strings or numbers, with every string valid
+// UTF-8 (no surrogates or overlong forms) and no raw control characters - what the backend parses.
+bool valid_record_json(const std::string& text) {
+	size_t i = 0;
+	const size_t n = text.size();
+	auto string = [&]() {
+		if (i >= n || text[i++] != '"') return false;
+		while (i < n) {
+			const unsigned char c = static_cast<unsigned char>(text[i]);
+			if (c == '"') return ++i, true;
+			if (c < 0x20) return false;
+			if (c == '\\') {
+				if (++i >= n) return false;
+				const char e = text[i++];
+				if (e == 'u') {
+					for (int k = 0; k < 4; ++k, ++i) {
+						if (i >= n || !std::isxdigit(static_cast<unsigned char>(text[i]))) return false;
+					}
+				} else if (!std::strchr("\"\\/bfnrt", e) || e == '\0') {
+					return false;
+				}
+				continue;
+			}
+			size_t len = c < 0x80 ? 1 : c >= 0xC2 && c <= 0xDF ? 2 : c >= 0xE0 && c <= 0xEF ? 3 : c >= 0xF0 && c <= 0xF4 ? 4 : 0;
+			if (len == 0 || i + len > n) return false;
+			uint32_t cp = len == 1 ? c : c & (0xFF >> (len + 1));
+			for (size_t k = 1; k < len; ++k) {
+				const unsigned char cc = static_cast<unsigned char>(text[i + k]);
+				if ((cc & 0xC0) != 0x80) return false;
+				cp = (cp << 6) | (cc & 0x3F);
+			}
+			if ((len == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) || (len == 4 && (cp < 0x10000 || cp > 0x10FFFF))) return false;
+			i += len;
+		}
+		return false;
+	};
+	if (i >= n || text[i++] != '{') return false;
+	for (bool first = true;; first = false) {
+		if (i < n && text[i] == '}' && first) return ++i == n;
+		if (!string() || i >= n || text[i++] != ':') return false;
+		if (i < n && text[i] == '"') {
+			if (!string()) return false;
+		} else {
+			const size_t start = i;
+			while (i < n && std::isdigit(static_cast<unsigned char>(text[i]))) ++i;
+			if (i == start) return false;
+		}
+		if (i < n && text[i] == ',') { ++i; continue; }
+		return i < n && text[i] == '}' && ++i == n;
+	}
+}
+
+template <typename CharT>
+bool view_inside(std::basic_string_view<CharT> view, const std::basic_string<CharT>& buffer) {
+	return view.empty() || (view.data() >= buffer.data() && view.data() + view.size() <= buffer.data() + buffer.size());
+}
+
+// Scans one input as the sender does (UTF-16/32 code units) and as the replay source does (UTF-8
+// bytes) and checks that every field points into the input and the records are valid JSON.
+template <typename CharT>
+bool fuzz_fields_once(const std::basic_string<CharT>& input) {
+	fim::SysmonFields<CharT> fields;
+	fim::extract_sysmon_fields(std::basic_string_view<CharT>(input), fields);
+	for (const auto& view : { fields.systemTime, fields.computer, fields.channel, fields.utcTime, fields.image,
+		fields.targetFilename, fields.processGuid, fields.hashes, fields.user }) {
+		if (!view_inside(view, input)) return false;
+	}
+	std::string record;
+	fim::append_event_record(record, fields);
+	return valid_record_json(record);
+}
+
+// Mutation fuzzing of the Sysmon field scanner: recorded-looking events are truncated, have bytes
+// flipped or replaced by markup characters, entity fragments and high bytes, and have ranges
+// deleted or duplicated. Every mutant is scanned as UTF-8 and as wide text (with stray surrogates)
+// and must only yield in-bounds fields and valid JSON. Build with -fsanitize=address,undefined to
+// also catch reads past the end.
+int run_fields_fuzz(size_t iterations) {
+	static const char* const kTokens[] = {
+		"<", ">", "/>", "</", "<!--", "<?", "'", "\"", "=", "&", "&amp;", "&#", "&#x", "&#x110000;", "&#xD800;",
+		";", "<Event>", "</Event>", "<EventID>", "<Data Name='TargetFilename'>", "</Data>", "\xC3", "\xE2\x82",
+		"\xF0\x9F\x98\x80", "\xED\xA0\x80", "\xFF", "\x01", "\n",
+	};
+	std::vector<std::string> seeds;
+	for (size_t i = 0; i < 4; ++i) seeds.push_back(fim::wide_to_utf8(synthetic_event(i).xml));
+	seeds.push_back("<Event><System><EventID>4663</EventID><Computer>a&amp;b</Computer></System><EventData>"
+		"<Data Name=\"ObjectName\">C:\\x&#x20AC;&#233;</Data><Data Name=\"ProcessName\">p</Data>"
+		"<Data Name=\"SubjectUserName\">u</Data></EventData></Event>");
+
+	{ // the seeds themselves must come out whole
+		fim::SysmonFields<char> fields;
+		const bool found = fim::extract_sysmon_fields(std::string_view(seeds[0]), fields);
+		if (!check("seed scans", found && fields.eventId == 11 && fields.targetFilename.find("report-0.docx") != std::string_view::npos &&
+			!fields.hashes.empty() && !fields.user.empty() && valid_record_json(fim::build_event_record(fields)))) {
+			return 1;
+		}
+	}
+
+	std::mt19937_64 rng(fim::getenv_size("FIM_FUZZ_SEED", 1));
+	auto pick = [&rng](size_t n) { return n ? static_cast<size_t>(rng() % n) : 0; };
+	size_t failures = 0;
+	size_t withEventId = 0;
+	for (size_t iter = 0; iter < iterations; ++iter) {
+		std::string input = seeds[pick(seeds.size())];
+		for (size_t m = 1 + pick(6); m > 0; --m) {
+			const size_t at = pick(input.size() + 1);
+			switch (pick(6)) {
+			case 0: input.resize(at); break;
+			case 1: if (at < input.size()) input[at] = static_cast<char>(rng()); break;
+			case 2: input.insert(at, kTokens[pick(sizeof(kTokens) / sizeof(kTokens[0]))]); break;
+			case 3: input.erase(at, pick(32)); break;
+			case 4: input.insert(at, input.substr(pick(input.size()), pick(64))); break;
+			default: if (at < input.size()) input[at] = "<>/'\"=&;#"[pick(9)]; break;
+			}
+		}
+		std::wstring wide;
+		fim::utf8_to_wide(input, wide);
+		if (!wide.empty() && pick(4) == 0) wide[pick(wide.size())] = static_cast<wchar_t>(0xD800 + pick(0x800));
+		// Exact-size copies, so a sanitizer sees any read past the end.
+		const std::string exact(input.begin(), input.end());
+		const std::wstring exactWide(wide.begin(), wide.end());
+		fim::SysmonFields<char> probe;
+		withEventId += fim::extract_sysmon_fields(std::string_view(exact), probe);
+		if (!fuzz_fields_once(exact) || !fuzz_fields_once(exactWide)) {
+			if (failures++ < 5) std::cerr << "[FIM] Fields fuzz failed on input " << iter << ": " << fim::json_escape(exact) << std::endl;
+		}
+	}
+	std::cout << "[FIM] Fields fuzz: " << iterations << " inputs (" << withEventId << " still with an EventID), "
+	          << failures << " failures" << std::endl;
+	std::cout << "[FIM] Fields fuzz " << (failures ? "FAILED" : "passed") << std::endl;
+	return failures ? 1 : 0;
+}
+
+// Stand-in backend behind a link: request bodies cross it one after another at bytesPerSec, and
+// each answer comes one rtt after its body got through. While busy, requests are answered 429
+// with Retry-After: 1 after one round trip.
+class SimulatedLink : public fim::HttpTransport {
+public:
+	struct Profile {
+		std::chrono::milliseconds rtt{1};
+		double bytesPerSec{1e9};
+		bool busy{false};
+	};
+
+	fim::HttpResponse post(const fim::HttpRequest& req) override {
+		Profile profile;
+		std::chrono::steady_clock::time_point answered;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			profile = profile_;
+			const auto now = std::chrono::steady_clock::now();
+			if (wireFree_ < now) wireFree_ = now;
+			if (!profile.busy) {
+				wireFree_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(static_cast<double>(req.bodySize) / profile.bytesPerSec));
+			}
+			answered = (profile.busy ? now : wireFree_) + profile.rtt;
+		}
+		std::this_thread::sleep_until(answered);
+		fim::HttpResponse resp;
+		if (profile.busy) {
+			resp.status = 429;
+			resp.retryAfterSec = 1;
+			return resp;
+		}
+		resp.status = 200;
+		size_t lines = 0;
+		for (size_t i = 0; i < req.bodySize; ++i) lines += req.body[i] == '\n';
+		records_.fetch_add(lines, std::memory_order_relaxed);
+		return resp;
+	}
+	const char* name() const override { return "simulated"; }
+
+	static void set_profile(const Profile& profile) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		profile_ = profile;
+	}
+
+	static std::atomic<uint64_t> records_;
+
+private:
+	static std::mutex mutex_;
+	static Profile profile_;
+	static std::chrono::steady_clock::time_point wireFree_;
+};
+
+std::atomic<uint64_t> SimulatedLink::records_{0};
+std::mutex SimulatedLink::mutex_;
+SimulatedLink::Profile SimulatedLink::profile_;
+std::chrono::steady_clock::time_point SimulatedLink::wireFree_{};
+
+std::unique_ptr<fim::HttpTransport> make_simulated_link(const fim::HttpEndpoint&, const fim::TransportOptions&) {
+	return std::make_unique<SimulatedLink>();
+}
+
+// Publishes ~600-byte HIGH records through an AlertFanout to the API sinks of an adaptive
+// ApiUploader (FIM_API_* batching knobs from the environment, 8 connections and upload threads
+// per batcher) for `seconds` per link profile, and reports where the flow controller settled on
+// each. The sink queue blocks when full, so every record published must arrive. Give each phase
+// 8 s or more: the full-size LAN batches in flight when the link slows take that long to drain. The busy phase is followed by a healthy one the retried batches
+// drain into. Passes when every record arrived and the limits moved the expected way: up on the
+// LAN, down on the WAN, and the in-flight limit cut by the 429s.
+int run_flow_check(size_t seconds) {
+	fim::TransportOptions transport;
+	transport.maxInFlight = 8;
+	fim::BatchLimits limits;
+	limits.maxEvents = fim::getenv_size("FIM_BATCH_MAX_EVENTS", limits.maxEvents);
+	limits.maxBytes = fim::getenv_size("FIM_BATCH_MAX_BYTES", limits.maxBytes);
+	fim::FlowOptions flow;
+	flow.maxInFlight = transport.maxInFlight;
+	flow.targetLatency = std::chrono::milliseconds(fim::getenv_size("FIM_API_TARGET_LATENCY_MS",
+		static_cast<size_t>(flow.targetLatency.count())));
+	fim::ApiUploader uploader(make_simulated_link);
+	uploader.configure("http://127.0.0.1/api/logs/upload", "flow-check-token", transport, limits, std::string(),
+		fim::WireEncoding::Ndjson, std::nullopt, flow);
+	fim::SinkOptions options = fim::SinkOptions::from_env();
+	options.overflow = fim::OverflowPolicy::Block;
+	fim::AlertFanout sinks;
+	sinks.add_api(uploader, options);
+
+	struct Phase {
+		const char* label;
+		SimulatedLink::Profile profile;
+		size_t seconds;
+	};
+	SimulatedLink::Profile lan;
+	SimulatedLink::Profile wan;
+	wan.rtt = std::chrono::milliseconds(150);
+	wan.bytesPerSec = 1e6;
+	SimulatedLink::Profile busy = lan;
+	busy.busy = true;
+	const std::vector<Phase> phases = {
+		{ "lan", lan, seconds }, { "wan", wan, seconds }, { "busy", busy, std::max<size_t>(seconds / 2, 1) },
+		{ "recovered", lan, seconds },
+	};
+
+	// The link changes on a timer of its own: publishing may be held up by a full sink queue.
+	std::atomic<size_t> current{0};
+	SimulatedLink::set_profile(phases[0].profile);
+	std::thread clock([&phases, &current]() {
+		for (size_t i = 0; i < phases.size(); ++i) {
+			std::this_thread::sleep_for(std::chrono::seconds(phases[i].seconds));
+			if (i + 1 < phases.size()) SimulatedLink::set_profile(phases[i + 1].profile);
+			current.store(i + 1);
+		}
+	});
+
+	const std::string payload = std::string(560, 'x');
+	uint64_t submitted = 0;
+	std::vector<fim::BatchLimits> settled;
+	std::vector<fim::FlowStats> flows;
+	std::vector<size_t> minInFlight;
+	for (size_t phase = 0; phase < phases.size(); ++phase) {
+		const uint64_t recordsBefore = SimulatedLink::records_.load();
+		const uint64_t busyBefore = uploader.flow_stats().backpressure;
+		const auto begin = std::chrono::steady_clock::now();
+		size_t lowest = transport.maxInFlight;
+		while (current.load() == phase) {
+			for (int i = 0; i < 100; ++i, ++submitted) {
+				sinks.publish_with([&payload](fim::AlertRecord& record) {
+					record.priority = fim::Priority::High;
+					record.key = "flow-check.json";
+					record.text = payload;
+				});
+			}
+			lowest = std::min(lowest, uploader.flow_stats().inFlightLimit);
+		}
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		fim::BatchLimits limitsNow;
+		const fim::FlowStats f = uploader.flow_stats(&limitsNow);
+		settled.push_back(limitsNow);
+		flows.push_back(f);
+		minInFlight.push_back(lowest);
+		std::cout << std::fixed << std::setprecision(0) << "[FIM] Flow check " << phases[phase].label << ": batch_events="
+		          << limitsNow.maxEvents << " batch_bytes=" << limitsNow.maxBytes << " inflight_limit=" << f.inFlightLimit
+		          << " (min " << lowest << ") delivered="
+		          << static_cast<double>(SimulatedLink::records_.load() - recordsBefore) / elapsed << " records/s busy="
+		          << f.backpressure - busyBefore << std::endl;
+	}
+	clock.join();
+	const uint64_t retried = uploader.busy_retries();
+	sinks.stop();
+	uploader.configure(std::string(), std::string(), transport); // flushes and waits for the last batches
+	const uint64_t delivered = SimulatedLink::records_.load();
+
+	std::cout << "[FIM] Flow check: submitted=" << submitted << " delivered=" << delivered
+	          << " retried=" << retried << std::endl;
+	const bool ok = delivered == submitted && settled[0].maxEvents > limits.maxEvents &&
+		settled[1].maxBytes < settled[0].maxBytes && flows[2].backpressure > flows[1].backpressure &&
+		minInFlight[2] < flows[1].inFlightLimit;
+	std::cout << "[FIM] Flow check " << (ok ? "passed" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	if (argc < 3) return usage();
+
+	const std::string configPath = argv[1];
+	std::vector<std::string> inputs;
+	fim::ReplayOptions replay;
+	fim::PipelineOptions pipelineOptions = fim::PipelineOptions::from_env();
+	pipelineOptions.echo = false;
+	bool payloadBench = false;
+	bool escapeBench = false;
+	bool utfBench = false;
+	size_t indexBench = 0;
+	size_t sinkCheck = 0;
+	size_t allocCheck = 0;
+	size_t flowCheck = 0;
+	bool queueCheck = false;
+	size_t matcherCheck = 0;
+	size_t fieldsFuzz = 0;
+	size_t escapeCheck = 0;
+	std::string wireFixture;
+	bool rescan = false;
+	std::string reloadPath;
+	for (int i = 2; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "--rate" && hasValue) {
+			replay.eventsPerSec = std::atof(argv[++i]);
+		} else if (arg == "--loops" && hasValue) {
+			replay.loops = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--workers" && hasValue) {
+			pipelineOptions.workers = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--echo") {
+			pipelineOptions.echo = true;
+		} else if (arg == "--rescan") {
+			rescan = true;
+		} else if (arg == "--reload" && hasValue) {
+			reloadPath = argv[++i];
+		} else if (arg == "--payload-bench") {
+			payloadBench = true;
+		} else if (arg == "--escape-bench") {
+			escapeBench = true;
+		} else if (arg == "--utf-bench") {
+			utfBench = true;
+		} else if (arg == "--index-bench" && hasValue) {
+			indexBench = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--sink-check" && hasValue) {
+			sinkCheck = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--alloc-check" && hasValue) {
+			allocCheck = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--flow-check" && hasValue) {
+			flowCheck = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--queue-check") {
+			queueCheck = true;
+		} else if (arg == "--matcher-check" && hasValue) {
+			matcherCheck = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--fields-fuzz" && hasValue) {
+			fieldsFuzz = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--escape-check" && hasValue) {
+			escapeCheck = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--wire-fixture" && hasValue) {
+			wireFixture = argv[++i];
+		} else if (arg.rfind("--", 0) == 0) {
+			return usage();
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+	if (indexBench) {
+		run_index_bench(indexBench, pipelineOptions.workers);
+		return 0;
+	}
+	if (sinkCheck) return run_sink_check(sinkCheck);
+	if (allocCheck) return run_alloc_check(allocCheck);
+	if (flowCheck) return run_flow_check(flowCheck);
+	if (queueCheck) return run_queue_check();
+	if (matcherCheck) return run_matcher_check(matcherCheck);
+	if (fieldsFuzz) return run_fields_fuzz(fieldsFuzz);
+	if (escapeCheck) return run_escape_check(escapeCheck);
+	if (!wireFixture.empty()) return run_wire_fixture(wireFixture);
+	if (inputs.empty()) return usage();
+
+	fim::ApiUploader uploader(make_api_transport);
+	uploader.refresh_from_env();
+	fim::AlertFanout sinks;
+	if (uploader.configured()) sinks.add_api(uploader);
+
+	std::unique_ptr<fim::EventPipeline> pipeline;
+	try {
+		const fim::FimConfig config = fim::load_fim_config(configPath);
+		sinks.add_configured(config.alerts);
+		pipeline = std::make_unique<fim::EventPipeline>(fim::PathMatcher(config), sinks, fim::portable_file_hasher);
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+	replay.keepXml = !sinks.empty() || payloadBench || escapeBench || utfBench;
+
+	if (utfBench) {
+		fim::ReplayEventSource source(inputs, replay);
+		if (!source.load()) return 1;
+		run_utf_bench(source.events(), replay.loops);
+		return 0;
+	}
+	if (escapeBench) {
+		fim::ReplayEventSource source(inputs, replay);
+		if (!source.load()) return 1;
+		run_escape_bench(source.events(), replay.loops);
+		return 0;
+	}
+	if (payloadBench) {
+		fim::ReplayEventSource source(inputs, replay);
+		if (!source.load()) return 1;
+		run_payload_bench(source.events(), replay.loops, fim::getenv_size("FIM_BATCH_MAX_EVENTS", fim::BatchLimits().maxEvents));
+		return 0;
+	}
+
+	fim::ReplayEventSource source(inputs, replay);
+	if (!source.load()) {
+		std::cerr << "[FIM] Replay: no events with a target path found in the inputs." << std::endl;
+		return 1;
+	}
+	// Same start-up order as the sender: events flow while the baseline indexes in the background.
+	pipeline->start(pipelineOptions);
+	pipeline->start_baseline();
+
+	fim::EventPipeline* sink = pipeline.get();
+	const auto begin = std::chrono::steady_clock::now();
+	if (!source.start([sink](fim::FimEvent&& ev) { sink->deliver(std::move(ev)); })) return 1;
+	source.wait();
+	pipeline->wait_baseline();
+	if (!reloadPath.empty()) {
+		const size_t before = pipeline->index().size();
+		try {
+			pipeline->reload(fim::PathMatcher(fim::load_fim_config(reloadPath)));
+		} catch (const std::exception& ex) {
+			std::cerr << ex.what() << std::endl;
+			return 1;
+		}
+		pipeline->wait_baseline();
+		std::cout << "[FIM] Reload: index " << before << " -> " << pipeline->index().size() << " files" << std::endl;
+	}
+	pipeline->stop();
+	if (!rescan) sinks.stop(); // drains the sink queues; a rescan below still reports through them
+	uploader.flush();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	const fim::LatencyHistogram& latency = pipeline->latency();
+	std::cout << std::fixed << std::setprecision(1)
+	          << "[FIM] Replayed " << source.emitted() << " events (" << source.loaded() << " recorded x "
+	          << replay.loops << ") in " << seconds << " s = "
+	          << (seconds > 0 ? static_cast<double>(source.emitted()) / seconds : 0.0) << " events/s" << std::endl;
+	std::cout << "[FIM] Latency us mean=" << latency.mean_us()
+	          << " p50=" << latency.percentile_us(0.50)
+	          << " p90=" << latency.percentile_us(0.90)
+	          << " p99=" << latency.percentile_us(0.99)
+	          << " max=" << latency.max_us() << std::endl;
+	pipeline->log_stats(std::cout);
+
+	if (rescan) {
+		fim::RescanScheduler scheduler(*pipeline, fim::RescanOptions::from_env(0));
+		scheduler.run_pass();
+		sinks.stop();
+		uploader.flush();
+	}
+	return 0;
+}
@@ -0,0 +1,171 @@
+// Adaptive batch size and upload concurrency for ApiUploader (AIMD, as in TCP congestion control).
+// No fixed threshold suits every site: on a fast LAN small batches waste round trips, on a
+// high-RTT link large ones run into the timeout. The controller starts from the configured batch
+// limits and half the in-flight ceiling, and adjusts after every batch upload:
+//   - success within the latency target: the batch scale grows by kScaleStep, and the in-flight
+//     limit by one per window of successes (a window being the current limit);
+//   - success over the target: batch scale and in-flight limit shrink by a quarter (the link or
+//     the backend is saturated);
+//   - HTTP 413: the batch scale halves;
+//   - transport error or other 5xx: batch scale and in-flight limit halve;
+//   - HTTP 429/503: both halve, and no upload starts until the Retry-After delay has passed
+//     (kDefaultPause when the header is missing, capped at FlowOptions::maxPause).
+// Like TCP, one congestion event shrinks the limits once: requests already in flight when the
+// limits came down do not cut them again. The scale applies to maxEvents and maxBytes alike and
+// stays within [kMinScale, kMaxScale]; the in-flight limit stays within [1, maxInFlight].
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "event_batcher.h"
+#include "http_transport.h"
+
+namespace fim {
+
+struct FlowOptions {
+	size_t maxInFlight{4};                         // ceiling; normally the transport's pool size
+	std::chrono::milliseconds targetLatency{1000}; // per batch upload
+	std::chrono::milliseconds maxPause{30000};     // longest Retry-After honoured
+};
+
+struct FlowStats {
+	double scale{1.0};             // current batch size relative to the configured one
+	size_t inFlightLimit{0};
+	uint64_t batchIncreases{0};    // successes that grew the batch size
+	uint64_t inFlightIncreases{0}; // windows of successes that raised the in-flight limit
+	uint64_t decreases{0};         // congestion events that shrank the limits
+	uint64_t slow{0};              // uploads over the latency target
+	uint64_t errors{0};            // transport errors and 5xx other than 503
+	uint64_t backpressure{0};      // 429/503 answers
+};
+
+class FlowController {
+public:
+	using clock = std::chrono::steady_clock;
+
+	explicit FlowController(const FlowOptions& options)
+		: options_(options), inFlightLimit_(std::max<size_t>((options.maxInFlight + 1) / 2, 1)) {
+		if (options_.maxInFlight == 0) options_.maxInFlight = 1;
+		stats_.inFlightLimit = inFlightLimit_;
+	}
+
+	FlowController(const FlowController&) = delete;
+	FlowController& operator=(const FlowController&) = delete;
+
+	// True for answers meaning "try again later": the request was not processed.
+	static bool backpressure(const HttpResponse& resp) { return resp.status == 429 || resp.status == 503; }
+
+	// Waits until another upload may start (under the in-flight limit and past any pause). The
+	// returned ticket goes back to release() with the outcome.
+	uint64_t acquire() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;) {
+			if (clock::now() < pausedUntil_) {
+				cv_.wait_until(lock, pausedUntil_);
+			} else if (inFlight_ >= inFlightLimit_) {
+				cv_.wait(lock);
+			} else {
+				break;
+			}
+		}
+		++inFlight_;
+		return nextTicket_++;
+	}
+
+	// Ends an upload started with acquire(). Returns true when the batch scale changed, so the
+	// caller can hand the new limits to its batchers.
+	bool release(uint64_t ticket, const HttpResponse& resp, clock::duration latency) {
+		bool rescaled = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--inFlight_;
+			const double before = scale_;
+			if (!resp.error.empty() || resp.status == 0 || (resp.status >= 500 && resp.status != 503)) {
+				++stats_.errors;
+				decrease_locked(ticket, kBackoff, true);
+			} else if (backpressure(resp)) {
+				++stats_.backpressure;
+				const auto pause = resp.retryAfterSec
+					? std::chrono::duration_cast<clock::duration>(std::chrono::seconds(resp.retryAfterSec))
+					: std::chrono::duration_cast<clock::duration>(kDefaultPause);
+				pausedUntil_ = std::max(pausedUntil_, clock::now() + std::min<clock::duration>(pause, options_.maxPause));
+				decrease_locked(ticket, kBackoff, true);
+			} else if (resp.status == 413) {
+				decrease_locked(ticket, kBackoff, false);
+			} else if (resp.ok() && latency > options_.targetLatency) {
+				++stats_.slow;
+				decrease_locked(ticket, kSlowBackoff, true);
+			} else if (resp.ok()) {
+				increase_locked();
+			}
+			rescaled = scale_ != before;
+			stats_.scale = scale_;
+			stats_.inFlightLimit = inFlightLimit_;
+		}
+		cv_.notify_all();
+		return rescaled;
+	}
+
+	// base with maxEvents and maxBytes multiplied by the current scale.
+	BatchLimits scaled(const BatchLimits& base) const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		BatchLimits limits = base;
+		limits.maxEvents = std::max<size_t>(static_cast<size_t>(static_cast<double>(base.maxEvents) * scale_), 1);
+		limits.maxBytes = std::max<size_t>(static_cast<size_t>(static_cast<double>(base.maxBytes) * scale_), 1);
+		return limits;
+	}
+
+	FlowStats stats() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return stats_;
+	}
+
+private:
+	static constexpr double kMinScale = 1.0 / 8;
+	static constexpr double kMaxScale = 8.0;
+	static constexpr double kScaleStep = 1.0 / 8;
+	static constexpr double kBackoff = 0.5;
+	static constexpr double kSlowBackoff = 0.75;
+	static constexpr std::chrono::seconds kDefaultPause{1};
+
+	void increase_locked() {
+		if (scale_ < kMaxScale) {
+			scale_ = std::min(scale_ + kScaleStep, kMaxScale);
+			++stats_.batchIncreases;
+		}
+		if (++windowSuccesses_ >= inFlightLimit_ && inFlightLimit_ < options_.maxInFlight) {
+			++inFlightLimit_;
+			windowSuccesses_ = 0;
+			++stats_.inFlightIncreases;
+		}
+	}
+
+	void decrease_locked(uint64_t ticket, double factor, bool concurrency) {
+		windowSuccesses_ = 0;
+		if (ticket < recoveryTicket_) return; // started before the last cut; already accounted for
+		recoveryTicket_ = nextTicket_;
+		scale_ = std::max(scale_ * factor, kMinScale);
+		if (concurrency) inFlightLimit_ = std::max<size_t>(static_cast<size_t>(static_cast<double>(inFlightLimit_) * factor), 1);
+		++stats_.decreases;
+	}
+
+	FlowOptions options_;
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	double scale_{1.0};
+	size_t inFlightLimit_;
+	size_t inFlight_{0};
+	size_t windowSuccesses_{0};
+	uint64_t nextTicket_{0};
+	uint64_t recoveryTicket_{0};
+	clock::time_point pausedUntil_{};
+	FlowStats stats_;
+};
+
+} // namespace fim
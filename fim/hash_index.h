@@ -0,0 +1,318 @@
+// In-memory index of the last known SHA-256 per monitored file.
+// Keys are normalized (lowercase, backslash separators) so differently spelled paths collapse.
+//
+// Sized for shares with millions of files: each shard is an open-addressing table of fixed 48-byte
+// slots (64-bit key hash, arena offset/length, raw 32-byte digest) plus one arena holding the
+// original paths as UTF-8. Nothing is allocated per entry; the filename is derived from the path
+// when needed. Shards are picked by the top bits of the key hash and each has its own lock, so
+// workers hashing different files rarely contend.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cwctype>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sha256.h"
+#include "utf_convert.h"
+
+namespace fim {
+
+enum class HashChange {
+	Unchanged,
+	Added,
+	Changed,
+};
+
+using FileDigest = std::array<uint8_t, 32>;
+
+// 64 hex characters (either case) -> raw digest; false when the text is not a SHA-256 hex digest.
+inline bool digest_from_hex(std::string_view hex, FileDigest& digest) {
+	if (hex.size() != digest.size() * 2) return false;
+	auto nibble = [](char c) -> int {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	};
+	for (size_t i = 0; i < digest.size(); ++i) {
+		const int hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+		if (hi < 0 || lo < 0) return false;
+		digest[i] = static_cast<uint8_t>((hi << 4) | lo);
+	}
+	return true;
+}
+
+inline std::string digest_to_hex(const FileDigest& digest) {
+	return digest_to_hex(digest.data(), digest.size());
+}
+
+class FileHashIndex {
+public:
+	static constexpr size_t kShardCount = 16;
+
+	static std::wstring normalize_path_key(const std::wstring& path) {
+		std::wstring normalized = path;
+		for (auto& ch : normalized) ch = normalize_char(ch);
+		return normalized;
+	}
+
+	static std::wstring extract_filename(const std::wstring& fullPath) {
+		const size_t sep = fullPath.find_last_of(L"\\/");
+		if (sep == std::wstring::npos) return fullPath;
+		std::wstring filename = fullPath.substr(sep + 1);
+		return filename.empty() ? fullPath : filename;
+	}
+
+	// Records newHash (hex) for fullPath; previousHash receives the old digest when it changed.
+	// A newHash that is not a SHA-256 hex digest is ignored and reported as Unchanged.
+	HashChange upsert(const std::wstring& fullPath, const std::string& newHash, std::string* previousHash = nullptr) {
+		FileDigest digest;
+		if (!digest_from_hex(newHash, digest)) return HashChange::Unchanged;
+		const std::wstring key = make_key(fullPath);
+		const uint64_t hash = hash_key(key);
+		Shard& shard = shard_for(hash);
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		Slot* slot = shard.find(hash, key);
+		if (!slot) {
+			shard.insert(hash, fullPath, digest);
+			size_.fetch_add(1, std::memory_order_relaxed);
+			return HashChange::Added;
+		}
+		if (slot->digest == digest) return HashChange::Unchanged;
+		if (previousHash) *previousHash = digest_to_hex(slot->digest);
+		slot->digest = digest;
+		return HashChange::Changed;
+	}
+
+	// Drops fullPath; returns false when it was not indexed.
+	bool remove(const std::wstring& fullPath, std::string* previousHash = nullptr) {
+		const std::wstring key = make_key(fullPath);
+		const uint64_t hash = hash_key(key);
+		Shard& shard = shard_for(hash);
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		Slot* slot = shard.find(hash, key);
+		if (!slot) return false;
+		if (previousHash) *previousHash = digest_to_hex(slot->digest);
+		shard.erase(*slot);
+		size_.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Hex digest currently recorded for fullPath, if any.
+	bool lookup(const std::wstring& fullPath, std::string* hashHex = nullptr) const {
+		const std::wstring key = make_key(fullPath);
+		const uint64_t hash = hash_key(key);
+		const Shard& shard = shards_[shard_index(hash)];
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		const Slot* slot = shard.find(hash, key);
+		if (!slot) return false;
+		if (hashHex) *hashHex = digest_to_hex(slot->digest);
+		return true;
+	}
+
+	// Calls fn(originalPath, hexDigest) for every entry of one shard (0..kShardCount-1). fn runs
+	// under the shard lock and must not call back into the index.
+	template <typename Fn>
+	void for_each_in_shard(size_t shardIndex, Fn&& fn) const {
+		const Shard& shard = shards_[shardIndex % kShardCount];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		for (const Slot& slot : shard.slots) {
+			if (slot.hash < kFirstHash) continue;
+			fn(utf8_to_wide(shard.path_of(slot)), digest_to_hex(slot.digest));
+		}
+	}
+
+	template <typename Fn>
+	void for_each(Fn&& fn) const {
+		for (size_t i = 0; i < kShardCount; ++i) for_each_in_shard(i, fn);
+	}
+
+	size_t size() const {
+		return size_.load(std::memory_order_relaxed);
+	}
+
+	// Heap bytes held by the tables and path arenas (for the bytes/entry figure in --index-bench).
+	size_t memory_bytes() const {
+		size_t total = sizeof(*this);
+		for (const Shard& shard : shards_) {
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			total += shard.slots.capacity() * sizeof(Slot) + shard.arena.capacity();
+		}
+		return total;
+	}
+
+private:
+	// Slot.hash: 0 = never used, 1 = erased (probing continues past it), otherwise the key hash.
+	static constexpr uint64_t kEmpty = 0;
+	static constexpr uint64_t kErased = 1;
+	static constexpr uint64_t kFirstHash = 2;
+
+	struct Slot {
+		uint64_t hash{kEmpty};
+		uint32_t offset{0};
+		uint32_t length{0};
+		FileDigest digest{};
+	};
+
+	struct Shard {
+		std::vector<Slot> slots;
+		std::string arena;   // original paths, UTF-8, back to back
+		size_t live{0};
+		size_t erased{0};
+		size_t deadBytes{0}; // arena bytes of erased entries, reclaimed by rebuild()
+		mutable std::mutex mutex;
+
+		std::string_view path_of(const Slot& slot) const {
+			return std::string_view(arena.data() + slot.offset, slot.length);
+		}
+
+		const Slot* find(uint64_t hash, const std::wstring& key) const {
+			if (slots.empty()) return nullptr;
+			const size_t mask = slots.size() - 1;
+			for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+				const Slot& slot = slots[i];
+				if (slot.hash == kEmpty) return nullptr;
+				if (slot.hash == hash && same_key(path_of(slot), key)) return &slot;
+			}
+		}
+
+		Slot* find(uint64_t hash, const std::wstring& key) {
+			return const_cast<Slot*>(static_cast<const Shard&>(*this).find(hash, key));
+		}
+
+		void insert(uint64_t hash, const std::wstring& fullPath, const FileDigest& digest) {
+			if ((live + erased + 1) * 10 > slots.size() * 7) {
+				size_t capacity = slots.empty() ? 64 : slots.size();
+				while ((live + 1) * 10 > capacity * 5) capacity *= 2; // leave room to grow after a rebuild
+				rebuild(capacity);
+			}
+			const size_t offset = arena.size();
+			wide_to_utf8(fullPath, arena);
+			if (arena.size() > UINT32_MAX) {
+				arena.resize(offset);
+				throw std::length_error("FileHashIndex: path arena exceeds 4 GiB in one shard");
+			}
+			Slot entry;
+			entry.hash = hash;
+			entry.offset = static_cast<uint32_t>(offset);
+			entry.length = static_cast<uint32_t>(arena.size() - offset);
+			entry.digest = digest;
+			place(entry);
+			++live;
+		}
+
+		void erase(Slot& slot) {
+			deadBytes += slot.length;
+			slot.hash = kErased;
+			--live;
+			++erased;
+			if (arena.size() > 65536 && deadBytes * 2 > arena.size()) rebuild(slots.size());
+		}
+
+		// Re-places every live entry into a fresh table of `capacity` slots and repacks the arena,
+		// dropping erased slots and the path bytes they held.
+		void rebuild(size_t capacity) {
+			const std::vector<Slot> old = std::move(slots);
+			slots.assign(capacity, Slot{});
+			const std::string oldArena = std::move(arena);
+			arena.clear();
+			arena.reserve(oldArena.size() - deadBytes);
+			for (Slot entry : old) {
+				if (entry.hash < kFirstHash) continue;
+				const size_t offset = arena.size();
+				arena.append(oldArena, entry.offset, entry.length);
+				entry.offset = static_cast<uint32_t>(offset);
+				place(entry);
+			}
+			erased = 0;
+			deadBytes = 0;
+		}
+
+		void place(const Slot& entry) {
+			const size_t mask = slots.size() - 1;
+			size_t i = static_cast<size_t>(entry.hash) & mask;
+			while (slots[i].hash >= kFirstHash) i = (i + 1) & mask;
+			slots[i] = entry;
+		}
+	};
+
+	// ASCII is folded inline; towlower() is a locale call per character and dominated lookups.
+	static wchar_t normalize_char(wchar_t ch) {
+		if (ch < 0x80) {
+			if (ch == L'/') return L'\\';
+			return (ch >= L'A' && ch <= L'Z') ? static_cast<wchar_t>(ch + (L'a' - L'A')) : ch;
+		}
+		return static_cast<wchar_t>(std::towlower(ch));
+	}
+
+	// FNV-1a over the normalized key, finished with a 64-bit mix so both the shard bits (top) and
+	// the slot bits (bottom) are well spread.
+	static uint64_t hash_key(const std::wstring& key) {
+		uint64_t h = 1469598103934665603ull;
+		for (wchar_t ch : key) {
+			h ^= static_cast<uint64_t>(static_cast<uint32_t>(ch));
+			h *= 1099511628211ull;
+		}
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return h < kFirstHash ? h + kFirstHash : h;
+	}
+
+	// Lookup key for fullPath. Paths are stored as UTF-8, so a path holding unpaired surrogates is
+	// keyed by its round-tripped (U+FFFD) form to match what same_key() will see.
+	static std::wstring make_key(const std::wstring& fullPath) {
+		for (wchar_t ch : fullPath) {
+			const uint32_t cp = static_cast<uint32_t>(ch);
+			if (cp >= 0xD800 && (cp <= 0xDFFF || cp > 0x10FFFF)) {
+				return normalize_path_key(utf8_to_wide(wide_to_utf8(fullPath)));
+			}
+		}
+		return normalize_path_key(fullPath);
+	}
+
+	// Compares a stored original path with an already-normalized key. All-ASCII paths (the common
+	// case) are compared byte by byte; anything else is widened first.
+	static bool same_key(std::string_view storedUtf8, const std::wstring& key) {
+		if (storedUtf8.size() == key.size()) {
+			size_t i = 0;
+			for (; i < key.size(); ++i) {
+				const unsigned char c = static_cast<unsigned char>(storedUtf8[i]);
+				if (c >= 0x80) break;
+				if (normalize_char(static_cast<wchar_t>(c)) != key[i]) return false;
+			}
+			if (i == key.size()) return true;
+		}
+		thread_local std::wstring stored;
+		stored.clear();
+		utf8_to_wide(storedUtf8, stored);
+		if (stored.size() != key.size()) return false;
+		for (size_t i = 0; i < key.size(); ++i) {
+			if (normalize_char(stored[i]) != key[i]) return false;
+		}
+		return true;
+	}
+
+	static size_t shard_index(uint64_t hash) {
+		return static_cast<size_t>(hash >> 60) % kShardCount;
+	}
+
+	Shard& shard_for(uint64_t hash) {
+		return shards_[shard_index(hash)];
+	}
+
+	std::array<Shard, kShardCount> shards_;
+	std::atomic<size_t> size_{0};
+};
+
+} // namespace fim
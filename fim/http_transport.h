@@ -0,0 +1,146 @@
+// HTTP transport abstraction for the FIM uploader.
+// Backends keep connections open between requests (keep-alive) and allow several requests
+// in flight at once; see winhttp_transport.h and curl_transport.h.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fim {
+
+// Parsed form of an http(s) URL such as FIM_API_URL.
+struct HttpEndpoint {
+	std::string url;      // original text
+	std::string host;
+	std::string resource; // path plus query, always starts with '/'
+	uint16_t port{0};
+	bool secure{false};
+};
+
+// Accepts "http://host[:port][/path][?query]" and the https equivalent.
+// Returns false for anything else (no scheme, empty host, bad port).
+inline bool parse_http_url(const std::string& url, HttpEndpoint& out) {
+	std::string rest;
+	bool secure = false;
+	if (url.compare(0, 7, "http://") == 0) {
+		rest = url.substr(7);
+	} else if (url.compare(0, 8, "https://") == 0) {
+		rest = url.substr(8);
+		secure = true;
+	} else {
+		return false;
+	}
+
+	const size_t slash = rest.find_first_of("/?");
+	std::string authority = rest.substr(0, slash);
+	std::string resource = slash == std::string::npos ? std::string("/") : rest.substr(slash);
+	if (resource[0] == '?') resource.insert(resource.begin(), '/');
+
+	// Drop any userinfo; credentials belong in FIM_API_TOKEN.
+	const size_t at = authority.rfind('@');
+	if (at != std::string::npos) authority.erase(0, at + 1);
+
+	uint16_t port = secure ? 443 : 80;
+	std::string host = authority;
+	const size_t bracket = authority.rfind(']');
+	const size_t colon = authority.rfind(':');
+	if (colon != std::string::npos && (bracket == std::string::npos || colon > bracket)) {
+		host = authority.substr(0, colon);
+		const std::string portText = authority.substr(colon + 1);
+		if (portText.empty()) return false;
+		char* end = nullptr;
+		const unsigned long parsed = std::strtoul(portText.c_str(), &end, 10);
+		if (*end != '\0' || parsed == 0 || parsed > 65535) return false;
+		port = static_cast<uint16_t>(parsed);
+	}
+	if (host.empty()) return false;
+
+	out.url = url;
+	out.host = std::move(host);
+	out.resource = std::move(resource);
+	out.port = port;
+	out.secure = secure;
+	return true;
+}
+
+// Borrows everything it points at: the caller keeps the strings alive until post() returns, so
+// building a request never copies (or allocates).
+struct HttpRequest {
+	std::string_view resource;    // overrides the endpoint resource when non-empty
+	std::string_view contentType{"application/json; charset=utf-8"};
+	std::string_view bearerToken; // sent as "Authorization: Bearer ..." when non-empty
+	std::vector<std::pair<std::string, std::string>> headers; // extra headers
+	const char* body{nullptr};
+	size_t bodySize{0};
+};
+
+struct HttpResponse {
+	int status{0};              // 0 when the request never got a response
+	unsigned retryAfterSec{0};  // parsed Retry-After header (seconds form only)
+	std::string error;          // transport-level failure description
+
+	bool ok() const { return status >= 200 && status < 300; }
+};
+
+struct TransportOptions {
+	size_t maxInFlight{4};      // concurrent requests (and pooled connections)
+	unsigned timeoutMs{5000};
+	std::string userAgent{"FIM/1.0"};
+};
+
+// A transport is bound to a single endpoint (scheme/host/port) and is safe to call from many threads.
+class HttpTransport {
+public:
+	virtual ~HttpTransport() = default;
+	virtual HttpResponse post(const HttpRequest& request) = 0;
+	virtual const char* name() const = 0;
+};
+
+using TransportFactory = std::unique_ptr<HttpTransport> (*)(const HttpEndpoint&, const TransportOptions&);
+
+// Counting semaphore used by backends to cap requests in flight.
+class InFlightLimiter {
+public:
+	explicit InFlightLimiter(size_t limit) : available_(limit == 0 ? 1 : limit) {}
+
+	void acquire() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [this]() { return available_ > 0; });
+		--available_;
+	}
+
+	void release() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			++available_;
+		}
+		cv_.notify_one();
+	}
+
+private:
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	size_t available_;
+};
+
+class InFlightSlot {
+public:
+	explicit InFlightSlot(InFlightLimiter& limiter) : limiter_(limiter) { limiter_.acquire(); }
+	~InFlightSlot() { limiter_.release(); }
+	InFlightSlot(const InFlightSlot&) = delete;
+	InFlightSlot& operator=(const InFlightSlot&) = delete;
+
+private:
+	InFlightLimiter& limiter_;
+};
+
+} // namespace fim
@@ -0,0 +1,169 @@
+// JSON string escaping for upload bodies.
+// The vector path checks 16 bytes (32 with AVX2) at a time for '"', '\\' and control characters
+// and copies clean runs in bulk; only the bytes that need escaping go through the scalar switch.
+// SSE2 is part of every x64 target and NEON of every AArch64 target; anything else uses the
+// scalar loop. Output is byte-identical to json_escape_scalar().
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FIM_JSON_ESCAPE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FIM_JSON_ESCAPE_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define FIM_JSON_ESCAPE_NEON 1
+#endif
+
+namespace fim {
+
+namespace detail {
+
+inline void append_escaped_char(std::string& out, unsigned char c) {
+	switch (c) {
+	case '\\': out += "\\\\"; break;
+	case '\"': out += "\\\""; break;
+	case '\b': out += "\\b"; break;
+	case '\f': out += "\\f"; break;
+	case '\n': out += "\\n"; break;
+	case '\r': out += "\\r"; break;
+	case '\t': out += "\\t"; break;
+	default:
+		if (c < 0x20) {
+			char buf[7];
+			std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out.append(buf, 6);
+		} else {
+			out.push_back(static_cast<char>(c));
+		}
+	}
+}
+
+inline bool needs_json_escape(unsigned char c) {
+	return c < 0x20 || c == '"' || c == '\\';
+}
+
+inline unsigned count_trailing_zeros(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned>(index);
+#else
+	return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+} // namespace detail
+
+// Reference implementation: one byte at a time.
+inline void json_escape_append_scalar(std::string& out, std::string_view input) {
+	for (unsigned char c : input) detail::append_escaped_char(out, c);
+}
+
+inline std::string json_escape_scalar(std::string_view input) {
+	std::string out;
+	out.reserve(input.size() + 16);
+	json_escape_append_scalar(out, input);
+	return out;
+}
+
+// Appends the escaped form of input to out (no surrounding quotes).
+inline void json_escape_append(std::string& out, std::string_view input) {
+	out.reserve(out.size() + input.size() + input.size() / 8 + 16);
+	const char* p = input.data();
+	const char* const end = p + input.size();
+	const char* run = p; // start of the pending clean run
+
+	// Each block step finds the first byte needing escape in the next chunk (mask bit set), or
+	// moves on by a whole chunk when there is none.
+#if defined(FIM_JSON_ESCAPE_AVX2)
+	{
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i backslash = _mm256_set1_epi8('\\');
+		const __m256i control = _mm256_set1_epi8(0x1F);
+		while (end - p >= 32) {
+			const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			const __m256i hits = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control), chunk)); // chunk <= 0x1F (unsigned)
+			const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+			if (mask == 0) {
+				p += 32;
+				continue;
+			}
+			p += detail::count_trailing_zeros(mask);
+			out.append(run, static_cast<size_t>(p - run));
+			detail::append_escaped_char(out, static_cast<unsigned char>(*p));
+			run = ++p;
+		}
+	}
+#endif
+#if defined(FIM_JSON_ESCAPE_SSE2)
+	{
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i control = _mm_set1_epi8(0x1F);
+		while (end - p >= 16) {
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			const __m128i hits = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+				_mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk)); // chunk <= 0x1F (unsigned)
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+			if (mask == 0) {
+				p += 16;
+				continue;
+			}
+			p += detail::count_trailing_zeros(mask);
+			out.append(run, static_cast<size_t>(p - run));
+			detail::append_escaped_char(out, static_cast<unsigned char>(*p));
+			run = ++p;
+		}
+	}
+#elif defined(FIM_JSON_ESCAPE_NEON)
+	{
+		const uint8x16_t quote = vdupq_n_u8('"');
+		const uint8x16_t backslash = vdupq_n_u8('\\');
+		const uint8x16_t control = vdupq_n_u8(0x20);
+		while (end - p >= 16) {
+			const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+			const uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+				vcltq_u8(chunk, control));
+			if (vmaxvq_u8(hits) == 0) {
+				p += 16;
+				continue;
+			}
+			while (!detail::needs_json_escape(static_cast<unsigned char>(*p))) ++p;
+			out.append(run, static_cast<size_t>(p - run));
+			detail::append_escaped_char(out, static_cast<unsigned char>(*p));
+			run = ++p;
+		}
+	}
+#endif
+
+	for (; p < end; ++p) {
+		if (!detail::needs_json_escape(static_cast<unsigned char>(*p))) continue;
+		out.append(run, static_cast<size_t>(p - run));
+		detail::append_escaped_char(out, static_cast<unsigned char>(*p));
+		run = p + 1;
+	}
+	out.append(run, static_cast<size_t>(end - run));
+}
+
+inline std::string json_escape(std::string_view input) {
+	std::string out;
+	json_escape_append(out, input);
+	return out;
+}
+
+} // namespace fim
@@ -0,0 +1,62 @@
+// Lock-free latency histogram with power-of-two microsecond buckets.
+// Percentiles are reported as the upper bound of the bucket they fall in (within 2x), capped at
+// the largest latency recorded.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace fim {
+
+class LatencyHistogram {
+public:
+	static constexpr size_t kBuckets = 40; // bucket i holds [2^(i-1), 2^i) us; last one is open-ended
+
+	void record(std::chrono::steady_clock::duration elapsed) {
+		const auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+		record_us(us < 0 ? 0 : static_cast<uint64_t>(us));
+	}
+
+	void record_us(uint64_t us) {
+		size_t bucket = 0;
+		while (bucket + 1 < kBuckets && (uint64_t(1) << bucket) <= us) ++bucket;
+		buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+		count_.fetch_add(1, std::memory_order_relaxed);
+		sumUs_.fetch_add(us, std::memory_order_relaxed);
+		uint64_t prev = maxUs_.load(std::memory_order_relaxed);
+		while (us > prev && !maxUs_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+	}
+
+	uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+	uint64_t max_us() const { return maxUs_.load(std::memory_order_relaxed); }
+
+	uint64_t mean_us() const {
+		const uint64_t n = count();
+		return n ? sumUs_.load(std::memory_order_relaxed) / n : 0;
+	}
+
+	// q in [0, 1], e.g. 0.99 for p99.
+	uint64_t percentile_us(double q) const {
+		const uint64_t n = count();
+		if (n == 0) return 0;
+		const uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n - 1)) + 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < kBuckets; ++i) {
+			seen += buckets_[i].load(std::memory_order_relaxed);
+			if (seen >= rank) return i + 1 < kBuckets ? std::min<uint64_t>(uint64_t(1) << i, max_us()) : max_us();
+		}
+		return max_us();
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+	std::atomic<uint64_t> count_{0};
+	std::atomic<uint64_t> sumUs_{0};
+	std::atomic<uint64_t> maxUs_{0};
+};
+
+} // namespace fim
@@ -0,0 +1,333 @@
+// Compiled path classifier for fim_config.yml rules.
+// Monitored roots go into a case-folded prefix trie, so finding the (deepest) root that covers a
+// path is a single walk over the path. Filename globs (file_types, exclude_patterns and
+// exclusions.global_patterns) are split by shape: exact names go into a hash set, "prefix*" and
+// "*suffix" into forward/reverse tries, and only irregular patterns fall back to a glob matcher.
+// Matching is case-insensitive and treats '/' and '\' alike, as Windows does. Portable C++17.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "fim_config.h"
+#include "utf_convert.h"
+
+namespace fim {
+
+inline wchar_t fold_path_char(wchar_t c) {
+	if (c == L'/') return L'\\';
+	return static_cast<wchar_t>(std::towlower(static_cast<wint_t>(c)));
+}
+
+inline std::wstring fold_path(std::wstring_view text) {
+	std::wstring out(text.size(), L'\0');
+	for (size_t i = 0; i < text.size(); ++i) out[i] = fold_path_char(text[i]);
+	return out;
+}
+
+namespace detail {
+
+// Character trie over folded wide strings. Nodes keep sorted child edges, which stays compact
+// for the sparse fan-out typical of paths and file extensions.
+class WideTrie {
+public:
+	static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+	WideTrie() : nodes_(1) {}
+
+	// Inserts key and tags its terminal node with value (later inserts of the same key win).
+	void insert(std::wstring_view key, uint32_t value) {
+		uint32_t node = 0;
+		for (wchar_t c : key) node = child_or_insert(node, c);
+		nodes_[node].value = value;
+	}
+
+	// Walks key from the front; calls visit(value, consumed) for every tagged node on the way.
+	// Stops early if visit returns false.
+	template <typename Visitor>
+	void walk(std::wstring_view key, Visitor&& visit) const {
+		uint32_t node = 0;
+		for (size_t i = 0; i < key.size(); ++i) {
+			node = child(node, key[i]);
+			if (node == kNone) return;
+			if (nodes_[node].value != kNone && !visit(nodes_[node].value, i + 1)) return;
+		}
+	}
+
+	// Same as walk() but consumes key from the back.
+	template <typename Visitor>
+	void walk_reverse(std::wstring_view key, Visitor&& visit) const {
+		uint32_t node = 0;
+		for (size_t i = key.size(); i > 0; --i) {
+			node = child(node, key[i - 1]);
+			if (node == kNone) return;
+			if (nodes_[node].value != kNone && !visit(nodes_[node].value, key.size() - i + 1)) return;
+		}
+	}
+
+	bool empty() const { return nodes_.size() == 1 && nodes_[0].value == kNone; }
+	size_t node_count() const { return nodes_.size(); }
+
+private:
+	struct Node {
+		std::vector<std::pair<wchar_t, uint32_t>> children; // sorted by character
+		uint32_t value{kNone};
+	};
+
+	uint32_t child(uint32_t node, wchar_t c) const {
+		const auto& kids = nodes_[node].children;
+		auto it = std::lower_bound(kids.begin(), kids.end(), c,
+			[](const std::pair<wchar_t, uint32_t>& edge, wchar_t ch) { return edge.first < ch; });
+		return (it != kids.end() && it->first == c) ? it->second : kNone;
+	}
+
+	uint32_t child_or_insert(uint32_t node, wchar_t c) {
+		auto& kids = nodes_[node].children;
+		auto it = std::lower_bound(kids.begin(), kids.end(), c,
+			[](const std::pair<wchar_t, uint32_t>& edge, wchar_t ch) { return edge.first < ch; });
+		if (it != kids.end() && it->first == c) return it->second;
+		const uint32_t created = static_cast<uint32_t>(nodes_.size());
+		kids.insert(it, { c, created });
+		nodes_.emplace_back(); // invalidates kids; not used afterwards
+		return created;
+	}
+
+	std::vector<Node> nodes_;
+};
+
+// Classic iterative '*'/'?' matcher with single-star backtracking; both inputs already folded.
+inline bool glob_match(std::wstring_view pattern, std::wstring_view text) {
+	size_t p = 0, t = 0, starP = std::wstring_view::npos, starT = 0;
+	while (t < text.size()) {
+		if (p < pattern.size() && (pattern[p] == L'?' || pattern[p] == text[t])) {
+			++p;
+			++t;
+		} else if (p < pattern.size() && pattern[p] == L'*') {
+			starP = p++;
+			starT = t;
+		} else if (starP != std::wstring_view::npos) {
+			p = starP + 1;
+			t = ++starT;
+		} else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == L'*') ++p;
+	return p == pattern.size();
+}
+
+} // namespace detail
+
+// Case-insensitive set of filename globs supporting '*' and '?'.
+class GlobSet {
+public:
+	void add(std::wstring_view rawPattern) {
+		const std::wstring pattern = fold_path(rawPattern);
+		if (pattern.empty()) return;
+		++size_;
+		const size_t firstWild = pattern.find_first_of(L"*?");
+		if (firstWild == std::wstring::npos) {
+			exact_.insert(pattern);
+			return;
+		}
+		if (pattern.find_first_not_of(L'*') == std::wstring::npos) {
+			matchAll_ = true;
+			return;
+		}
+		const size_t lastWild = pattern.find_last_of(L"*?");
+		if (firstWild == lastWild && pattern[firstWild] == L'*') {
+			if (firstWild == 0) {
+				suffixes_.insert(std::wstring(pattern.rbegin(), pattern.rend() - 1), 0);
+				return;
+			}
+			if (firstWild == pattern.size() - 1) {
+				prefixes_.insert(std::wstring_view(pattern).substr(0, firstWild), 0);
+				return;
+			}
+		}
+		general_.push_back(pattern);
+	}
+
+	void add_all(const std::vector<std::string>& utf8Patterns) {
+		for (const auto& p : utf8Patterns) add(utf8_to_wide(p));
+	}
+
+	// name must already be folded with fold_path().
+	bool matches_folded(std::wstring_view name) const {
+		if (matchAll_) return true;
+		if (!exact_.empty() && exact_.count(std::wstring(name))) return true;
+		bool hit = false;
+		if (!prefixes_.empty()) {
+			prefixes_.walk(name, [&hit](uint32_t, size_t) { hit = true; return false; });
+			if (hit) return true;
+		}
+		if (!suffixes_.empty()) {
+			suffixes_.walk_reverse(name, [&hit](uint32_t, size_t) { hit = true; return false; });
+			if (hit) return true;
+		}
+		for (const auto& pattern : general_) {
+			if (detail::glob_match(pattern, name)) return true;
+		}
+		return false;
+	}
+
+	bool matches(std::wstring_view name) const { return matches_folded(fold_path(name)); }
+
+	bool empty() const { return size_ == 0; }
+	bool matches_everything() const { return matchAll_; }
+	size_t size() const { return size_; }
+
+private:
+	std::unordered_set<std::wstring> exact_;
+	detail::WideTrie prefixes_;
+	detail::WideTrie suffixes_; // patterns stored reversed
+	std::vector<std::wstring> general_;
+	bool matchAll_{false};
+	size_t size_{0};
+};
+
+enum class PathVerdict {
+	Unmonitored, // outside every root (or below a non-recursive root)
+	Excluded,    // inside a root but filtered by file_types / exclude patterns
+	Monitored,
+};
+
+struct PathClassification {
+	PathVerdict verdict{PathVerdict::Unmonitored};
+	uint32_t root{detail::WideTrie::kNone}; // index into PathMatcher::roots()
+	Priority priority{Priority::Medium};
+
+	bool monitored() const { return verdict == PathVerdict::Monitored; }
+};
+
+class PathMatcher {
+public:
+	struct Root {
+		std::wstring path;   // as configured (trailing separators trimmed)
+		std::string name;
+		bool recursive{true};
+		Priority priority{Priority::Medium};
+		GlobSet include;     // empty = everything
+		GlobSet exclude;
+		std::string filters; // file_types and exclude_patterns as configured, for root_signature()
+	};
+
+	PathMatcher() = default;
+
+	explicit PathMatcher(const FimConfig& cfg) {
+		globalExclude_.add_all(cfg.globalExcludes);
+		for (const auto& pattern : cfg.globalExcludes) globalFilters_ += pattern + '\n';
+		for (const auto& dir : cfg.directories) {
+			Root root;
+			root.path = utf8_to_wide(dir.path);
+			root.name = dir.name;
+			root.recursive = dir.recursive;
+			root.priority = dir.priority;
+			root.include.add_all(dir.fileTypes);
+			root.exclude.add_all(dir.excludePatterns);
+			for (const auto& pattern : dir.fileTypes) root.filters += "+" + pattern + '\n';
+			for (const auto& pattern : dir.excludePatterns) root.filters += "-" + pattern + '\n';
+			add_root(std::move(root));
+		}
+	}
+
+	void add_root(Root root) {
+		while (root.path.size() > 1 && (root.path.back() == L'\\' || root.path.back() == L'/')) root.path.pop_back();
+		if (root.path.empty()) return;
+		const uint32_t index = static_cast<uint32_t>(roots_.size());
+		trie_.insert(fold_path(root.path), index);
+		roots_.push_back(std::move(root));
+	}
+
+	void add_global_exclude(std::wstring_view pattern) {
+		globalExclude_.add(pattern);
+		globalFilters_ += wide_to_utf8(pattern) + '\n';
+	}
+
+	// Everything that decides which files roots()[index] covers: its folded path, recursion, its
+	// own and the global filters, and the roots nested under it (whose files it does not own).
+	// Equal signatures across two matchers mean the root indexes the same files; priority and
+	// name are left out.
+	std::string root_signature(uint32_t index) const {
+		const Root& root = roots_[index];
+		const std::wstring folded = fold_path(root.path);
+		std::string sig = wide_to_utf8(folded);
+		sig += root.recursive ? "\nR\n" : "\nN\n";
+		sig += root.filters;
+		sig += "|\n";
+		sig += globalFilters_;
+		std::vector<std::string> nested;
+		for (const Root& other : roots_) {
+			const std::wstring otherFolded = fold_path(other.path);
+			if (otherFolded.size() > folded.size() && otherFolded.compare(0, folded.size(), folded) == 0 &&
+				(folded.back() == L'\\' || otherFolded[folded.size()] == L'\\')) {
+				nested.push_back(wide_to_utf8(otherFolded));
+			}
+		}
+		std::sort(nested.begin(), nested.end());
+		for (const auto& path : nested) sig += "|" + path;
+		return sig;
+	}
+
+	// One pass over the path to find the deepest covering root, then the filename filters.
+	PathClassification classify(std::wstring_view path) const {
+		PathClassification result;
+		const std::wstring folded = fold_path(path);
+
+		uint32_t best = detail::WideTrie::kNone;
+		size_t bestLen = 0;
+		trie_.walk(folded, [&](uint32_t index, size_t consumed) {
+			// Only accept roots ending on a component boundary ("C:\Data" must not cover "C:\Database").
+			if (consumed == folded.size() || folded[consumed] == L'\\' || folded[consumed - 1] == L'\\') {
+				best = index;
+				bestLen = consumed;
+			}
+			return true;
+		});
+		if (best == detail::WideTrie::kNone) return result;
+
+		const Root& root = roots_[best];
+		result.root = best;
+		result.priority = root.priority;
+
+		size_t restStart = bestLen;
+		while (restStart < folded.size() && folded[restStart] == L'\\') ++restStart;
+		const std::wstring_view rest = std::wstring_view(folded).substr(restStart);
+		if (rest.empty()) {
+			result.verdict = PathVerdict::Monitored; // the root itself
+			return result;
+		}
+		const size_t lastSep = rest.find_last_of(L'\\');
+		if (!root.recursive && lastSep != std::wstring_view::npos) {
+			return result; // deeper than a non-recursive root covers
+		}
+		const std::wstring_view name = lastSep == std::wstring_view::npos ? rest : rest.substr(lastSep + 1);
+
+		if (globalExclude_.matches_folded(name) || root.exclude.matches_folded(name) ||
+			(!root.include.empty() && !root.include.matches_folded(name))) {
+			result.verdict = PathVerdict::Excluded;
+			return result;
+		}
+		result.verdict = PathVerdict::Monitored;
+		return result;
+	}
+
+	const std::vector<Root>& roots() const { return roots_; }
+	size_t trie_nodes() const { return trie_.node_count(); }
+
+private:
+	detail::WideTrie trie_;
+	std::vector<Root> roots_;
+	GlobSet globalExclude_;
+	std::string globalFilters_;
+};
+
+} // namespace fim
@@ -0,0 +1,46 @@
+// Per-directory alert priority (monitored_directories[].priority in fim_config.yml).
+// Kept apart from fim_config.h so queues and event types can use it without yaml-cpp.
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <string>
+
+namespace fim {
+
+// Lower value = more urgent.
+enum class Priority {
+	Critical = 0,
+	High = 1,
+	Medium = 2,
+	Low = 3,
+};
+
+inline const char* priority_name(Priority p) {
+	switch (p) {
+	case Priority::Critical: return "CRITICAL";
+	case Priority::High: return "HIGH";
+	case Priority::Medium: return "MEDIUM";
+	case Priority::Low: return "LOW";
+	}
+	return "MEDIUM";
+}
+
+// Unknown or missing values map to Medium.
+inline Priority parse_priority(const std::string& text) {
+	std::string upper(text);
+	std::transform(upper.begin(), upper.end(), upper.begin(),
+		[](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+	if (upper == "CRITICAL") return Priority::Critical;
+	if (upper == "HIGH") return Priority::High;
+	if (upper == "LOW") return Priority::Low;
+	return Priority::Medium;
+}
+
+constexpr size_t kPriorityCount = 4;
+
+inline size_t priority_index(Priority p) { return static_cast<size_t>(p); }
+
+} // namespace fim
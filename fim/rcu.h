@@ -0,0 +1,92 @@
+// Read-mostly shared object with RCU-style replacement.
+// Readers take a ReadGuard: one atomic increment and a few atomic loads, never a lock or an
+// allocation, so the event hot path can consult the current configuration for free. A writer
+// publishes a new object, flips the reader epoch and waits for readers still registered in the
+// old epoch to leave (a grace period) before dropping its reference to the old object. Code that
+// needs the object for a long time (a baseline walk, a rescan pass) takes a shared_ptr snapshot
+// instead of holding a guard, so it never stretches a writer's grace period.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace fim {
+
+template <typename T>
+class RcuPointer {
+	struct alignas(64) ReaderCount {
+		std::atomic<uint64_t> value{0};
+	};
+
+public:
+	class ReadGuard {
+	public:
+		ReadGuard(ReadGuard&& other) noexcept : count_(other.count_), ptr_(other.ptr_) { other.count_ = nullptr; }
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+		ReadGuard& operator=(ReadGuard&&) = delete;
+		~ReadGuard() {
+			if (count_) count_->fetch_sub(1);
+		}
+
+		const T* operator->() const { return ptr_; }
+		const T& operator*() const { return *ptr_; }
+
+	private:
+		friend class RcuPointer;
+		ReadGuard(std::atomic<uint64_t>* count, const T* ptr) : count_(count), ptr_(ptr) {}
+
+		std::atomic<uint64_t>* count_;
+		const T* ptr_;
+	};
+
+	explicit RcuPointer(std::shared_ptr<const T> initial) : current_(initial.get()), owner_(std::move(initial)) {}
+
+	RcuPointer(const RcuPointer&) = delete;
+	RcuPointer& operator=(const RcuPointer&) = delete;
+
+	// Lock-free. The pointer stays valid until the guard is destroyed; keep guards short-lived.
+	// All operations are seq_cst: the reader's count increment must be ordered before its load of
+	// current_, and the writer's store of current_ before its epoch flip and count check.
+	// A reader that stalls between reading the epoch and registering could otherwise land in a
+	// counter whose grace period is already over; it re-checks the epoch once registered, and
+	// if a writer flipped it meanwhile, backs out and registers again in the new epoch.
+	ReadGuard read() const {
+		for (;;) {
+			const unsigned epoch = epoch_.load();
+			readers_[epoch].value.fetch_add(1);
+			if (epoch_.load() == epoch) return ReadGuard(&readers_[epoch].value, current_.load());
+			readers_[epoch].value.fetch_sub(1);
+		}
+	}
+
+	// Reference for long-lived use. Takes the writer lock, so not for the hot path.
+	std::shared_ptr<const T> snapshot() const {
+		std::lock_guard<std::mutex> lock(writeMutex_);
+		return owner_;
+	}
+
+	// Makes next current and returns once no reader can still see the previous object.
+	void publish(std::shared_ptr<const T> next) {
+		std::lock_guard<std::mutex> lock(writeMutex_);
+		current_.store(next.get());
+		const unsigned old = epoch_.load();
+		epoch_.store(old ^ 1u);
+		while (readers_[old].value.load() != 0) std::this_thread::yield();
+		owner_ = std::move(next); // previous object freed here unless a snapshot still holds it
+	}
+
+private:
+	mutable ReaderCount readers_[2];
+	std::atomic<unsigned> epoch_{0};
+	std::atomic<const T*> current_;
+	mutable std::mutex writeMutex_;
+	std::shared_ptr<const T> owner_;
+};
+
+} // namespace fim
@@ -0,0 +1,163 @@
+// Replay event source: feeds recorded Sysmon/Security event XML through the FIM pipeline.
+// Input files hold one or more <Event> elements (e.g. `wevtutil qe Microsoft-Windows-Sysmon/Operational`
+// or Get-WinEvent | ForEach-Object { $_.ToXml() } output, optionally wrapped in <Events>).
+// Events are loaded up front so disk reads do not distort timing, then emitted on a background
+// thread at a fixed rate or as fast as the sink accepts them. Portable C++17.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "event_source.h"
+#include "sysmon_fields.h"
+#include "utf_convert.h"
+
+namespace fim {
+
+struct ReplayOptions {
+	double eventsPerSec{0}; // 0 = as fast as possible
+	size_t loops{1};        // passes over the recorded events
+	bool keepXml{true};     // attach the raw XML to each event (needed for uploads)
+};
+
+// Splits a document into its <Event>...</Event> elements and extracts EventID and target path.
+// Events without a target path are skipped, as the live callback would.
+inline size_t parse_recorded_events(std::string_view doc, bool keepXml, std::vector<FimEvent>& out) {
+	size_t added = 0;
+	size_t pos = 0;
+	while ((pos = doc.find("<Event", pos)) != std::string_view::npos) {
+		const size_t nameEnd = pos + 6;
+		if (nameEnd >= doc.size() || (doc[nameEnd] != '>' && doc[nameEnd] != ' ')) {
+			pos = nameEnd; // <EventID>, <EventData>, <Events> ...
+			continue;
+		}
+		const size_t end = doc.find("</Event>", nameEnd);
+		if (end == std::string_view::npos) break;
+		const std::string_view xml = doc.substr(pos, end + 8 - pos);
+		pos = end + 8;
+
+		SysmonFields<char> fields;
+		if (!extract_sysmon_fields(xml, fields) || fields.targetFilename.empty()) continue;
+
+		FimEvent ev;
+		ev.eventId = fields.eventId;
+		ev.target = utf8_to_wide(xml_text(fields.targetFilename));
+		if (keepXml) ev.xml = utf8_to_wide(xml);
+		out.emplace_back(std::move(ev));
+		++added;
+	}
+	return added;
+}
+
+class ReplayEventSource : public EventSource {
+public:
+	ReplayEventSource(std::vector<std::string> inputs, const ReplayOptions& options)
+		: inputs_(std::move(inputs)), options_(options) {}
+
+	~ReplayEventSource() override { stop(); }
+
+	// Reads and parses every input; directories contribute their *.xml files in name order.
+	bool load() {
+		events_.clear();
+		for (const auto& input : inputs_) {
+			std::error_code ec;
+			if (std::filesystem::is_directory(input, ec)) {
+				std::vector<std::filesystem::path> files;
+				for (const auto& entry : std::filesystem::directory_iterator(input, ec)) {
+					if (entry.path().extension() == ".xml") files.push_back(entry.path());
+				}
+				std::sort(files.begin(), files.end());
+				for (const auto& file : files) load_file(file.string());
+			} else {
+				load_file(input);
+			}
+		}
+		return !events_.empty();
+	}
+
+	bool start(EventSink sink) override {
+		if (events_.empty() && !load()) {
+			std::cerr << "[FIM] Replay: no events with a target path found in the inputs." << std::endl;
+			return false;
+		}
+		stop();
+		stopRequested_ = false;
+		finished_ = false;
+		emitted_ = 0;
+		worker_ = std::thread([this, sink = std::move(sink)]() { run(sink); });
+		return true;
+	}
+
+	void stop() override {
+		stopRequested_ = true;
+		if (worker_.joinable()) worker_.join();
+	}
+
+	// Blocks until every loop has been emitted (or stop() was called).
+	void wait() {
+		if (worker_.joinable()) worker_.join();
+	}
+
+	const char* name() const override { return "replay"; }
+
+	bool finished() const { return finished_.load(); }
+	uint64_t emitted() const { return emitted_.load(); }
+	size_t loaded() const { return events_.size(); }
+	const std::vector<FimEvent>& events() const { return events_; }
+
+private:
+	void load_file(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			std::cerr << "[FIM] Replay: unable to open " << path << std::endl;
+			return;
+		}
+		const std::string doc((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		const size_t count = parse_recorded_events(doc, options_.keepXml, events_);
+		std::cout << "[FIM] Replay: loaded " << count << " events from " << path << std::endl;
+	}
+
+	void run(const EventSink& sink) {
+		using clock = std::chrono::steady_clock;
+		const auto begin = clock::now();
+		uint64_t sent = 0;
+		for (size_t loop = 0; loop < options_.loops && !stopRequested_; ++loop) {
+			for (const auto& recorded : events_) {
+				if (stopRequested_) break;
+				if (options_.eventsPerSec > 0) {
+					const auto due = begin + std::chrono::duration_cast<clock::duration>(
+						std::chrono::duration<double>(static_cast<double>(sent) / options_.eventsPerSec));
+					std::this_thread::sleep_until(due);
+				}
+				FimEvent ev = recorded;
+				ev.received = clock::now();
+				sink(std::move(ev));
+				++sent;
+				emitted_.store(sent, std::memory_order_relaxed);
+			}
+		}
+		finished_ = true;
+	}
+
+	std::vector<std::string> inputs_;
+	ReplayOptions options_;
+	std::vector<FimEvent> events_;
+	std::thread worker_;
+	std::atomic<bool> stopRequested_{false};
+	std::atomic<bool> finished_{false};
+	std::atomic<uint64_t> emitted_{0};
+};
+
+} // namespace fim
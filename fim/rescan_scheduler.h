@@ -0,0 +1,417 @@
+// Periodic, throttled rescans of the monitored trees (fim_settings.scan_interval).
+// Live events keep the hash index current only as long as Sysmon delivers them; a dropped event or
+// a dead subscription would otherwise leave the baseline wrong forever. Every interval a background
+// thread walks each root in sorted order, re-hashes every monitored file through the pipeline (so
+// differences are reported like live changes) and finally reports indexed files that have vanished.
+// The walk is paced by files/s and bytes/s budgets so it never hammers production disks, and its
+// position is saved to a small state file so a restart resumes the pass instead of starting over.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "env.h"
+#include "event_pipeline.h"
+#include "utf_convert.h"
+
+namespace fim {
+
+struct RescanOptions {
+	std::chrono::seconds interval{0}; // 0 = rescans disabled
+	double filesPerSec{200};           // files hashed (and directories listed / deletions checked)
+	double bytesPerSec{8.0 * 1024 * 1024};
+	std::string statePath{"fim_rescan.state"};
+
+	// scan_interval comes from fim_config.yml; FIM_RESCAN_INTERVAL (seconds) overrides it.
+	// Budgets from FIM_RESCAN_FILES_PER_SEC and FIM_RESCAN_BYTES_PER_SEC, the resume file from
+	// FIM_RESCAN_STATE. All optional.
+	static RescanOptions from_env(unsigned scanIntervalSec) {
+		RescanOptions options;
+		options.interval = std::chrono::seconds(getenv_size("FIM_RESCAN_INTERVAL", scanIntervalSec));
+		options.filesPerSec = static_cast<double>(getenv_size("FIM_RESCAN_FILES_PER_SEC", static_cast<size_t>(options.filesPerSec)));
+		options.bytesPerSec = static_cast<double>(getenv_size("FIM_RESCAN_BYTES_PER_SEC", static_cast<size_t>(options.bytesPerSec)));
+		const std::string state = getenv_string("FIM_RESCAN_STATE");
+		if (!state.empty()) options.statePath = state;
+		return options;
+	}
+};
+
+// Token bucket holding at most one second of budget. charge() may overdraw (a file larger than
+// the per-second byte budget still gets hashed) and returns how long to pause to pay it back.
+class RateBudget {
+public:
+	explicit RateBudget(double perSec = 0) : rate_(perSec), available_(perSec) {}
+
+	std::chrono::steady_clock::duration charge(double amount) {
+		if (rate_ <= 0) return {};
+		const auto now = std::chrono::steady_clock::now();
+		if (last_ != std::chrono::steady_clock::time_point{}) {
+			available_ = std::min(rate_, available_ + std::chrono::duration<double>(now - last_).count() * rate_);
+		}
+		last_ = now;
+		available_ -= amount;
+		if (available_ >= 0) return {};
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(-available_ / rate_));
+	}
+
+private:
+	double rate_;
+	double available_;
+	std::chrono::steady_clock::time_point last_{};
+};
+
+// Where a pass stands; persisted between runs. `position` is the last finished file relative to
+// `root`, components joined with '/', in the walk's sorted order.
+struct RescanCursor {
+	int64_t passStarted{0}; // unix seconds, 0 = no pass recorded
+	bool complete{true};
+	std::string root;       // UTF-8, as configured
+	std::string position;   // UTF-8
+
+	bool load(const std::string& path) {
+		std::ifstream in(path);
+		if (!in) return false;
+		std::string line;
+		if (!std::getline(in, line) || line != "fim-rescan 1") return false;
+		while (std::getline(in, line)) {
+			const size_t eq = line.find('=');
+			if (eq == std::string::npos) continue;
+			const std::string key = line.substr(0, eq);
+			const std::string value = line.substr(eq + 1);
+			if (key == "started") passStarted = std::strtoll(value.c_str(), nullptr, 10);
+			else if (key == "complete") complete = value == "1";
+			else if (key == "root") root = value;
+			else if (key == "position") position = value;
+		}
+		return passStarted != 0;
+	}
+
+	// Written to a temporary file and renamed over the old one so a crash never leaves it torn.
+	bool save(const std::string& path) const {
+		const std::string tmp = path + ".tmp";
+		{
+			std::ofstream out(tmp, std::ios::trunc);
+			if (!out) return false;
+			out << "fim-rescan 1\n"
+			    << "started=" << passStarted << "\n"
+			    << "complete=" << (complete ? 1 : 0) << "\n"
+			    << "root=" << root << "\n"
+			    << "position=" << position << "\n";
+			if (!out.flush()) return false;
+		}
+		std::error_code ec;
+		std::filesystem::rename(std::filesystem::u8path(tmp), std::filesystem::u8path(path), ec);
+		return !ec;
+	}
+};
+
+struct RescanStats {
+	uint64_t passes{0};
+	uint64_t files{0};
+	uint64_t bytes{0};
+	uint64_t added{0};
+	uint64_t changed{0};
+	uint64_t removed{0};
+};
+
+class RescanScheduler {
+public:
+	RescanScheduler(EventPipeline& pipeline, const RescanOptions& options)
+		: pipeline_(pipeline), options_(options), files_(options.filesPerSec), bytes_(options.bytesPerSec) {}
+
+	~RescanScheduler() { stop(); }
+
+	RescanScheduler(const RescanScheduler&) = delete;
+	RescanScheduler& operator=(const RescanScheduler&) = delete;
+
+	bool enabled() const { return options_.interval.count() > 0; }
+
+	// Starts the background thread. An interrupted pass resumes at once; otherwise the next pass
+	// is due one interval after the last one started (or after now, when no pass is on record,
+	// since the start-up baseline has just hashed everything).
+	void start() {
+		if (!enabled() || thread_.joinable()) return;
+		if (!cursor_.load(options_.statePath)) {
+			cursor_ = RescanCursor();
+			cursor_.passStarted = unix_now();
+			cursor_.save(options_.statePath);
+		}
+		std::cout << "[FIM] Rescan every " << options_.interval.count() << " s, budget "
+		          << static_cast<uint64_t>(options_.filesPerSec) << " files/s, "
+		          << static_cast<uint64_t>(options_.bytesPerSec) << " bytes/s"
+		          << (cursor_.complete ? "" : " (resuming interrupted pass)") << std::endl;
+		thread_ = std::thread([this]() { run(); });
+	}
+
+	// Stops after the current file and saves the position. Idempotent.
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		cv_.notify_all();
+		if (thread_.joinable()) thread_.join();
+	}
+
+	// Runs one whole pass on the calling thread (resuming a saved cursor if there is one);
+	// returns false if stop() interrupted it. Not for use while the background thread runs.
+	bool run_pass() {
+		if (cursor_.complete) {
+			cursor_ = RescanCursor();
+			cursor_.passStarted = unix_now();
+			cursor_.complete = false;
+		}
+		const auto begin = std::chrono::steady_clock::now();
+		const RescanStats before = stats();
+		bool finished = true;
+		matcher_ = pipeline_.matcher(); // rules stay fixed for this pass even if the config is reloaded
+		const auto& roots = matcher_->roots();
+		size_t first = 0;
+		if (!cursor_.root.empty()) {
+			const auto it = std::find_if(roots.begin(), roots.end(),
+				[this](const PathMatcher::Root& r) { return wide_to_utf8(r.path) == cursor_.root; });
+			if (it != roots.end()) first = static_cast<size_t>(it - roots.begin());
+			else cursor_.position.clear(); // root no longer configured: start over
+		}
+		for (size_t i = first; i < roots.size() && finished; ++i) {
+			if (wide_to_utf8(roots[i].path) != cursor_.root) {
+				cursor_.root = wide_to_utf8(roots[i].path);
+				cursor_.position.clear();
+			}
+			finished = scan_root(static_cast<uint32_t>(i));
+		}
+		if (finished) finished = sweep_missing();
+
+		cursor_.complete = finished;
+		if (finished) {
+			cursor_.root.clear();
+			cursor_.position.clear();
+		}
+		cursor_.save(options_.statePath);
+		if (finished) {
+			const RescanStats after = stats();
+			{
+				std::lock_guard<std::mutex> lock(statsMutex_);
+				++stats_.passes;
+			}
+			std::cout << "[FIM] Rescan pass complete in "
+			          << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - begin).count()
+			          << " s: files=" << after.files - before.files << " bytes=" << after.bytes - before.bytes
+			          << " added=" << after.added - before.added << " changed=" << after.changed - before.changed
+			          << " removed=" << after.removed - before.removed << std::endl;
+		}
+		return finished;
+	}
+
+	RescanStats stats() const {
+		std::lock_guard<std::mutex> lock(statsMutex_);
+		return stats_;
+	}
+
+private:
+	struct Entry {
+		std::wstring name;
+		bool directory{false};
+		uint64_t size{0};
+	};
+
+	static int64_t unix_now() {
+		return static_cast<int64_t>(std::time(nullptr));
+	}
+
+	void run() {
+		// Never overlap the start-up baseline; it is hashing the same files.
+		while (pipeline_.baseline_running()) {
+			if (!pause(std::chrono::seconds(1))) return;
+		}
+		for (;;) {
+			if (cursor_.complete) {
+				const auto due = std::chrono::system_clock::from_time_t(static_cast<std::time_t>(cursor_.passStarted)) + options_.interval;
+				const auto wait = due - std::chrono::system_clock::now();
+				if (wait > std::chrono::system_clock::duration::zero() &&
+					!pause(std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait))) {
+					return;
+				}
+			}
+			if (!run_pass()) return;
+		}
+	}
+
+	// Sleeps for d unless stop() is called first; false means stop.
+	bool pause(std::chrono::steady_clock::duration d) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (d > std::chrono::steady_clock::duration::zero()) {
+			cv_.wait_for(lock, d, [this]() { return stopping_; });
+		}
+		return !stopping_;
+	}
+
+	bool throttle(double files, double bytes) {
+		const auto waitFiles = files_.charge(files);
+		const auto waitBytes = bytes > 0 ? bytes_.charge(bytes) : std::chrono::steady_clock::duration::zero();
+		return pause(std::max(waitFiles, waitBytes));
+	}
+
+	// Component-wise comparison against the saved position (matches the sorted walk order).
+	static int compare_to_cursor(const std::vector<std::wstring>& rel, const std::vector<std::wstring>& cursor) {
+		const size_t n = std::min(rel.size(), cursor.size());
+		for (size_t i = 0; i < n; ++i) {
+			if (rel[i] < cursor[i]) return -1;
+			if (cursor[i] < rel[i]) return 1;
+		}
+		if (rel.size() == cursor.size()) return 0;
+		return rel.size() < cursor.size() ? -1 : 1; // a directory on the cursor's path sorts first
+	}
+
+	static std::vector<std::wstring> split_position(const std::string& position) {
+		std::vector<std::wstring> parts;
+		size_t start = 0;
+		while (start < position.size()) {
+			size_t slash = position.find('/', start);
+			if (slash == std::string::npos) slash = position.size();
+			if (slash > start) parts.push_back(utf8_to_wide(position.substr(start, slash - start)));
+			start = slash + 1;
+		}
+		return parts;
+	}
+
+	static std::string join_position(const std::vector<std::wstring>& rel) {
+		std::string out;
+		for (const auto& part : rel) {
+			if (!out.empty()) out.push_back('/');
+			wide_to_utf8(part, out);
+		}
+		return out;
+	}
+
+	bool scan_root(uint32_t rootIndex) {
+		const PathMatcher::Root& root = matcher_->roots()[rootIndex];
+		const std::filesystem::path fsPath(root.path);
+		std::error_code ec;
+		if (std::filesystem::is_regular_file(fsPath, ec)) {
+			if (!cursor_.position.empty()) return true; // single-file root already done
+			const uint64_t size = std::filesystem::file_size(fsPath, ec);
+			return scan_file(fsPath.wstring(), ec ? 0 : size, {});
+		}
+		if (!std::filesystem::is_directory(fsPath, ec)) return true;
+		resume_ = split_position(cursor_.position);
+		std::vector<std::wstring> rel;
+		return scan_directory(fsPath, rootIndex, root.recursive, rel);
+	}
+
+	bool scan_directory(const std::filesystem::path& dir, uint32_t rootIndex, bool recursive, std::vector<std::wstring>& rel) {
+		if (!throttle(1, 0)) return false;
+		std::vector<Entry> entries;
+		std::error_code ec;
+		for (std::filesystem::directory_iterator it(dir, std::filesystem::directory_options::skip_permission_denied, ec), end;
+			!ec && it != end; it.increment(ec)) {
+			std::error_code entryEc;
+			Entry entry;
+			entry.name = it->path().filename().wstring();
+			entry.directory = it->is_directory(entryEc);
+			if (entry.directory) {
+				if (it->is_symlink(entryEc)) continue; // like the baseline walk: do not follow directory links
+			} else {
+				if (!it->is_regular_file(entryEc)) continue;
+				entry.size = it->file_size(entryEc);
+				if (entryEc) entry.size = 0;
+			}
+			entries.push_back(std::move(entry));
+		}
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+		for (const Entry& entry : entries) {
+			rel.push_back(entry.name);
+			const int order = resume_.empty() ? 1 : compare_to_cursor(rel, resume_);
+			bool ok = true;
+			if (entry.directory) {
+				// Enter directories after the cursor, and the one that contains it.
+				if (recursive && (order > 0 || (order < 0 && rel.size() < resume_.size() &&
+					std::equal(rel.begin(), rel.end(), resume_.begin())))) {
+					ok = scan_directory(dir / entry.name, rootIndex, recursive, rel);
+				}
+			} else if (order > 0) {
+				resume_.clear();
+				const std::wstring path = (dir / entry.name).wstring();
+				const PathClassification c = matcher_->classify(path);
+				// Files under a nested root are left to that root's walk.
+				if (c.monitored() && c.root == rootIndex) ok = scan_file(path, entry.size, rel);
+			}
+			rel.pop_back();
+			if (!ok) return false;
+		}
+		return true;
+	}
+
+	bool scan_file(const std::wstring& path, uint64_t size, const std::vector<std::wstring>& rel) {
+		if (!throttle(1, static_cast<double>(size))) return false;
+		const HashChange change = pipeline_.rescan_file(path);
+		{
+			std::lock_guard<std::mutex> lock(statsMutex_);
+			++stats_.files;
+			stats_.bytes += size;
+			if (change == HashChange::Added) ++stats_.added;
+			else if (change == HashChange::Changed) ++stats_.changed;
+		}
+		cursor_.position = rel.empty() ? std::string(".") : join_position(rel);
+		const auto now = std::chrono::steady_clock::now();
+		if (now - lastSave_ >= std::chrono::seconds(5)) {
+			cursor_.save(options_.statePath);
+			lastSave_ = now;
+		}
+		return true;
+	}
+
+	// Reports indexed files that no longer exist. One index shard's paths are copied at a time
+	// so existence checks run without holding the shard lock.
+	bool sweep_missing() {
+		FileHashIndex& index = pipeline_.index();
+		std::vector<std::wstring> paths;
+		for (size_t shard = 0; shard < FileHashIndex::kShardCount; ++shard) {
+			paths.clear();
+			index.for_each_in_shard(shard, [&paths](const std::wstring& path, const std::string&) { paths.push_back(path); });
+			for (const auto& path : paths) {
+				if (!throttle(1, 0)) return false;
+				std::error_code ec;
+				if (std::filesystem::exists(std::filesystem::path(path), ec) || ec) continue;
+				if (pipeline_.report_missing(path)) {
+					std::lock_guard<std::mutex> lock(statsMutex_);
+					++stats_.removed;
+				}
+			}
+		}
+		return true;
+	}
+
+	EventPipeline& pipeline_;
+	RescanOptions options_;
+	RateBudget files_;
+	RateBudget bytes_;
+	RescanCursor cursor_;
+	std::shared_ptr<const PathMatcher> matcher_; // rules for the current pass
+	std::vector<std::wstring> resume_; // components of the saved position while skipping ahead
+	std::chrono::steady_clock::time_point lastSave_{};
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stopping_{false};
+	std::thread thread_;
+	mutable std::mutex statsMutex_;
+	RescanStats stats_;
+};
+
+} // namespace fim
@@ -0,0 +1,384 @@
+// Streaming field extractor for rendered Sysmon / Security event XML.
+// Walks the markup once, without building a DOM, and returns views into the caller's buffer for
+// the handful of fields the backend uses. Templated on the character type so the UTF-16 buffer
+// from EvtRender is scanned in place; the same code reads UTF-8 recordings in the replay tool.
+// append_json_text() then decodes XML entities, transcodes to UTF-8 and JSON-escapes in a single
+// pass, so a structured record costs one output copy instead of the XML -> UTF-8 -> escaped chain.
+// All scanning is bounds-checked; malformed input yields missing fields, never a read past the end.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace fim {
+
+template <typename CharT>
+struct SysmonFields {
+	using View = std::basic_string_view<CharT>;
+
+	bool hasEventId{false};
+	uint16_t eventId{0};
+	View systemTime;     // System/TimeCreated/@SystemTime
+	View computer;       // System/Computer
+	View channel;        // System/Channel
+	View utcTime;        // EventData UtcTime
+	View image;          // EventData Image (Sysmon) or ProcessName (Security)
+	View targetFilename; // EventData TargetFilename (Sysmon) or ObjectName (Security)
+	View processGuid;    // EventData ProcessGuid
+	View hashes;         // EventData Hashes ("SHA256=...,IMPHASH=..." when Sysmon hashing is on)
+	View user;           // EventData User (Sysmon) or SubjectUserName (Security)
+};
+
+namespace detail {
+
+template <typename CharT>
+inline bool ascii_equals(std::basic_string_view<CharT> text, const char* ascii) {
+	size_t i = 0;
+	for (; ascii[i]; ++i) {
+		if (i >= text.size() || text[i] != static_cast<CharT>(ascii[i])) return false;
+	}
+	return i == text.size();
+}
+
+template <typename CharT>
+inline bool is_xml_space(CharT c) {
+	return c == CharT(' ') || c == CharT('\t') || c == CharT('\r') || c == CharT('\n');
+}
+
+template <typename CharT>
+inline size_t find_char(std::basic_string_view<CharT> text, CharT c, size_t from) {
+	return from >= text.size() ? std::basic_string_view<CharT>::npos : text.find(c, from);
+}
+
+// One start/end tag: its name and the raw attribute section.
+template <typename CharT>
+struct XmlTag {
+	std::basic_string_view<CharT> name;
+	std::basic_string_view<CharT> attrs;
+	bool closing{false};
+	bool selfClosing{false};
+};
+
+// Value of attribute `name` within a tag's attribute section (either quote style), or empty.
+template <typename CharT>
+inline std::basic_string_view<CharT> xml_attribute(std::basic_string_view<CharT> attrs, const char* name) {
+	using View = std::basic_string_view<CharT>;
+	size_t i = 0;
+	while (i < attrs.size()) {
+		while (i < attrs.size() && is_xml_space(attrs[i])) ++i;
+		const size_t nameStart = i;
+		while (i < attrs.size() && attrs[i] != CharT('=') && !is_xml_space(attrs[i])) ++i;
+		const View attrName = attrs.substr(nameStart, i - nameStart);
+		while (i < attrs.size() && is_xml_space(attrs[i])) ++i;
+		if (i >= attrs.size() || attrs[i] != CharT('=')) return {};
+		++i;
+		while (i < attrs.size() && is_xml_space(attrs[i])) ++i;
+		if (i >= attrs.size() || (attrs[i] != CharT('\'') && attrs[i] != CharT('"'))) return {};
+		const CharT quote = attrs[i++];
+		const size_t valueEnd = find_char(attrs, quote, i);
+		if (valueEnd == View::npos) return {};
+		if (ascii_equals(attrName, name)) return attrs.substr(i, valueEnd - i);
+		i = valueEnd + 1;
+	}
+	return {};
+}
+
+template <typename CharT>
+inline bool parse_event_id(std::basic_string_view<CharT> text, uint16_t& out) {
+	uint32_t value = 0;
+	size_t digits = 0;
+	for (CharT c : text) {
+		if (is_xml_space(c)) continue;
+		if (c < CharT('0') || c > CharT('9') || ++digits > 5) return false;
+		value = value * 10 + static_cast<uint32_t>(c - CharT('0'));
+	}
+	if (digits == 0 || value > 0xFFFF) return false;
+	out = static_cast<uint16_t>(value);
+	return true;
+}
+
+} // namespace detail
+
+// Scans one rendered event. Returns false when no <Event> element with a numeric EventID was found.
+template <typename CharT>
+inline bool extract_sysmon_fields(std::basic_string_view<CharT> xml, SysmonFields<CharT>& out) {
+	using View = std::basic_string_view<CharT>;
+	out = SysmonFields<CharT>();
+	bool inEvent = false;
+	size_t pos = 0;
+	while ((pos = detail::find_char(xml, CharT('<'), pos)) != View::npos) {
+		const size_t tagStart = pos + 1;
+		if (tagStart >= xml.size()) break;
+		// Comments, declarations and processing instructions carry nothing we want.
+		if (xml[tagStart] == CharT('!') || xml[tagStart] == CharT('?')) {
+			const size_t end = detail::find_char(xml, CharT('>'), tagStart);
+			if (end == View::npos) break;
+			pos = end + 1;
+			continue;
+		}
+		const size_t tagEnd = detail::find_char(xml, CharT('>'), tagStart);
+		if (tagEnd == View::npos) break;
+
+		detail::XmlTag<CharT> tag;
+		size_t i = tagStart;
+		if (xml[i] == CharT('/')) {
+			tag.closing = true;
+			++i;
+		}
+		const size_t nameStart = i;
+		while (i < tagEnd && !detail::is_xml_space(xml[i]) && xml[i] != CharT('/')) ++i;
+		tag.name = xml.substr(nameStart, i - nameStart);
+		tag.selfClosing = tagEnd > tagStart && xml[tagEnd - 1] == CharT('/');
+		tag.attrs = xml.substr(i, tagEnd - i - (tag.selfClosing && tagEnd - 1 >= i ? 1 : 0));
+		pos = tagEnd + 1;
+
+		if (detail::ascii_equals(tag.name, "Event")) {
+			if (tag.closing && inEvent) break; // one event per call
+			inEvent = !tag.closing;
+			continue;
+		}
+		if (!inEvent || tag.closing) continue;
+
+		if (detail::ascii_equals(tag.name, "TimeCreated")) {
+			out.systemTime = detail::xml_attribute(tag.attrs, "SystemTime");
+			continue;
+		}
+		if (tag.selfClosing) continue;
+
+		// Element text runs up to the next tag; entities stay encoded until append_json_text().
+		const size_t textEnd = detail::find_char(xml, CharT('<'), pos);
+		const View text = xml.substr(pos, (textEnd == View::npos ? xml.size() : textEnd) - pos);
+
+		if (detail::ascii_equals(tag.name, "EventID")) {
+			out.hasEventId = detail::parse_event_id(text, out.eventId);
+		} else if (detail::ascii_equals(tag.name, "Computer")) {
+			out.computer = text;
+		} else if (detail::ascii_equals(tag.name, "Channel")) {
+			out.channel = text;
+		} else if (detail::ascii_equals(tag.name, "Data")) {
+			const View name = detail::xml_attribute(tag.attrs, "Name");
+			if (detail::ascii_equals(name, "TargetFilename") || detail::ascii_equals(name, "ObjectName")) {
+				if (out.targetFilename.empty()) out.targetFilename = text;
+			} else if (detail::ascii_equals(name, "Image") || detail::ascii_equals(name, "ProcessName")) {
+				if (out.image.empty()) out.image = text;
+			} else if (detail::ascii_equals(name, "UtcTime")) {
+				out.utcTime = text;
+			} else if (detail::ascii_equals(name, "ProcessGuid")) {
+				out.processGuid = text;
+			} else if (detail::ascii_equals(name, "Hashes")) {
+				out.hashes = text;
+			} else if (detail::ascii_equals(name, "User") || detail::ascii_equals(name, "SubjectUserName")) {
+				if (out.user.empty()) out.user = text;
+			}
+		}
+	}
+	return out.hasEventId;
+}
+
+namespace detail {
+
+inline void append_utf8(std::string& out, uint32_t cp) {
+	if (cp < 0x80) {
+		out.push_back(static_cast<char>(cp));
+	} else if (cp < 0x800) {
+		out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+		out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	} else if (cp < 0x10000) {
+		out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+		out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	} else {
+		out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+		out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	}
+}
+
+template <bool JsonEscape>
+inline void append_text_code_point(std::string& out, uint32_t cp) {
+	if constexpr (!JsonEscape) {
+		if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) cp = 0xFFFD;
+		append_utf8(out, cp);
+		return;
+	}
+	switch (cp) {
+	case '\\': out += "\\\\"; return;
+	case '"': out += "\\\""; return;
+	case '\b': out += "\\b"; return;
+	case '\f': out += "\\f"; return;
+	case '\n': out += "\\n"; return;
+	case '\r': out += "\\r"; return;
+	case '\t': out += "\\t"; return;
+	default: break;
+	}
+	if (cp < 0x20) {
+		char buf[7];
+		std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(cp));
+		out.append(buf, 6);
+		return;
+	}
+	if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) cp = 0xFFFD;
+	append_utf8(out, cp);
+}
+
+// Decodes "&name;" / "&#NN;" / "&#xNN;" at text[i] (which is '&'). Returns chars consumed, 0 if not an entity.
+template <typename CharT>
+inline size_t decode_xml_entity(std::basic_string_view<CharT> text, size_t i, uint32_t& cp) {
+	const size_t semi = find_char(text, CharT(';'), i + 1);
+	if (semi == std::basic_string_view<CharT>::npos || semi - i > 12) return 0;
+	const std::basic_string_view<CharT> body = text.substr(i + 1, semi - i - 1);
+	if (ascii_equals(body, "amp")) cp = '&';
+	else if (ascii_equals(body, "lt")) cp = '<';
+	else if (ascii_equals(body, "gt")) cp = '>';
+	else if (ascii_equals(body, "quot")) cp = '"';
+	else if (ascii_equals(body, "apos")) cp = '\'';
+	else if (body.size() >= 2 && body[0] == CharT('#')) {
+		const bool hex = body[1] == CharT('x') || body[1] == CharT('X');
+		uint32_t value = 0;
+		for (size_t k = hex ? 2 : 1; k < body.size(); ++k) {
+			const CharT c = body[k];
+			uint32_t digit;
+			if (c >= CharT('0') && c <= CharT('9')) digit = static_cast<uint32_t>(c - CharT('0'));
+			else if (hex && c >= CharT('a') && c <= CharT('f')) digit = static_cast<uint32_t>(c - CharT('a') + 10);
+			else if (hex && c >= CharT('A') && c <= CharT('F')) digit = static_cast<uint32_t>(c - CharT('A') + 10);
+			else return 0;
+			value = value * (hex ? 16 : 10) + digit;
+			if (value > 0x10FFFF) return 0;
+		}
+		if (body.size() == (hex ? 2u : 1u)) return 0;
+		cp = value;
+	} else {
+		return 0;
+	}
+	return semi - i + 1;
+}
+
+template <bool JsonEscape, typename CharT>
+inline void append_xml_text(std::string& out, std::basic_string_view<CharT> text) {
+	const size_t n = text.size();
+	for (size_t i = 0; i < n;) {
+		uint32_t cp = static_cast<uint32_t>(static_cast<std::make_unsigned_t<CharT>>(text[i]));
+		if (cp == '&') {
+			const size_t used = decode_xml_entity(text, i, cp);
+			if (used) {
+				append_text_code_point<JsonEscape>(out, cp);
+				i += used;
+				continue;
+			}
+		}
+		if constexpr (sizeof(CharT) == 1) {
+			if (cp >= 0x80) {
+				// Validate the sequence rather than trusting it; JSON must stay valid UTF-8.
+				size_t len = 0;
+				if (cp >= 0xC2 && cp <= 0xDF) { len = 2; cp &= 0x1F; }
+				else if (cp >= 0xE0 && cp <= 0xEF) { len = 3; cp &= 0x0F; }
+				else if (cp >= 0xF0 && cp <= 0xF4) { len = 4; cp &= 0x07; }
+				bool valid = len != 0 && i + len <= n;
+				for (size_t k = 1; valid && k < len; ++k) {
+					const unsigned char cc = static_cast<unsigned char>(text[i + k]);
+					if ((cc & 0xC0) != 0x80) valid = false;
+					cp = (cp << 6) | (cc & 0x3F);
+				}
+				if (valid && ((len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10FFFF)))) valid = false;
+				append_text_code_point<JsonEscape>(out, valid ? cp : 0xFFFD);
+				i += valid ? len : 1;
+				continue;
+			}
+		} else if constexpr (sizeof(CharT) == 2) {
+			if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < n) {
+				const uint32_t lo = static_cast<uint16_t>(text[i + 1]);
+				if (lo >= 0xDC00 && lo <= 0xDFFF) {
+					append_text_code_point<JsonEscape>(out, 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00));
+					i += 2;
+					continue;
+				}
+			}
+		}
+		append_text_code_point<JsonEscape>(out, cp);
+		++i;
+	}
+}
+
+} // namespace detail
+
+// Appends XML element text as the body of a JSON string (no surrounding quotes): entities are
+// decoded, the input (UTF-8 bytes, or UTF-16/32 code units) becomes UTF-8 and JSON specials are
+// escaped. Unpaired surrogates and invalid UTF-8 become U+FFFD.
+template <typename CharT>
+inline void append_json_text(std::string& out, std::basic_string_view<CharT> text) {
+	detail::append_xml_text<true>(out, text);
+}
+
+// Same decoding and transcoding without JSON escaping, for binary encodings.
+template <typename CharT>
+inline void append_utf8_text(std::string& out, std::basic_string_view<CharT> text) {
+	detail::append_xml_text<false>(out, text);
+}
+
+// Decoded, unescaped element text in the same character type (e.g. a target path as wstring).
+template <typename CharT>
+inline std::basic_string<CharT> xml_text(std::basic_string_view<CharT> text) {
+	std::basic_string<CharT> out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size(); ++i) {
+		uint32_t cp = 0;
+		const size_t used = text[i] == CharT('&') ? detail::decode_xml_entity(text, i, cp) : 0;
+		if (used && cp < 0x80) { // named entities and ASCII references; others are kept verbatim
+			out.push_back(static_cast<CharT>(cp));
+			i += used - 1;
+		} else {
+			out.push_back(text[i]);
+		}
+	}
+	return out;
+}
+
+// Compact JSON record for one event, e.g.
+// {"event_id":11,"utc_time":"...","image":"...","target":"...","process_guid":"...","hashes":"..."}
+// Empty fields are omitted.
+// Appended to out, so a reused buffer keeps its capacity. The reservation is rounded up to a
+// power of two: a recycled buffer then settles on one size class instead of growing again for
+// every slightly longer record.
+template <typename CharT>
+inline void append_event_record(std::string& out, const SysmonFields<CharT>& fields) {
+	const size_t estimate = out.size() + 64 + 2 * (fields.image.size() + fields.targetFilename.size() + fields.hashes.size()) +
+		fields.utcTime.size() + fields.processGuid.size();
+	if (estimate > out.capacity()) {
+		size_t rounded = 256;
+		while (rounded < estimate) rounded *= 2;
+		out.reserve(rounded);
+	}
+	out += "{\"event_id\":";
+	out += std::to_string(fields.eventId);
+	auto add = [&out](const char* key, std::basic_string_view<CharT> value) {
+		if (value.empty()) return;
+		out += ",\"";
+		out += key;
+		out += "\":\"";
+		append_json_text(out, value);
+		out.push_back('"');
+	};
+	add("utc_time", fields.utcTime.empty() ? fields.systemTime : fields.utcTime);
+	add("computer", fields.computer);
+	add("channel", fields.channel);
+	add("image", fields.image);
+	add("target", fields.targetFilename);
+	add("process_guid", fields.processGuid);
+	add("hashes", fields.hashes);
+	add("user", fields.user);
+	out.push_back('}');
+}
+
+template <typename CharT>
+inline std::string build_event_record(const SysmonFields<CharT>& fields) {
+	std::string out;
+	append_event_record(out, fields);
+	return out;
+}
+
+} // namespace fim
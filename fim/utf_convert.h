@@ -0,0 +1,268 @@
+// Portable UTF-8 <-> wide string conversion for the FIM components.
+// wchar_t is UTF-16 on Windows and UTF-32 elsewhere; both are handled. Invalid input is replaced
+// with U+FFFD rather than rejected, matching what the Win32 converters do without MB_ERR_INVALID_CHARS;
+// the appending forms return how many replacements were made so callers can validate.
+// Event XML, paths and log lines are overwhelmingly ASCII, so runs of ASCII are converted 16 bytes
+// (UTF-8 side) at a time with SSE2/NEON, and only non-ASCII code points take the scalar path.
+// The appending forms write into a caller-owned buffer so hot paths can reuse its capacity.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FIM_UTF_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define FIM_UTF_NEON 1
+#endif
+
+namespace fim {
+
+namespace detail {
+
+constexpr uint32_t kReplacementChar = 0xFFFD;
+
+// Decodes one UTF-8 sequence at s[i]; sets len to the bytes consumed and valid to false when the
+// sequence was replaced with U+FFFD (an overlong or surrogate form still consumes its full length).
+inline uint32_t decode_utf8(std::string_view s, size_t i, size_t& len, bool& valid) {
+	const size_t n = s.size();
+	const unsigned char c = static_cast<unsigned char>(s[i]);
+	auto cont = [&](size_t k) { return i + k < n && (static_cast<unsigned char>(s[i + k]) & 0xC0) == 0x80; };
+	auto bits = [&](size_t k) { return static_cast<uint32_t>(static_cast<unsigned char>(s[i + k]) & 0x3Fu); };
+	len = 1;
+	valid = true;
+	if (c < 0x80) return c;
+	if (c >= 0xC2 && c <= 0xDF && cont(1)) {
+		len = 2;
+		return ((c & 0x1Fu) << 6) | bits(1);
+	}
+	if (c >= 0xE0 && c <= 0xEF && cont(1) && cont(2)) {
+		const uint32_t cp = ((c & 0x0Fu) << 12) | (bits(1) << 6) | bits(2);
+		len = 3;
+		valid = !(cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF));
+		return valid ? cp : kReplacementChar;
+	}
+	if (c >= 0xF0 && c <= 0xF4 && cont(1) && cont(2) && cont(3)) {
+		const uint32_t cp = ((c & 0x07u) << 18) | (bits(1) << 12) | (bits(2) << 6) | bits(3);
+		len = 4;
+		valid = !(cp < 0x10000 || cp > 0x10FFFF);
+		return valid ? cp : kReplacementChar;
+	}
+	valid = false;
+	return kReplacementChar;
+}
+
+inline void push_wide(std::wstring& out, uint32_t cp) {
+	if (sizeof(wchar_t) == 2 && cp > 0xFFFF) {
+		cp -= 0x10000;
+		out.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+		out.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+	} else {
+		out.push_back(static_cast<wchar_t>(cp));
+	}
+}
+
+inline void push_utf8(std::string& out, uint32_t cp) {
+	if (cp < 0x80) {
+		out.push_back(static_cast<char>(cp));
+	} else if (cp < 0x800) {
+		out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+		out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	} else if (cp < 0x10000) {
+		out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+		out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	} else {
+		out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+		out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	}
+}
+
+// Length of the all-ASCII prefix of s[i..], checked 16 bytes at a time (stops at a block boundary
+// before the first non-ASCII block; the scalar loop finishes from there).
+inline size_t ascii_run_utf8(std::string_view s, size_t i) {
+	const size_t start = i;
+#if defined(FIM_UTF_SSE2)
+	while (s.size() - i >= 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s.data() + i));
+		if (_mm_movemask_epi8(chunk) != 0) break;
+		i += 16;
+	}
+#elif defined(FIM_UTF_NEON)
+	while (s.size() - i >= 16) {
+		if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(s.data() + i))) >= 0x80) break;
+		i += 16;
+	}
+#endif
+	return i - start;
+}
+
+// Widens count ASCII bytes from src onto the end of out.
+inline void widen_ascii(std::wstring& out, const char* src, size_t count) {
+	const size_t base = out.size();
+	out.resize(base + count);
+	wchar_t* dst = &out[base];
+	size_t k = 0;
+#if defined(FIM_UTF_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; k + 16 <= count; k += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k));
+		const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+		const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+		if constexpr (sizeof(wchar_t) == 2) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k + 8), hi);
+		} else {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k + 4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k + 8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k + 12), _mm_unpackhi_epi16(hi, zero));
+		}
+	}
+#endif
+	for (; k < count; ++k) dst[k] = static_cast<wchar_t>(static_cast<unsigned char>(src[k]));
+}
+
+// Length of the all-ASCII prefix of ws[i..], checked 16 code units at a time.
+inline size_t ascii_run_wide(std::wstring_view ws, size_t i) {
+	const size_t start = i;
+#if defined(FIM_UTF_SSE2)
+	constexpr size_t kUnits = 16 / sizeof(wchar_t);
+	const __m128i high = sizeof(wchar_t) == 2 ? _mm_set1_epi16(static_cast<short>(0xFF80)) : _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+	const __m128i zero = _mm_setzero_si128();
+	while (ws.size() - i >= 2 * kUnits) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ws.data() + i));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ws.data() + i + kUnits));
+		const __m128i bad = _mm_and_si128(_mm_or_si128(a, b), high);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, zero)) != 0xFFFF) break;
+		i += 2 * kUnits;
+	}
+#endif
+	return i - start;
+}
+
+// Narrows count ASCII code units from src onto the end of out.
+inline void narrow_ascii(std::string& out, const wchar_t* src, size_t count) {
+	const size_t base = out.size();
+	out.resize(base + count);
+	char* dst = &out[base];
+	size_t k = 0;
+#if defined(FIM_UTF_SSE2)
+	for (; k + 16 <= count; k += 16) {
+		__m128i packed;
+		if constexpr (sizeof(wchar_t) == 2) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k + 8));
+			packed = _mm_packus_epi16(a, b);
+		} else {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k + 4));
+			const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k + 8));
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k + 12));
+			packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), packed);
+	}
+#endif
+	for (; k < count; ++k) dst[k] = static_cast<char>(src[k]);
+}
+
+inline uint32_t next_wide_code_point(std::wstring_view ws, size_t& i, size_t& replaced) {
+	uint32_t cp = static_cast<uint32_t>(ws[i]);
+	if (sizeof(wchar_t) == 2) cp &= 0xFFFF;
+	++i;
+	if (cp >= 0xD800 && cp <= 0xDBFF && i < ws.size()) {
+		const uint32_t lo = static_cast<uint32_t>(ws[i]) & 0xFFFF;
+		if (lo >= 0xDC00 && lo <= 0xDFFF) {
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+			++i;
+		}
+	}
+	if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) { // lone surrogate / not a code point
+		++replaced;
+		return kReplacementChar;
+	}
+	return cp;
+}
+
+} // namespace detail
+
+// Reference implementations: one code point at a time. Output is identical to the forms below.
+inline size_t utf8_to_wide_scalar(std::string_view s, std::wstring& out) {
+	size_t replaced = 0;
+	for (size_t i = 0; i < s.size();) {
+		size_t len = 1;
+		bool valid = true;
+		detail::push_wide(out, detail::decode_utf8(s, i, len, valid));
+		if (!valid) ++replaced;
+		i += len;
+	}
+	return replaced;
+}
+
+inline size_t wide_to_utf8_scalar(std::wstring_view ws, std::string& out) {
+	size_t replaced = 0;
+	for (size_t i = 0; i < ws.size();) detail::push_utf8(out, detail::next_wide_code_point(ws, i, replaced));
+	return replaced;
+}
+
+// Appends the wide form of s to out; returns the number of invalid sequences replaced.
+inline size_t utf8_to_wide(std::string_view s, std::wstring& out) {
+	out.reserve(out.size() + s.size());
+	size_t replaced = 0;
+	const size_t n = s.size();
+	for (size_t i = 0; i < n;) {
+		const size_t run = detail::ascii_run_utf8(s, i);
+		if (run) {
+			detail::widen_ascii(out, s.data() + i, run);
+			i += run;
+			continue;
+		}
+		size_t len = 1;
+		bool valid = true;
+		const uint32_t cp = detail::decode_utf8(s, i, len, valid);
+		if (!valid) ++replaced;
+		detail::push_wide(out, cp);
+		i += len;
+	}
+	return replaced;
+}
+
+// Appends the UTF-8 form of ws to out; returns the number of unpaired surrogates (or, with 32-bit
+// wchar_t, out-of-range values) replaced.
+inline size_t wide_to_utf8(std::wstring_view ws, std::string& out) {
+	out.reserve(out.size() + ws.size() + ws.size() / 4);
+	size_t replaced = 0;
+	const size_t n = ws.size();
+	for (size_t i = 0; i < n;) {
+		const size_t run = detail::ascii_run_wide(ws, i);
+		if (run) {
+			detail::narrow_ascii(out, ws.data() + i, run);
+			i += run;
+			continue;
+		}
+		detail::push_utf8(out, detail::next_wide_code_point(ws, i, replaced));
+	}
+	return replaced;
+}
+
+inline std::wstring utf8_to_wide(std::string_view s) {
+	std::wstring out;
+	utf8_to_wide(s, out);
+	return out;
+}
+
+inline std::string wide_to_utf8(std::wstring_view ws) {
+	std::string out;
+	wide_to_utf8(ws, out);
+	return out;
+}
+
+} // namespace fim
@@ -14,58 +14,32 @@
 #include <cctype>
 #include <cwctype>
 #include <cstdio>
-#include <unordered_map>
+#include <thread>
+#include <chrono>
 
 #include <yaml-cpp/yaml.h>
 
+#include <winsock2.h> // before windows.h, which would pull in the old winsock.h (syslog sink)
 #include <windows.h>
 #include <winevt.h>
 #pragma comment(lib, "wevtapi.lib")
-#include <winhttp.h>
-#pragma comment(lib, "winhttp.lib")
 #include <bcrypt.h>
 #pragma comment(lib, "bcrypt.lib")
 #include <iostream>
 
-namespace fim {
-
-// Returns the list of directory paths to monitor where the entry is enabled (or enabled missing -> true).
-// Throws std::runtime_error if the config cannot be read/parsed.
-std::vector<std::string> get_monitored_paths(const std::string& config_path) {
-	YAML::Node root = YAML::LoadFile(config_path);
-	if (!root || !root.IsMap()) {
-		throw std::runtime_error("FIM config root must be a map/object");
-	}
-
-	std::vector<std::string> paths;
-	const YAML::Node md = root["monitored_directories"];
-	if (!md || !md.IsSequence()) {
-		// No monitored directories is not fatal; return empty list
-		return paths;
-	}
-
-	for (const auto& item : md) {
-		if (!item || !item.IsMap()) continue;
-		// enabled defaults to true if missing
-		bool enabled = true;
-		if (const auto en = item["enabled"]) {
-			try { enabled = en.as<bool>(); } catch (...) { /* keep default */ }
-		}
-		if (!enabled) continue;
-
-		if (const auto p = item["path"]) {
-			try {
-				auto path = p.as<std::string>();
-				if (!path.empty()) paths.emplace_back(std::move(path));
-			} catch (...) {
-				// skip malformed path
-			}
-		}
-	}
-	return paths;
-}
-
-} // namespace fim
+#include "alert_sinks.h"
+#include "api_uploader.h"
+#include "config_watcher.h"
+#include "env.h"
+#include "event_pipeline.h"
+#include "fim_config.h"
+#include "rescan_scheduler.h"
+#include "utf_convert.h"
+#if defined(FIM_USE_CURL)
+#include "curl_transport.h"
+#else
+#include "winhttp_transport.h"
+#endif
 
 // -------------- Windows Event Log (Winevtapi) subscription scaffolding --------------
 
@@ -143,76 +117,29 @@ static bool load_env_file(const std::filesystem::path& envPath) {
 	return anyApplied;
 }
 
-// Helper: UTF-8 to UTF-16
-static std::wstring to_wstring(const std::string& s) {
-	if (s.empty()) return std::wstring();
-	int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
-	std::wstring ws;
-	ws.resize(len);
-	MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), ws.data(), len);
-	return ws;
-}
-
-// Helper: UTF-16 to UTF-8
-static std::string to_utf8(const std::wstring& ws) {
-    if (ws.empty()) return std::string();
-    int len = WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), nullptr, 0, nullptr, nullptr);
-    std::string s;
-    s.resize(len);
-    WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), s.data(), len, nullptr, nullptr);
-    return s;
-}
-
-static std::string json_escape(const std::string& input) {
-	std::string out;
-	out.reserve(input.size() + 16);
-	for (unsigned char c : input) {
-		switch (c) {
-		case '\\': out += "\\\\"; break;
-		case '\"': out += "\\\""; break;
-		case '\b': out += "\\b"; break;
-		case '\f': out += "\\f"; break;
-		case '\n': out += "\\n"; break;
-		case '\r': out += "\\r"; break;
-		case '\t': out += "\\t"; break;
-		default:
-			if (c < 0x20) {
-				char buf[7];
-				std::snprintf(buf, sizeof(buf), "\\u%04x", c);
-				out.append(buf, 6);
-			} else {
-				out.push_back(static_cast<char>(c));
-			}
-		}
-	}
-	return out;
-}
-
-// Case-insensitive starts-with for Windows paths
-static bool starts_with_path_icase(const std::wstring& path, const std::wstring& prefix) {
-	if (prefix.empty()) return true;
-	if (path.size() < prefix.size()) return false;
-	return _wcsnicmp(path.c_str(), prefix.c_str(), prefix.size()) == 0;
-}
-
-static std::string render_event_xml_utf8(EVT_HANDLE event) {
+// Renders the event XML as UTF-16. The EVT_HANDLE handed to the subscription callback is only
+// valid until the callback returns, so this is the one piece of rendering that cannot be deferred.
+static std::wstring render_event_xml(EVT_HANDLE event) {
 	DWORD bufferUsed = 0;
 	DWORD propertyCount = 0;
 	if (!EvtRender(nullptr, event, EvtRenderEventXml, 0, nullptr, &bufferUsed, &propertyCount)) {
 		if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-			return std::string();
+			return std::wstring();
 		}
 	}
-	if (bufferUsed == 0) return std::string();
-	std::vector<WCHAR> buffer(bufferUsed / sizeof(WCHAR));
+	if (bufferUsed == 0) return std::wstring();
+	// Rendered into a per-thread buffer that only grows, so the returned string is the one
+	// allocation per event.
+	thread_local std::vector<WCHAR> buffer;
+	if (buffer.size() < bufferUsed / sizeof(WCHAR)) buffer.resize(bufferUsed / sizeof(WCHAR));
 	if (!EvtRender(nullptr, event, EvtRenderEventXml, bufferUsed, buffer.data(), &bufferUsed, &propertyCount)) {
-		return std::string();
+		return std::wstring();
 	}
-	return to_utf8(std::wstring(buffer.data()));
+	return std::wstring(buffer.data());
 }
 
 struct SubscriptionCtx {
-	std::vector<std::wstring> prefixes; // monitored directory prefixes
+	fim::EventPipeline* pipeline{nullptr}; // classification, hashing and uploads (event_pipeline.h)
 };
 
 // Try extract a file path from an event using known fields for Sysmon and Security
@@ -268,231 +195,23 @@ static USHORT get_event_id(EVT_HANDLE event) {
 	return id;
 }
 
-static std::string build_event_object_suffix(USHORT eventId) {
-	SYSTEMTIME st;
-	GetSystemTime(&st);
-	std::ostringstream oss;
-	oss << std::setfill('0')
-		<< std::setw(4) << st.wYear
-		<< std::setw(2) << st.wMonth
-		<< std::setw(2) << st.wDay
-		<< 'T'
-		<< std::setw(2) << st.wHour
-		<< std::setw(2) << st.wMinute
-		<< std::setw(2) << st.wSecond
-		<< '.' << std::setw(3) << st.wMilliseconds
-		<< 'Z'
-		<< "_evt-" << eventId
-		<< "_pid-" << GetCurrentProcessId()
-		<< ".xml";
-	return oss.str();
-}
-
-// Minimal HTTP uploader that forwards rendered XML blobs to the configured API endpoint.
-// Requires FIM_API_URL (and optional FIM_API_TOKEN) environment variables.
-class ApiUploader {
-public:
-	ApiUploader() = default;
-
-	void refresh_from_env() {
-		std::lock_guard<std::mutex> lock(uploadMutex_);
-		endpoint_ = getenv_string("FIM_API_URL");
-		token_ = getenv_string("FIM_API_TOKEN");
-	}
-
-	bool configured() const {
-		std::lock_guard<std::mutex> lock(uploadMutex_);
-		return !endpoint_.empty();
-	}
-
-		bool upload_payload(const std::string& keySuffix, const std::string& payload) {
-			if (payload.empty()) return false;
-			std::lock_guard<std::mutex> lock(uploadMutex_);
-			if (endpoint_.empty()) return false;
-			return send_locked(keySuffix, payload);
-		}
-
-	ApiUploader(const ApiUploader&) = delete;
-	ApiUploader& operator=(const ApiUploader&) = delete;
-
-private:
-	struct ParsedUrl {
-		std::wstring host;
-		std::wstring resource;
-		INTERNET_PORT port{0};
-		bool secure{false};
-	};
-
-		bool send_locked(const std::string& keySuffix, const std::string& payload) {
-			ParsedUrl url;
-			if (!parse_url_locked(url)) {
-				std::cerr << "[FIM] Invalid FIM_API_URL, unable to forward event." << std::endl;
-			return false;
-		}
-
-		HINTERNET session = WinHttpOpen(L"FIM/1.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
-			WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
-		if (!session) {
-			std::cerr << "[FIM] WinHttpOpen failed: " << GetLastError() << std::endl;
-			return false;
-		}
-
-		HINTERNET connect = WinHttpConnect(session, url.host.c_str(), url.port, 0);
-		if (!connect) {
-			std::cerr << "[FIM] WinHttpConnect failed: " << GetLastError() << std::endl;
-			WinHttpCloseHandle(session);
-			return false;
-		}
-
-		DWORD flags = url.secure ? WINHTTP_FLAG_SECURE : 0;
-		HINTERNET request = WinHttpOpenRequest(connect, L"POST", url.resource.c_str(),
-			nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
-		if (!request) {
-			std::cerr << "[FIM] WinHttpOpenRequest failed: " << GetLastError() << std::endl;
-			WinHttpCloseHandle(connect);
-			WinHttpCloseHandle(session);
-			return false;
-		}
-
-		std::wstring headers = L"Content-Type: application/json; charset=utf-8\r\n";
-		if (!token_.empty()) {
-			headers += L"Authorization: Bearer " + to_wstring(token_) + L"\r\n";
-		}
-
-		std::string body = "{\"log\":\"" + json_escape(payload) + "\",\"filename\":\"" + json_escape(keySuffix) + "\"}";
-		DWORD bodySize = static_cast<DWORD>(body.size());
-		LPVOID bodyPtr = body.empty() ? nullptr : const_cast<char*>(body.data());
-
-		BOOL sent = WinHttpSendRequest(
-			request,
-			headers.c_str(),
-			(DWORD)-1,
-			bodyPtr,
-			bodySize,
-			bodySize,
-			0);
-		if (!sent) {
-			std::cerr << "[FIM] WinHttpSendRequest failed: " << GetLastError() << std::endl;
-			WinHttpCloseHandle(request);
-			WinHttpCloseHandle(connect);
-			WinHttpCloseHandle(session);
-			return false;
-		}
-
-		if (!WinHttpReceiveResponse(request, nullptr)) {
-			std::cerr << "[FIM] WinHttpReceiveResponse failed: " << GetLastError() << std::endl;
-			WinHttpCloseHandle(request);
-			WinHttpCloseHandle(connect);
-			WinHttpCloseHandle(session);
-			return false;
-		}
-
-		WinHttpCloseHandle(request);
-		WinHttpCloseHandle(connect);
-		WinHttpCloseHandle(session);
-		return true;
-	}
-
-	bool parse_url_locked(ParsedUrl& parsed) const {
-		if (endpoint_.empty()) return false;
-		std::wstring wideUrl = to_wstring(endpoint_);
-		URL_COMPONENTS comps{};
-		ZeroMemory(&comps, sizeof(comps));
-		comps.dwStructSize = sizeof(comps);
-		comps.dwSchemeLength = (DWORD)-1;
-		comps.dwHostNameLength = (DWORD)-1;
-		comps.dwUrlPathLength = (DWORD)-1;
-		comps.dwExtraInfoLength = (DWORD)-1;
-
-		if (!WinHttpCrackUrl(wideUrl.c_str(), static_cast<DWORD>(wideUrl.size()), 0, &comps)) {
-			std::cerr << "[FIM] WinHttpCrackUrl failed: " << GetLastError() << std::endl;
-			return false;
-		}
-
-		if (!comps.lpszHostName || comps.dwHostNameLength == 0) {
-			return false;
-		}
-
-		parsed.secure = (comps.nScheme == INTERNET_SCHEME_HTTPS);
-		parsed.port = comps.nPort ? comps.nPort :
-			(parsed.secure ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT);
-		parsed.host.assign(comps.lpszHostName, comps.dwHostNameLength);
-		parsed.resource.clear();
-		if (comps.dwUrlPathLength > 0 && comps.lpszUrlPath) {
-			parsed.resource.assign(comps.lpszUrlPath, comps.dwUrlPathLength);
-		}
-		if (parsed.resource.empty()) {
-			parsed.resource = L"/";
-		}
-		if (comps.dwExtraInfoLength > 0 && comps.lpszExtraInfo) {
-			parsed.resource.append(comps.lpszExtraInfo, comps.dwExtraInfoLength);
-		}
-		return true;
-	}
-
-	static std::string getenv_string(const char* name) {
-		if (const char* value = std::getenv(name)) return value;
-		return {};
-	}
-
-	std::string endpoint_;
-	std::string token_;
-	mutable std::mutex uploadMutex_;
-};
-
-static ApiUploader g_api_uploader;
-
-static void maybe_send_event_to_api(EVT_HANDLE event, USHORT eventId) {
-	static std::once_flag warnOnce;
-	if (!g_api_uploader.configured()) {
-		std::call_once(warnOnce, []() {
-			std::cerr << "[FIM] Remote uploads disabled. Provide FIM_API_URL (and optional FIM_API_TOKEN) "
-			          << "to forward events to the backend API." << std::endl;
-		});
-		return;
-	}
-	std::string xml = render_event_xml_utf8(event);
-	if (xml.empty()) return;
-	const std::string keySuffix = build_event_object_suffix(eventId);
-	if (!g_api_uploader.upload_payload(keySuffix, xml)) {
-		std::cerr << "[FIM] Failed to POST Windows Event XML to API (object=" << keySuffix << ")." << std::endl;
+// Transport backend for the uploader: WinHTTP by default, libcurl when built with /DFIM_USE_CURL.
+static std::unique_ptr<fim::HttpTransport> make_api_transport(const fim::HttpEndpoint& endpoint, const fim::TransportOptions& options) {
+#if defined(FIM_USE_CURL)
+	auto transport = std::make_unique<fim::CurlTransport>(endpoint, options);
+#else
+	auto transport = std::make_unique<fim::WinHttpTransport>(endpoint, options);
+#endif
+	if (!transport->valid()) {
+		std::cerr << "[FIM] Failed to initialise " << transport->name() << " transport: " << GetLastError() << std::endl;
+		return nullptr;
 	}
+	return transport;
 }
 
-// -------------- File hash tracking and change reporting --------------
+static fim::ApiUploader g_api_uploader(make_api_transport);
 
-struct FileHashInfo {
-	std::wstring originalPath;
-	std::wstring fileName;
-	std::string hashHex;
-};
-
-enum class HashLogMode {
-	Silent,
-	Verbose,
-};
-
-static std::unordered_map<std::wstring, FileHashInfo> g_file_hashes;
-static std::mutex g_file_hash_mutex;
-
-static std::wstring normalize_path_key(const std::wstring& path) {
-	std::wstring normalized = path;
-	for (auto& ch : normalized) {
-		if (ch == L'/') ch = L'\\';
-		ch = static_cast<wchar_t>(std::towlower(ch));
-	}
-	return normalized;
-}
-
-static std::wstring extract_filename(const std::wstring& fullPath) {
-	try {
-		const std::filesystem::path fsPath(fullPath);
-		std::wstring filename = fsPath.filename().wstring();
-		if (!filename.empty()) return filename;
-	} catch (...) {
-	}
-	return fullPath;
-}
+// -------------- File hashing (BCrypt) --------------
 
 static std::string bytes_to_hex(const std::vector<BYTE>& data) {
 	static const char* digits = "0123456789abcdef";
@@ -570,157 +289,7 @@ cleanup:
 	return success;
 }
 
-static std::string build_hash_log_suffix(const char* tag) {
-	SYSTEMTIME st;
-	GetSystemTime(&st);
-	std::ostringstream oss;
-	oss << std::setfill('0')
-		<< std::setw(4) << st.wYear
-		<< std::setw(2) << st.wMonth
-		<< std::setw(2) << st.wDay
-		<< 'T'
-		<< std::setw(2) << st.wHour
-		<< std::setw(2) << st.wMinute
-		<< std::setw(2) << st.wSecond
-		<< '.' << std::setw(3) << st.wMilliseconds
-		<< 'Z'
-		<< "_hash-" << tag
-		<< "_pid-" << GetCurrentProcessId()
-		<< ".log";
-	return oss.str();
-}
-
-static void emit_hash_log_entry(const std::wstring& prefix, const std::wstring& path, const std::string& previousHash, const std::string& newHash, const char* tag) {
-	std::wstringstream wss;
-	wss << L"[HASH] " << prefix << L" path=" << path;
-	if (!previousHash.empty()) {
-		wss << L" previous=" << to_wstring(previousHash);
-	}
-	if (!newHash.empty()) {
-		wss << L" current=" << to_wstring(newHash);
-	}
-	const std::wstring line = wss.str();
-	std::wcout << line << std::endl;
-
-	if (g_api_uploader.configured()) {
-		g_api_uploader.upload_payload(build_hash_log_suffix(tag), to_utf8(line));
-	}
-}
-
-static void upsert_hash_record(const std::wstring& fullPath, const std::string& newHash, HashLogMode mode) {
-	if (newHash.empty()) return;
-
-	const std::wstring key = normalize_path_key(fullPath);
-	FileHashInfo record;
-	record.originalPath = fullPath;
-	record.fileName = extract_filename(fullPath);
-	record.hashHex = newHash;
-
-	bool isNew = false;
-	bool changed = false;
-	std::string previousHash;
-
-	{
-		std::lock_guard<std::mutex> lock(g_file_hash_mutex);
-		auto it = g_file_hashes.find(key);
-		if (it == g_file_hashes.end()) {
-			g_file_hashes.emplace(key, record);
-			isNew = true;
-		} else if (it->second.hashHex != newHash) {
-			previousHash = it->second.hashHex;
-			it->second = record;
-			changed = true;
-		} else {
-			return; // unchanged
-		}
-	}
-
-	if (mode == HashLogMode::Verbose) {
-		if (isNew) {
-			emit_hash_log_entry(L"Recorded baseline hash", fullPath, {}, newHash, "add");
-		} else if (changed) {
-			emit_hash_log_entry(L"Hash changed", fullPath, previousHash, newHash, "change");
-		}
-	}
-}
-
-static void remove_hash_record(const std::wstring& fullPath, HashLogMode mode) {
-	const std::wstring key = normalize_path_key(fullPath);
-	FileHashInfo removed;
-	bool existed = false;
-
-	{
-		std::lock_guard<std::mutex> lock(g_file_hash_mutex);
-		auto it = g_file_hashes.find(key);
-		if (it != g_file_hashes.end()) {
-			removed = it->second;
-			g_file_hashes.erase(it);
-			existed = true;
-		}
-	}
-
-	if (existed && mode == HashLogMode::Verbose) {
-		emit_hash_log_entry(L"Hash entry removed", fullPath, removed.hashHex, {}, "remove");
-	}
-}
-
-static void index_existing_file(const std::wstring& filePath, HashLogMode mode) {
-	std::string hash;
-	if (compute_file_sha256(filePath, hash)) {
-		upsert_hash_record(filePath, hash, mode);
-	}
-}
-
-static void build_initial_hash_index(const std::vector<std::wstring>& rootPaths) {
-	for (const auto& root : rootPaths) {
-		std::error_code ec;
-		const std::filesystem::path fsPath(root);
-		if (!std::filesystem::exists(fsPath, ec)) {
-			std::wcerr << L"[HASH] Skipping missing path: " << root << std::endl;
-			continue;
-		}
-
-		if (std::filesystem::is_regular_file(fsPath, ec)) {
-			index_existing_file(fsPath.wstring(), HashLogMode::Silent);
-			continue;
-		}
-
-		if (!std::filesystem::is_directory(fsPath, ec)) {
-			continue;
-		}
-
-		try {
-			const std::filesystem::directory_options opts = std::filesystem::directory_options::skip_permission_denied;
-			for (std::filesystem::recursive_directory_iterator it(fsPath, opts), end; it != end; ++it) {
-				std::error_code entryEc;
-				if (it->is_directory(entryEc)) {
-					continue;
-				}
-				if (it->is_regular_file(entryEc)) {
-					index_existing_file(it->path().wstring(), HashLogMode::Silent);
-				}
-			}
-		} catch (const std::exception& ex) {
-			std::wcerr << L"[HASH] Failed to index " << root << L": " << to_wstring(ex.what()) << std::endl;
-		}
-	}
-}
-
-static void handle_hash_tracking_for_event(const std::wstring& fullPath, USHORT eventId) {
-	if (eventId == 23 || eventId == 26) {
-		remove_hash_record(fullPath, HashLogMode::Verbose);
-		return;
-	}
-
-	std::string newHash;
-	if (!compute_file_sha256(fullPath, newHash)) {
-		std::wcerr << L"[HASH] Unable to compute hash for " << fullPath << std::endl;
-		return;
-	}
-	upsert_hash_record(fullPath, newHash, HashLogMode::Verbose);
-}
-
-// Subscription callback
+// Subscription callback: does the minimum that needs the live EVT_HANDLE, then hands off to the pool.
 static DWORD WINAPI evt_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, PVOID userCtx, EVT_HANDLE event) {
 	auto* ctx = reinterpret_cast<SubscriptionCtx*>(userCtx);
 	switch (action) {
@@ -730,26 +299,18 @@ static DWORD WINAPI evt_callback(EVT_SUBSCRIBE_NOTIFY_ACTION action, PVOID userC
 		}
 		case EvtSubscribeActionDeliver: {
 			std::wstring target = extract_path_from_event(event, ctx);
-			if (!target.empty()) {
-				USHORT evId = get_event_id(event);
-				const wchar_t* label = L"EVENT";
-				// Common Sysmon file EventIDs; Security 4663 = access attempt
-				if (evId == 11) label = L"CREATED";
-				else if (evId == 23) label = L"DELETED";
-				else if (evId == 26) label = L"DELETE_DETECTED";
-				else if (evId == 4663) label = L"ACCESS";
-					for (const auto& pref : ctx->prefixes) {
-						if (starts_with_path_icase(target, pref)) {
-							// Print locally and forward to remote storage if configured.
-							DWORD pid = GetCurrentProcessId();
-							fwprintf(stdout, L"[PID %lu] %s : %s\n", pid, label, target.c_str());
-							fflush(stdout);
-							maybe_send_event_to_api(event, evId);
-							handle_hash_tracking_for_event(target, evId);
-							break;
-						}
-					}
-				}
+			if (target.empty()) break;
+			const fim::PathClassification c = ctx->pipeline->classify(target);
+			if (!c.monitored()) break;
+
+			fim::FimEvent item;
+			item.eventId = get_event_id(event);
+			item.priority = c.priority;
+			item.target = std::move(target);
+			if (ctx->pipeline->wants_xml()) {
+				item.xml = render_event_xml(event);
+			}
+			ctx->pipeline->submit(std::move(item));
 			break;
 		}
 		default: break;
@@ -812,25 +373,30 @@ int wmain(int argc, wchar_t** wargv) {
 	}
 	load_env_file(envPath);
 	g_api_uploader.refresh_from_env();
+	if (g_api_uploader.configured()) {
+		std::cout << "[FIM] Forwarding events via " << g_api_uploader.transport_name() << " transport"
+		          << (g_api_uploader.batching() ? " (batched NDJSON)" : "") << std::endl;
+	}
 
 	std::wstring cfg = argc > 1 ? wargv[1] : L"fim_config.yml";
-	// Load prefixes from YAML (UTF-8 file path assumed)
-	std::vector<std::string> u8paths;
+	// Load monitored directories and exclusion rules from YAML (UTF-8 file path assumed)
+	// Every alert goes to the API and to the alerts.methods sinks, each through its own queue
+	fim::AlertFanout sinks;
+	if (g_api_uploader.configured()) sinks.add_api(g_api_uploader);
+	std::unique_ptr<fim::EventPipeline> pipeline;
+	unsigned scanIntervalSec = 0;
 	try {
-		u8paths = fim::get_monitored_paths(to_utf8(cfg));
+		const fim::FimConfig config = fim::load_fim_config(fim::wide_to_utf8(cfg));
+		scanIntervalSec = config.scanIntervalSec;
+		sinks.add_configured(config.alerts);
+		pipeline = std::make_unique<fim::EventPipeline>(fim::PathMatcher(config), sinks, compute_file_sha256);
 	} catch (const std::exception& ex) {
 		std::cerr << ex.what() << std::endl;
 		return 1;
 	}
-
+	pipeline->start(fim::PipelineOptions::from_env());
 	SubscriptionCtx ctx;
-	ctx.prefixes.reserve(u8paths.size());
-	for (const auto& p : u8paths) {
-		// Normalize to backslash-prefixed Windows path; allow both C:\ and \\?\ forms
-		auto ws = to_wstring(p);
-		ctx.prefixes.push_back(ws);
-	}
-	build_initial_hash_index(ctx.prefixes);
+	ctx.pipeline = pipeline.get();
 
 	EVT_HANDLE sysmonSub = start_sysmon_subscription(&ctx);
 	if (!sysmonSub) {
@@ -842,12 +408,35 @@ int wmain(int argc, wchar_t** wargv) {
 		std::cerr << "Security subscription may not be active (requires audit policy and SACLs)." << std::endl;
 	}
 
+	// Subscriptions are live before indexing starts, so nothing is missed while the baseline builds
+	pipeline->start_baseline();
+	// Periodic throttled rescans catch anything the event subscriptions missed
+	fim::RescanScheduler rescan(*pipeline, fim::RescanOptions::from_env(scanIntervalSec));
+	rescan.start();
+	// Directory and exclusion rules are picked up from the config file without a restart
+	fim::ConfigWatcher configWatcher(*pipeline, std::filesystem::path(cfg), scanIntervalSec);
+	configWatcher.start();
+
 	std::wcout << L"Event subscriptions active. Press Ctrl+C to exit." << std::endl;
-	// Simple wait loop
-	while (true) Sleep(1000);
+	// Simple wait loop; report queue metrics once a minute
+	const size_t statsIntervalSec = fim::getenv_size("FIM_STATS_INTERVAL", 60);
+	size_t elapsedSec = 0;
+	while (true) {
+		Sleep(1000);
+		if (++elapsedSec >= statsIntervalSec) {
+			elapsedSec = 0;
+			pipeline->log_stats(std::cout);
+		}
+	}
 
 	// Cleanup (unreachable here, but good practice if you adapt)
 	if (sysmonSub) EvtClose(sysmonSub);
 	if (secSub) EvtClose(secSub);
+	configWatcher.stop();
+	rescan.stop();
+	pipeline->stop();
+	sinks.stop();
+	g_api_uploader.flush();
+	pipeline->log_stats(std::cout);
 	return 0;
 }
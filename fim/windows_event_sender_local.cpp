@@ -20,6 +20,8 @@
 #pragma comment(lib, "wevtapi.lib")
 #include <iostream>
 
+#include "utf_convert.h"
+
 namespace fim {
 
 // Returns the list of directory paths to monitor where the entry is enabled (or enabled missing -> true).
@@ -120,20 +122,26 @@ static bool starts_with_path_icase(const std::wstring& path, const std::wstring&
 	return _wcsnicmp(path.c_str(), prefix.c_str(), prefix.size()) == 0;
 }
 
-static std::string render_event_xml_utf8(EVT_HANDLE event) {
+// The returned text lives in a per-thread buffer and stays valid until the thread's next call;
+// both the UTF-16 render and its UTF-8 form reuse their capacity from event to event.
+static const std::string& render_event_xml_utf8(EVT_HANDLE event) {
+	thread_local std::vector<WCHAR> buffer;
+	thread_local std::string utf8;
+	utf8.clear();
 	DWORD bufferUsed = 0;
 	DWORD propertyCount = 0;
 	if (!EvtRender(nullptr, event, EvtRenderEventXml, 0, nullptr, &bufferUsed, &propertyCount)) {
 		if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
-			return std::string();
+			return utf8;
 		}
 	}
-	if (bufferUsed == 0) return std::string();
-	std::vector<WCHAR> buffer(bufferUsed / sizeof(WCHAR));
+	if (bufferUsed == 0) return utf8;
+	if (buffer.size() < bufferUsed / sizeof(WCHAR)) buffer.resize(bufferUsed / sizeof(WCHAR));
 	if (!EvtRender(nullptr, event, EvtRenderEventXml, bufferUsed, buffer.data(), &bufferUsed, &propertyCount)) {
-		return std::string();
+		return utf8;
 	}
-	return to_utf8(std::wstring(buffer.data()));
+	fim::wide_to_utf8(std::wstring_view(buffer.data()), utf8);
+	return utf8;
 }
 
 struct SubscriptionCtx {
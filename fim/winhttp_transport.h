@@ -0,0 +1,138 @@
+// WinHTTP backend for fim::HttpTransport.
+// One session and one connect handle live for the lifetime of the transport; WinHTTP keeps the
+// underlying keep-alive sockets pooled per connect handle, so only the first request (and any
+// reconnect) pays the TCP/TLS handshake. Windows only.
+
+#pragma once
+
+#include <string>
+
+#include <windows.h>
+#include <winhttp.h>
+#pragma comment(lib, "winhttp.lib")
+
+#include "http_transport.h"
+#include "utf_convert.h"
+
+namespace fim {
+
+class WinHttpTransport : public HttpTransport {
+public:
+	WinHttpTransport(const HttpEndpoint& endpoint, const TransportOptions& options)
+		: endpoint_(endpoint), limiter_(options.maxInFlight) {
+		const std::wstring agent = widen(options.userAgent);
+		session_ = WinHttpOpen(agent.c_str(), WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
+			WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+		if (!session_) return;
+
+		const int timeout = static_cast<int>(options.timeoutMs);
+		WinHttpSetTimeouts(session_, timeout, timeout, timeout, timeout);
+		DWORD maxConns = static_cast<DWORD>(options.maxInFlight == 0 ? 1 : options.maxInFlight);
+		WinHttpSetOption(session_, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &maxConns, sizeof(maxConns));
+
+		const std::wstring host = widen(endpoint_.host);
+		connect_ = WinHttpConnect(session_, host.c_str(), endpoint_.port, 0);
+	}
+
+	~WinHttpTransport() override {
+		if (connect_) WinHttpCloseHandle(connect_);
+		if (session_) WinHttpCloseHandle(session_);
+	}
+
+	WinHttpTransport(const WinHttpTransport&) = delete;
+	WinHttpTransport& operator=(const WinHttpTransport&) = delete;
+
+	bool valid() const { return session_ && connect_; }
+
+	HttpResponse post(const HttpRequest& req) override {
+		HttpResponse resp;
+		if (!valid()) {
+			resp.error = "WinHTTP session not initialised";
+			return resp;
+		}
+
+		InFlightSlot slot(limiter_);
+		// Per-thread scratch: after the first request on a thread, building these reuses its capacity.
+		thread_local std::wstring resource;
+		thread_local std::wstring headers;
+		resource.clear();
+		utf8_to_wide(req.resource.empty() ? std::string_view(endpoint_.resource) : req.resource, resource);
+		const DWORD flags = endpoint_.secure ? WINHTTP_FLAG_SECURE : 0;
+		HINTERNET request = WinHttpOpenRequest(connect_, L"POST", resource.c_str(),
+			nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
+		if (!request) {
+			resp.error = "WinHttpOpenRequest failed: " + std::to_string(GetLastError());
+			return resp;
+		}
+
+		headers.assign(L"Content-Type: ");
+		utf8_to_wide(req.contentType, headers);
+		headers += L"\r\n";
+		if (!req.bearerToken.empty()) {
+			headers += L"Authorization: Bearer ";
+			utf8_to_wide(req.bearerToken, headers);
+			headers += L"\r\n";
+		}
+		for (const auto& header : req.headers) {
+			utf8_to_wide(header.first, headers);
+			headers += L": ";
+			utf8_to_wide(header.second, headers);
+			headers += L"\r\n";
+		}
+
+		const DWORD bodySize = static_cast<DWORD>(req.bodySize);
+		LPVOID bodyPtr = bodySize ? const_cast<char*>(req.body) : WINHTTP_NO_REQUEST_DATA;
+		if (!WinHttpSendRequest(request, headers.c_str(), (DWORD)-1, bodyPtr, bodySize, bodySize, 0)) {
+			resp.error = "WinHttpSendRequest failed: " + std::to_string(GetLastError());
+			WinHttpCloseHandle(request);
+			return resp;
+		}
+		if (!WinHttpReceiveResponse(request, nullptr)) {
+			resp.error = "WinHttpReceiveResponse failed: " + std::to_string(GetLastError());
+			WinHttpCloseHandle(request);
+			return resp;
+		}
+
+		DWORD status = 0;
+		DWORD size = sizeof(status);
+		if (WinHttpQueryHeaders(request, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+			WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX)) {
+			resp.status = static_cast<int>(status);
+		}
+		DWORD retryAfter = 0;
+		size = sizeof(retryAfter);
+		if (WinHttpQueryHeaders(request, WINHTTP_QUERY_RETRY_AFTER | WINHTTP_QUERY_FLAG_NUMBER,
+			WINHTTP_HEADER_NAME_BY_INDEX, &retryAfter, &size, WINHTTP_NO_HEADER_INDEX)) {
+			resp.retryAfterSec = static_cast<unsigned>(retryAfter);
+		}
+
+		// The response body must be consumed for WinHTTP to return the socket to its pool.
+		drain_response(request);
+		WinHttpCloseHandle(request);
+		return resp;
+	}
+
+	const char* name() const override { return "winhttp"; }
+
+private:
+	static std::wstring widen(const std::string& s) {
+		return utf8_to_wide(s);
+	}
+
+	static void drain_response(HINTERNET request) {
+		char scratch[4096];
+		DWORD available = 0;
+		while (WinHttpQueryDataAvailable(request, &available) && available > 0) {
+			DWORD read = 0;
+			const DWORD chunk = available < sizeof(scratch) ? available : static_cast<DWORD>(sizeof(scratch));
+			if (!WinHttpReadData(request, scratch, chunk, &read) || read == 0) break;
+		}
+	}
+
+	HttpEndpoint endpoint_;
+	InFlightLimiter limiter_;
+	HINTERNET session_{nullptr};
+	HINTERNET connect_{nullptr};
+};
+
+} // namespace fim
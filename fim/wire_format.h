@@ -0,0 +1,327 @@
+// Compact binary batch format for agent -> backend uploads (Content-Type application/x-fim-binary).
+// An alternative to NDJSON that avoids JSON escaping on the client and JSON parsing on the server.
+// Decoded by backend/internal/wire; keep the two in step and bump kWireVersion on any change.
+//
+// Frame (schema version 2):
+//   "FIMB" u8(version)  then records until the end of the body
+// Record:
+//   varint(bodyLength) body
+//   body = varint(type) fields...
+//     type 1 (log):   str(filename) str(log)
+//     type 2 (event): str(filename) varint(eventId) varint(unixMillis, 0 = unknown) str(utcTime)
+//                     str(computer) str(channel) str(image) str(target) str(processGuid)
+//                     str(hashes) str(user)
+// Strings:
+//   varint(tag): 0 = empty, 1 = literal (varint len, bytes), 2 = literal added to the frame's
+//   string table, n >= 3 = table[n - 3]. Values that repeat within a batch (host, channel, image,
+//   process GUID, user) are interned; paths and hashes are written as plain literals. The table
+//   holds at most kWireMaxInterned entries; further values are sent as plain literals.
+// utcTime is empty unless the event's time text did not parse into unixMillis; it then carries
+// that text unchanged (version 1 frames have no utcTime and are still accepted by the backend).
+// Varints are unsigned LEB128. New record types or fields require a new schema version.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "json_escape.h"
+
+namespace fim {
+
+constexpr char kWireMagic[4] = { 'F', 'I', 'M', 'B' };
+constexpr uint8_t kWireVersion = 2;
+// The backend refuses a frame whose string table grows past this (maxTableEntries in wire.go).
+constexpr size_t kWireMaxInterned = size_t(1) << 16;
+constexpr const char* kWireContentType = "application/x-fim-binary";
+
+enum class WireRecordType : uint8_t {
+	Log = 1,
+	Event = 2,
+};
+
+// Event fields carried by the binary format (UTF-8).
+struct WireEvent {
+	uint16_t eventId{0};
+	uint64_t unixMillis{0};
+	std::string utcTime; // the time text as received, kept only when it did not parse into unixMillis
+	std::string computer;
+	std::string channel;
+	std::string image;
+	std::string target;
+	std::string processGuid;
+	std::string hashes;
+	std::string user;
+};
+
+// Empties every field; the strings keep their capacity for the next event.
+inline void clear_wire_event(WireEvent& ev) {
+	ev.eventId = 0;
+	ev.unixMillis = 0;
+	for (std::string* text : { &ev.utcTime, &ev.computer, &ev.channel, &ev.image, &ev.target, &ev.processGuid,
+			&ev.hashes, &ev.user }) {
+		text->clear();
+	}
+}
+
+namespace detail {
+
+inline void put_varint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+inline bool get_varint(std::string_view in, size_t& pos, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos >= in.size()) return false;
+		const uint8_t byte = static_cast<uint8_t>(in[pos++]);
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+inline int parse_digits(std::string_view text, size_t pos, size_t count) {
+	if (pos + count > text.size()) return -1;
+	int value = 0;
+	for (size_t i = pos; i < pos + count; ++i) {
+		if (text[i] < '0' || text[i] > '9') return -1;
+		value = value * 10 + (text[i] - '0');
+	}
+	return value;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date.
+inline int64_t days_from_civil(int y, int m, int d) {
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const int64_t yoe = y - era * 400;
+	const int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+} // namespace detail
+
+// "2024-01-01 12:00:00.123" (Sysmon UtcTime) or "2024-01-01T12:00:00.1234567Z" (SystemTime), UTC.
+// Returns 0 when the text is not in either form.
+inline uint64_t parse_utc_millis(std::string_view text) {
+	using detail::parse_digits;
+	if (text.size() < 19 || text[4] != '-' || text[7] != '-' || (text[10] != ' ' && text[10] != 'T') ||
+		text[13] != ':' || text[16] != ':') {
+		return 0;
+	}
+	const int year = parse_digits(text, 0, 4), month = parse_digits(text, 5, 2), day = parse_digits(text, 8, 2);
+	const int hour = parse_digits(text, 11, 2), minute = parse_digits(text, 14, 2), second = parse_digits(text, 17, 2);
+	if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 ||
+		minute < 0 || minute > 59 || second < 0 || second > 60) {
+		return 0;
+	}
+	int millis = 0;
+	if (text.size() > 20 && text[19] == '.') {
+		int scale = 100;
+		for (size_t i = 20; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, scale /= 10) {
+			millis += (text[i] - '0') * scale;
+			if (scale == 1) break;
+		}
+	}
+	const int64_t days = detail::days_from_civil(year, month, day);
+	return static_cast<uint64_t>(((days * 24 + hour) * 60 + minute) * 60 + second) * 1000 + millis;
+}
+
+// Same JSON object the "fields" payload uses, for callers that hold a decoded WireEvent.
+inline std::string wire_event_json(const WireEvent& ev) {
+	std::string out = "{\"event_id\":" + std::to_string(ev.eventId);
+	if (ev.unixMillis) {
+		const std::time_t seconds = static_cast<std::time_t>(ev.unixMillis / 1000);
+		std::tm tm{};
+#if defined(_WIN32)
+		gmtime_s(&tm, &seconds);
+#else
+		gmtime_r(&seconds, &tm);
+#endif
+		char buf[64];
+		std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%03u", tm.tm_year + 1900, tm.tm_mon + 1,
+			tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<unsigned>(ev.unixMillis % 1000));
+		out += ",\"utc_time\":\"";
+		out += buf;
+		out += '"';
+	} else if (!ev.utcTime.empty()) {
+		out += ",\"utc_time\":\"";
+		json_escape_append(out, ev.utcTime);
+		out += '"';
+	}
+	auto add = [&out](const char* key, const std::string& value) {
+		if (value.empty()) return;
+		out += ",\"";
+		out += key;
+		out += "\":\"";
+		json_escape_append(out, value);
+		out += '"';
+	};
+	add("computer", ev.computer);
+	add("channel", ev.channel);
+	add("image", ev.image);
+	add("target", ev.target);
+	add("process_guid", ev.processGuid);
+	add("hashes", ev.hashes);
+	add("user", ev.user);
+	out += '}';
+	return out;
+}
+
+// Appends records to a frame. Interned strings are scoped to one frame: call begin() for each new
+// batch. Not thread-safe; the batcher serialises access.
+class WireWriter {
+public:
+	void begin(std::string& out) {
+		interned_.clear();
+		out.append(kWireMagic, sizeof(kWireMagic));
+		out.push_back(static_cast<char>(kWireVersion));
+	}
+
+	void add_log(std::string& out, std::string_view filename, std::string_view log) {
+		scratch_.clear();
+		detail::put_varint(scratch_, static_cast<uint64_t>(WireRecordType::Log));
+		put_literal(scratch_, filename);
+		put_literal(scratch_, log);
+		commit(out);
+	}
+
+	void add_event(std::string& out, std::string_view filename, const WireEvent& ev) {
+		scratch_.clear();
+		detail::put_varint(scratch_, static_cast<uint64_t>(WireRecordType::Event));
+		put_literal(scratch_, filename);
+		detail::put_varint(scratch_, ev.eventId);
+		detail::put_varint(scratch_, ev.unixMillis);
+		put_literal(scratch_, ev.unixMillis ? std::string_view() : std::string_view(ev.utcTime));
+		put_interned(scratch_, ev.computer);
+		put_interned(scratch_, ev.channel);
+		put_interned(scratch_, ev.image);
+		put_literal(scratch_, ev.target);
+		put_interned(scratch_, ev.processGuid);
+		put_literal(scratch_, ev.hashes);
+		put_interned(scratch_, ev.user);
+		commit(out);
+	}
+
+	size_t interned_count() const { return interned_.size(); }
+
+private:
+	static void put_literal(std::string& out, std::string_view value) {
+		if (value.empty()) {
+			detail::put_varint(out, 0);
+			return;
+		}
+		detail::put_varint(out, 1);
+		detail::put_varint(out, value.size());
+		out.append(value.data(), value.size());
+	}
+
+	void put_interned(std::string& out, const std::string& value) {
+		if (value.empty()) {
+			detail::put_varint(out, 0);
+			return;
+		}
+		auto it = interned_.find(value);
+		if (it != interned_.end()) {
+			detail::put_varint(out, it->second + 3);
+			return;
+		}
+		if (interned_.size() >= kWireMaxInterned) {
+			put_literal(out, value);
+			return;
+		}
+		interned_.emplace(value, static_cast<uint64_t>(interned_.size()));
+		detail::put_varint(out, 2);
+		detail::put_varint(out, value.size());
+		out.append(value);
+	}
+
+	void commit(std::string& out) {
+		detail::put_varint(out, scratch_.size());
+		out.append(scratch_);
+	}
+
+	std::unordered_map<std::string, uint64_t> interned_;
+	std::string scratch_;
+};
+
+// Decoded record; `event` is only meaningful for WireRecordType::Event.
+struct WireRecord {
+	WireRecordType type{WireRecordType::Log};
+	std::string filename;
+	std::string log;
+	WireEvent event;
+};
+
+// Reference decoder (the backend has its own in Go). Returns false on a malformed frame.
+inline bool decode_wire_frame(std::string_view in, std::vector<WireRecord>& out) {
+	if (in.size() < 5 || in.compare(0, 4, std::string_view(kWireMagic, 4)) != 0 ||
+		static_cast<uint8_t>(in[4]) != kWireVersion) {
+		return false;
+	}
+	std::vector<std::string> table;
+	size_t pos = 5;
+	while (pos < in.size()) {
+		uint64_t length = 0;
+		if (!detail::get_varint(in, pos, length) || length > in.size() - pos) return false;
+		const std::string_view body = in.substr(pos, static_cast<size_t>(length));
+		pos += static_cast<size_t>(length);
+
+		size_t p = 0;
+		auto get_string = [&](std::string& value) {
+			uint64_t tag = 0;
+			if (!detail::get_varint(body, p, tag)) return false;
+			if (tag == 0) {
+				value.clear();
+				return true;
+			}
+			if (tag >= 3) {
+				if (tag - 3 >= table.size()) return false;
+				value = table[static_cast<size_t>(tag - 3)];
+				return true;
+			}
+			uint64_t len = 0;
+			if (!detail::get_varint(body, p, len) || len > body.size() - p) return false;
+			value.assign(body.data() + p, static_cast<size_t>(len));
+			p += static_cast<size_t>(len);
+			if (tag == 2) table.push_back(value);
+			return true;
+		};
+
+		uint64_t type = 0;
+		if (!detail::get_varint(body, p, type)) return false;
+		WireRecord record;
+		if (type == static_cast<uint64_t>(WireRecordType::Log)) {
+			record.type = WireRecordType::Log;
+			if (!get_string(record.filename) || !get_string(record.log)) return false;
+		} else if (type == static_cast<uint64_t>(WireRecordType::Event)) {
+			record.type = WireRecordType::Event;
+			WireEvent& ev = record.event;
+			uint64_t eventId = 0;
+			if (!get_string(record.filename) || !detail::get_varint(body, p, eventId) || eventId > 0xFFFF ||
+				!detail::get_varint(body, p, ev.unixMillis) || !get_string(ev.utcTime) || !get_string(ev.computer) || !get_string(ev.channel) ||
+				!get_string(ev.image) || !get_string(ev.target) || !get_string(ev.processGuid) ||
+				!get_string(ev.hashes) || !get_string(ev.user)) {
+				return false;
+			}
+			ev.eventId = static_cast<uint16_t>(eventId);
+		} else {
+			return false;
+		}
+		out.emplace_back(std::move(record));
+	}
+	return true;
+}
+
+} // namespace fim
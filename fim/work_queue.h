@@ -0,0 +1,320 @@
+// Bounded work queue and worker pool for the FIM sender.
+// Keeps the Windows event callbacks short: callbacks push a small work item and return,
+// worker threads do the expensive rendering, hashing and uploading.
+// Platform-neutral (standard library only) so it can be built and exercised on Linux.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fim {
+
+// What push() does when the queue is at capacity.
+enum class OverflowPolicy {
+	Block,       // wait for a free slot (back-pressures the producer)
+	DropNewest,  // reject the incoming item (or the newest item of a less urgent lane)
+	DropOldest,  // evict the oldest item of the least urgent lane to make room
+};
+
+inline const char* overflow_policy_name(OverflowPolicy policy) {
+	switch (policy) {
+	case OverflowPolicy::Block: return "block";
+	case OverflowPolicy::DropNewest: return "drop_newest";
+	case OverflowPolicy::DropOldest: return "drop_oldest";
+	}
+	return "unknown";
+}
+
+// Parses "block", "drop_newest" or "drop_oldest" (case-insensitive). Returns false on unknown text.
+inline bool parse_overflow_policy(const std::string& text, OverflowPolicy& out) {
+	std::string lower(text);
+	std::transform(lower.begin(), lower.end(), lower.begin(),
+		[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	if (lower == "block") { out = OverflowPolicy::Block; return true; }
+	if (lower == "drop_newest") { out = OverflowPolicy::DropNewest; return true; }
+	if (lower == "drop_oldest") { out = OverflowPolicy::DropOldest; return true; }
+	return false;
+}
+
+namespace detail {
+
+// FIFO ring that grows by doubling and never shrinks, so a queue that has once reached its
+// working depth pushes and pops without allocating (std::deque frees and re-allocates its
+// blocks as the queue moves along).
+template <typename T>
+class Ring {
+public:
+	bool empty() const { return size_ == 0; }
+	size_t size() const { return size_; }
+
+	// Makes room for at least n items up front.
+	void reserve(size_t n) {
+		while (slots_.size() < n) grow();
+	}
+
+	void push_back(T item) {
+		if (size_ == slots_.size()) grow();
+		slots_[(head_ + size_) & (slots_.size() - 1)] = std::move(item);
+		++size_;
+	}
+
+	T& front() { return slots_[head_]; }
+
+	void pop_front() {
+		slots_[head_] = T(); // release what the item holds now, not when the slot is reused
+		head_ = (head_ + 1) & (slots_.size() - 1);
+		--size_;
+	}
+
+	void pop_back() {
+		--size_;
+		slots_[(head_ + size_) & (slots_.size() - 1)] = T();
+	}
+
+private:
+	void grow() {
+		std::vector<T> bigger(slots_.empty() ? 16 : slots_.size() * 2);
+		for (size_t i = 0; i < size_; ++i) bigger[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+		slots_.swap(bigger);
+		head_ = 0;
+	}
+
+	std::vector<T> slots_; // size is zero or a power of two
+	size_t head_{0};
+	size_t size_{0};
+};
+
+} // namespace detail
+
+// Items are queued in lanes; lane 0 is the most urgent (the lanes line up with Priority values).
+constexpr size_t kQueueLanes = 4;
+constexpr size_t kDefaultLane = 2;
+
+// Snapshot of queue/pool counters. All counters are cumulative since construction.
+struct QueueStats {
+	uint64_t enqueued{0};   // items accepted by push()
+	uint64_t dropped{0};    // items rejected or evicted because the queue was full
+	uint64_t blocked{0};    // push() calls that had to wait for a free slot
+	uint64_t processed{0};  // items handled by a worker
+	uint64_t failed{0};     // handler invocations that threw
+	size_t depth{0};        // items currently queued
+	size_t highWatermark{0};
+	size_t capacity{0};
+	std::array<uint64_t, kQueueLanes> droppedByLane{}; // dropped, split by the lane of the lost item
+};
+
+// Bounded multi-lane FIFO. pop() serves the most urgent non-empty lane first (FIFO within a lane),
+// and when the queue is full the drop policies sacrifice the least urgent items first: an
+// incoming item only loses when nothing less urgent is queued.
+template <typename T>
+class BoundedQueue {
+public:
+	BoundedQueue(size_t capacity, OverflowPolicy policy)
+		: capacity_(capacity == 0 ? 1 : capacity), policy_(policy) {
+		for (auto& lane : lanes_) lane.reserve(std::min(capacity_, kPreallocatedSlots));
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// Returns false when the item was not queued (dropped on a full queue, or queue closed).
+	bool push(T item, size_t lane = kDefaultLane) {
+		if (lane >= kQueueLanes) lane = kQueueLanes - 1;
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (closed_) return false;
+		if (size_ >= capacity_) {
+			switch (policy_) {
+			case OverflowPolicy::Block:
+				++blocked_;
+				notFull_.wait(lock, [this]() { return closed_ || size_ < capacity_; });
+				if (closed_) return false;
+				break;
+			case OverflowPolicy::DropNewest:
+			case OverflowPolicy::DropOldest: {
+				// Evict from the least urgent lane that is no more urgent than the newcomer
+				// (DropNewest: strictly less urgent); otherwise the newcomer is the one dropped.
+				const size_t floor = policy_ == OverflowPolicy::DropNewest ? lane + 1 : lane;
+				size_t victim = kQueueLanes;
+				for (size_t l = kQueueLanes; l-- > floor;) {
+					if (!lanes_[l].empty()) {
+						victim = l;
+						break;
+					}
+				}
+				++dropped_;
+				if (victim == kQueueLanes) {
+					++droppedByLane_[lane];
+					return false;
+				}
+				if (policy_ == OverflowPolicy::DropNewest) lanes_[victim].pop_back();
+				else lanes_[victim].pop_front();
+				++droppedByLane_[victim];
+				--size_;
+				break;
+			}
+			}
+		}
+		lanes_[lane].push_back(std::move(item));
+		++size_;
+		++enqueued_;
+		highWatermark_ = std::max(highWatermark_, size_);
+		lock.unlock();
+		notEmpty_.notify_one();
+		return true;
+	}
+
+	// Blocks until an item is available. Returns false once the queue is closed and drained.
+	bool pop(T& out) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		notEmpty_.wait(lock, [this]() { return closed_ || size_ > 0; });
+		if (size_ == 0) return false;
+		out = take_locked();
+		lock.unlock();
+		notFull_.notify_one();
+		return true;
+	}
+
+	// Blocks like pop() for the first item, then also takes whatever else is queued, up to
+	// maxItems in total, most urgent first. Returns the number of items appended to out (0 once
+	// closed and drained).
+	size_t pop_batch(std::vector<T>& out, size_t maxItems) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		notEmpty_.wait(lock, [this]() { return closed_ || size_ > 0; });
+		const size_t count = std::min(size_, maxItems == 0 ? 1 : maxItems);
+		for (size_t i = 0; i < count; ++i) out.push_back(take_locked());
+		lock.unlock();
+		if (count) notFull_.notify_all();
+		return count;
+	}
+
+	// Wakes all waiters; queued items can still be popped, new pushes are refused.
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closed_ = true;
+		}
+		notEmpty_.notify_all();
+		notFull_.notify_all();
+	}
+
+	QueueStats stats() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		QueueStats s;
+		s.enqueued = enqueued_;
+		s.dropped = dropped_;
+		s.blocked = blocked_;
+		s.depth = size_;
+		s.highWatermark = highWatermark_;
+		s.capacity = capacity_;
+		s.droppedByLane = droppedByLane_;
+		return s;
+	}
+
+	OverflowPolicy policy() const { return policy_; }
+
+private:
+	// Slots each lane gets up front; deeper lanes grow on demand (and stay grown).
+	static constexpr size_t kPreallocatedSlots = 1024;
+
+	T take_locked() {
+		for (auto& lane : lanes_) {
+			if (lane.empty()) continue;
+			T item = std::move(lane.front());
+			lane.pop_front();
+			--size_;
+			return item;
+		}
+		return T();
+	}
+
+	const size_t capacity_;
+	const OverflowPolicy policy_;
+	mutable std::mutex mutex_;
+	std::condition_variable notEmpty_;
+	std::condition_variable notFull_;
+	std::array<detail::Ring<T>, kQueueLanes> lanes_;
+	size_t size_{0};
+	bool closed_{false};
+	uint64_t enqueued_{0};
+	uint64_t dropped_{0};
+	uint64_t blocked_{0};
+	std::array<uint64_t, kQueueLanes> droppedByLane_{};
+	size_t highWatermark_{0};
+};
+
+// Fixed set of threads draining a BoundedQueue through a handler.
+// Handler exceptions are counted and swallowed so one bad item cannot kill a worker.
+template <typename T>
+class WorkerPool {
+public:
+	using Handler = std::function<void(T&)>;
+
+	WorkerPool(size_t workerCount, size_t capacity, OverflowPolicy policy, Handler handler)
+		: queue_(capacity, policy), handler_(std::move(handler)) {
+		if (workerCount == 0) workerCount = 1;
+		workers_.reserve(workerCount);
+		for (size_t i = 0; i < workerCount; ++i) {
+			workers_.emplace_back([this]() { run(); });
+		}
+	}
+
+	~WorkerPool() { stop(); }
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	bool submit(T item, size_t lane = kDefaultLane) { return queue_.push(std::move(item), lane); }
+
+	// Refuses new work, lets workers drain what is queued, then joins them. Idempotent.
+	void stop() {
+		queue_.close();
+		for (auto& worker : workers_) {
+			if (worker.joinable()) worker.join();
+		}
+	}
+
+	QueueStats stats() const {
+		QueueStats s = queue_.stats();
+		s.processed = processed_.load(std::memory_order_relaxed);
+		s.failed = failed_.load(std::memory_order_relaxed);
+		return s;
+	}
+
+	size_t worker_count() const { return workers_.size(); }
+	OverflowPolicy policy() const { return queue_.policy(); }
+
+private:
+	void run() {
+		T item;
+		while (queue_.pop(item)) {
+			try {
+				handler_(item);
+			} catch (...) {
+				failed_.fetch_add(1, std::memory_order_relaxed);
+			}
+			processed_.fetch_add(1, std::memory_order_relaxed);
+			item = T();
+		}
+	}
+
+	BoundedQueue<T> queue_;
+	Handler handler_;
+	std::vector<std::thread> workers_;
+	std::atomic<uint64_t> processed_{0};
+	std::atomic<uint64_t> failed_{0};
+};
+
+} // namespace fim